@@ -23,10 +23,11 @@ Page {
     readonly property int yVelocity:    900 // vertical pixels in seconds
     readonly property int pageVelocity: 2000 // vertical pixels in seconds
     readonly property var sqlDatePeriod: [
-        { "text": QT_TR_NOOP("Day"),   "modifier": "start of day",  "format": "%Y-%m-%d %H:%M" },
-        { "text": QT_TR_NOOP("Week"),  "modifier": "-7 days",       "format": "%Y-%m-%d %H:%M" },
-        { "text": QT_TR_NOOP("Month"), "modifier": "-1 months",     "format": "%Y-%m-%d" },
-        { "text": QT_TR_NOOP("Year"),  "modifier": "-1 years",      "format": "%Y-%m" },
+        // the bucket seconds of the aggregated time and of the detailed one, see rollupTable()
+        { "text": QT_TR_NOOP("Day"),   "modifier": "start of day",  "format": "%Y-%m-%d %H:%M", "bucket": [600, 60] },
+        { "text": QT_TR_NOOP("Week"),  "modifier": "-7 days",       "format": "%Y-%m-%d %H:%M", "bucket": [3600, 600] },
+        { "text": QT_TR_NOOP("Month"), "modifier": "-1 months",     "format": "%Y-%m-%d",       "bucket": [86400, 86400] },
+        { "text": QT_TR_NOOP("Year"),  "modifier": "-1 years",      "format": "%Y-%m",          "bucket": [86400, 86400] },
     ]
     property string currentProject
     property bool aggregateTime: true
@@ -46,36 +47,44 @@ Page {
     function makeDbQuery() {
         if (!RestApiSet.walletAddress || tabBar.currentIndex < 0 || tabBar.currentIndex >= sqlDatePeriod.length)
             return
+        var period = sqlDatePeriod[tabBar.currentIndex]
+        var bucket = period.bucket[aggregateTime ? 0 : 1]
+        var table = sqlTableModel.rollupTable(RestApiSet.walletAddress, bucket)
+        var rollup = (table !== RestApiSet.walletAddress)
+        var time = rollup ? "BucketTime" : columnKey(SqliteProducer.LocalTime)
         var query = "SELECT "
         if (!control.currentProject) {
             query += columnKey(SqliteProducer.ProjectId)
         } else {
-            query += "strftime('" + sqlDatePeriod[tabBar.currentIndex].format
-            if (tabBar.currentIndex === 1) {
-                if (aggregateTime) {
-                    query += "',LocalTime/3600*3600+3600,'unixepoch','localtime')"
-                } else {
-                    query += "',LocalTime/600*600+600,'unixepoch','localtime')"
-                }
-            } else if (tabBar.currentIndex === 0 && aggregateTime) {
-                query += "',LocalTime/600*600+600,'unixepoch','localtime')"
-            } else {
-                query += "',LocalTime,'unixepoch','localtime')"
+            query += "strftime('" + period.format + "',"
+            if (bucket > 60 && bucket < 86400) { // to the end of the bucket
+                query += time + "/" + bucket + "*" + bucket + "+" + bucket
+            } else { // the minutes or the days by format
+                query += time
             }
+            query += ",'unixepoch','localtime')"
         }
-        query += " AS column0, COUNT(*) AS minutesActive"
-        query += ", " + columnKey(SqliteProducer.KeyPresses, true)
-        query += ", " + columnKey(SqliteProducer.MouseClicks, true)
-        query += ", " + columnKey(SqliteProducer.MouseDistance, true)
-        query += " FROM '" + RestApiSet.walletAddress + "'"
-        query += " WHERE datetime(" + columnKey(SqliteProducer.LocalTime) + ", 'unixepoch','localtime')"
-        query += " BETWEEN datetime('now','" + sqlDatePeriod[tabBar.currentIndex].modifier + "','localtime')"
+        query += rollup ? " AS column0, SUM(RowCount) AS minutesActive" : " AS column0, COUNT(*) AS minutesActive"
+        query += ", " + sqlTableModel.countersSql()
+        query += " FROM '" + table + "'"
+        query += " WHERE datetime(" + time + ", 'unixepoch','localtime')"
+        query += " BETWEEN datetime('now','" + period.modifier + "','localtime')"
         query += " AND datetime('now','localtime')"
         if (control.currentProject) {
             query += " AND " + columnKey(SqliteProducer.ProjectId) + " IS '" + control.currentProject + "'"
         }
         query += " GROUP BY column0"
 
+        // the same range selects the monthly database files to read
+        var from = new Date()
+        switch (tabBar.currentIndex) {
+        case 0: from.setHours(0, 0, 0, 0); break
+        case 1: from.setDate(from.getDate() - 7); break
+        case 2: from.setMonth(from.getMonth() - 1); break
+        case 3: from.setFullYear(from.getFullYear() - 1); break
+        }
+        sqlTableModel.fromTime = Math.floor(from.getTime() / 1000)
+
         RestApiSet.saveLogFile(query)
         sqlTableModel.view = query
     }
@@ -21,6 +21,8 @@ Item {
 
     readonly property int dataSyncDelay: 1 * 60 * 1000   // 1 minute in milliseconds after App started
     readonly property int dataSyncPeriod: 10 * 60 * 1000 // 10 minutes in milliseconds of dataSyncTimer interval
+    readonly property int dataSyncLag: 2 * 60            // 2 minutes in seconds the last minute rows may be committed after
+    readonly property int dataSyncLate: 24 * 3600        // 1 day in seconds the parked rows may be committed after
     readonly property bool busy: HttpRequest.status === HttpRequest.Busy || noncePollTimer.running
 
     readonly property string loggerFilePath: SystemHelper.appLogPath(Qt.application.name + ".log")
@@ -126,38 +128,64 @@ Item {
         id: sqlExecQuery
         timeStep: dataSyncPeriod / 1000
         // The lastDataSync and lastToAt is the time in seconds from UTC.
+        // The rows to send have SyncState=1 until the server got them, the partial index of the
+        // database finds them at once; lastDataSync only bounds the monthly files to read.
+        // They are marked sending before the query reads them, only those are marked uploaded
+        // then, the rows written or merged meanwhile wait for the next sync.
         property int lastDataSync: SystemHelper.loadSettings(myClassName + "/lastDataSync", Date.now() / 1000)
         property int lastToAt: 0
-        property int lastReqId: 0
+        property int lastReqId: 0  // -1 while the rows to send are being marked
+        property int syncFrom: 0   // the local time in seconds of the rows sent, syncFrom <= LocalTime < syncBefore
+        property int syncBefore: 0
         function syncServer() {
             if (!accessToken || !walletAddress || lastReqId) return
+            if (lastDataSync <= 0 || !SystemHelper.loadSettings(myClassName + "/syncState", false)) {
+                // the rows written before the SyncState column, or all of them from scratch
+                ActivityCounter.setSqlDbSynced(lastDataSync > 0 ? fromUtcSeconds(lastDataSync) : 0, 0,
+                                               SqliteProducer.SyncPending)
+                SystemHelper.saveSettings(myClassName + "/syncState", true)
+            }
+            // the bucket still getting the minute rows waits for the next sync
+            var now = Math.floor(Date.now() / 1000)
+            var local = fromUtcSeconds(now) - dataSyncLag
+            syncBefore = timeStep > 0 ? Math.floor(local / timeStep) * timeStep : local
+            syncFrom = lastDataSync > 0 ? fromUtcSeconds(lastDataSync) - dataSyncLate : 0
+            lastToAt = syncBefore - (local + dataSyncLag - now)
+            lastReqId = -1
+            ActivityCounter.setSqlDbSynced(syncFrom, syncBefore, SqliteProducer.SyncSending)
+        }
+        function sendMarked() {
             var query = "SELECT LocalTime"
             if (timeStep > 0) query += '/' + timeStep + '*' + timeStep + '+' + timeStep
-            query += " AS column0, ProjectId, TextNote, COUNT(*) AS minutesActive,"
-            query += " TOTAL(KeyPresses) AS KeyPresses, TOTAL(MouseClicks) AS MouseClicks, TOTAL(MouseDistance) AS MouseDistance"
-            query += " FROM '" + walletAddress + "'"
-            if (lastDataSync > 0) query += " WHERE column0 > " + fromUtcSeconds(lastDataSync)
+            query += " AS column0, ProjectId, TextNote, COUNT(*) AS minutesActive, " + countersSql()
+            query += " FROM '" + walletAddress + "' WHERE SyncState=" + SqliteProducer.SyncSending +
+                     " AND LocalTime < " + syncBefore
+            if (syncFrom > 0) query += " AND LocalTime >= " + syncFrom
             query += " GROUP by column0, ProjectId"
             if (control.logging) saveLogFile(query)
-            lastReqId = request(query)
+            lastReqId = request(query, syncFrom, syncBefore)
         }
         onLastErrorChanged: control.errorOccurred(lastError)
         onResponse: function(reqid, array) {
             if (reqid !== lastReqId) return
             lastReqId = 0
             if (array.length && accessToken) {
-                lastToAt = array[array.length - 1].toAt
                 var url = restApiServer + activityTimeUrl
                 if (control.logging) {
                     saveLogFile("POST " + url + " (" + array.length + " records)" +
                                 "\n\taccessToken: " + accessToken + "\n" + JSON.stringify(array, null, 4))
                 }
                 HttpRequest.sendArray(HttpRequest.MethodPost, url, accessToken, array)
-            } else if (control.logging) {
-                saveLogFile("No records to send")
+            } else {
+                if (control.logging) saveLogFile("No records to send")
+                if (accessToken) saveSyncTime() // the idle rows are done as well
             }
         }
         function saveSyncTime() {
+            if (syncBefore > 0) {
+                ActivityCounter.setSqlDbSynced(syncFrom, syncBefore, SqliteProducer.SyncUploaded)
+                syncBefore = 0
+            }
             if (lastToAt > 0) {
                 lastDataSync = lastToAt
                 SystemHelper.saveSettings(myClassName + "/lastDataSync", lastDataSync)
@@ -174,6 +202,13 @@ Item {
                 setTokenPair(jwt["accessToken"], jwt["refreshToken"], false)
             } else clearWallet(false)
         }
+        function onSqlDbSynced(table, fromTime, toTime, state, ok) {
+            if (table !== walletAddress || state !== SqliteProducer.SyncSending || sqlExecQuery.lastReqId !== -1 ||
+                fromTime !== sqlExecQuery.syncFrom || toTime !== sqlExecQuery.syncBefore) return
+            if (control.logging) saveLogFile("The rows to send are marked " + (ok ? "ok" : "failed"))
+            if (ok) sqlExecQuery.sendMarked()
+            else sqlExecQuery.lastReqId = 0
+        }
     }
 
     Connections {
@@ -0,0 +1,293 @@
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QtEndian>
+#include <cstring>
+#include <algorithm>
+
+#include "ActivityChain.h"
+#include "ActivityPack.h"
+#include "SqliteProducer.h"
+
+static const char *sqlTableInfo =
+    "PRAGMA table_info('%1')";
+static const char *sqlChainRows = // the chains one after another, the project days in LocalTime order;
+                                   // the DataBaseColumn order, the RowHash and the ProjectRef after
+    "SELECT %2, r.RowHash, r.ProjectRef FROM '%1' AS r %3 ORDER BY r.ProjectRef, r.LocalTime";
+static const char *sqlChainPacked =
+    "SELECT DayTime, ProjectId, Data, ChainHash FROM '%1'";
+static const char *sqlCountRows =
+    "SELECT COUNT(*) FROM '%1'";
+static const char *sqlChainSigned =
+    "SELECT DayTime, Signature FROM '%1'";
+
+extern bool sshReadEd25519(const QString &filename, QByteArray &secretKey, QByteArray &publicKey);
+extern QByteArray sshSignEd25519(const QByteArray &secretKey, const QByteArray &message);
+extern bool sshVerifyEd25519(const QByteArray &publicKey, const QByteArray &message, const QByteArray &signature);
+
+static_assert(ActivityChain::rowValues == ActivitySchema::valueCount(), "rowHash() columns mismatch");
+
+static QStringList tableColumns(QSqlDatabase &db, const QString &table)
+{
+    QStringList columns;
+    QSqlQuery sql(db);
+    if (sql.exec(QString(sqlTableInfo).arg(table))) {
+        while (sql.next()) columns.append(sql.value(1).toString());
+    }
+    return columns;
+}
+
+class ChainPartitionTask : public QRunnable
+{
+public:
+    ChainPartitionTask(const QString &path, const QString &table, const QByteArray &publicKey,
+                       ActivityChain::Result &result, QMutex &mutex)
+        : partition_path(path), table_name(table), public_key(publicKey), chain_result(result), result_mutex(mutex) {}
+private:
+    void run() override {
+        const ActivityChain::Result part = ActivityChain::verifyPartition(partition_path, table_name, public_key);
+        QMutexLocker locker(&result_mutex);
+        chain_result.rows += part.rows;
+        chain_result.unchained += part.unchained;
+        chain_result.signedDays += part.signedDays;
+        chain_result.unsignedDays += part.unsignedDays;
+        chain_result.broken += part.broken;
+        if (chain_result.error.isEmpty()) chain_result.error = part.error;
+    }
+    const QString partition_path;
+    const QString table_name;
+    const QByteArray public_key;
+    ActivityChain::Result &chain_result;
+    QMutex &result_mutex;
+};
+
+// static
+QByteArray ActivityChain::seed(const QString &table)
+{
+    return QCryptographicHash::hash(table.toUtf8(), QCryptographicHash::Sha512).left(hashSize);
+}
+
+// The previous hash, the integers as 64 bit little endian and the strings as the zero
+// terminated UTF-8; a NULL reads as 0 and as the empty string. The ServerStatus and the
+// SyncState change after the row is written, the hashed columns are the ones of the record.
+// static
+QByteArray ActivityChain::rowHash(const QByteArray &prev, qint64 localTime, const QString &projectId,
+                                  const QString &textNote, qint64 keyPresses, qint64 mouseClicks,
+                                  qint64 mouseDistance, qint64 activeMask)
+{
+    const QByteArray project = projectId.toUtf8();
+    const QByteArray note = textNote.toUtf8();
+    QByteArray data(prev.size() + 5 * 8 + project.size() + note.size() + 2, Qt::Uninitialized);
+    char *p = data.data();
+    std::memcpy(p, prev.constData(), size_t(prev.size()));
+    p += prev.size();
+    for (qint64 value : { localTime, keyPresses, mouseClicks, mouseDistance, activeMask }) {
+        qToLittleEndian<qint64>(value, p);
+        p += 8;
+    }
+    std::memcpy(p, project.constData(), size_t(project.size() + 1));
+    p += project.size() + 1;
+    std::memcpy(p, note.constData(), size_t(note.size() + 1));
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha512).left(hashSize);
+}
+
+// The zero terminated UTF-8 of the table and of the projects, the DayTime as 64 bit little
+// endian, a byte of 1 before the head of a packed day and of 0 before the one of the rows
+// static
+QByteArray ActivityChain::headsMessage(const QString &table, qint64 day, const DayHeads &heads)
+{
+    QByteArray message = table.toUtf8();
+    message.append('\0');
+    char time[8];
+    qToLittleEndian<qint64>(day, time);
+    message.append(time, sizeof(time));
+    for (auto it = heads.constBegin(); it != heads.constEnd(); ++it) {
+        message.append(it.key().first.toUtf8());
+        message.append('\0');
+        message.append(it.key().second ? '\1' : '\0');
+        message.append(it.value());
+    }
+    return message;
+}
+
+// static
+bool ActivityChain::readKey(const QString &keyPath, QByteArray &secretKey, QByteArray &publicKey)
+{
+    return !keyPath.isEmpty() && sshReadEd25519(keyPath, secretKey, publicKey);
+}
+
+// static
+QByteArray ActivityChain::signHeads(const QByteArray &secretKey, const QByteArray &message)
+{
+    return sshSignEd25519(secretKey, message);
+}
+
+// static
+bool ActivityChain::verifyHeads(const QByteArray &publicKey, const QByteArray &message, const QByteArray &signature)
+{
+    return sshVerifyEd25519(publicKey, message, signature);
+}
+
+// static
+ActivityChain::Result ActivityChain::verify(const QString &filepath, const QString &table, int threads,
+                                            const QByteArray &publicKey)
+{
+    Result result;
+    QMutex mutex;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads > 0 ? threads : QThread::idealThreadCount());
+    const auto files = SqliteProducer::partitionFiles(filepath);
+    for (const auto &path : files) {
+        pool.start(new ChainPartitionTask(path, table, publicKey, result, mutex));
+    }
+    pool.waitForDone();
+    std::sort(result.broken.begin(), result.broken.end());
+    return result;
+}
+
+// The partition file by its own read-only connection; the rows of a table not migrated to
+// the dictionaries yet and the rows written before the chain are counted as unchained. The
+// heads of every day are collected on the way for the signatures, if the public key is given.
+// static
+ActivityChain::Result ActivityChain::verifyPartition(const QString &path, const QString &table,
+                                                     const QByteArray &publicKey)
+{
+    Result result;
+    const QString conn_name = QStringLiteral("ActivityChain") +
+            QString::number(reinterpret_cast<quint64>(QThread::currentThreadId()));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), conn_name);
+        db.setDatabaseName(path);
+        db.setConnectOptions("QSQLITE_OPEN_READONLY");
+        if (!db.open()) {
+            result.error = db.lastError().text();
+        } else {
+            const QByteArray start = seed(table);
+            const QString rows = SqliteProducer::rowsName(table);
+            const QString plain = SqliteProducer::plainName(table);
+            const QString packed = SqliteProducer::packedName(table);
+            const QStringList columns = tableColumns(db, rows);
+            QMap<qint64,DayHeads> days;
+            QSqlQuery sql(db);
+            sql.setForwardOnly(true);
+            for (const auto &name : { plain, columns.isEmpty() ? table : QString() }) {
+                if (name.isEmpty() || tableColumns(db, name).isEmpty()) continue;
+                if (sql.exec(QString(sqlCountRows).arg(name)) && sql.next()) result.unchained += sql.value(0).toLongLong();
+                sql.finish();
+            }
+            if (columns.contains(QLatin1String("RowHash")) &&
+                sql.exec(QString(sqlChainRows).arg(rows, ActivitySchema::viewColumns(), ActivitySchema::viewJoins()))) {
+                QByteArray prev;
+                qint64 project = -1, day_from = 0, day_to = 0;
+                while (sql.next()) {
+                    const qint64 time = sql.value(SqliteProducer::LocalTime).toLongLong();
+                    if (time < day_from || time >= day_to) {
+                        const QDate date = QDateTime::fromSecsSinceEpoch(time).date();
+                        day_from = date.startOfDay().toSecsSinceEpoch();
+                        day_to = date.addDays(1).startOfDay().toSecsSinceEpoch();
+                        prev = start;
+                    }
+                    if (sql.value(SqliteProducer::TotalColumns + 1).toLongLong() != project) {
+                        project = sql.value(SqliteProducer::TotalColumns + 1).toLongLong();
+                        prev = start;
+                    }
+                    const QByteArray stored = sql.value(SqliteProducer::TotalColumns).toByteArray();
+                    if (stored.isEmpty()) {
+                        result.unchained++;
+                        continue;
+                    }
+                    result.rows++;
+                    days[day_from][qMakePair(sql.value(SqliteProducer::ProjectId).toString(), false)] = stored;
+                    if (rowHash(prev, time, sql.value(SqliteProducer::ProjectId).toString(),
+                                sql.value(SqliteProducer::TextNote).toString(),
+                                sql.value(SqliteProducer::KeyPresses).toLongLong(),
+                                sql.value(SqliteProducer::MouseClicks).toLongLong(),
+                                sql.value(SqliteProducer::MouseDistance).toLongLong(),
+                                sql.value(SqliteProducer::ActiveMask).toLongLong()) != stored) {
+                        result.broken.append(time);
+                    }
+                    prev = stored;
+                }
+            } else if (sql.lastError().isValid()) {
+                result.error = sql.lastError().text();
+            }
+            sql.finish();
+            if (tableColumns(db, packed).contains(QLatin1String("ChainHash")) &&
+                sql.exec(QString(sqlChainPacked).arg(packed))) {
+                while (sql.next()) {
+                    const qint64 day = sql.value(0).toLongLong();
+                    QVector<ActivityPack::Row> day_rows;
+                    if (!ActivityPack::unpack(day, sql.value(2).toByteArray(), day_rows)) {
+                        result.broken.append(day);
+                        continue;
+                    }
+                    const QByteArray stored = sql.value(3).toByteArray();
+                    if (stored.isEmpty()) {
+                        result.unchained += day_rows.size();
+                        continue;
+                    }
+                    const QString project = sql.value(1).toString();
+                    days[day][qMakePair(project, true)] = stored;
+                    QByteArray prev = start;
+                    for (const auto &row : day_rows) {
+                        prev = rowHash(prev, row.localTime, project, row.textNote, row.keyPresses,
+                                       row.mouseClicks, row.mouseDistance, row.activeMask);
+                    }
+                    result.rows += day_rows.size();
+                    if (prev != stored) result.broken.append(day);
+                }
+            }
+            sql.finish();
+            const QString signatures = SqliteProducer::signedName(table);
+            if (!publicKey.isEmpty() && !tableColumns(db, signatures).isEmpty() &&
+                sql.exec(QString(sqlChainSigned).arg(signatures))) {
+                while (sql.next()) {
+                    const qint64 day = sql.value(0).toLongLong();
+                    auto heads = days.find(day);
+                    if (heads == days.end() ||
+                        !verifyHeads(publicKey, headsMessage(table, day, heads.value()), sql.value(1).toByteArray())) {
+                        result.broken.append(day); // a removed chain as well
+                    } else {
+                        result.signedDays++;
+                    }
+                    if (heads != days.end()) days.erase(heads);
+                }
+                sql.finish();
+            }
+            // the current day is signed once closed
+            if (!publicKey.isEmpty()) {
+                const qint64 today = QDate::currentDate().startOfDay().toSecsSinceEpoch();
+                for (auto it = days.constBegin(); it != days.constEnd() && it.key() < today; ++it) {
+                    result.unsignedDays++;
+                }
+            }
+        }
+    }
+    QSqlDatabase::removeDatabase(conn_name);
+    return result;
+}
+
+void ActivityChainTask::run()
+{
+    QElapsedTimer clock;
+    clock.start();
+    const ActivityChain::Result result = ActivityChain::verify(db_filepath, table_name, 0, public_key);
+    QVariantList broken;
+    for (qint64 time : result.broken) broken.append(time);
+    emit verified({
+        { QStringLiteral("rows"), result.rows },
+        { QStringLiteral("unchained"), result.unchained },
+        { QStringLiteral("signed"), result.signedDays },
+        { QStringLiteral("unsigned"), result.unsignedDays },
+        { QStringLiteral("broken"), broken },
+        { QStringLiteral("error"), result.error },
+        { QStringLiteral("msecs"), clock.elapsed() }
+    });
+}
@@ -0,0 +1,84 @@
+#ifndef ACTIVITYCHAIN_H
+#define ACTIVITYCHAIN_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QByteArray>
+#include <QVariantMap>
+#include <QVector>
+#include <QMap>
+#include <QPair>
+
+// Tamper-evident hash chain over the minute rows of a table.
+//
+// A chain is one project day: the RowHash of a row is the hash of the RowHash of the previous
+// row of the same project and day, or of the seed for the first one, and of the row columns.
+// Packing a closed day keeps the head of its chain recomputed over the packed rows as the
+// ChainHash, so the retention drops the whole chains. The hash is the SHA-512 truncated to
+// hashSize bytes.
+//
+// The seed is not a secret, anyone able to write the file may chain the changed rows again.
+// The heads of the chains of a closed day are therefore signed by the Ed25519 key of the app
+// (SystemHelper::appSshKey) into the signed table of the partition, and the producer signs a
+// day again only after the changes it made itself to a day whose signature held. A changed
+// row, a removed tail of a day or a dropped chain breaks the signature of its day, unless the
+// key file was read as well; the days closed before the signing are counted as unsigned.
+class ActivityChain
+{
+public:
+    static constexpr int const hashSize  = 32; // bytes of the SHA-512 kept
+    static constexpr int const rowValues = 7;  // the row columns hashed by rowHash()
+
+    // (ProjectId, packed) -> the head of the chain, the last RowHash or the ChainHash
+    typedef QMap<QPair<QString,bool>,QByteArray> DayHeads;
+
+    struct Result {
+        qint64 rows = 0;           // verified by the hash
+        qint64 unchained = 0;      // written before the chain, no hash to verify
+        qint64 signedDays = 0;     // the days whose heads verify by the signature
+        qint64 unsignedDays = 0;   // the days with the heads and no signature
+        QVector<qint64> broken;    // the LocalTime of the rows, the DayTime of the packed days
+                                   // and of the days whose signature does not verify
+        QString error;
+    };
+
+    static QByteArray seed(const QString &table);
+    static QByteArray rowHash(const QByteArray &prev, qint64 localTime, const QString &projectId,
+                              const QString &textNote, qint64 keyPresses, qint64 mouseClicks,
+                              qint64 mouseDistance, qint64 activeMask);
+
+    // The signed message of a day: the table, the DayTime and the heads in the DayHeads order
+    static QByteArray headsMessage(const QString &table, qint64 day, const DayHeads &heads);
+    static bool readKey(const QString &keyPath, QByteArray &secretKey, QByteArray &publicKey);
+    static QByteArray signHeads(const QByteArray &secretKey, const QByteArray &message);
+    static bool verifyHeads(const QByteArray &publicKey, const QByteArray &message, const QByteArray &signature);
+
+    // every partition file of the table by a task of its own, 0 threads for all the cores;
+    // the signatures of the days are checked by the public key, if any
+    static Result verify(const QString &filepath, const QString &table, int threads = 0,
+                         const QByteArray &publicKey = QByteArray());
+    static Result verifyPartition(const QString &path, const QString &table,
+                                  const QByteArray &publicKey = QByteArray());
+};
+
+class ActivityChainTask : public QObject, public QRunnable
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ActivityChainTask)
+
+public:
+    ActivityChainTask(const QString &filepath, const QString &table, const QByteArray &publicKey,
+                      QObject *parent = nullptr)
+        : QObject(parent), db_filepath(filepath), table_name(table), public_key(publicKey) {}
+
+signals:
+    void verified(const QVariantMap &result);
+
+private:
+    void run() override;
+    const QString db_filepath;
+    const QString table_name;
+    const QByteArray public_key;
+};
+
+#endif // ACTIVITYCHAIN_H
@@ -2,17 +2,18 @@
 #include <QSettings>
 #include <QTimer>
 #include <QThread>
-#include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QUuid>
-#include <QPoint>
 #include <QDateTime>
 #include <QMetaObject>
 #include <QtDebug>
 
 #include "ActivityCounter.h"
 #include "ActivityRecord.h"
+#include "InputEventRing.h"
 #include "SqliteProducer.h"
 #include "SystemHelper.h"
+#include "UiohookCounterThread.h"
 #include "uiohook.h"
 
 //#define TRACE_ACTIVITYCOUNTER
@@ -25,14 +26,6 @@
 #define TRACE_ARG(x)
 #endif
 
-//#define TRACE_UIOHOOKCOUNTERTHREAD
-#ifdef TRACE_UIOHOOKCOUNTERTHREAD
-#include <QTime>
-#define TRACE_UIOHOOK(x) qDebug() << QTime::currentTime().toString("hh:mm:ss.zzz") << QThread::currentThreadId() << Q_FUNC_INFO << x;
-#else
-#define TRACE_UIOHOOK(x)
-#endif
-
 Q_GLOBAL_STATIC(ActivityCounter, globalActivityCounter)
 
 static const struct errorStatusEntry {
@@ -49,6 +42,10 @@ static const struct errorStatusEntry {
     { UIOHOOK_ERROR_X_RECORD_CREATE_CONTEXT, "Unable to allocate XRecord context" },
     { UIOHOOK_ERROR_X_RECORD_ENABLE_CONTEXT, "Failed to enable XRecord context" },
     { UIOHOOK_ERROR_X_RECORD_GET_CONTEXT,    "Failed to get XRecord context" },
+    { UIOHOOK_ERROR_X_INPUT_NOT_FOUND,       "Unable to locate XInput 2.2 extension" },
+    { UIOHOOK_ERROR_X_INPUT_SELECT_EVENTS,   "Failed to select XInput raw events" },
+    { UIOHOOK_ERROR_EVDEV_NO_DEVICES,        "No readable input devices, check the input group membership" },
+    { UIOHOOK_ERROR_EPOLL_CREATE,            "Failed to create the input device poll" },
 
     // Windows specific errors
     { UIOHOOK_ERROR_SET_WINDOWS_HOOK_EX,     "Failed to register low level windows hook" },
@@ -72,134 +69,6 @@ static QString errorStatusText(int status)
     return QLatin1String("Unknown error occurred");
 }
 
-class UiohookCounterThread : public QThread
-{
-public:
-    UiohookCounterThread() : QThread(), uiohook_status(UIOHOOK_FAILURE) {
-        TRACE_UIOHOOK("Create");
-
-        hook_set_dispatch_proc(&uiohookEvent);
-    }
-    ~UiohookCounterThread() override;
-
-    QAtomicInt uiohook_status;
-    QAtomicInt count_actions;
-    QAtomicInt key_presses;
-    QAtomicInt mouse_clicks;
-    QAtomicInt mouse_distance;
-
-protected:
-    void run() override {
-        setTerminationEnabled(true);
-        uiohook_status = hook_run();
-        TRACE_UIOHOOK("hook_run() status" << uiohook_status);
-    }
-private:
-    static void uiohookEvent(struct _uiohook_event *const event);
-    void setLastPos(int x, int y);
-    QPoint last_pos;
-};
-
-UiohookCounterThread::~UiohookCounterThread()
-{
-    TRACE_UIOHOOK("Destroy");
-
-    if (isRunning()) {
-        requestInterruption();
-        for (int i = 0; !wait(250) && i < 4; i++) {
-            if (i) qWarning() << Q_FUNC_INFO << "Still running, trying terminate" << i;
-            else { TRACE_UIOHOOK("Terminate"); }
-            terminate();
-        }
-    }
-}
-
-// static
-void UiohookCounterThread::uiohookEvent(uiohook_event *const event)
-{
-    //TRACE_UIOHOOK(event);
-
-    if (QThread::currentThread()->isInterruptionRequested()) return;
-
-    auto self = ActivityCounter::instance()->uiohook_thread;
-    Q_ASSERT(self);
-
-    if (event->type == EVENT_HOOK_ENABLED) {
-        TRACE_UIOHOOK("Hook enabled");
-        self->uiohook_status = UIOHOOK_SUCCESS;
-        return;
-    }
-    if (event->type == EVENT_HOOK_DISABLED) {
-        TRACE_UIOHOOK("Hook disabled");
-        self->uiohook_status = UIOHOOK_FAILURE;
-        return;
-    }
-    if (!self->count_actions) return;
-
-    switch (event->type) {
-    case EVENT_KEY_PRESSED:
-        TRACE_UIOHOOK(event->type << "keyPressed" << event->data.keyboard.keycode
-                                  << "rawCode" << event->data.keyboard.rawcode);
-        break;
-    case EVENT_KEY_RELEASED:
-        if (event->data.keyboard.keycode || event->data.keyboard.rawcode)
-            self->key_presses++;
-        TRACE_UIOHOOK(event->type << "keyReleased" << event->data.keyboard.keycode
-                                  << "rawCode" << event->data.keyboard.rawcode);
-        break;
-    case EVENT_KEY_TYPED:
-        TRACE_UIOHOOK(event->type << "keyChar" << event->data.keyboard.keychar
-                                  << "rawCode" << event->data.keyboard.rawcode);
-        break;
-    case EVENT_MOUSE_PRESSED:
-        TRACE_UIOHOOK(event->type << "posPressed" << event->data.mouse.x << event->data.mouse.y
-                                  << "button" << event->data.mouse.button
-                                  << "clicks" << event->data.mouse.clicks);
-        break;
-    case EVENT_MOUSE_RELEASED:
-        TRACE_UIOHOOK(event->type << "posReleased" << event->data.mouse.x << event->data.mouse.y
-                                  << "button" << event->data.mouse.button
-                                  << "clicks" << event->data.mouse.clicks);
-        break;
-    case EVENT_MOUSE_CLICKED:
-        if (event->data.mouse.button || event->data.mouse.clicks)
-            self->mouse_clicks++;
-        TRACE_UIOHOOK(event->type << "posClicked" << event->data.mouse.x << event->data.mouse.y
-                                  << "button" << event->data.mouse.button
-                                  << "clicks" << event->data.mouse.clicks);
-        break;
-    case EVENT_MOUSE_MOVED:
-        self->setLastPos(event->data.mouse.x, event->data.mouse.y);
-        TRACE_UIOHOOK(event->type << "posMoved" << event->data.mouse.x << event->data.mouse.y
-                                  << "button" << event->data.mouse.button
-                                  << "clicks" << event->data.mouse.clicks);
-        break;
-    case EVENT_MOUSE_DRAGGED:
-        self->setLastPos(event->data.mouse.x, event->data.mouse.y);
-        TRACE_UIOHOOK(event->type << "posDragged" << event->data.mouse.x << event->data.mouse.y
-                                  << "button" << event->data.mouse.button
-                                  << "clicks" << event->data.mouse.clicks);
-        break;
-    case EVENT_MOUSE_WHEEL:
-        TRACE_UIOHOOK(event->type << "wheelType" << event->data.wheel.type
-                                  << "amount" << event->data.wheel.amount
-                                  << "rotation" << event->data.wheel.rotation);
-        break;
-    default:
-        qWarning() << Q_FUNC_INFO << "Unexpected event type" << event->type;
-    }
-}
-
-void UiohookCounterThread::setLastPos(int x, int y)
-{
-    QPoint pos(x, y);
-    if (!last_pos.isNull()) {
-        QPoint diff = pos - last_pos;
-        mouse_distance += diff.manhattanLength();
-    }
-    last_pos = pos;
-}
-
 static QString loadTextNote(const QString &id)
 {
     if (!id.isEmpty()) {
@@ -233,6 +102,10 @@ ActivityCounter::ActivityCounter(QObject *parent)
     , last_keys(0)
     , last_clicks(0)
     , last_distance(0)
+    , active_mask(0)
+    , input_drops(0)
+    , spill_queued(0)
+    , spill_journaled(0)
     , daily_timer(nullptr)
     , second_timer(nullptr)
     , history_on(SqliteProducer::HistoryOn > 0)
@@ -244,6 +117,7 @@ ActivityCounter::ActivityCounter(QObject *parent)
     TRACE();
 
     qRegisterMetaType<ActivityRecord>("ActivityRecord");
+    qRegisterMetaType<QVector<ActivityRecord>>("QVector<ActivityRecord>");
     qRegisterMetaType<ServerStatusMap>("ServerStatusMap");
 
     QSettings settings;
@@ -320,9 +194,12 @@ void ActivityCounter::startUp()
             auto thread = new SqliteProducerThread(SystemHelper::appDataPath(SqliteProducer::dataBaseFile), this);
             sql_db = thread->worker();
             Q_ASSERT(sql_db);
+            sql_db->setChainKey(SystemHelper::appSshKey());
             connect(sql_db, &SqliteProducer::errorOccurred, this, &ActivityCounter::setLastError, Qt::QueuedConnection);
             connect(sql_db, &SqliteProducer::dataChanged, this, &ActivityCounter::sqlDbChanged, Qt::QueuedConnection);
             connect(sql_db, &SqliteProducer::configChanged, this,&ActivityCounter::onSqlConfigChanged, Qt::QueuedConnection);
+            connect(sql_db, &SqliteProducer::spillChanged, this, &ActivityCounter::onSqlSpillChanged, Qt::QueuedConnection);
+            connect(sql_db, &SqliteProducer::syncStateChanged, this, &ActivityCounter::sqlDbSynced, Qt::QueuedConnection);
             thread->start();
         }
         if (!daily_timer->isActive())
@@ -400,12 +277,14 @@ void ActivityCounter::onDailyTimer()
     bool clicks_changed = (mouse_clicks != 0);
     bool distance_changed = (mouse_distance != 0);
 
-    uiohook_thread->key_presses = uiohook_thread->mouse_clicks = uiohook_thread->mouse_distance = 0;
-
     key_presses = last_keys = 0;
     mouse_clicks = last_clicks = 0;
     mouse_distance = last_distance = 0;
 
+    source_latency.reset();
+    queue_latency.reset();
+    total_latency.reset();
+
     daily_timer->start(msecsToMidnight());
 
     if (time_count) {
@@ -416,6 +295,7 @@ void ActivityCounter::onDailyTimer()
     if (keys_changed) emit keyPressesChanged();
     if (clicks_changed) emit mouseClicksChanged();
     if (distance_changed) emit mouseDistanceChanged();
+    emit inputLatencyChanged();
 }
 
 void ActivityCounter::onSecondTimer()
@@ -436,9 +316,12 @@ void ActivityCounter::onSecondTimer()
         return;
     }
 
-    int keys = uiohook_thread->key_presses;
-    int clicks = uiohook_thread->mouse_clicks;
-    int distance = uiohook_thread->mouse_distance;
+    int keys = key_presses;
+    int clicks = mouse_clicks;
+    int distance = mouse_distance;
+    quint32 sampled = total_latency.count();
+    drainInput(keys, clicks, distance);
+    bool latency_changed = (total_latency.count() != sampled);
 
     bool keys_changed = (keys != key_presses);
     bool clicks_changed = (clicks != mouse_clicks);
@@ -448,6 +331,11 @@ void ActivityCounter::onSecondTimer()
     mouse_clicks = clicks;
     mouse_distance = distance;
 
+    // The time step is split into 60 slots, one second each for the default one minute step
+    if (second_step && (keys_changed || clicks_changed || distance_changed)) {
+        active_mask |= Q_UINT64_C(1) << ((second_count % second_step) * 60 / second_step);
+    }
+
     second_count++;
     if (history_on && second_step && (second_count % second_step) == 0 &&
             !table_name.isEmpty() && !project_id.isEmpty()) {
@@ -457,7 +345,8 @@ void ActivityCounter::onSecondTimer()
         if (keys || clicks || distance) {
             QDateTime now = QDateTime::currentDateTime();
             TRACE_ARG("second_count" << second_count << "Now" << now.toString());
-            ActivityRecord record(table_name, now, QUuid(project_id), text_note, keys, clicks, distance);
+            ActivityRecord record(table_name, now, QUuid(project_id), text_note, keys, clicks, distance,
+                                  active_mask);
             if (record.isValid() && sql_db) {
                 QMetaObject::invokeMethod(sql_db, "insertRow", Qt::QueuedConnection,
                                           Q_ARG(ActivityRecord, record));
@@ -467,6 +356,7 @@ void ActivityCounter::onSecondTimer()
             last_distance = mouse_distance;
         }
     }
+    if (second_step && (second_count % second_step) == 0) active_mask = 0;
 
     time_count++;
     emit timeCountChanged();
@@ -474,6 +364,7 @@ void ActivityCounter::onSecondTimer()
     if (keys_changed) emit keyPressesChanged();
     if (clicks_changed) emit mouseClicksChanged();
     if (distance_changed) emit mouseDistanceChanged();
+    if (latency_changed) emit inputLatencyChanged();
 
     if (keys_changed || clicks_changed || distance_changed) {
         idle_count = 0;
@@ -484,6 +375,42 @@ void ActivityCounter::onSecondTimer()
     }
 }
 
+void ActivityCounter::drainInput(int &keys, int &clicks, int &distance)
+{
+    InputSample batch[UiohookCounterThread::batchSize];
+    int count;
+    while ((count = uiohook_thread->input_ring.pop(batch, UiohookCounterThread::batchSize)) > 0) {
+        quint32 now = quint32(QElapsedTimer::msecsSinceReference());
+        for (int i = 0; i < count; i++) {
+            const InputSample &sample = batch[i];
+            quint32 queued = now - sample.time;
+            source_latency.record(sample.lag);
+            queue_latency.record(queued);
+            total_latency.record(queued + sample.lag);
+            switch (sample.type) {
+            case EVENT_KEY_RELEASED:
+                keys++;
+                break;
+            case EVENT_MOUSE_CLICKED:
+                clicks++;
+                break;
+            case EVENT_MOUSE_MOVED:
+            case EVENT_MOUSE_DRAGGED:
+                distance += sample.value;
+                break;
+            default:
+                break;
+            }
+        }
+        if (count < UiohookCounterThread::batchSize) break;
+    }
+    quint32 drops = uiohook_thread->input_ring.dropped();
+    if (drops != input_drops) {
+        qWarning() << Q_FUNC_INFO << "Input ring overflow, samples dropped" << drops - input_drops;
+        input_drops = drops;
+    }
+}
+
 QString ActivityCounter::tableName() const
 {
     return table_name;
@@ -603,6 +530,8 @@ void ActivityCounter::setRunning(bool enable)
         second_count = now.second();
         if (second_count < 30) second_count += 60;
         TRACE_ARG("second_count" << second_count << "Now" << now.toString());
+        uiohook_thread->input_ring.clear();
+        active_mask = 0;
         second_timer->start();
         uiohook_thread->count_actions = 1;
     } else {
@@ -624,6 +553,67 @@ QString ActivityCounter::lastError() const
     return last_error;
 }
 
+static QVariantMap latencyMap(const LatencyHistogram &histogram)
+{
+    QVariantMap map;
+    map.insert(QStringLiteral("count"), histogram.count());
+    map.insert(QStringLiteral("p50"),   histogram.percentile(0.5));
+    map.insert(QStringLiteral("p99"),   histogram.percentile(0.99));
+    map.insert(QStringLiteral("p999"),  histogram.percentile(0.999));
+    map.insert(QStringLiteral("max"),   histogram.maximum());
+    return map;
+}
+
+QVariantMap ActivityCounter::inputLatency() const
+{
+    QVariantMap map;
+    map.insert(QStringLiteral("source"), latencyMap(source_latency));
+    map.insert(QStringLiteral("queue"),  latencyMap(queue_latency));
+    map.insert(QStringLiteral("total"),  latencyMap(total_latency));
+    return map;
+}
+
+QVariantMap ActivityCounter::sqlSpill() const
+{
+    QVariantMap map;
+    map.insert(QStringLiteral("queued"),    spill_queued);
+    map.insert(QStringLiteral("journaled"), spill_journaled);
+    if (sql_db) map.insert(QStringLiteral("replay"), latencyMap(sql_db->replayLatency()));
+    return map;
+}
+
+void ActivityCounter::onSqlSpillChanged(int queued, int journaled)
+{
+    TRACE_ARG(queued << journaled);
+
+    spill_queued = queued;
+    spill_journaled = journaled;
+    emit sqlSpillChanged();
+}
+
+QString ActivityCounter::dumpInputLatency() const
+{
+    static const struct {
+        const char *stage;
+        LatencyHistogram ActivityCounter::*histogram;
+    } stages[] = {
+        { "source -> hook",    &ActivityCounter::source_latency },
+        { "hook -> counter",   &ActivityCounter::queue_latency },
+        { "source -> counter", &ActivityCounter::total_latency }
+    };
+    QString text = QString::asprintf("%-18s %10s %8s %8s %8s %8s\n", "Input latency, ms",
+                                     "count", "p50", "p99", "p999", "max");
+    for (const auto &it : stages) {
+        const LatencyHistogram &h = this->*it.histogram;
+        text += QString::asprintf("%-18s %10u %8u %8u %8u %8u\n", it.stage, h.count(),
+                                  h.percentile(0.5), h.percentile(0.99), h.percentile(0.999), h.maximum());
+    }
+    text += QString::asprintf("Input ring dropped %u of %d\n", uiohook_thread->input_ring.dropped(),
+                              uiohook_thread->input_ring.capacity());
+    qInfo().noquote() << text;
+    return text;
+}
+
 void ActivityCounter::setLastError(const QString &text)
 {
     TRACE_ARG(text);
@@ -700,6 +690,16 @@ QString ActivityCounter::uuidCache(const QUuid &uuid) const
     return !uuid.isNull() ? title_cache.cacheValue(uuid) : QString();
 }
 
+void ActivityCounter::setSqlDbSynced(qint64 fromTime, qint64 toTime, int state)
+{
+    TRACE_ARG(fromTime << toTime << state);
+
+    if (sql_db && !table_name.isEmpty()) {
+        QMetaObject::invokeMethod(sql_db, "setSyncState", Qt::QueuedConnection, Q_ARG(QString, table_name),
+                                  Q_ARG(qint64, fromTime), Q_ARG(qint64, toTime), Q_ARG(int, state));
+    }
+}
+
 void ActivityCounter::setSqlDbStatus(const QJsonArray &array)
 {
     TRACE_ARG(array);
@@ -723,7 +723,7 @@ void ActivityCounter::setSqlDbStatus(const QJsonArray &array)
         }
         if (status.size() == array.size()) {
             QMetaObject::invokeMethod(sql_db, "setServerStatus", Qt::QueuedConnection,
-                                      Q_ARG(ServerStatusMap, status));
+                                      Q_ARG(QString, table_name), Q_ARG(ServerStatusMap, status));
         } else {
             qWarning() << Q_FUNC_INFO << "Malformed JsonArray" << array.size() << status.size();
         }
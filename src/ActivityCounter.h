@@ -5,7 +5,9 @@
 #include <QUuid>
 #include <QHash>
 #include <QJsonArray>
+#include <QVariantMap>
 
+#include "LatencyHistogram.h"
 #include "PermanentCache.h"
 
 class QTimer;
@@ -32,6 +34,8 @@ class ActivityCounter : public QObject
     Q_PROPERTY(int      timeStep READ timeStep      NOTIFY timeStepChanged FINAL)
     Q_PROPERTY(QString timeCount READ timeCount     NOTIFY timeCountChanged FINAL)
     Q_PROPERTY(QString lastError READ lastError     NOTIFY lastErrorChanged FINAL)
+    Q_PROPERTY(QVariantMap inputLatency READ inputLatency NOTIFY inputLatencyChanged FINAL)
+    Q_PROPERTY(QVariantMap sqlSpill READ sqlSpill NOTIFY sqlSpillChanged FINAL)
 
 public:
     static constexpr int const startUpDelay    = 750; // milliseconds
@@ -76,15 +80,19 @@ public:
     int timeStep() const; // in seconds
     QString timeCount() const;
     QString lastError() const;
+    QVariantMap inputLatency() const; // p50/p99/p999 in milliseconds per stage
+    QVariantMap sqlSpill() const; // the records parked by the busy database and their replay latency
 
     Q_INVOKABLE void setTitleCache(const QString &id, const QString &title);
     Q_INVOKABLE bool isTitleCache(const QString &id) const;
     Q_INVOKABLE QString titleCache(const QString &id) const;
     QString uuidCache(const QUuid &uuid) const;
+    Q_INVOKABLE QString dumpInputLatency() const;
 
 public slots:
     void start();
     void setSqlDbStatus(const QJsonArray &array);
+    void setSqlDbSynced(qint64 fromTime, qint64 toTime, int state); // SqliteProducer::DataBaseSync, local seconds, 0 is unbound
 
 signals:
     void tableNameChanged();
@@ -99,7 +107,10 @@ signals:
     void timeStepChanged();
     void timeCountChanged();
     void lastErrorChanged(const QString &text);
-    void sqlDbChanged();
+    void inputLatencyChanged();
+    void sqlSpillChanged();
+    void sqlDbChanged(const QString &table, qint64 fromTime, qint64 toTime); // as SqliteProducer::dataChanged
+    void sqlDbSynced(const QString &table, qint64 fromTime, qint64 toTime, int state, bool ok); // as SqliteProducer::syncStateChanged
     void notification(const QString &text);
 
 private:
@@ -107,8 +118,10 @@ private:
     void startUp();
     void cleanUp();
     void onSqlConfigChanged(const QVariantMap &map);
+    void onSqlSpillChanged(int queued, int journaled);
     void onDailyTimer();
     void onSecondTimer();
+    void drainInput(int &keys, int &clicks, int &distance);
     void setLastError(const QString &text);
     void saveWorkTime();
 
@@ -128,6 +141,15 @@ private:
     int last_keys;
     int last_clicks;
     int last_distance;
+    quint64 active_mask; // the bit per second of the time step with input
+    quint32 input_drops;
+    int spill_queued;
+    int spill_journaled;
+
+    // source event timestamp -> hook dispatch -> onSecondTimer() consumption
+    LatencyHistogram source_latency;
+    LatencyHistogram queue_latency;
+    LatencyHistogram total_latency;
 
     QTimer *daily_timer;
     QTimer *second_timer;
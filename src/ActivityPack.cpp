@@ -0,0 +1,138 @@
+#include <QHash>
+#include <QStringList>
+#include <QtDebug>
+
+#include "ActivityPack.h"
+
+// static
+void ActivityPack::putVarint(QByteArray &buffer, quint64 value)
+{
+    while (value >= 0x80) {
+        buffer.append(char(value | 0x80));
+        value >>= 7;
+    }
+    buffer.append(char(value));
+}
+
+// static
+bool ActivityPack::getVarint(const QByteArray &buffer, int &offset, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (offset >= buffer.size()) return false;
+        quint8 byte = quint8(buffer.at(offset++));
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false; // malformed, too long
+}
+
+// static
+bool ActivityPack::getZigzag(const QByteArray &buffer, int &offset, qint64 &value)
+{
+    quint64 raw;
+    if (!getVarint(buffer, offset, raw)) return false;
+    value = qint64(raw >> 1) ^ -qint64(raw & 1);
+    return true;
+}
+
+// static
+QByteArray ActivityPack::pack(qint64 dayTime, const QVector<Row> &rows, bool compress)
+{
+    QStringList strings;
+    QHash<QString,int> index; // 1 based, 0 for none
+    auto stringIndex = [&](const QString &text) -> int {
+        if (text.isEmpty()) return 0;
+        int &i = index[text];
+        if (!i) {
+            strings.append(text);
+            i = strings.size();
+        }
+        return i;
+    };
+    QVector<int> notes, status;
+    notes.reserve(rows.size());
+    status.reserve(rows.size());
+    for (const auto &row : rows) {
+        notes.append(stringIndex(row.textNote));
+        status.append(stringIndex(row.serverStatus));
+    }
+    QByteArray payload;
+    payload.reserve(rows.size() * 8 + 64);
+    putVarint(payload, quint64(rows.size()));
+    putVarint(payload, quint64(strings.size()));
+    for (const auto &text : strings) {
+        const QByteArray utf8 = text.toUtf8();
+        putVarint(payload, quint64(utf8.size()));
+        payload.append(utf8);
+    }
+    qint64 last = dayTime;
+    for (const auto &row : rows) {
+        putVarint(payload, quint64(row.localTime - last));
+        last = row.localTime;
+    }
+    for (const auto &row : rows) putVarint(payload, quint64(row.keyPresses));
+    for (const auto &row : rows) putVarint(payload, quint64(row.mouseClicks));
+    for (const auto &row : rows) putVarint(payload, quint64(row.mouseDistance));
+    for (const auto &row : rows) putVarint(payload, quint64(row.activeMask));
+    for (int i : notes) putVarint(payload, quint64(i));
+    for (int i : status) putVarint(payload, quint64(i));
+
+    QByteArray blob;
+    blob.append(char(formatVersion));
+    if (compress && payload.size() >= compressMin) {
+        QByteArray packed = qCompress(payload);
+        if (packed.size() < payload.size()) {
+            blob.append(char(packedCompressed));
+            blob.append(packed);
+            return blob;
+        }
+    }
+    blob.append(char(0));
+    blob.append(payload);
+    return blob;
+}
+
+// static
+bool ActivityPack::unpack(qint64 dayTime, const QByteArray &blob, QVector<Row> &rows)
+{
+    if (blob.size() < 2 || blob.at(0) != char(formatVersion)) {
+        qWarning() << Q_FUNC_INFO << "Unsupported format version";
+        return false;
+    }
+    const QByteArray payload = (blob.at(1) & packedCompressed) ? qUncompress(blob.mid(2)) : blob.mid(2);
+    int offset = 0;
+    quint64 count, value;
+    if (!getVarint(payload, offset, count) || count > quint64(payload.size())) return false;
+    if (!getVarint(payload, offset, value) || value > quint64(payload.size())) return false;
+    QStringList strings;
+    for (quint64 i = value; i > 0; i--) {
+        quint64 size;
+        if (!getVarint(payload, offset, size) || size > quint64(payload.size() - offset)) return false;
+        strings.append(QString::fromUtf8(payload.constData() + offset, int(size)));
+        offset += int(size);
+    }
+    QVector<Row> row(int(count));
+    qint64 last = dayTime;
+    for (quint64 i = 0; i < count; i++) {
+        if (!getVarint(payload, offset, value)) return false;
+        row[i].localTime = last += qint64(value);
+    }
+    qint64 Row::*columns[] = { &Row::keyPresses, &Row::mouseClicks, &Row::mouseDistance, &Row::activeMask };
+    for (auto column : columns) {
+        for (quint64 i = 0; i < count; i++) {
+            if (!getVarint(payload, offset, value)) return false;
+            row[i].*column = qint64(value);
+        }
+    }
+    QString Row::*texts[] = { &Row::textNote, &Row::serverStatus };
+    for (auto text : texts) {
+        for (quint64 i = 0; i < count; i++) {
+            if (!getVarint(payload, offset, value) || value > quint64(strings.size())) return false;
+            if (value) row[i].*text = strings.at(int(value - 1));
+        }
+    }
+    if (offset != payload.size()) return false;
+    rows += row;
+    return true;
+}
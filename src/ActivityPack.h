@@ -0,0 +1,48 @@
+#ifndef ACTIVITYPACK_H
+#define ACTIVITYPACK_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// Packed cold storage of the activity rows of one project day.
+//
+// The blob starts with the format version byte and the flags byte, the rest is compressed
+// by qCompress when the packedCompressed flag is set. The payload is the varint row count,
+// the string table of the TextNote and ServerStatus values (the varint count and the varint
+// length prefixed UTF-8) and the columns one after another: LocalTime as the varint deltas
+// from the previous row (the first one from the day start), KeyPresses, MouseClicks,
+// MouseDistance and ActiveMask as varints, TextNote and ServerStatus as the varint indexes
+// in the string table, 0 for none.
+class ActivityPack
+{
+public:
+    static constexpr int const formatVersion    = 1;
+    static constexpr int const packedCompressed = 0x01;
+    static constexpr int const compressMin      = 64; // payload bytes worth to compress
+
+    static constexpr int const rowColumns  = 7; // the Row members
+    static constexpr int const rowCounters = 3; // the keyPresses, mouseClicks and mouseDistance
+
+    struct Row {
+        qint64 localTime;
+        qint64 keyPresses;
+        qint64 mouseClicks;
+        qint64 mouseDistance;
+        qint64 activeMask;
+        QString textNote;
+        QString serverStatus;
+    };
+
+    // the rows must be sorted by the LocalTime, none before the day start
+    static QByteArray pack(qint64 dayTime, const QVector<Row> &rows, bool compress = true);
+    // the rows are appended, none on a malformed blob
+    static bool unpack(qint64 dayTime, const QByteArray &blob, QVector<Row> &rows);
+
+    static void putVarint(QByteArray &buffer, quint64 value);
+    static void putZigzag(QByteArray &buffer, qint64 value) { putVarint(buffer, quint64(value << 1) ^ quint64(value >> 63)); }
+    static bool getVarint(const QByteArray &buffer, int &offset, quint64 &value);
+    static bool getZigzag(const QByteArray &buffer, int &offset, qint64 &value);
+};
+
+#endif // ACTIVITYPACK_H
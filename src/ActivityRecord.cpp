@@ -10,6 +10,7 @@ public:
         : key_presses(0)
         , mouse_clicks(0)
         , mouse_distance(0)
+        , active_mask(0)
     {}
     ActivityRecordData(const ActivityRecordData &other)
         : QSharedData(other)
@@ -20,6 +21,7 @@ public:
         , key_presses(other.key_presses)
         , mouse_clicks(other.mouse_clicks)
         , mouse_distance(other.mouse_distance)
+        , active_mask(other.active_mask)
     {}
     ~ActivityRecordData() {}
 
@@ -30,6 +32,7 @@ public:
     int key_presses;
     int mouse_clicks;
     int mouse_distance;
+    quint64 active_mask;
 };
 
 ActivityRecord::ActivityRecord()
@@ -39,7 +42,7 @@ ActivityRecord::ActivityRecord()
 
 ActivityRecord::ActivityRecord(const QString &table_name,
                                const QDateTime &local_time, const QUuid &uuid, const QString &text_note,
-                               int key_presses, int mouse_clicks, int mouse_distance)
+                               int key_presses, int mouse_clicks, int mouse_distance, quint64 active_mask)
     : d(new ActivityRecordData)
 {
     d->table_name = !table_name.isEmpty() ? table_name : QStringLiteral("ActivityTable");
@@ -49,6 +52,7 @@ ActivityRecord::ActivityRecord(const QString &table_name,
     d->key_presses = key_presses > 0 ? key_presses : 0;
     d->mouse_clicks = mouse_clicks > 0 ? mouse_clicks : 0;
     d->mouse_distance = mouse_distance > 0 ? mouse_distance : 0;
+    d->active_mask = active_mask;
 }
 
 ActivityRecord::ActivityRecord(const ActivityRecord &other)
@@ -74,7 +78,8 @@ bool ActivityRecord::operator==(const ActivityRecord &other) const
             d->text_note == other.d->text_note &&
             d->key_presses == other.d->key_presses &&
             d->mouse_clicks == other.d->mouse_clicks &&
-            d->mouse_distance == other.d->mouse_distance);
+            d->mouse_distance == other.d->mouse_distance &&
+            d->active_mask == other.d->active_mask);
 }
 
 bool ActivityRecord::operator!=(const ActivityRecord &other) const
@@ -85,7 +90,8 @@ bool ActivityRecord::operator!=(const ActivityRecord &other) const
             d->text_note != other.d->text_note ||
             d->key_presses != other.d->key_presses ||
             d->mouse_clicks != other.d->mouse_clicks ||
-            d->mouse_distance != other.d->mouse_distance);
+            d->mouse_distance != other.d->mouse_distance ||
+            d->active_mask != other.d->active_mask);
 }
 
 bool ActivityRecord::isValid() const
@@ -99,6 +105,7 @@ void ActivityRecord::clearCounters()
     d->key_presses = 0;
     d->mouse_clicks = 0;
     d->mouse_distance = 0;
+    d->active_mask = 0;
 }
 
 QString ActivityRecord::tableName() const
@@ -146,6 +153,16 @@ int ActivityRecord::mouseDistance() const
     return d->mouse_distance;
 }
 
+quint64 ActivityRecord::activeMask() const
+{
+    return d->active_mask;
+}
+
+int ActivityRecord::activeSeconds() const
+{
+    return qPopulationCount(d->active_mask);
+}
+
 void ActivityRecord::dump(QDebug &dbg) const
 {
     QDebugStateSaver saver(dbg);
@@ -156,5 +173,6 @@ void ActivityRecord::dump(QDebug &dbg) const
         << "\n\t textNote"      << '"' << d->text_note << '"'
         << "\n\t keyPresses"    << d->key_presses
         << "\n\t mouseClicks"   << d->mouse_clicks
-        << "\n\t mouseDistance" << d->mouse_distance;
+        << "\n\t mouseDistance" << d->mouse_distance
+        << "\n\t activeMask"    << QString::number(d->active_mask, 16);
 }
@@ -19,13 +19,15 @@ class ActivityRecord
     Q_PROPERTY(int      keyPresses READ keyPresses    CONSTANT FINAL)
     Q_PROPERTY(int     mouseClicks READ mouseClicks   CONSTANT FINAL)
     Q_PROPERTY(int   mouseDistance READ mouseDistance CONSTANT FINAL)
+    Q_PROPERTY(int   activeSeconds READ activeSeconds CONSTANT FINAL)
 
 public:
     ActivityRecord();
     // the time must be specified as Local time, e.g. QDateTime::currentDateTime()
+    // the bit N of the activeMask is set when there was input in the second N of the minute
     ActivityRecord(const QString &tableName,
                    const QDateTime &localTime, const QUuid &uuid, const QString &textNote,
-                   int keyPresses, int mouseClicks, int mouseDistance);
+                   int keyPresses, int mouseClicks, int mouseDistance, quint64 activeMask = 0);
     ActivityRecord(const ActivityRecord &);
     ActivityRecord &operator=(const ActivityRecord &);
     ~ActivityRecord();
@@ -45,6 +47,8 @@ public:
     int keyPresses() const;
     int mouseClicks() const;
     int mouseDistance() const;
+    quint64 activeMask() const;
+    int activeSeconds() const; // number of bits set in the activeMask() above
 
     friend inline QDebug& operator<<(QDebug &dbg, const ActivityRecord &from) {
         from.dump(dbg); return dbg; }
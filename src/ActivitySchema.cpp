@@ -0,0 +1,142 @@
+#include <QStringList>
+
+#include "ActivitySchema.h"
+
+// static
+QString ActivitySchema::storedName(int column, bool encoded)
+{
+    const Column &c = columns[column];
+    return QLatin1String(encoded && (c.flags & Dictionary) ? c.refName : c.name);
+}
+
+// static
+QString ActivitySchema::definition(int column, bool encoded, bool constraints)
+{
+    const Column &c = columns[column];
+    QString text = storedName(column, encoded) + ' ' +
+            QLatin1String(encoded && (c.flags & Dictionary) ? "INTEGER" : c.type);
+    if (constraints && (c.flags & PrimaryKey)) text += QLatin1String(" PRIMARY KEY");
+    if (constraints && (c.flags & NotNull)) text += QLatin1String(" NOT NULL");
+    return text;
+}
+
+// static
+QString ActivitySchema::definitions(bool encoded, bool constraints)
+{
+    QStringList list;
+    for (int i = 0; i < columnCount; i++) list.append(definition(i, encoded, constraints));
+    return list.join(QLatin1String(", "));
+}
+
+// static
+QString ActivitySchema::names(bool encoded)
+{
+    QStringList list;
+    for (int i = 0; i < columnCount; i++) list.append(storedName(i, encoded));
+    return list.join(QLatin1String(", "));
+}
+
+// static
+QString ActivitySchema::insertNames(bool encoded)
+{
+    QStringList list;
+    for (int i = 0; i < columnCount; i++) {
+        if (columns[i].value || columns[i].initial) list.append(storedName(i, encoded));
+    }
+    return list.join(QLatin1String(", "));
+}
+
+// static
+QString ActivitySchema::insertValues()
+{
+    QStringList list;
+    for (const auto &c : columns) {
+        if (c.value) list.append(QStringLiteral("?"));
+        else if (c.initial) list.append(QLatin1String(c.initial));
+    }
+    return list.join(QLatin1String(", "));
+}
+
+// static
+QString ActivitySchema::mergeSql(bool encoded, bool replace)
+{
+    QStringList list;
+    for (int i = 0; i < columnCount; i++) {
+        const Column &c = columns[i];
+        if (!c.merge || (!replace && (c.flags & Dictionary))) continue;
+        list.append(QString(QLatin1String(c.merge)).arg(storedName(i, encoded)));
+    }
+    return list.join(QLatin1String(", "));
+}
+
+// static
+QString ActivitySchema::mergeWhere(bool encoded)
+{
+    QStringList list;
+    for (int i = 0; i < columnCount; i++) {
+        if (columns[i].flags & MergeKey) list.append(QString(QLatin1String("%1=excluded.%1")).arg(storedName(i, encoded)));
+    }
+    return list.join(QLatin1String(" AND "));
+}
+
+// static
+QString ActivitySchema::viewColumns()
+{
+    QStringList list;
+    for (int i = 0; i < columnCount; i++) {
+        const Column &c = columns[i];
+        if (c.flags & Dictionary) list.append(QString("d%1.Value AS %2").arg(i).arg(QLatin1String(c.name)));
+        else list.append(QString("r.%1 AS %1").arg(QLatin1String(c.name)));
+    }
+    return list.join(QLatin1String(", "));
+}
+
+// static
+QString ActivitySchema::viewJoins(const QString &schema)
+{
+    const QString prefix = schema.isEmpty() ? QString() : schema + QLatin1Char('.');
+    QStringList list;
+    for (int i = 0; i < columnCount; i++) {
+        const Column &c = columns[i];
+        if (!(c.flags & Dictionary)) continue;
+        list.append(QString("%1 %2'%3' AS d%4 ON d%4.Id=r.%5").arg(QLatin1String((c.flags & NotNull) ? "JOIN" : "LEFT JOIN"),
+                                                                  prefix, QLatin1String(c.dictionary)).arg(i)
+                    .arg(QLatin1String(c.refName)));
+    }
+    return list.join(' ');
+}
+
+// static
+QString ActivitySchema::encodeValues(const QString &schema)
+{
+    QStringList list;
+    for (const auto &c : columns) {
+        if (c.flags & Dictionary) {
+            list.append(QString("(SELECT Id FROM %1.'%2' WHERE Value=c.%3)").arg(schema, QLatin1String(c.dictionary),
+                                                                              QLatin1String(c.name)));
+        } else {
+            list.append(QLatin1String("c.") + QLatin1String(c.name));
+        }
+    }
+    return list.join(QLatin1String(", "));
+}
+
+// static
+QString ActivitySchema::countersSql(const QString &function)
+{
+    QStringList list;
+    for (const auto &c : columns) {
+        if (c.flags & Counter) list.append(QString("%1(%2) AS %2").arg(function, QLatin1String(c.name)));
+    }
+    return list.join(QLatin1String(", "));
+}
+
+// static
+QString ActivitySchema::counters(const char *format)
+{
+    QStringList list;
+    for (const auto &c : columns) {
+        if (c.flags & Counter) list.append(QString(QLatin1String(format)).arg(QLatin1String(c.name)));
+    }
+    return list.join(QLatin1String(", "));
+}
@@ -0,0 +1,125 @@
+#ifndef ACTIVITYSCHEMA_H
+#define ACTIVITYSCHEMA_H
+
+#include <QString>
+#include <QVariant>
+
+#include "ActivityRecord.h"
+
+// The columns of the activity tables, defined once.
+//
+// The table is constexpr, the order is the one of SqliteProducer::DataBaseColumn. The column
+// lists of the statements are generated from it when they are prepared, the records are bound by
+// the position and the counters are uploaded by the jsonKey, so a column adds no name lookup
+// per row. A Counter column is summed up on the LocalTime collision and by the queries of
+// the QML; an Appended one is added by ALTER TABLE to the tables of the older versions.
+// The collision merges only the rows of the same MergeKey value (the project), the record
+// of another one is moved to the next free second, up to mergeShift seconds later.
+class ActivitySchema
+{
+public:
+    enum ColumnFlag {
+        PrimaryKey = 0x01, // the LocalTime
+        NotNull    = 0x02,
+        Dictionary = 0x04, // the rows table keeps the id of the value in the dictionary
+        Counter    = 0x08,
+        Appended   = 0x10,
+        MergeKey   = 0x20  // the LocalTime collision merges only the rows of the same value
+    };
+    static constexpr int const mergeShift = 60; // seconds
+
+    struct Column {
+        const char *name;
+        const char *type;    // the SQLite type affinity
+        int flags;
+        const char *merge;   // the ON CONFLICT assignment of %1, none keeps the value
+        const char *initial; // the inserted SQL value of a column not in the record, none is NULL
+        QVariant (*value)(const ActivityRecord &record); // bound by the insert, none for initial
+        const char *refName;    // of the Dictionary column in the rows table
+        const char *dictionary; // the table of the values
+        const char *jsonKey;    // in the uploaded rows
+    };
+
+    static constexpr Column const columns[] = {
+        { "LocalTime", "INTEGER", PrimaryKey | NotNull, nullptr, nullptr,
+          [](const ActivityRecord &r) -> QVariant { return r.localTime().toSecsSinceEpoch(); },
+          nullptr, nullptr, "toAt" },
+        { "ProjectId", "TEXT", NotNull | Dictionary | MergeKey, nullptr, nullptr,
+          [](const ActivityRecord &r) -> QVariant { return r.projectId(); },
+          "ProjectRef", "Projects", "activityId" },
+        { "TextNote", "TEXT", Dictionary, "%1=excluded.%1", nullptr,
+          [](const ActivityRecord &r) -> QVariant { return r.textNote(); },
+          "NoteRef", "Notes", "note" },
+        { "KeyPresses", "INTEGER", Counter, "%1=%1+excluded.%1", nullptr,
+          [](const ActivityRecord &r) -> QVariant { return r.keyPresses(); },
+          nullptr, nullptr, "keyboardKeys" },
+        { "MouseClicks", "INTEGER", Counter, "%1=%1+excluded.%1", nullptr,
+          [](const ActivityRecord &r) -> QVariant { return r.mouseClicks(); },
+          nullptr, nullptr, "mouseKeys" },
+        { "MouseDistance", "INTEGER", Counter, "%1=%1+excluded.%1", nullptr,
+          [](const ActivityRecord &r) -> QVariant { return r.mouseDistance(); },
+          nullptr, nullptr, "mouseDistance" },
+        { "ServerStatus", "TEXT", 0, "%1=NULL", nullptr, nullptr,
+          nullptr, nullptr, nullptr },
+        { "ActiveMask", "INTEGER", Appended, "%1=IFNULL(%1,0)|IFNULL(excluded.%1,0)", nullptr,
+          [](const ActivityRecord &r) -> QVariant { return qint64(r.activeMask()); },
+          nullptr, nullptr, nullptr },
+        { "SyncState", "INTEGER", Appended, "%1=1", "1", nullptr,
+          nullptr, nullptr, nullptr }
+    };
+    static constexpr int const columnCount = int(sizeof(columns) / sizeof(columns[0]));
+
+    static constexpr int indexOf(const char *name) {
+        for (int i = 0; i < columnCount; i++) {
+            if (equal(columns[i].name, name)) return i;
+        }
+        return -1;
+    }
+    static constexpr bool equal(const char *a, const char *b) {
+        while (*a && *a == *b) { a++; b++; }
+        return *a == *b;
+    }
+    // the columns with all of the flags
+    static constexpr int count(int flags) {
+        int n = 0;
+        for (int i = 0; i < columnCount; i++) {
+            if ((columns[i].flags & flags) == flags) n++;
+        }
+        return n;
+    }
+    // the columns bound from the record, the ones the record keeps
+    static constexpr int valueCount() {
+        int n = 0;
+        for (int i = 0; i < columnCount; i++) {
+            if (columns[i].value) n++;
+        }
+        return n;
+    }
+
+    // the name of the column in the plain table or in the rows table
+    static QString storedName(int column, bool encoded);
+    // "LocalTime INTEGER PRIMARY KEY NOT NULL, ProjectId TEXT NOT NULL, ..."
+    static QString definitions(bool encoded, bool constraints = true);
+    static QString definition(int column, bool encoded, bool constraints = true);
+    // "LocalTime, ProjectId, ..." or "LocalTime, ProjectRef, ..."
+    static QString names(bool encoded = false);
+    // the inserted columns, "?" for the ones with the value() in the column order
+    static QString insertNames(bool encoded);
+    static QString insertValues();
+    // the ON CONFLICT assignments, the Dictionary columns only when replaced
+    static QString mergeSql(bool encoded, bool replace = true);
+    // the ON CONFLICT condition, "ProjectId=excluded.ProjectId" of the MergeKey columns
+    static QString mergeWhere(bool encoded);
+    // the rows table r joined with the dictionaries, as the plain columns in the column order;
+    // the dictionaries of the schema when given, by the name alone in the view
+    static QString viewColumns();
+    static QString viewJoins(const QString &schema = QString());
+    // the plain rows c with the ids of the dictionaries of the schema
+    static QString encodeValues(const QString &schema);
+    // "TOTAL(KeyPresses) AS KeyPresses, ..." of the Counter columns
+    static QString countersSql(const QString &function);
+    // the format with %1 of every Counter column name, "SUM(KeyPresses), ..." by "SUM(%1)"
+    static QString counters(const char *format);
+};
+
+#endif // ACTIVITYSCHEMA_H
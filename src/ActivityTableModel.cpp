@@ -1,6 +1,9 @@
+#include <QTimer>
+
 #include "ActivityTableModel.h"
 #include "ActivityCounter.h"
 #include "SqliteProducer.h"
+#include "ActivitySchema.h"
 #include "SystemHelper.h"
 
 //#define TRACE_ACTIVITYTABLEMODEL
@@ -15,7 +18,11 @@
 
 ActivityTableModel::ActivityTableModel(QObject *parent)
     : QAbstractTableModel(parent)
+    , from_time(0)
+    , to_time(0)
     , sql_busy(false)
+    , refresh_timer(nullptr)
+    , refresh_pending(false)
 {
     TRACE();
 
@@ -24,7 +31,7 @@ ActivityTableModel::ActivityTableModel(QObject *parent)
     Q_ASSERT(sql_db);
     connect(sql_db, &SqliteConsumer::queryError, this, &ActivityTableModel::setLastError, Qt::QueuedConnection);
     connect(sql_db, &SqliteConsumer::queryResult, this, &ActivityTableModel::onQueryResult, Qt::QueuedConnection);
-    connect(ActivityCounter::instance(), &ActivityCounter::sqlDbChanged, this, &ActivityTableModel::execLastQuery);
+    connect(ActivityCounter::instance(), &ActivityCounter::sqlDbChanged, this, &ActivityTableModel::onSqlDbChanged);
 
     thread->start();
 }
@@ -63,6 +70,36 @@ void ActivityTableModel::setView(const QString &query)
     }
 }
 
+qint64 ActivityTableModel::fromTime() const
+{
+    return from_time;
+}
+
+void ActivityTableModel::setFromTime(qint64 seconds)
+{
+    TRACE_ARG(seconds);
+
+    if (seconds != from_time) {
+        from_time = seconds;
+        emit fromTimeChanged();
+    }
+}
+
+qint64 ActivityTableModel::toTime() const
+{
+    return to_time;
+}
+
+void ActivityTableModel::setToTime(qint64 seconds)
+{
+    TRACE_ARG(seconds);
+
+    if (seconds != to_time) {
+        to_time = seconds;
+        emit toTimeChanged();
+    }
+}
+
 void ActivityTableModel::execLastQuery()
 {
     TRACE();
@@ -70,12 +107,42 @@ void ActivityTableModel::execLastQuery()
     if (sql_busy || last_query.isEmpty()) return;
 
     Q_ASSERT(sql_db);
-    QMetaObject::invokeMethod(sql_db, "execQuery", Qt::QueuedConnection, Q_ARG(QString, last_query));
+    QMetaObject::invokeMethod(sql_db, "execQuery", Qt::QueuedConnection, Q_ARG(QString, last_query),
+                              Q_ARG(qint64, from_time), Q_ARG(qint64, to_time));
 
     sql_busy = true;
     emit busyChanged();
 }
 
+// The query reruns once after the RefreshDelay for all the changes in its time range;
+// the table is matched by its whole name in the query text, a rollup of it matches as well
+void ActivityTableModel::onSqlDbChanged(const QString &table, qint64 fromTime, qint64 toTime)
+{
+    TRACE_ARG(table << fromTime << toTime);
+
+    if (last_query.isEmpty()) return;
+    if (!table.isEmpty() && !SqliteProducer::namesTable(last_query, table, true)) return;
+    if ((to_time > 0 && fromTime > to_time) || (toTime > 0 && from_time > 0 && toTime < from_time)) return;
+
+    if (!refresh_timer) {
+        refresh_timer = new QTimer(this);
+        refresh_timer->setSingleShot(true);
+        connect(refresh_timer, &QTimer::timeout, this, &ActivityTableModel::onRefreshTimer);
+    }
+    if (!refresh_timer->isActive()) refresh_timer->start(RefreshDelay);
+}
+
+void ActivityTableModel::onRefreshTimer()
+{
+    TRACE();
+
+    if (sql_busy) {
+        refresh_pending = true;
+        return;
+    }
+    execLastQuery();
+}
+
 bool ActivityTableModel::busy() const
 {
     return sql_busy;
@@ -94,6 +161,10 @@ void ActivityTableModel::setLastError(const QString &text)
         sql_busy = false;
         emit busyChanged();
     }
+    if (refresh_pending) {
+        refresh_pending = false;
+        refresh_timer->start(RefreshDelay);
+    }
     if (text != last_error) {
         last_error = text;
         emit lastErrorChanged(text);
@@ -128,6 +199,19 @@ int ActivityTableModel::columnIdIndex(const QString &name)
     return SqliteProducer::columnIndex(name);
 }
 
+// static
+// "TOTAL(KeyPresses) AS KeyPresses, ..." of the counters, the rollups have them as well
+QString ActivityTableModel::countersSql(const QString &function)
+{
+    return ActivitySchema::countersSql(function);
+}
+
+// static
+QString ActivityTableModel::rollupTable(const QString &table, int bucket)
+{
+    return SqliteProducer::rollupTable(table, bucket);
+}
+
 void ActivityTableModel::onQueryResult(const CborMapArray &rows)
 {
     CborValueArray keys;
@@ -152,6 +236,10 @@ void ActivityTableModel::onQueryResult(const CborMapArray &rows)
         sql_busy = false;
         emit busyChanged();
     }
+    if (refresh_pending) {
+        refresh_pending = false;
+        refresh_timer->start(RefreshDelay);
+    }
     //if (header_changed) emit headerDataChanged(Qt::Horizontal, 0, header_keys.size() - 1);
     emit viewChanged();
 }
@@ -163,8 +251,8 @@ void ActivityTableModel::onQueryResult(const CborMapArray &rows)
     if (role_names.isEmpty()) {
         // 0="display", 1="decoration", 2="edit", 3="toolTip", 4="statusTip", 5="whatsThis", 256=UserRole
         role_names = QAbstractTableModel::roleNames();
-        for (int i = 0; i < SqliteProducer::TotalColumns; i++) {
-            role_names[Qt::UserRole + i] = SqliteProducer::dataBaseColumn[i];
+        for (int i = 0; i < ActivitySchema::columnCount; i++) {
+            role_names[Qt::UserRole + i] = ActivitySchema::columns[i].name;
         }
     }
     return role_names;
@@ -4,6 +4,8 @@
 #include <QAbstractTableModel>
 #include <QCborValue>
 
+class QTimer;
+
 #include "SqliteConsumer.h"
 
 class ActivityTableModel : public QAbstractTableModel // !QSqlQueryModel
@@ -12,16 +14,29 @@ class ActivityTableModel : public QAbstractTableModel // !QSqlQueryModel
     Q_DISABLE_COPY(ActivityTableModel)
 
     Q_PROPERTY(QString       view READ view      WRITE setView NOTIFY viewChanged FINAL)
+    Q_PROPERTY(qint64    fromTime READ fromTime  WRITE setFromTime NOTIFY fromTimeChanged FINAL)
+    Q_PROPERTY(qint64      toTime READ toTime    WRITE setToTime NOTIFY toTimeChanged FINAL)
     Q_PROPERTY(bool          busy READ busy      NOTIFY busyChanged FINAL)
     Q_PROPERTY(QString  lastError READ lastError NOTIFY lastErrorChanged FINAL)
 
 public:
+    enum ModelRefresh {
+        RefreshDelay = 1000 // milliseconds the changes of the database are gathered before the query reruns
+    };
+    Q_ENUM(ModelRefresh)
+
     explicit ActivityTableModel(QObject *parent = nullptr);
     ~ActivityTableModel();
 
     QString view() const;
     void setView(const QString &query);
 
+    // the view time range in seconds, 0 is unbound
+    qint64 fromTime() const;
+    void setFromTime(qint64 seconds);
+    qint64 toTime() const;
+    void setToTime(qint64 seconds);
+
     bool busy() const;
     QString lastError() const;
 
@@ -29,6 +44,8 @@ public:
 
     Q_INVOKABLE static QString columnIdName(int column);
     Q_INVOKABLE static int columnIdIndex(const QString &name);
+    Q_INVOKABLE static QString countersSql(const QString &function = QStringLiteral("TOTAL"));
+    Q_INVOKABLE static QString rollupTable(const QString &table, int bucket); // bucket in seconds
 
     // reimplemented from QAbstractItemModel
     //QHash<int, QByteArray> roleNames() const override;
@@ -39,20 +56,28 @@ public:
 
 signals:
     void viewChanged();
+    void fromTimeChanged();
+    void toTimeChanged();
     void busyChanged();
     void lastErrorChanged(const QString &text);
 
 private:
     void setLastError(const QString &text);
     void execLastQuery();
+    void onSqlDbChanged(const QString &table, qint64 fromTime, qint64 toTime);
+    void onRefreshTimer();
     void onQueryResult(const CborMapArray &rows);
 
     SqliteConsumer *sql_db;
     CborValueArray header_keys;
     CborMapArray sql_data;
     QString last_query;
+    qint64 from_time;
+    qint64 to_time;
     QString last_error;
     bool sql_busy;
+    QTimer *refresh_timer;
+    bool refresh_pending; // changed while the query runs
 };
 
 #endif // ACTIVITYTABLEMODEL_H
@@ -0,0 +1,95 @@
+#ifndef INPUTEVENTRING_H
+#define INPUTEVENTRING_H
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+
+// One compact input sample passed from the uiohook thread to the GUI thread
+struct InputSample
+{
+    quint32 time;  // receipt time, milliseconds of the monotonic clock (wraps)
+    quint16 type;  // uiohook event_type
+    quint16 lag;   // milliseconds from the source event timestamp to the receipt (saturated)
+    qint16 x;      // pointer position for the mouse events
+    qint16 y;
+    quint32 value; // event specific payload, e.g. keycode or button
+};
+Q_DECLARE_TYPEINFO(InputSample, Q_PRIMITIVE_TYPE);
+
+// Lock-free single-producer/single-consumer ring. The producer index, the consumer
+// index and the cached copies of the opposite side live on separate cache lines,
+// so in the steady state neither thread touches a line written by the other one.
+template <class T, int Size>
+class InputEventRing
+{
+    static_assert(Size > 0 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+    static constexpr int const cacheLine = 64;
+
+    InputEventRing() : head(0), tail_cache(0), drops(0), tail(0), head_cache(0) {}
+
+    // producer side only
+    inline bool push(const T &item) {
+        quint32 h = head.loadRelaxed();
+        if (h - tail_cache >= quint32(Size)) {
+            tail_cache = tail.loadAcquire();
+            if (h - tail_cache >= quint32(Size)) {
+                drops.storeRelaxed(drops.loadRelaxed() + 1);
+                return false;
+            }
+        }
+        ring[h & (Size - 1)] = item;
+        head.storeRelease(h + 1);
+        return true;
+    }
+
+    // producer side only; true if the next push() would drop the item
+    inline bool full() {
+        quint32 h = head.loadRelaxed();
+        if (h - tail_cache >= quint32(Size)) tail_cache = tail.loadAcquire();
+        return h - tail_cache >= quint32(Size);
+    }
+
+    // consumer side only; returns the number of items copied into the batch
+    inline int pop(T *batch, int max) {
+        quint32 t = tail.loadRelaxed();
+        if (head_cache == t) {
+            head_cache = head.loadAcquire();
+            if (head_cache == t) return 0;
+        }
+        int count = qMin(int(head_cache - t), max);
+        for (int i = 0; i < count; i++) {
+            batch[i] = ring[(t + i) & (Size - 1)];
+        }
+        tail.storeRelease(t + count);
+        return count;
+    }
+
+    // consumer side only; discard everything pushed so far
+    inline void clear() {
+        head_cache = head.loadAcquire();
+        tail.storeRelease(head_cache);
+    }
+
+    // safe from any thread
+    inline int size() const { return int(head.loadAcquire() - tail.loadAcquire()); }
+    inline quint32 dropped() const { return drops.loadRelaxed(); }
+    static constexpr int capacity() { return Size; }
+
+private:
+    Q_DISABLE_COPY(InputEventRing)
+
+    // written by the producer
+    alignas(cacheLine) QAtomicInteger<quint32> head;
+    quint32 tail_cache;
+    QAtomicInteger<quint32> drops;
+
+    // written by the consumer
+    alignas(cacheLine) QAtomicInteger<quint32> tail;
+    quint32 head_cache;
+
+    alignas(cacheLine) T ring[Size];
+};
+
+#endif // INPUTEVENTRING_H
@@ -0,0 +1,71 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+#include <QtAlgorithms>
+#include <QAtomicInteger>
+
+// Lock-free log-linear (HDR style) histogram of 32 bit values, e.g. milliseconds.
+// Every power of two range is split into subCount linear buckets, so the relative
+// error of a reported percentile is below 1/subCount. Recording is wait-free and
+// may run concurrently with the readers; a read is a relaxed, not atomic, snapshot.
+class LatencyHistogram
+{
+public:
+    static constexpr int const subBits     = 4;
+    static constexpr int const subCount    = 1 << subBits;
+    static constexpr int const bucketCount = (32 - subBits + 1) * subCount;
+
+    LatencyHistogram() { reset(); }
+
+    inline void record(quint32 value) {
+        buckets[index(value)].fetchAndAddRelaxed(1);
+        total.fetchAndAddRelaxed(1);
+        quint32 max = highest.loadRelaxed();
+        while (value > max && !highest.testAndSetRelaxed(max, value, max)) {}
+    }
+
+    void reset() {
+        for (int i = 0; i < bucketCount; i++) buckets[i].storeRelaxed(0);
+        total.storeRelaxed(0);
+        highest.storeRelaxed(0);
+    }
+
+    quint32 count() const { return total.loadRelaxed(); }
+    quint32 maximum() const { return highest.loadRelaxed(); }
+
+    // the upper bound of the bucket holding the requested fraction, e.g. 0.99 for p99
+    quint32 percentile(double fraction) const {
+        quint32 n = count();
+        if (!n) return 0;
+        quint64 target = qMax(quint64(1), quint64(fraction * n + 0.999999));
+        quint64 sum = 0;
+        for (int i = 0; i < bucketCount; i++) {
+            sum += buckets[i].loadRelaxed();
+            if (sum >= target) return qMin(upperBound(i), maximum());
+        }
+        return maximum();
+    }
+
+    static inline int index(quint32 value) {
+        if (value < quint32(subCount)) return int(value);
+        int exp = 31 - qCountLeadingZeroBits(value);
+        return (exp - subBits + 1) * subCount + int((value >> (exp - subBits)) - subCount);
+    }
+
+    static inline quint32 upperBound(int index) {
+        if (index < subCount) return quint32(index);
+        int exp = index / subCount + subBits - 1;
+        quint64 sub = quint64(index % subCount + subCount);
+        return quint32(qMin(((sub + 1) << (exp - subBits)) - 1, quint64(0xffffffff)));
+    }
+
+private:
+    Q_DISABLE_COPY(LatencyHistogram)
+
+    QAtomicInteger<quint32> buckets[bucketCount];
+    QAtomicInteger<quint32> total;
+    QAtomicInteger<quint32> highest;
+};
+
+#endif // LATENCYHISTOGRAM_H
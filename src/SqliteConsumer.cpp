@@ -1,9 +1,13 @@
+#include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QSqlError>
 #include <QFileInfo>
+#include <QDateTime>
 #include <QTimer>
+#include <QDate>
 #include <QtDebug>
+#include <limits>
 
 #ifdef Q_OS_LINUX
 #include <sys/prctl.h>
@@ -11,6 +15,8 @@
 
 #include "SqliteConsumer.h"
 #include "SqliteProducer.h"
+#include "ActivitySchema.h"
+#include "ActivityPack.h"
 
 //#define TRACE_SQLITECONSUMER
 #ifdef TRACE_SQLITECONSUMER
@@ -22,6 +28,34 @@
 #define TRACE_ARG(x)
 #endif
 
+static const char *sqlAttach =
+    "ATTACH DATABASE '%1' AS %2";
+static const char *sqlDetach =
+    "DETACH DATABASE %1";
+static const char *sqlTableInfo =
+    "PRAGMA %1.table_info('%2')";
+static const char *sqlSchemaTables =
+    "SELECT name FROM %1.sqlite_master WHERE type IN ('table','view')";
+static const char *sqlTempView =
+    "CREATE TEMP VIEW '%1' AS %2";
+static const char *sqlTempTable =
+    "CREATE TEMP TABLE '%1' AS %2";
+static const char *sqlTempInsert =
+    "INSERT INTO temp.'%1' %2";
+static const char *sqlTempDrop =
+    "DROP %1 IF EXISTS temp.'%2'";
+static const char *sqlSelectFrom =
+    "SELECT %1 FROM %2";
+static const char *sqlSelectRange =
+    "SELECT %1 FROM %2 WHERE %3 BETWEEN %4 AND %5";
+static const char *sqlPackedRange =
+    "SELECT DayTime, ProjectId, Data FROM %1 WHERE DayTime <= %2 AND LastTime >= %3";
+static const char *sqlUnpackedCreate = // the columns of ActivitySchema
+    "CREATE TEMP TABLE '%1' (%2)";
+static const char *sqlUnpackedInsert = // the columns of ActivityPack, the rest is NULL: the packed rows are uploaded
+    "INSERT INTO temp.'%1' (LocalTime, ProjectId, TextNote, KeyPresses, MouseClicks, MouseDistance, ServerStatus,"
+    " ActiveMask) VALUES (?, ?, ?, ?, ?, ?, ?, ?)";
+
 
 SqliteConsumer::SqliteConsumer(const QString &filepath, QObject *parent)
     : QObject(parent)
@@ -92,9 +126,9 @@ void SqliteConsumer::reopen()
     open_timer->start();
 }
 
-void SqliteConsumer::execQuery(const QString &request)
+void SqliteConsumer::execQuery(const QString &request, qint64 fromTime, qint64 toTime)
 {
-    TRACE_ARG(request);
+    TRACE_ARG(request << fromTime << toTime);
 
     if (conn_name.isEmpty()) {
         TRACE_ARG("Not started");
@@ -110,17 +144,20 @@ void SqliteConsumer::execQuery(const QString &request)
         emit queryError(db.lastError().text());
         return;
     }
+    // The producer writes to the WAL files, they are checked along with the main ones
+    qint64 mtime = lastModified();
+    if (mtime > db_mtime) {
+        db_mtime = mtime;
+        query_cache.clear();
+    }
     QString query = !request.isEmpty() ? request : SqliteProducer::sqlConfigQuery;
-    bool cached = query_cache.contains(query);
-    if (cached) {
-        qint64 mtime = QFileInfo(db.databaseName()).lastModified().toMSecsSinceEpoch();
-        if (mtime > db_mtime) {
-            db_mtime = mtime;
-            query_cache.clear();
-            cached = false;
-        }
+    if (!request.isEmpty() && !attachRange(db, query, fromTime, toTime)) {
+        TRACE_ARG(db.lastError().text());
+        emit queryError(db.lastError().text());
+        return;
     }
-    if (!cached) {
+    const QString key = range_key + '\n' + query;
+    if (!query_cache.contains(key)) {
         QSqlQuery sql(db);
         sql.setForwardOnly(true);
         if (!sql.exec(query)) {
@@ -132,16 +169,212 @@ void SqliteConsumer::execQuery(const QString &request)
             }
             return;
         }
+        // the keys once per query, the values by the column position
+        const QSqlRecord record = sql.record();
+        CborValueArray keys;
+        keys.reserve(record.count());
+        for (int col = 0; col < record.count(); col++) keys.append(QCborValue(record.fieldName(col)));
         CborMapArray rows;
         for (int row = 0; row < maxRowsPerQuery && sql.next(); row++) {
             QCborMap map;
-            for (int col = 0; col < sql.record().count(); col++) {
-                map.insert(sql.record().fieldName(col), QCborValue::fromVariant(sql.value(col)));
+            for (int col = 0; col < keys.size(); col++) {
+                map.insert(keys.at(col), QCborValue::fromVariant(sql.value(col)));
             }
             rows.append(map);
         }
-        query_cache.insert(query, rows);
+        query_cache.insert(key, rows);
         TRACE_ARG("result rows" << rows.size());
     }
-    emit queryResult(query_cache.value(query));
+    emit queryResult(query_cache.value(key));
+}
+
+// The temp views named like the activity tables join the main file with the monthly
+// partitions of the range, so the queries are written as for the single file. When the
+// range has more partitions than may be attached at once, the rows of the range are
+// copied to the temp tables one partition after another instead, only for the tables
+// named in the query. The project days packed in the closed months are decoded into the
+// temp tables for the range, when the query names their table.
+bool SqliteConsumer::attachRange(QSqlDatabase &db, const QString &query, qint64 fromTime, qint64 toTime)
+{
+    const QDate first = fromTime > 0 ? SqliteProducer::partitionMonth(fromTime) : QDate();
+    const QDate last = toTime > 0 ? SqliteProducer::partitionMonth(toTime) : QDate();
+    const auto files = SqliteProducer::partitionFiles(db_filepath);
+    QMap<QDate,QString> months;
+    for (auto it = files.constBegin(); it != files.constEnd(); ++it) {
+        if (first.isValid() && it.key() < first) continue;
+        if (last.isValid() && it.key() > last) break;
+        months.insert(it.key(), it.value());
+    }
+    // the query must still find the tables, the range filter is in the query itself
+    if (months.isEmpty() && !files.isEmpty()) months.insert(files.lastKey(), files.last());
+    const bool copy = months.size() > maxAttached;
+    const bool cold = !months.isEmpty() && months.firstKey() < SqliteProducer::partitionMonth(QDateTime::currentSecsSinceEpoch());
+    QStringList schemas;
+    for (auto it = months.constBegin(); it != months.constEnd(); ++it) {
+        schemas.append(SqliteProducer::partitionSchema(it.key()));
+    }
+    QString key = schemas.join(',');
+    if (copy || cold) key += QString(";%1-%2@%3#%4").arg(fromTime).arg(toTime).arg(db_mtime).arg(qHash(query));
+    if (key == range_key) return true;
+
+    detachAll(db);
+    if (months.isEmpty()) return true; // the main file alone
+
+    const QString from = QString::number(qMax(fromTime, qint64(0)));
+    const QString to = toTime > 0 ? QString::number(toTime) : QString::number(std::numeric_limits<qint64>::max());
+    QMap<QString,QStringList> sources; // table name -> SELECT of every schema
+    auto addSource = [&](const QString &schema, const QString &table) -> bool {
+        if (table == QLatin1String(SqliteProducer::dataBaseConfig) || SqliteProducer::isInternal(table)) return true;
+        if (copy && !SqliteProducer::namesTable(query, table)) return true; // not by its rollups
+        // the rollups are always created with all the columns
+        const bool rollup = SqliteProducer::isRollup(table);
+        QString select = rollup ? QStringLiteral("*") : selectColumns(tableColumns(db, schema, table));
+        QString ref = SqliteProducer::tableRef(schema, table);
+        if (!copy) {
+            sources[table].append(QString(sqlSelectFrom).arg(select, ref));
+            return true;
+        }
+        select = QString(sqlSelectRange).arg(select, ref, rollup ? QStringLiteral("BucketTime")
+                                                               : QStringLiteral("LocalTime"), from, to);
+        QSqlQuery sql(db);
+        if (temp_tables.contains(table)) return sql.exec(QString(sqlTempInsert).arg(table, select));
+        if (!sql.exec(QString(sqlTempTable).arg(table, select))) return false;
+        temp_tables.append(table);
+        return true;
+    };
+    const auto tables = db.tables();
+    for (const auto &table : tables) {
+        if (!addSource(QStringLiteral("main"), table)) return false;
+    }
+    for (auto it = months.constBegin(); it != months.constEnd(); ++it) {
+        const QString schema = SqliteProducer::partitionSchema(it.key());
+        QString path = it.value();
+        QSqlQuery sql(db);
+        if (!sql.exec(QString(sqlAttach).arg(path.replace('\'', QLatin1String("''")), schema))) return false;
+        attached.append(schema);
+
+        QStringList names;
+        if (sql.exec(QString(sqlSchemaTables).arg(schema))) {
+            while (sql.next()) names.append(sql.value(0).toString());
+        }
+        sql.finish();
+        for (const auto &table : names) {
+            if (!addSource(schema, table)) return false;
+            if (!names.contains(SqliteProducer::packedName(table)) || !SqliteProducer::namesTable(query, table)) continue;
+            // the copy has the columns of the view, the temp view gets the unpacked rows once
+            const QString target = copy ? table : SqliteProducer::packedName(table);
+            if (!temp_tables.contains(target)) {
+                if (!sql.exec(QString(sqlUnpackedCreate).arg(target, ActivitySchema::definitions(false, false)))) return false;
+                temp_tables.append(target);
+                sources[table].append(QString(sqlSelectFrom).arg(QStringLiteral("*"),
+                                                                 QString("temp.'%1'").arg(target)));
+            }
+            if (!unpackRange(db, schema, table, target, from.toLongLong(), to.toLongLong())) return false;
+        }
+        if (copy) { // the rows are in the temp tables already
+            sql.exec(QString(sqlDetach).arg(schema));
+            attached.removeAll(schema);
+        }
+    }
+    for (auto it = sources.constBegin(); it != sources.constEnd(); ++it) {
+        QSqlQuery sql(db);
+        if (!sql.exec(QString(sqlTempView).arg(it.key(), it.value().join(QLatin1String(" UNION ALL "))))) return false;
+        temp_views.append(it.key());
+    }
+    range_key = key;
+    TRACE_ARG(range_key << temp_views << temp_tables);
+    return true;
+}
+
+bool SqliteConsumer::unpackRange(QSqlDatabase &db, const QString &schema, const QString &table,
+                                 const QString &target, qint64 fromTime, qint64 toTime)
+{
+    QSqlQuery select(db);
+    select.setForwardOnly(true);
+    const QString packed = SqliteProducer::tableRef(schema, SqliteProducer::packedName(table));
+    if (!select.exec(QString(sqlPackedRange).arg(packed).arg(toTime).arg(fromTime))) return false;
+
+    QSqlQuery insert(db);
+    if (!insert.prepare(QString(sqlUnpackedInsert).arg(target))) return false;
+    bool ta = db.transaction();
+    bool ok = true;
+    QVector<ActivityPack::Row> rows;
+    while (ok && select.next()) {
+        rows.resize(0);
+        if (!ActivityPack::unpack(select.value(0).toLongLong(), select.value(2).toByteArray(), rows)) {
+            TRACE_ARG("Malformed" << packed << select.value(0) << select.value(1));
+            continue;
+        }
+        const QString project = select.value(1).toString();
+        for (const auto &row : rows) {
+            if (row.localTime < fromTime || row.localTime > toTime) continue;
+            insert.addBindValue(row.localTime);
+            insert.addBindValue(project);
+            insert.addBindValue(row.textNote);
+            insert.addBindValue(row.keyPresses);
+            insert.addBindValue(row.mouseClicks);
+            insert.addBindValue(row.mouseDistance);
+            insert.addBindValue(row.serverStatus.isEmpty() ? QVariant() : QVariant(row.serverStatus));
+            insert.addBindValue(row.activeMask);
+            if (!(ok = insert.exec())) break;
+        }
+    }
+    if (ta) {
+        if (ok) ok = db.commit();
+        else db.rollback();
+    }
+    return ok;
+}
+
+void SqliteConsumer::detachAll(QSqlDatabase &db)
+{
+    QSqlQuery sql(db);
+    for (const auto &name : temp_views) {
+        sql.exec(QString(sqlTempDrop).arg(QStringLiteral("VIEW"), name));
+    }
+    for (const auto &name : temp_tables) {
+        sql.exec(QString(sqlTempDrop).arg(QStringLiteral("TABLE"), name));
+    }
+    for (const auto &schema : attached) {
+        if (!sql.exec(QString(sqlDetach).arg(schema))) TRACE_ARG(sql.lastError().text());
+    }
+    temp_views.clear();
+    temp_tables.clear();
+    attached.clear();
+    range_key.clear();
+}
+
+QStringList SqliteConsumer::tableColumns(QSqlDatabase &db, const QString &schema, const QString &table)
+{
+    QStringList columns;
+    QSqlQuery sql(db);
+    if (sql.exec(QString(sqlTableInfo).arg(schema, table))) {
+        while (sql.next()) columns.append(sql.value(1).toString());
+    }
+    return columns;
+}
+
+// The same column list for every partition, the older tables miss the appended columns
+QString SqliteConsumer::selectColumns(const QStringList &columns) const
+{
+    QStringList list;
+    for (int i = 0; i < ActivitySchema::columnCount; i++) {
+        const QLatin1String name(ActivitySchema::columns[i].name);
+        list.append(columns.contains(name) ? QString(name) : QString("NULL AS %1").arg(name));
+    }
+    return list.join(QLatin1String(", "));
+}
+
+qint64 SqliteConsumer::lastModified() const
+{
+    QStringList paths(db_filepath);
+    paths += SqliteProducer::partitionFiles(db_filepath).values();
+    qint64 mtime = 0;
+    for (const auto &path : paths) {
+        for (const auto &name : { path, path + QLatin1String("-wal") }) {
+            QFileInfo info(name);
+            if (info.exists()) mtime = qMax(mtime, info.lastModified().toMSecsSinceEpoch());
+        }
+    }
+    return mtime;
 }
@@ -16,6 +16,7 @@ typedef QList<QCborValue>   CborValueArray;
 #endif
 
 class QTimer;
+class QSqlDatabase;
 
 class SqliteConsumer : public QObject
 {
@@ -24,13 +25,15 @@ class SqliteConsumer : public QObject
 
 public:
     static constexpr int const maxRowsPerQuery = 24 * 60; // minutes per day
+    static constexpr int const maxAttached     = 10; // SQLITE_MAX_ATTACHED default
 
     explicit SqliteConsumer(const QString &filepath, QObject *parent = nullptr);
     virtual ~SqliteConsumer();
 
 public slots:
     void start();
-    void execQuery(const QString &request);
+    // The time range in seconds selects the monthly partitions to attach, 0 is unbound
+    void execQuery(const QString &request, qint64 fromTime = 0, qint64 toTime = 0);
 
 signals:
     void queryError(const QString &text);
@@ -38,12 +41,23 @@ signals:
 
 private:
     void reopen();
+    bool attachRange(QSqlDatabase &db, const QString &query, qint64 fromTime, qint64 toTime);
+    bool unpackRange(QSqlDatabase &db, const QString &schema, const QString &table,
+                     const QString &target, qint64 fromTime, qint64 toTime);
+    void detachAll(QSqlDatabase &db);
+    QStringList tableColumns(QSqlDatabase &db, const QString &schema, const QString &table);
+    QString selectColumns(const QStringList &columns) const;
+    qint64 lastModified() const;
 
     QString conn_name;
     QString db_filepath;
     QTimer *open_timer;
     int open_retry;
     qint64 db_mtime;
+    QString range_key; // the attached months
+    QStringList attached;
+    QStringList temp_views;
+    QStringList temp_tables;
     QHash<QString,CborMapArray> query_cache;
 };
 
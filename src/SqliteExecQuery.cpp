@@ -7,6 +7,8 @@
 #include <QDateTime>
 
 #include "SqliteExecQuery.h"
+#include "ActivitySchema.h"
+#include "ActivityChain.h"
 #include "SqliteProducer.h"
 #include "SystemHelper.h"
 
@@ -75,11 +77,30 @@ int SqliteExecQuery::columnIdIndex(const QString &name)
     return SqliteProducer::columnIndex(name);
 }
 
-int SqliteExecQuery::request(const QString &query)
+// static
+QString SqliteExecQuery::countersSql(const QString &function)
+{
+    return ActivitySchema::countersSql(function);
+}
+
+// static
+// Aggregate it like "TOTAL(<expr>) AS secondsActive", the NULL masks of the older rows are skipped
+QString SqliteExecQuery::activeSecondsSql(const QString &column)
 {
-    TRACE_ARG(query);
+    return SqliteProducer::activeSecondsSql(column);
+}
 
-    auto task = new SqliteExecTask(db_filepath, query.simplified());
+// static
+QString SqliteExecQuery::rollupTable(const QString &table, int bucket)
+{
+    return SqliteProducer::rollupTable(table, bucket);
+}
+
+int SqliteExecQuery::request(const QString &query, qint64 fromTime, qint64 toTime)
+{
+    TRACE_ARG(query << fromTime << toTime);
+
+    auto task = new SqliteExecTask(db_filepath, query.simplified(), fromTime, toTime);
     connect(task, &SqliteConsumer::queryError, this, [this, task](const QString &text) {
         task_hash.remove(task);
         setLastError(text);
@@ -101,6 +122,28 @@ int SqliteExecQuery::request(const QString &query)
     return reqid;
 }
 
+int SqliteExecQuery::verifyChain(const QString &table)
+{
+    TRACE_ARG(table);
+
+    int reqid = QRandomGenerator::global()->generate();
+    if (!reqid) reqid++; // skip over 0
+
+    QByteArray secret_key, public_key;
+    ActivityChain::readKey(SystemHelper::appSshKey(), secret_key, public_key);
+    auto task = new ActivityChainTask(db_filepath, table, public_key);
+    connect(task, &ActivityChainTask::verified, this, [this, reqid](const QVariantMap &result) {
+        const QString error = result.value(QStringLiteral("error")).toString();
+        if (!error.isEmpty()) setLastError(error);
+        emit chainVerified(reqid, result);
+    }, Qt::QueuedConnection);
+
+    auto pool = QThreadPool::globalInstance();
+    pool->setExpiryTimeout(5000);
+    pool->start(task);
+    return reqid;
+}
+
 // static
 qint64 SqliteExecQuery::fromUtcSeconds(qint64 seconds)
 {
@@ -124,38 +167,49 @@ QJsonArray SqliteExecQuery::makeJsonArray(const CborMapArray &rows) const
         if (time_step > 0) obj.insert(QLatin1String("fromAt"), QJsonValue(seconds - time_step));
         obj.insert(QLatin1String("toAt"), QJsonValue(seconds));
 
-        QString uuid = row.value(QLatin1String("ProjectId")).toString();
+        const auto &project = ActivitySchema::columns[SqliteProducer::ProjectId];
+        QString uuid = row.value(QLatin1String(project.name)).toString();
         if (uuid.isEmpty()) continue;
-        obj.insert(QLatin1String("activityId"), uuid);
+        obj.insert(QLatin1String(project.jsonKey), uuid);
 
-        QString note = row.value(QLatin1String("TextNote")).toString();
+        const auto &text = ActivitySchema::columns[SqliteProducer::TextNote];
+        QString note = row.value(QLatin1String(text.name)).toString();
         if (note.isNull()) note = "";
-        obj.insert(QLatin1String("note"), QJsonValue(note));
+        obj.insert(QLatin1String(text.jsonKey), QJsonValue(note));
 
         int minutes = row.value(QLatin1String("minutesActive")).toInteger(0);
         obj.insert(QLatin1String("minutesActive"), QJsonValue(minutes));
 
-        int keys = row.value(QLatin1String("KeyPresses")).toInteger(-1);
-        if (keys == -1) continue;
-        obj.insert(QLatin1String("keyboardKeys"), QJsonValue(keys));
-
-        int clicks = row.value(QLatin1String("MouseClicks")).toInteger(-1);
-        if (clicks == -1) continue;
-        obj.insert(QLatin1String("mouseKeys"), QJsonValue(clicks));
-
-        int distance = row.value(QLatin1String("MouseDistance")).toInteger(-1);
-        if (distance == -1) continue;
-        obj.insert(QLatin1String("mouseDistance"), QJsonValue(distance));
+        if (row.contains(QLatin1String("secondsActive"))) {
+            // TOTAL() yields a real number
+            qint64 seconds_active = qint64(row.value(QLatin1String("secondsActive")).toDouble(0));
+            obj.insert(QLatin1String("secondsActive"), QJsonValue(seconds_active));
+        }
 
-        if (keys || clicks || distance)
+        // every counter is required, the rows without any activity are skipped
+        bool valid = true, active = false;
+        for (const auto &column : ActivitySchema::columns) {
+            if (!(column.flags & ActivitySchema::Counter)) continue;
+            int value = row.value(QLatin1String(column.name)).toInteger(-1);
+            if (value == -1) {
+                valid = false;
+                break;
+            }
+            obj.insert(QLatin1String(column.jsonKey), QJsonValue(value));
+            if (value) active = true;
+        }
+        if (valid && active)
             array.append(obj);
     }
     return array;
 }
 
-SqliteExecTask::SqliteExecTask(const QString &filepath, const QString &query, QObject *parent)
+SqliteExecTask::SqliteExecTask(const QString &filepath, const QString &query, qint64 fromTime, qint64 toTime,
+                               QObject *parent)
     : SqliteConsumer(filepath, parent)
     , curr_query(query)
+    , from_time(fromTime)
+    , to_time(toTime)
 {
     TRACE();
 }
@@ -169,5 +223,5 @@ void SqliteExecTask::run()
 {
     TRACE();
     SqliteConsumer::start();
-    SqliteConsumer::execQuery(curr_query);
+    SqliteConsumer::execQuery(curr_query, from_time, to_time);
 }
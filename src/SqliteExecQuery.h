@@ -4,6 +4,7 @@
 #include <QObject>
 #include <QHash>
 #include <QRunnable>
+#include <QVariantMap>
 
 #include "SqliteConsumer.h"
 
@@ -30,14 +31,22 @@ public:
 
     Q_INVOKABLE static QString columnIdName(int column);
     Q_INVOKABLE static int columnIdIndex(const QString &name);
+    Q_INVOKABLE static QString countersSql(const QString &function = QStringLiteral("TOTAL"));
+    Q_INVOKABLE static QString activeSecondsSql(const QString &column = QStringLiteral("ActiveMask"));
+    Q_INVOKABLE static QString rollupTable(const QString &table, int bucket); // bucket in seconds
 
-    Q_INVOKABLE int request(const QString &query); // return reqid
+    // the time range in seconds selects the partitions to read, 0 is unbound
+    Q_INVOKABLE int request(const QString &query, qint64 fromTime = 0, qint64 toTime = 0); // return reqid
     Q_INVOKABLE static qint64 fromUtcSeconds(qint64 seconds);
 
+    // the hash chain of the table over all the partitions, the broken rows by LocalTime
+    Q_INVOKABLE int verifyChain(const QString &table); // return reqid
+
 signals:
     void timeStepChanged();
     void lastErrorChanged(const QString &text);
     void response(int reqid, const QJsonArray &array);
+    void chainVerified(int reqid, const QVariantMap &result);
 
 private:
     void setLastError(const QString &text);
@@ -53,11 +62,14 @@ private:
 class SqliteExecTask : public SqliteConsumer, public QRunnable
 {
 public:
-    explicit SqliteExecTask(const QString &filepath, const QString &query, QObject *parent = nullptr);
+    SqliteExecTask(const QString &filepath, const QString &query, qint64 fromTime, qint64 toTime,
+                   QObject *parent = nullptr);
     ~SqliteExecTask() override;
 private:
     void run() override;
     const QString curr_query;
+    const qint64 from_time;
+    const qint64 to_time;
 };
 
 #endif // SQLITEEXECQUERY_H
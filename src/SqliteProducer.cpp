@@ -3,11 +3,17 @@
 #include <QSqlRecord>
 #include <QSqlError>
 #include <QFileInfo>
+#include <QDir>
 #include <QDateTime>
 #include <QFile>
 #include <QTimer>
+#include <QMutex>
 #include <QUuid>
+#include <QSet>
+#include <QDataStream>
 #include <QtDebug>
+#include <algorithm>
+#include <limits>
 
 #ifdef Q_OS_LINUX
 #include <sys/prctl.h>
@@ -15,6 +21,8 @@
 
 #include "SqliteProducer.h"
 #include "ActivityRecord.h"
+#include "ActivityPack.h"
+#include "ActivityChain.h"
 
 //#define TRACE_SQLITEPRODUCER
 #ifdef TRACE_SQLITEPRODUCER
@@ -28,35 +36,242 @@
 
 static const char *sqlConfigCreate =
     "CREATE TABLE '%1' (Created TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
-    " HistoryOn TINYINT, TimeStep TINYINT, KeepDays SMALLINT, ReduceAt TEXT, PRIMARY KEY (Created))";
+    " HistoryOn TINYINT, TimeStep TINYINT, KeepDays SMALLINT, ReduceAt TEXT, Synchronous TINYINT,"
+    " KeepTenMinutes SMALLINT, KeepHourly SMALLINT, KeepDaily SMALLINT, PRIMARY KEY (Created))";
 static const char *sqlConfigViewCreate =
-    "CREATE VIEW Config AS SELECT tab.Created, tab.HistoryOn, tab.TimeStep, tab.KeepDays, tab.ReduceAt"
+    "CREATE VIEW Config AS SELECT tab.Created, tab.HistoryOn, tab.TimeStep, tab.KeepDays, tab.ReduceAt,"
+    " IFNULL(tab.Synchronous, %2) AS Synchronous, IFNULL(tab.KeepTenMinutes, %3) AS KeepTenMinutes,"
+    " IFNULL(tab.KeepHourly, %4) AS KeepHourly, IFNULL(tab.KeepDaily, %5) AS KeepDaily"
     " FROM '%1' AS tab WHERE tab.Created =(SELECT MAX(Created) FROM '%1')";
+static const char *sqlConfigViewDrop =
+    "DROP VIEW IF EXISTS Config";
+static const char *sqlConfigAddColumn =
+    "ALTER TABLE '%1' ADD COLUMN %2";
 static const char *sqlConfigInsert =
-    "INSERT INTO '%1' (HistoryOn, TimeStep, KeepDays, ReduceAt) VALUES (%2, %3, %4, '%5')";
-
-static const char *sqlTableCreate =
-    "CREATE TABLE '%1' (LocalTime INTEGER PRIMARY KEY NOT NULL,"
-    " ProjectId TEXT NOT NULL, TextNote TEXT, KeyPresses INTEGER, MouseClicks INTEGER, MouseDistance INTEGER, ServerStatus TEXT"
-    ") WITHOUT ROWID";
-static const char *sqlTableInsert =
-    "INSERT INTO '%1' (LocalTime, ProjectId, TextNote, KeyPresses, MouseClicks, MouseDistance)"
-    " VALUES (:LocalTime, :ProjectId, :TextNote, :KeyPresses, :MouseClicks, :MouseDistance)";
-static const char *sqlTableStatusUpdate =
-        "UPDATE '%1' SET ServerStatus='%2' WHERE LocalTime=%3";
-static const char *sqlTableStatusBatch =
-        "UPDATE '%1' SET ServerStatus=(CASE %2 END) WHERE LocalTime IN (%3)";
-static const char *sqlTableStatusWhen =
-        " WHEN LocalTime=%1 THEN '%2'";
-static const char *sqlTableReduce =
-    "DELETE FROM '%1' WHERE LocalTime < %2";
+    "INSERT INTO '%1' (HistoryOn, TimeStep, KeepDays, ReduceAt, Synchronous, KeepTenMinutes, KeepHourly, KeepDaily)"
+    " VALUES (%2, %3, %4, '%5', %6, %7, %8, %9)";
+
+static const char *sqlJournalWal =
+    "PRAGMA journal_mode=WAL";
+static const char *sqlSynchronous =
+    "PRAGMA synchronous=%1";
+static const char *sqlAutoCheckpoint =
+    "PRAGMA wal_autocheckpoint=0"; // the checkpoints are scheduled by the producer
+static const char *sqlCheckpoint =
+    "PRAGMA wal_checkpoint(%1)";
+static const char *sqlAutoVacuum =
+    "PRAGMA %1.auto_vacuum"; // 0=NONE, 1=FULL, 2=INCREMENTAL
+static const char *sqlAutoVacuumIncremental =
+    "PRAGMA %1.auto_vacuum=INCREMENTAL";
+static const char *sqlIncrementalVacuum =
+    "PRAGMA %1.incremental_vacuum(%2)";
+static const char *sqlFreelistCount =
+    "PRAGMA %1.freelist_count";
+
+static const char *sqlAttach =
+    "ATTACH DATABASE '%1' AS %2";
+static const char *sqlDetach =
+    "DETACH DATABASE %1";
+static const char *sqlSchemaWal =
+    "PRAGMA %1.journal_mode=WAL";
+static const char *sqlSchemaSynchronous =
+    "PRAGMA %1.synchronous=%2";
+static const char *sqlUserVersion =
+    "PRAGMA %1.user_version";
+static const char *sqlUserVersionSet =
+    "PRAGMA %1.user_version=%2";
+static const char *sqlTableInfo =
+    "PRAGMA %1.table_info('%2')";
+
+static const char *sqlTableCreate = // the column definitions of ActivitySchema
+    "CREATE TABLE %1 (%2) WITHOUT ROWID";
+static const char *sqlTableAddColumn =
+    "ALTER TABLE %1 ADD COLUMN %2";
+static const char *sqlSyncIndexCreate = // the pending and the sending rows alone, a few entries
+    "CREATE INDEX IF NOT EXISTS %1.'%2' ON '%3' (LocalTime) WHERE SyncState IS NOT NULL";
+static const char *sqlSyncIndexDrop =
+    "DROP INDEX IF EXISTS %1.'%2'";
+static const char *sqlSyncUpdate =
+    "UPDATE %1 SET SyncState=%2 WHERE SyncState %3 AND LocalTime >= %4 AND LocalTime < %5";
+static const char *sqlTableInsert = // the values bound by the position, the conflicts merged as ActivitySchema says
+    "INSERT INTO %1 (%2) VALUES (%3) ON CONFLICT(LocalTime) DO UPDATE SET %4 WHERE %5";
+static const char *sqlMergeKeySelect = // the project of the row a record would be merged into
+    "SELECT ProjectId FROM %1 WHERE LocalTime=%2";
+static const char *sqlDictionaryCreate =
+    "CREATE TABLE IF NOT EXISTS %1 (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)";
+static const char *sqlDictionarySelect =
+    "SELECT Id FROM %1 WHERE Value=:Value";
+static const char *sqlDictionaryInsert =
+    "INSERT INTO %1 (Value) VALUES (:Value)";
+static const char *sqlRowsCreate =
+    "CREATE TABLE %1 (%2, RowHash BLOB) WITHOUT ROWID";
+static const char *sqlRowsViewCreate = // the columns and the name of the plain activity table
+    "CREATE VIEW IF NOT EXISTS %1.'%2' AS SELECT %4 FROM '%3' AS r %5";
+static const char *sqlRowsInsert = // the merged row is chained again with its day
+    "INSERT INTO %1 (%2, RowHash) VALUES (%3, ?) ON CONFLICT(LocalTime) DO UPDATE SET %4, RowHash=NULL WHERE %5";
+static const char *sqlRowsProject =
+    "(SELECT Value FROM '%1' WHERE Id=%2.ProjectRef)";
+static const char *sqlPlainUnion = // appended to the view while the plain rows are migrated
+    " UNION ALL SELECT %2 FROM '%1'";
+static const char *sqlTableRename =
+    "ALTER TABLE %1 RENAME TO '%2'";
+static const char *sqlDropTrigger =
+    "DROP TRIGGER IF EXISTS %1";
+static const char *sqlMigrateChunk =
+    "SELECT * FROM %1 ORDER BY LocalTime LIMIT %2";
+static const char *sqlMigrateIntern =
+    "INSERT OR IGNORE INTO %1 (Value) SELECT DISTINCT %2 FROM (%3) WHERE %2 %4";
+static const char *sqlMigrateInsert = // the dictionary columns of a row already moved are kept
+    "INSERT INTO %1 (%2) SELECT %3 FROM (%4) AS c WHERE 1 ON CONFLICT(LocalTime) DO UPDATE SET %5, RowHash=NULL";
+static const char *sqlMigrateDelete =
+    "DELETE FROM %1 WHERE LocalTime IN (SELECT LocalTime FROM (%2))";
+static const char *sqlPackedCreate =
+    "CREATE TABLE IF NOT EXISTS %1 (DayTime INTEGER NOT NULL, ProjectId TEXT NOT NULL, RowCount INTEGER,"
+    " LastTime INTEGER, Data BLOB, ChainHash BLOB, UNIQUE (DayTime, ProjectId))";
+static const char *sqlPackedSelect =
+    "SELECT Data FROM %1 WHERE DayTime=:DayTime AND ProjectId=:ProjectId";
+static const char *sqlPackedInsert =
+    "INSERT INTO %1 (DayTime, ProjectId, RowCount, LastTime, Data, ChainHash)"
+    " VALUES (:DayTime, :ProjectId, :RowCount, :LastTime, :Data, :ChainHash)"
+    " ON CONFLICT(DayTime, ProjectId) DO UPDATE SET RowCount=excluded.RowCount, LastTime=excluded.LastTime,"
+    " Data=excluded.Data, ChainHash=excluded.ChainHash";
+static const char *sqlPackFirst =
+    "SELECT MIN(LocalTime) FROM %1 WHERE LocalTime >= %2";
+static const char *sqlPackRows = // the DataBaseColumn order, the RowHash after
+    "SELECT %2, r.RowHash FROM %1 AS r %3 WHERE r.LocalTime >= %4 AND r.LocalTime < %5 ORDER BY ProjectId, r.LocalTime";
+// the packed row is the one of the rows table less the ProjectId of the day and the SyncState,
+// only the synced rows are packed
+static_assert(ActivityPack::rowColumns == ActivitySchema::columnCount - 2 &&
+              ActivityPack::rowCounters == ActivitySchema::count(ActivitySchema::Counter), "ActivityPack::Row mismatch");
+static const char *sqlPackDelete =
+    "DELETE FROM %1 WHERE LocalTime >= %2 AND LocalTime < %3 AND ProjectRef=(SELECT Id FROM %4 WHERE Value=:ProjectId)";
+static const char *sqlTableAddHash =
+    "ALTER TABLE %1 ADD COLUMN %2 BLOB";
+static const char *sqlChainLast =
+    "SELECT MAX(LocalTime) FROM %1";
+static const char *sqlChainHead =
+    "SELECT RowHash FROM %1 WHERE LocalTime >= %2 AND LocalTime < %3 AND ProjectRef=%4 AND RowHash IS NOT NULL"
+    " ORDER BY LocalTime DESC LIMIT 1";
+static const char *sqlChainDay = // the DataBaseColumn order, the RowHash and the ProjectRef after
+    "SELECT %2, r.RowHash, r.ProjectRef FROM %1 AS r %3 WHERE r.LocalTime >= %4 AND r.LocalTime < %5"
+    " ORDER BY r.ProjectRef, r.LocalTime";
+static const char *sqlChainUpdate =
+    "UPDATE %1 SET RowHash=:RowHash WHERE LocalTime=:LocalTime";
+static const char *sqlHeadsRows = // the last RowHash of a project day comes last
+    "SELECT p.Value, r.LocalTime, r.RowHash FROM %1 AS r JOIN %2 AS p ON p.Id=r.ProjectRef"
+    " WHERE r.LocalTime >= %3 AND r.LocalTime < %4 AND r.RowHash IS NOT NULL ORDER BY r.LocalTime";
+static const char *sqlHeadsPacked =
+    "SELECT DayTime, ProjectId, ChainHash FROM %1 WHERE DayTime >= %2 AND DayTime < %3 AND ChainHash IS NOT NULL";
+static const char *sqlSignedCreate =
+    "CREATE TABLE IF NOT EXISTS %1 (DayTime INTEGER PRIMARY KEY NOT NULL, Signature BLOB NOT NULL)";
+static const char *sqlSignedLast =
+    "SELECT MAX(DayTime) FROM %1";
+static const char *sqlSignedSelect =
+    "SELECT Signature FROM %1 WHERE DayTime=%2";
+static const char *sqlSignedUpsert =
+    "INSERT OR REPLACE INTO %1 (DayTime, Signature) VALUES (:DayTime, :Signature)";
+static const char *sqlStatusCreate = // the statuses of one setServerStatus() bound once
+    "CREATE TEMP TABLE IF NOT EXISTS '%1' (StatusTime INTEGER PRIMARY KEY, Status TEXT)";
+static const char *sqlStatusClear =
+    "DELETE FROM temp.'%1'";
+static const char *sqlStatusInsert =
+    "INSERT OR REPLACE INTO temp.'%1' (StatusTime, Status) VALUES (?, ?)";
+static const char *sqlStatusApply =
+    "UPDATE %1 SET ServerStatus=(SELECT Status FROM temp.'%2' WHERE StatusTime=LocalTime)"
+    " WHERE LocalTime IN (SELECT StatusTime FROM temp.'%2' WHERE StatusTime >= %3 AND StatusTime < %4)";
+
+// the rollups sum up the Counter columns of ActivitySchema, the lists are the last args
+static const char *sqlRollupCreate =
+    "CREATE TABLE %1 (BucketTime INTEGER NOT NULL, ProjectId TEXT NOT NULL, RowCount INTEGER, %2,"
+    " ActiveSeconds INTEGER, PRIMARY KEY (BucketTime, ProjectId)) WITHOUT ROWID";
+static const char *sqlRollupFill =
+    "INSERT INTO %1 SELECT %3 AS Bucket, ProjectId, COUNT(*), %6, SUM(IFNULL(%4,0)) FROM %2 WHERE %5"
+    " GROUP BY Bucket, ProjectId";
+static const char *sqlRollupClear =
+    "DELETE FROM %1 WHERE %2";
+// the rollup being backfilled keeps the next bucket to fill in the RowCount of the row at -1
+static const char *sqlBackfillInsert =
+    "INSERT INTO %1 (BucketTime, ProjectId, RowCount) VALUES (-1, '', 0)";
+static const char *sqlBackfillCursor =
+    "SELECT RowCount FROM %1 WHERE BucketTime=-1";
+static const char *sqlBackfillUpdate =
+    "UPDATE %1 SET RowCount=%2 WHERE BucketTime=-1";
+static const char *sqlBackfillDelete =
+    "DELETE FROM %1 WHERE BucketTime=-1";
+static const char *sqlBackfillEnd =
+    "SELECT %4, %5 FROM %1 WHERE LocalTime >= %2 ORDER BY LocalTime LIMIT 1 OFFSET %3";
+static const char *sqlRollupUpsert =
+    "INSERT INTO '%1' (BucketTime, ProjectId, RowCount, %5, ActiveSeconds) VALUES (%2, %4, 1, %6, IFNULL(%3,0))"
+    " ON CONFLICT(BucketTime, ProjectId) DO UPDATE SET RowCount=RowCount+1, %7,"
+    " ActiveSeconds=ActiveSeconds+excluded.ActiveSeconds;";
+static const char *sqlRollupRemove =
+    "UPDATE '%1' SET RowCount=RowCount-1, %5, ActiveSeconds=ActiveSeconds-IFNULL(%3,0)"
+    " WHERE BucketTime=%2 AND ProjectId=%4; DELETE FROM '%1' WHERE BucketTime=%2 AND ProjectId=%4 AND RowCount<=0;";
+static const char *sqlRollupInsertTrigger =
+    "CREATE TRIGGER IF NOT EXISTS %1.'%2' AFTER INSERT ON '%3' BEGIN %4 END";
+static const char *sqlRollupDeleteTrigger =
+    "CREATE TRIGGER IF NOT EXISTS %1.'%2' AFTER DELETE ON '%3' BEGIN %4 END";
+static const char *sqlRollupUpdateTrigger =
+    "CREATE TRIGGER IF NOT EXISTS %1.'%2' AFTER UPDATE OF %5, %6, ActiveMask ON '%3' BEGIN %4 END";
+static const char *sqlRetainDelete = // %5 keeps the rows not uploaded yet
+    "DELETE FROM %1 WHERE %2 IN (SELECT DISTINCT %2 FROM %1 WHERE %2 < %3%5 ORDER BY %2 LIMIT %4)";
+static const char *sqlRetainUnsynced = // any row not uploaded yet, through the partial index
+    "SELECT 1 FROM %1 WHERE SyncState IS NOT NULL LIMIT 1";
+static const char *sqlSchemaTables =
+    "SELECT name FROM %1.sqlite_master WHERE type IN ('table','view')";
+static const char *sqlDropTable =
+    "DROP TABLE IF EXISTS %1";
+static const char *sqlDropView =
+    "DROP VIEW IF EXISTS %1";
+
+static const int rollupSteps[] = {
+    SqliteProducer::RollupMinutes, SqliteProducer::RollupHour, SqliteProducer::RollupDay
+};
+static const int retainSteps[] = { // 0 for the activity rows
+    0, SqliteProducer::RollupMinutes, SqliteProducer::RollupHour, SqliteProducer::RollupDay
+};
+
+// the rollups of the main file being backfilled, read and written from the different threads
+static QMutex backfill_mutex;
+static QStringList backfill_rollups;
+
+static qint64 dayTime(const QDateTime &localTime)
+{
+    return localTime.date().startOfDay().toSecsSinceEpoch();
+}
+
+static qint64 nextDayTime(qint64 day)
+{
+    return QDateTime::fromSecsSinceEpoch(day).date().addDays(1).startOfDay().toSecsSinceEpoch();
+}
 
 
 SqliteProducer::SqliteProducer(const QString &filepath, QObject *parent)
     : QObject(parent)
     , db_filepath(filepath)
     , keep_days(KeepDays)
+    , keep_ten_minutes(KeepTenMinutes)
+    , keep_hourly(KeepHourly)
+    , keep_daily(KeepDaily)
     , reduce_timer(nullptr)
+    , commit_window(CommitWindow)
+    , commit_count(CommitCount)
+    , commit_timer(nullptr)
+    , spill_journaled(0)
+    , replay_timer(nullptr)
+    , replay_delay(0)
+    , synchronous(Synchronous)
+    , checkpoint_timer(nullptr)
+    , full_vacuum(false)
+    , full_vacuum_timer(nullptr)
+    , vacuum_timer(nullptr)
+    , vacuum_pages(0)
+    , retain_timer(nullptr)
+    , retain_rows(0)
+    , retain_drops(0)
+    , retain_packed(0)
+    , migrate_timer(nullptr)
+    , migrate_rows(0)
 {
     TRACE();
 }
@@ -64,6 +279,13 @@ SqliteProducer::SqliteProducer(const QString &filepath, QObject *parent)
 SqliteProducer::~SqliteProducer()
 {
     TRACE();
+
+    // the worker is deleted in its own thread, the records still parked go to the journal
+    if (replay_timer) replay_timer->stop();
+    if (!spill_rows.isEmpty() || spill_journaled) replaySpill();
+    else commitRows();
+    if (!spill_rows.isEmpty() && writeJournal(spill_rows, 0)) spill_rows.clear();
+    insert_queries.clear();
 }
 
 void SqliteProducer::start()
@@ -78,7 +300,7 @@ void SqliteProducer::start()
 
     QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), conn_name);
     db.setDatabaseName(db_filepath);
-    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=2000");
+    db.setConnectOptions(QString("QSQLITE_BUSY_TIMEOUT=%1").arg(BusyTimeout));
 
     TRACE_ARG(db.connectionName() << db.databaseName());
 
@@ -88,20 +310,93 @@ void SqliteProducer::start()
         return;
     }
     db_config.clear();
+    if (!chain_key.isEmpty() && !ActivityChain::readKey(chain_key, sign_secret, sign_public)) {
+        qWarning() << "The chain heads are not signed, no key in" << chain_key;
+    }
 
     QSqlQuery sql(db);
     QStringList tables = db.tables();
     if (tables.isEmpty()) sql.exec("PRAGMA encoding = 'UTF-8'");
+    if (sql.exec(QString(sqlAutoVacuum).arg(QStringLiteral("main"))) && sql.next() && sql.value(0).toInt() != 2) {
+        // Takes effect right away on a new file, the existing one needs a full VACUUM once
+        sql.finish();
+        sql.exec(QString(sqlAutoVacuumIncremental).arg(QStringLiteral("main")));
+        full_vacuum = !tables.isEmpty();
+    }
+    sql.finish();
+    if (full_vacuum) scheduleCheckpoint();
+    if (sql.exec(sqlJournalWal) && sql.next()) {
+        TRACE_ARG("journal_mode" << sql.value(0).toString());
+    }
+    sql.finish();
     if (!tables.contains(dataBaseConfig)) {
         sql.exec(QString(sqlConfigCreate).arg(dataBaseConfig));
-        sql.exec(QString(sqlConfigViewCreate).arg(dataBaseConfig));
+        sql.exec(QString(sqlConfigViewCreate).arg(dataBaseConfig)
+                     .arg(Synchronous).arg(KeepTenMinutes).arg(KeepHourly).arg(KeepDaily));
         sql.exec(QString(sqlConfigInsert).arg(dataBaseConfig)
-                     .arg(HistoryOn).arg(TimeStep).arg(KeepDays).arg(dataBaseReduce));
+                     .arg(HistoryOn).arg(TimeStep).arg(KeepDays).arg(dataBaseReduce).arg(Synchronous)
+                     .arg(KeepTenMinutes).arg(KeepHourly).arg(KeepDaily));
         db_config.insert(QStringLiteral("HistoryOn"), HistoryOn);
         db_config.insert(QStringLiteral("TimeStep"), TimeStep);
         db_config.insert(QStringLiteral("KeepDays"), KeepDays);
         db_config.insert(QStringLiteral("ReduceAt"), dataBaseReduce);
+        db_config.insert(QStringLiteral("Synchronous"), Synchronous);
+        db_config.insert(QStringLiteral("KeepTenMinutes"), KeepTenMinutes);
+        db_config.insert(QStringLiteral("KeepHourly"), KeepHourly);
+        db_config.insert(QStringLiteral("KeepDaily"), KeepDaily);
+    } else if (userVersion(db, QStringLiteral("main")) < MainVersion) {
+        // the columns added by the later versions, NULL in the older rows reads as default
+        static const char *added[] = {
+            "Synchronous TINYINT", "KeepTenMinutes SMALLINT", "KeepHourly SMALLINT", "KeepDaily SMALLINT"
+        };
+        QSqlRecord record = db.record(dataBaseConfig);
+        bool altered = false;
+        for (const char *column : added) {
+            if (record.contains(QString(column).section(' ', 0, 0))) continue;
+            sql.exec(QString(sqlConfigAddColumn).arg(QLatin1String(dataBaseConfig), QLatin1String(column)));
+            altered = true;
+        }
+        if (altered) {
+            sql.exec(sqlConfigViewDrop);
+            sql.exec(QString(sqlConfigViewCreate).arg(dataBaseConfig)
+                         .arg(Synchronous).arg(KeepTenMinutes).arg(KeepHourly).arg(KeepDaily));
+        }
+    }
+    // the main file migrations are small and run right away, the partitions are migrated in slices
+    sql.exec(QString(sqlUserVersionSet).arg(QStringLiteral("main")).arg(MainVersion));
+    legacy_tables.clear();
+    for (const auto &table : tables) {
+        if (table == dataBaseConfig || isRollup(table) || isInternal(table)) continue;
+        legacy_tables.append(table);
+        // the legacy rows stay readable through the rollups as well
+        bool ta = db.transaction();
+        bool ok = prepareTable(db, QStringLiteral("main"), table, true);
+        if (ta) {
+            if (ok) ok = db.commit();
+            else db.rollback();
+        }
+        if (!ok) TRACE_ARG(table << db.lastError().text());
     }
+    // the rollups created above, or by a run that quit before the end, are summed up in the
+    // retention slices and the queries read the rows until then
+    QStringList backfills;
+    retain_tasks.clear();
+    for (const auto &table : legacy_tables) {
+        for (int step : rollupSteps) {
+            const QString rollup = rollupName(table, step);
+            if (sql.exec(QString(sqlBackfillCursor).arg(tableRef(QStringLiteral("main"), rollup))) && sql.next()) {
+                retain_tasks.append({ RetainBackfill, QDate(), step, sql.value(0).toLongLong(), table });
+                backfills.append(rollup);
+            }
+            sql.finish();
+        }
+    }
+    {
+        QMutexLocker locker(&backfill_mutex);
+        backfill_rollups = backfills;
+    }
+    ready_tables.clear();
+    encoded_tables.clear();
     if (db_config.isEmpty()) {
         sql.exec(sqlConfigQuery);
         if (sql.last()) {
@@ -118,6 +413,33 @@ void SqliteProducer::start()
     if (mdate != QDate::currentDate())
         reduceTimer()->start(1500);
 
+    if (!retain_tasks.isEmpty()) {
+        retain_rows = retain_drops = retain_packed = 0;
+        retain_clock.start();
+        retainTimer()->start(RetainPause);
+    }
+
+    migrate_months = partitionFiles(db_filepath).keys();
+    migrate_rows = 0;
+    migrate_clock.start();
+    if (!migrate_months.isEmpty()) {
+        if (!migrate_timer) {
+            migrate_timer = new QTimer(this);
+            migrate_timer->setSingleShot(true);
+            connect(migrate_timer, &QTimer::timeout, this, &SqliteProducer::migrateSlice);
+        }
+        migrate_timer->start(MigrateDelay);
+    }
+
+    // the records the previous run could not commit
+    QVector<ActivityRecord> journal;
+    spill_journaled = readJournal(journal);
+    if (spill_journaled) {
+        spill_clock.start();
+        scheduleReplay();
+        emit spillChanged(spill_rows.size(), spill_journaled);
+    }
+
     emit configChanged(db_config);
 }
 
@@ -130,7 +452,7 @@ void SqliteProducer::configure(const QVariantMap &map)
         return;
     }
     QSqlDatabase db = QSqlDatabase::database(conn_name);
-    if (!db.isValid() || db.lastError().isValid()) {
+    if (!db.isValid()) {
         TRACE_ARG("Not ready");
         return;
     }
@@ -140,6 +462,10 @@ void SqliteProducer::configure(const QVariantMap &map)
         next.insert(QStringLiteral("TimeStep"), TimeStep);
         next.insert(QStringLiteral("KeepDays"), KeepDays);
         next.insert(QStringLiteral("ReduceAt"), dataBaseReduce);
+        next.insert(QStringLiteral("Synchronous"), Synchronous);
+        next.insert(QStringLiteral("KeepTenMinutes"), KeepTenMinutes);
+        next.insert(QStringLiteral("KeepHourly"), KeepHourly);
+        next.insert(QStringLiteral("KeepDaily"), KeepDaily);
     }
     for (auto it = db_config.constBegin(); it != db_config.constEnd(); ++it) {
         if (!next.contains(it.key())) next.insert(it.key(), it.value());
@@ -147,7 +473,7 @@ void SqliteProducer::configure(const QVariantMap &map)
     if (next == db_config) return;
 
     bool ok = false;
-    if (db.isOpen() || db.open()) {
+    if (openDb(db)) {
         QString insert = QString("INSERT INTO '%1'(").arg(dataBaseConfig);
         QString values = ") VALUES (";
         int i = 0;
@@ -190,50 +516,577 @@ void SqliteProducer::insertRow(const ActivityRecord &record)
         TRACE_ARG("ActivityRecord is invalid");
         return;
     }
+    pending_rows.append(record);
+    scheduleCommit();
+}
+
+void SqliteProducer::insertRows(const QVector<ActivityRecord> &records)
+{
+    TRACE_ARG(records.size());
+
+    for (const auto &record : records) {
+        if (record.isValid()) pending_rows.append(record);
+    }
+    scheduleCommit();
+}
+
+void SqliteProducer::setCommitWindow(int msecs, int count)
+{
+    TRACE_ARG(msecs << count);
+
+    commit_window = qMax(msecs, 0);
+    commit_count = qMax(count, 1);
+    if (commit_timer && commit_timer->isActive()) commit_timer->start(commit_window);
+    scheduleCommit();
+}
+
+void SqliteProducer::scheduleCommit()
+{
+    if (pending_rows.isEmpty()) return;
+    if (pending_rows.size() >= commit_count) {
+        commitRows();
+        return;
+    }
+    if (!commit_timer) {
+        commit_timer = new QTimer(this);
+        commit_timer->setSingleShot(true);
+        connect(commit_timer, &QTimer::timeout, this, &SqliteProducer::commitRows);
+    }
+    if (!commit_timer->isActive()) commit_timer->start(commit_window);
+}
+
+// Write all the pending records in one transaction, a LocalTime collision (e.g. after
+// a restart within the same second) merges the counters into the existing row of the same
+// project, see mergeTarget(); a record without a free second is reported and not counted
+// as written. The records of a month failed by a busy lock or an I/O error are parked and
+// replayed later.
+void SqliteProducer::commitRows()
+{
+    if (commit_timer) commit_timer->stop();
+    if (pending_rows.isEmpty()) return;
+
     if (conn_name.isEmpty()) {
         TRACE_ARG("Not started");
         return;
     }
+    if (replay_timer && replay_timer->isActive()) { // still busy, keep the order of the records
+        spillRows(pending_rows);
+        pending_rows.clear();
+        return;
+    }
     QSqlDatabase db = QSqlDatabase::database(conn_name);
-    if (!db.isValid() || db.lastError().isValid()) {
+    if (!db.isValid()) {
         TRACE_ARG("Not ready");
         return;
     }
-    if (!db.isOpen() && !db.open()) {
+    if (!openDb(db)) {
         TRACE_ARG(db.lastError().text());
-        emit errorOccurred(db.lastError().text());
+        if (isTransient(db.lastError())) {
+            spillRows(pending_rows);
+            pending_rows.clear();
+        } else emit errorOccurred(db.lastError().text());
         return;
     }
-    QString table = record.tableName();
-    if (!db.tables().contains(table)) {
-        QSqlQuery sql(db);
-        if (!sql.exec(QString(sqlTableCreate).arg(table))) {
-            TRACE_ARG(db.lastError().text());
-            emit errorOccurred(db.lastError().text());
+    const QVector<ActivityRecord> rows = pending_rows;
+    pending_rows.clear();
+
+    // ATTACH is not allowed inside a transaction, so every month is committed apart
+    QMap<QDate,QVector<ActivityRecord>> months;
+    for (const auto &record : rows) {
+        months[partitionMonth(record.localTime().toSecsSinceEpoch())].append(record);
+    }
+    bool ok = true;
+    QSqlError error;
+    QMap<QString,QPair<qint64,qint64>> changed; // the committed tables and ranges
+    int dropped = 0; // the records of the committed months without a free second
+    const qint64 today = QDate::currentDate().startOfDay().toSecsSinceEpoch();
+    auto it = months.constBegin();
+    for (; it != months.constEnd(); ++it) {
+        if (!attachPartition(db, it.key())) {
+            ok = false;
+            break;
+        }
+        const QString schema = partitionSchema(it.key());
+        QMap<QPair<QString,qint64>,qint64> rechain; // the tables and the days -> the first row without a hash
+        QVector<ActivityRecord> committed; // as moved by mergeTarget()
+        QMap<QPair<QString,qint64>,DaySignature> closed; // the tables and the closed days -> signed before
+        QStringList chained; // the encoded tables
+        int unmerged = 0;
+        bool ta = db.transaction();
+        for (const auto &pending : it.value()) {
+            QSqlQuery *sql = insertQuery(db, schema, pending.tableName());
+            if (!sql) {
+                ok = false;
+                break;
+            }
+            const ActivityRecord record = mergeTarget(db, schema, pending, ok);
+            if (!ok) break;
+            if (!record.isValid()) { // the other projects took every second to move it to
+                unmerged++;
+                continue;
+            }
+            committed.append(record);
+            // by the position in the column order, the rows table gets the ids of the dictionaries
+            const bool encoded = encoded_tables.contains(tableRef(schema, record.tableName()));
+            if (encoded && !sign_secret.isEmpty()) {
+                const auto day = qMakePair(record.tableName(), dayTime(record.localTime()));
+                if (day.second < today && !closed.contains(day)) { // before its first row goes in
+                    DaySignature state;
+                    if (!daySignature(db, schema, day.first, day.second, state)) {
+                        ok = false;
+                        break;
+                    }
+                    closed.insert(day, state);
+                }
+                if (!chained.contains(day.first)) chained.append(day.first);
+            }
+            qint64 project = -1;
+            int pos = 0;
+            for (int i = 0; ok && i < ActivitySchema::columnCount; i++) {
+                const ActivitySchema::Column &column = ActivitySchema::columns[i];
+                if (!column.value) continue;
+                QVariant value = column.value(record);
+                if (encoded && (column.flags & ActivitySchema::Dictionary)) {
+                    const QString text = value.toString();
+                    qint64 id = (text.isEmpty() && !(column.flags & ActivitySchema::NotNull)) ? 0
+                              : internId(db, schema, column.dictionary, text);
+                    if (id < 0) ok = false;
+                    if (i == ProjectId) project = id;
+                    value = id > 0 ? QVariant(id) : QVariant();
+                }
+                sql->bindValue(pos++, value);
+            }
+            if (!ok) break;
+            if (encoded) {
+                QByteArray hash;
+                if (!chainRow(db, schema, record, project, hash)) {
+                    ok = false;
+                    break;
+                }
+                if (hash.isEmpty()) {
+                    const qint64 time = record.localTime().toSecsSinceEpoch();
+                    auto day = rechain.find(qMakePair(record.tableName(), dayTime(record.localTime())));
+                    if (day == rechain.end()) {
+                        rechain.insert(qMakePair(record.tableName(), dayTime(record.localTime())), time);
+                    } else {
+                        day.value() = qMin(day.value(), time);
+                    }
+                }
+                sql->bindValue(pos, hash.isEmpty() ? QVariant() : QVariant(hash));
+            }
+            ok = sql->exec();
+            if (!ok) {
+                error = sql->lastError();
+                sql->finish();
+                break;
+            }
+            sql->finish();
+        }
+        for (auto day = rechain.constBegin(); ok && day != rechain.constEnd(); ++day) {
+            ok = rechainDay(db, schema, day.key().first, day.key().second, day.value());
+        }
+        // a closed day is signed again only when its signature held before the rows of the producer
+        for (auto day = closed.constBegin(); ok && day != closed.constEnd(); ++day) {
+            if (day.value() == DaySigned) {
+                ok = signDays(db, schema, day.key().first, day.key().second, nextDayTime(day.key().second));
+            } else if (day.value() == DayBroken) {
+                qWarning() << "Broken signature" << tableRef(schema, day.key().first) << day.key().second
+                           << "the day is not signed again";
+            }
+        }
+        for (int i = 0; ok && i < chained.size(); i++) {
+            ok = signClosedDays(db, schema, chained.at(i));
+        }
+        if (ta) {
+            if (ok) ok = db.commit();
+            if (!ok) { // a busy COMMIT leaves the transaction open
+                if (!error.isValid()) error = db.lastError();
+                db.rollback();
+            }
+        }
+        if (!ok) break;
+        dropped += unmerged;
+        for (const auto &record : committed) {
+            const qint64 time = record.localTime().toSecsSinceEpoch();
+            auto range = changed.find(record.tableName());
+            if (range == changed.end()) {
+                changed.insert(record.tableName(), qMakePair(dayTime(record.localTime()), time));
+            } else {
+                range->first = qMin(range->first, dayTime(record.localTime()));
+                range->second = qMax(range->second, time);
+            }
+        }
+    }
+    if (!ok) {
+        intern_ids.clear(); // may hold the ids rolled back
+        chain_last.clear(); // and the hashes
+        chain_heads.clear();
+        signed_until.clear();
+        if (!error.isValid()) error = db.lastError();
+        TRACE_ARG(error.text());
+        if (isTransient(error)) { // the months before are committed
+            QVector<ActivityRecord> failed;
+            for (; it != months.constEnd(); ++it) failed += it.value();
+            spillRows(failed);
+            if (failed.size() == rows.size()) return;
+        } else {
+            emit errorOccurred(error.text());
             return;
         }
     }
-    bool ta = db.transaction();
+    TRACE_ARG("Committed" << rows.size() << "dropped" << dropped);
+    if (dropped) {
+        emit errorOccurred(QString("%1 records dropped, no free second within %2 seconds of their time")
+                               .arg(dropped).arg(ActivitySchema::mergeShift));
+    }
+    if (changed.isEmpty()) return;
+    scheduleCheckpoint();
+    for (auto range = changed.constBegin(); range != changed.constEnd(); ++range) {
+        emit dataChanged(range.key(), range->first, range->second);
+    }
+}
+
+// SQLITE_BUSY, SQLITE_LOCKED, SQLITE_IOERR, SQLITE_FULL and SQLITE_CANTOPEN may pass by
+// themselves; an extended code keeps the primary one in the low byte
+bool SqliteProducer::isTransient(const QSqlError &error)
+{
+    bool ok = false;
+    const int code = error.nativeErrorCode().toInt(&ok) & 0xff;
+    if (!ok) return error.type() == QSqlError::ConnectionError;
+    return code == 5 || code == 6 || code == 10 || code == 13 || code == 14;
+}
+
+// The first SpillRows records are parked in memory, the overflow is appended to the journal
+void SqliteProducer::spillRows(const QVector<ActivityRecord> &rows)
+{
+    TRACE_ARG(rows.size() << spill_rows.size() << spill_journaled);
+
+    if (spill_rows.isEmpty() && !spill_journaled) spill_clock.start();
+    const int room = qMax(SpillRows - spill_rows.size(), 0);
+    spill_rows += rows.mid(0, room);
+    if (rows.size() > room && !writeJournal(rows, room)) {
+        emit errorOccurred(QString("Can't write '%1', %2 records lost")
+                               .arg(db_filepath + spillSuffix).arg(rows.size() - room));
+    }
+    scheduleReplay();
+    emit spillChanged(spill_rows.size(), spill_journaled);
+}
+
+// The replay backoff doubles from ReplayFirst to ReplayMax while the database stays busy
+void SqliteProducer::scheduleReplay()
+{
+    if (!replay_timer) {
+        replay_timer = new QTimer(this);
+        replay_timer->setSingleShot(true);
+        connect(replay_timer, &QTimer::timeout, this, &SqliteProducer::replaySpill);
+    }
+    if (replay_timer->isActive()) return;
+    replay_delay = replay_delay ? qMin(replay_delay * 2, int(ReplayMax)) : int(ReplayFirst);
+    replay_timer->start(replay_delay);
+}
+
+// The parked records are committed ahead of the pending ones, the journal after the memory
+void SqliteProducer::replaySpill()
+{
+    if (replay_timer) replay_timer->stop();
+    const int parked = spill_rows.size() + spill_journaled;
+    if (!parked) return;
+
+    QVector<ActivityRecord> rows;
+    rows.swap(spill_rows);
+    if (spill_journaled) {
+        readJournal(rows);
+        QFile::remove(db_filepath + spillSuffix);
+        spill_journaled = 0;
+    }
+    const qint64 msecs = spill_clock.elapsed();
+    pending_rows = rows + pending_rows;
+    commitRows();
+    if (!spill_rows.isEmpty() || spill_journaled) return; // parked again
+
+    replay_delay = 0;
+    replay_latency.record(quint32(qMin(msecs, qint64(0xffffffff))));
+    qInfo() << "Replayed" << parked << "parked records after" << msecs << "ms";
+    emit spillChanged(0, 0);
+}
+
+bool SqliteProducer::writeJournal(const QVector<ActivityRecord> &rows, int from)
+{
+    QFile file(db_filepath + spillSuffix);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) return false;
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_12);
+    for (int i = from; i < rows.size(); i++) {
+        const ActivityRecord &record = rows.at(i);
+        out << record.tableName() << record.localTime() << record.uuid() << record.textNote()
+            << qint32(record.keyPresses()) << qint32(record.mouseClicks()) << qint32(record.mouseDistance())
+            << record.activeMask();
+    }
+    file.flush();
+    if (out.status() != QDataStream::Ok || file.error() != QFileDevice::NoError) return false;
+    spill_journaled += rows.size() - from;
+    return true;
+}
+
+// Returns the number of the records appended, the tail of an interrupted write is ignored
+int SqliteProducer::readJournal(QVector<ActivityRecord> &rows)
+{
+    QFile file(db_filepath + spillSuffix);
+    if (!file.open(QIODevice::ReadOnly)) return 0;
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_12);
+    int count = 0;
+    while (!in.atEnd()) {
+        QString table, note;
+        QDateTime time;
+        QUuid uuid;
+        qint32 keys, clicks, distance;
+        quint64 mask;
+        in >> table >> time >> uuid >> note >> keys >> clicks >> distance >> mask;
+        if (in.status() != QDataStream::Ok) break;
+        rows.append(ActivityRecord(table, time, uuid, note, keys, clicks, distance, mask));
+        count++;
+    }
+    return count;
+}
+
+// The counters of another project are never merged into the row, that would move them
+// to the project of the record; the record goes to the next second without a row of
+// another project instead. Resolved before the insert, so the row hash is computed with
+// the final LocalTime.
+ActivityRecord SqliteProducer::mergeTarget(QSqlDatabase &db, const QString &schema, const ActivityRecord &record,
+                                           bool &ok)
+{
     QSqlQuery sql(db);
-    sql.prepare(QString(sqlTableInsert).arg(table));
-    sql.bindValue(":LocalTime",     record.localTime().toSecsSinceEpoch());
-    sql.bindValue(":ProjectId",     record.projectId());
-    sql.bindValue(":TextNote",      record.textNote());
-    sql.bindValue(":KeyPresses",    record.keyPresses());
-    sql.bindValue(":MouseClicks",   record.mouseClicks());
-    sql.bindValue(":MouseDistance", record.mouseDistance());
-    bool ok = sql.exec();
-    if (ok) sql.finish();
-    if (ta) {
-        if (ok) db.commit();
-        else db.rollback();
+    const QString ref = tableRef(schema, record.tableName());
+    const qint64 time = record.localTime().toSecsSinceEpoch();
+    for (int shift = 0; shift < ActivitySchema::mergeShift; shift++) {
+        if (!sql.exec(QString(sqlMergeKeySelect).arg(ref).arg(time + shift))) {
+            ok = false;
+            return record;
+        }
+        if (sql.next() && sql.value(0).toString() != record.projectId()) continue;
+        if (!shift) return record;
+        TRACE_ARG(ref << "LocalTime" << time << "taken by another project, moved by" << shift);
+        return ActivityRecord(record.tableName(), record.localTime().addSecs(shift), record.uuid(), record.textNote(),
+                              record.keyPresses(), record.mouseClicks(), record.mouseDistance(), record.activeMask());
     }
-    if (!ok) {
-        TRACE_ARG(db.lastError().text());
-        emit errorOccurred(db.lastError().text());
-        return;
+    // the ON CONFLICT condition would leave the row alone, the caller reports the record instead
+    TRACE_ARG(ref << "No free second after" << time);
+    return ActivityRecord();
+}
+
+// The prepared insert statement is kept per table for the connection lifetime
+QSqlQuery *SqliteProducer::insertQuery(QSqlDatabase &db, const QString &schema, const QString &table)
+{
+    const QString ref = tableRef(schema, table);
+    auto it = insert_queries.find(ref);
+    if (it != insert_queries.end()) return it->data();
+
+    if (!prepareTable(db, schema, table)) return nullptr;
+
+    QSharedPointer<QSqlQuery> sql(new QSqlQuery(db));
+    if (encoded_tables.contains(ref)) {
+        if (!sql->prepare(QString(sqlRowsInsert).arg(tableRef(schema, rowsName(table)), ActivitySchema::insertNames(true),
+                                                     ActivitySchema::insertValues(), ActivitySchema::mergeSql(true),
+                                                     ActivitySchema::mergeWhere(true)))) {
+            return nullptr;
+        }
+    } else if (!sql->prepare(QString(sqlTableInsert).arg(ref, ActivitySchema::insertNames(false),
+                                                         ActivitySchema::insertValues(), ActivitySchema::mergeSql(false),
+                                                         ActivitySchema::mergeWhere(false)))) {
+        return nullptr;
+    }
+    insert_queries.insert(ref, sql);
+    return sql.data();
+}
+
+// A record after the last row of the table extends the chain of its project day, the head
+// is read once and then kept; one at or before the last row gets no hash here, its day is
+// chained again by rechainDay() after the insert.
+bool SqliteProducer::chainRow(QSqlDatabase &db, const QString &schema, const ActivityRecord &record, qint64 project,
+                              QByteArray &hash)
+{
+    hash.clear();
+    const QString rows = tableRef(schema, rowsName(record.tableName()));
+    const qint64 time = record.localTime().toSecsSinceEpoch();
+    auto last = chain_last.find(rows);
+    if (last == chain_last.end()) {
+        QSqlQuery sql(db);
+        if (!sql.exec(QString(sqlChainLast).arg(rows)) || !sql.next()) return false;
+        last = chain_last.insert(rows, sql.value(0).toLongLong());
+        sql.finish();
+    }
+    if (time <= last.value()) return true;
+    last.value() = time;
+
+    const qint64 day = dayTime(record.localTime());
+    const QString key = QString("%1/%2/%3").arg(rows).arg(project).arg(day);
+    auto head = chain_heads.find(key);
+    if (head == chain_heads.end()) {
+        if (chain_heads.size() >= ChainHeads) chain_heads.clear();
+        QSqlQuery sql(db);
+        const qint64 next = record.localTime().date().addDays(1).startOfDay().toSecsSinceEpoch();
+        if (!sql.exec(QString(sqlChainHead).arg(rows).arg(day).arg(next).arg(project))) return false;
+        head = chain_heads.insert(key, sql.next() ? sql.value(0).toByteArray() : ActivityChain::seed(record.tableName()));
+        sql.finish();
+    }
+    hash = ActivityChain::rowHash(head.value(), time, record.projectId(), record.textNote(), record.keyPresses(),
+                                  record.mouseClicks(), record.mouseDistance(), qint64(record.activeMask()));
+    head.value() = hash;
+    return true;
+}
+
+// The chains of the day again from the first row inserted without a hash. The stored hashes
+// are checked first against the chain they were written in; on a mismatch the day is left as
+// it is, the new rows unchained, for the verifier to report. The rows before the first changed
+// one keep their hash and only the ones whose hash changed are updated.
+bool SqliteProducer::rechainDay(QSqlDatabase &db, const QString &schema, const QString &table, qint64 day,
+                                qint64 from)
+{
+    const QString rows = tableRef(schema, rowsName(table));
+    const qint64 next = QDateTime::fromSecsSinceEpoch(day).date().addDays(1).startOfDay().toSecsSinceEpoch();
+    QSqlQuery sql(db);
+    sql.setForwardOnly(true);
+    if (!sql.exec(QString(sqlChainDay).arg(rows, ActivitySchema::viewColumns(), ActivitySchema::viewJoins(schema))
+                  .arg(day).arg(next))) return false;
+    const QByteArray seed = ActivityChain::seed(table);
+    QVector<QPair<qint64,QByteArray>> changed;
+    QByteArray prev, written; // the chain from the first changed row and the stored one
+    qint64 project = -1;
+    while (sql.next()) {
+        if (sql.value(TotalColumns + 1).toLongLong() != project) {
+            project = sql.value(TotalColumns + 1).toLongLong();
+            prev = written = seed;
+        }
+        const qint64 time = sql.value(LocalTime).toLongLong();
+        const auto hashAfter = [&sql, time](const QByteArray &head) {
+            return ActivityChain::rowHash(head, time, sql.value(ProjectId).toString(), sql.value(TextNote).toString(),
+                                          sql.value(KeyPresses).toLongLong(), sql.value(MouseClicks).toLongLong(),
+                                          sql.value(MouseDistance).toLongLong(), sql.value(ActiveMask).toLongLong());
+        };
+        const QByteArray stored = sql.value(TotalColumns).toByteArray();
+        if (!stored.isEmpty()) {
+            if (!written.isEmpty() && hashAfter(written) != stored) {
+                qWarning() << "Broken chain" << rows << sql.value(ProjectId).toString() << time << "the day is not rechained";
+                sql.finish();
+                chain_heads.clear();
+                return true;
+            }
+        } else if (time < from) {
+            continue; // written before the chain, it stays unchained
+        }
+        if (time >= from) {
+            const QByteArray hash = (!stored.isEmpty() && prev == written) ? stored : hashAfter(prev);
+            if (hash != stored) changed.append(qMakePair(time, hash));
+            prev = hash;
+        } else {
+            prev = stored;
+        }
+        written = stored; // after a merged row the next one has nothing stored to be checked against
+    }
+    sql.finish();
+    chain_heads.clear(); // the heads of the day may have moved
+    TRACE_ARG(table << day << from << changed.size());
+    if (changed.isEmpty()) return true;
+    if (!sql.prepare(QString(sqlChainUpdate).arg(rows))) return false;
+    for (const auto &row : changed) {
+        sql.bindValue(":RowHash", row.second);
+        sql.bindValue(":LocalTime", row.first);
+        if (!sql.exec()) return false;
+    }
+    return true;
+}
+
+// The heads of the project day chains between the times by the day: the last RowHash of the
+// rows table and the ChainHash of the packed days, as the verifier collects them
+bool SqliteProducer::dayHeads(QSqlDatabase &db, const QString &schema, const QString &table, qint64 from, qint64 to,
+                              QMap<qint64,ActivityChain::DayHeads> &days)
+{
+    QSqlQuery sql(db);
+    sql.setForwardOnly(true);
+    if (!sql.exec(QString(sqlHeadsRows).arg(tableRef(schema, rowsName(table)),
+                                            tableRef(schema, QLatin1String(dataBaseProjects))).arg(from).arg(to)))
+        return false;
+    qint64 day_from = 0, day_to = 0;
+    while (sql.next()) {
+        const qint64 time = sql.value(1).toLongLong();
+        if (time < day_from || time >= day_to) {
+            day_from = dayTime(QDateTime::fromSecsSinceEpoch(time));
+            day_to = nextDayTime(day_from);
+        }
+        days[day_from][qMakePair(sql.value(0).toString(), false)] = sql.value(2).toByteArray();
+    }
+    sql.finish();
+    if (!tableColumns(db, schema, packedName(table)).contains(QLatin1String("ChainHash"))) return true;
+    if (!sql.exec(QString(sqlHeadsPacked).arg(tableRef(schema, packedName(table))).arg(from).arg(to))) return false;
+    while (sql.next()) {
+        days[sql.value(0).toLongLong()][qMakePair(sql.value(1).toString(), true)] = sql.value(2).toByteArray();
+    }
+    return true;
+}
+
+// Whether the signature of the closed day holds for the heads of its chains as they are now
+bool SqliteProducer::daySignature(QSqlDatabase &db, const QString &schema, const QString &table, qint64 day,
+                                  DaySignature &state)
+{
+    state = DayUnsigned;
+    if (sign_secret.isEmpty() || tableColumns(db, schema, signedName(table)).isEmpty()) return true;
+    QSqlQuery sql(db);
+    if (!sql.exec(QString(sqlSignedSelect).arg(tableRef(schema, signedName(table))).arg(day))) return false;
+    if (!sql.next()) return true;
+    const QByteArray signature = sql.value(0).toByteArray();
+    sql.finish();
+    QMap<qint64,ActivityChain::DayHeads> days;
+    if (!dayHeads(db, schema, table, day, nextDayTime(day), days)) return false;
+    state = ActivityChain::verifyHeads(sign_public, ActivityChain::headsMessage(table, day, days.value(day)), signature)
+          ? DaySigned : DayBroken;
+    return true;
+}
+
+// Sign the heads of every closed day between the times with its chains, one signature a day
+bool SqliteProducer::signDays(QSqlDatabase &db, const QString &schema, const QString &table, qint64 from, qint64 to)
+{
+    if (sign_secret.isEmpty()) return true;
+    to = qMin(to, QDate::currentDate().startOfDay().toSecsSinceEpoch());
+    if (from >= to) return true;
+    QMap<qint64,ActivityChain::DayHeads> days;
+    if (!dayHeads(db, schema, table, from, to, days)) return false;
+    if (days.isEmpty()) return true;
+    const QString ref = tableRef(schema, signedName(table));
+    QSqlQuery sql(db);
+    if (!sql.exec(QString(sqlSignedCreate).arg(ref)) || !sql.prepare(QString(sqlSignedUpsert).arg(ref))) return false;
+    for (auto it = days.constBegin(); it != days.constEnd(); ++it) {
+        sql.bindValue(":DayTime", it.key());
+        sql.bindValue(":Signature", ActivityChain::signHeads(sign_secret,
+                                                             ActivityChain::headsMessage(table, it.key(), it.value())));
+        if (!sql.exec()) return false;
+    }
+    TRACE_ARG(table << from << to << days.size());
+    return true;
+}
+
+// The days closed since the last one signed get their signature, looked for once a day; the
+// days before it without one are left unsigned for the verifier to report
+bool SqliteProducer::signClosedDays(QSqlDatabase &db, const QString &schema, const QString &table)
+{
+    if (sign_secret.isEmpty()) return true;
+    const qint64 today = QDate::currentDate().startOfDay().toSecsSinceEpoch();
+    const QString ref = tableRef(schema, signedName(table));
+    auto until = signed_until.find(ref);
+    if (until == signed_until.end()) {
+        qint64 from = 0;
+        if (!tableColumns(db, schema, signedName(table)).isEmpty()) {
+            QSqlQuery sql(db);
+            if (!sql.exec(QString(sqlSignedLast).arg(ref)) || !sql.next()) return false;
+            if (!sql.value(0).isNull()) from = nextDayTime(sql.value(0).toLongLong());
+        }
+        until = signed_until.insert(ref, from);
     }
-    emit dataChanged();
+    if (until.value() >= today) return true;
+    if (!signDays(db, schema, table, until.value(), today)) return false;
+    until.value() = today;
+    return true;
 }
 
 void SqliteProducer::setServerStatus(const QString &table, const ServerStatusMap &status)
@@ -247,149 +1100,1287 @@ void SqliteProducer::setServerStatus(const QString &table, const ServerStatusMap
         return;
     }
     QSqlDatabase db = QSqlDatabase::database(conn_name);
-    if (!db.isValid() || db.lastError().isValid()) {
+    if (!db.isValid()) {
         TRACE_ARG("Not ready");
         return;
     }
-    if (!db.isOpen() && !db.open()) {
+    if (!openDb(db)) {
         TRACE_ARG(db.lastError().text());
         emit errorOccurred(db.lastError().text());
         return;
     }
-    if (!db.tables().contains(table)) return;
-
-    bool ok = true;
-    bool ta = db.transaction();
-    if (status.size() == 1) { //"UPDATE '%1' SET ServerStatus='%2' WHERE LocalTime=%3"
-            QSqlQuery sql(db);
-            ok = sql.exec(QString(sqlTableStatusUpdate).arg(table, status.first()).arg(status.firstKey()));
-    } else {
-        int batch = 0;
-        QString when, where;
-        for (auto it = status.constBegin(); it != status.constEnd() && ok; ++it) {
-            //" WHEN LocalTime=%1 THEN '%2'"
-            if (!when.isEmpty()) when += '\n';
-            when += QString(sqlTableStatusWhen).arg(it.key()).arg(it.value());
-            if (!where.isEmpty()) where += ", ";
-            where += QString::number(it.key());
-
-            if (++batch > 10) { //"UPDATE '%1' SET ServerStatus=(CASE %2 END) WHERE LocalTime IN (%3)"
-                if (when.isEmpty() || where.isEmpty()) break; // just for sanity
-                QSqlQuery sql(db);
-                ok = sql.exec(QString(sqlTableStatusBatch).arg(table, when, where));
-                batch = 0;
-                when.clear();
-                where.clear();
-            }
-        }
-        if (!when.isEmpty() && !where.isEmpty()) {
-            QSqlQuery sql(db);
-            ok = sql.exec(QString(sqlTableStatusBatch).arg(table, when, where));
-        }
+    QList<QDate> months; // the keys are ascending
+    for (auto it = status.constBegin(); it != status.constEnd(); ++it) {
+        const QDate month = partitionMonth(it.key());
+        if (months.isEmpty() || months.last() != month) months.append(month);
     }
-    if (ta) {
-        if (ok) db.commit();
-        else db.rollback();
+    bool ok = fillStatus(db, status), changed = false;
+    for (int i = 0; i < months.size() && ok; i++) {
+        const QDate &month = months.at(i);
+        if (!QFile::exists(partitionPath(db_filepath, month))) continue;
+        ok = attachPartition(db, month);
+        const QString schema = partitionSchema(month);
+        if (!ok || tableColumns(db, schema, table).isEmpty()) continue;
+        const qint64 from = month.startOfDay().toSecsSinceEpoch();
+        const qint64 to = month.addMonths(1).startOfDay().toSecsSinceEpoch();
+        const QString rows = rowsName(table);
+        ok = updateStatus(db, tableRef(schema, tableColumns(db, schema, rows).isEmpty() ? table : rows), from, to);
+        if (ok && !tableColumns(db, schema, plainName(table)).isEmpty()) // being migrated
+            ok = updateStatus(db, tableRef(schema, plainName(table)), from, to);
+        changed = true;
+    }
+    if (ok && legacy_tables.contains(table)) {
+        ok = updateStatus(db, tableRef(QStringLiteral("main"), table), 0, std::numeric_limits<qint64>::max());
+        changed = true;
     }
+    QSqlQuery(db).exec(QString(sqlStatusClear).arg(QLatin1String(statusTable)));
     if (!ok) {
         TRACE_ARG(db.lastError().text());
         emit errorOccurred(db.lastError().text());
         return;
     }
-    emit dataChanged();
-}
-
-QTimer *SqliteProducer::reduceTimer()
-{
-    if (!reduce_timer) {
-        reduce_timer = new QTimer(this);
-        reduce_timer->setSingleShot(true);
-        reduce_timer->setTimerType(Qt::VeryCoarseTimer);
-        connect(reduce_timer, &QTimer::timeout, this, &SqliteProducer::reduce);
-    }
-    return reduce_timer;
-}
-
-static int millisecondsTo(const QString &at)
-{
-    QTime tm = QTime::fromString(at, QStringLiteral("hh:mm:ss"));
-    int ms = QTime::currentTime().msecsTo(tm.isValid() ? tm : QTime(23,59,55));
-    if (ms < 0) ms += 24 * 60 * 60 * 1000;
-    return ms;
-}
-
-void SqliteProducer::reconfig()
-{
-    QString at = db_config.value(QStringLiteral("ReduceAt")).toString();
-    if (!at.isEmpty() && at != reduce_at) {
-        reduceTimer()->start(millisecondsTo(at));
-        reduce_at = at;
-    }
-    int kd = db_config.value(QStringLiteral("KeepDays")).toUInt();
-    if (kd && kd != keep_days) {
-        if (kd < keep_days) reduceTimer()->start(0);
-        keep_days = kd;
-    }
-    TRACE_ARG(keep_days << reduce_at);
+    if (!changed) return;
+    scheduleCheckpoint();
+    emit dataChanged(table, status.firstKey(), status.lastKey());
 }
 
-void SqliteProducer::reduce()
+// The pending rows of the range are marked sending before the upload reads them, the rows
+// written or merged meanwhile stay pending; once uploaded only the sending ones leave the
+// partial index, or all the rows of the range enter it to be uploaded again. The upper bound
+// of the range is exclusive, 0 is unbound.
+void SqliteProducer::setSyncState(const QString &table, qint64 fromTime, qint64 toTime, int state)
 {
-    TRACE();
+    TRACE_ARG(table << fromTime << toTime << state);
 
-    if (keep_days < 1) return;
+    if (table.isEmpty() || isRollup(table) || isInternal(table)) return;
 
     if (conn_name.isEmpty()) {
         TRACE_ARG("Not started");
+        emit syncStateChanged(table, fromTime, toTime, state, false);
         return;
     }
     QSqlDatabase db = QSqlDatabase::database(conn_name);
-    if (!db.isValid() || db.lastError().isValid()) {
+    if (!db.isValid()) {
         TRACE_ARG("Not ready");
+        emit syncStateChanged(table, fromTime, toTime, state, false);
         return;
     }
-    if (!db.isOpen() && !db.open()) {
+    if (!openDb(db)) {
         TRACE_ARG(db.lastError().text());
         emit errorOccurred(db.lastError().text());
+        emit syncStateChanged(table, fromTime, toTime, state, false);
         return;
     }
-    int count = 0;
-    QStringList db_tables = db.tables();
-    for (const auto &table : db_tables) {
-        if (table.isEmpty()) continue;
-        bool ta = db.transaction();
-        QSqlQuery sql(db);
-        QDateTime now = QDateTime::currentDateTime();
-        auto sec = now.addSecs(-keep_days * 86400).secsTo(now); // to consider DST
-        bool ok = sql.exec(QString(sqlTableReduce).arg(table).arg(sec));
-        if (ok) sql.finish();
-        if (ta) {
-            if (ok) ok = db.commit();
-            else db.rollback();
-        }
-        if (!ok) {
-            TRACE_ARG(db.lastError().text());
-            emit errorOccurred(db.lastError().text());
-            return;
-        }
-        count++;
+    const qint64 before = toTime > 0 ? toTime : std::numeric_limits<qint64>::max();
+    const QDate first = fromTime > 0 ? partitionMonth(fromTime) : QDate();
+    const QDate last = partitionMonth(qMin(before, QDateTime::currentSecsSinceEpoch()));
+    QString value, where;
+    switch (state) {
+    case SyncUploaded: value = QStringLiteral("NULL"); where = QStringLiteral("=2"); break;
+    case SyncSending:  value = QStringLiteral("2");    where = QStringLiteral("=1"); break;
+    default:           value = QStringLiteral("1");    where = QStringLiteral("IS NOT 1"); break;
     }
-    if (count) {
+    auto update = [&](const QString &schema, const QString &source) -> bool {
         QSqlQuery sql(db);
-        sql.exec("VACUUM");
+        if (!sql.exec(QString(sqlSyncUpdate).arg(tableRef(schema, source), value, where)
+                                            .arg(qMax(fromTime, qint64(0))).arg(before))) return false;
+        TRACE_ARG(schema << source << sql.numRowsAffected());
+        return true;
+    };
+    bool ok = true;
+    const auto files = partitionFiles(db_filepath);
+    for (auto it = files.constBegin(); it != files.constEnd() && ok; ++it) {
+        if (first.isValid() && it.key() < first) continue;
+        if (it.key() > last) break;
+        ok = attachPartition(db, it.key());
+        const QString schema = partitionSchema(it.key());
+        if (!ok || tableColumns(db, schema, table).isEmpty()) continue;
+        ok = prepareTable(db, schema, table) &&
+             update(schema, encoded_tables.contains(tableRef(schema, table)) ? rowsName(table) : table);
+        const QString plain = plainName(table);
+        if (ok && tableColumns(db, schema, plain).contains(columnName(SyncState)))
+            ok = update(schema, plain);
     }
-    if (!reduce_at.isEmpty()) {
-        int msec = millisecondsTo(reduce_at);
-        TRACE_ARG("Next time" << QTime(0,0).addMSecs(msec).toString());
-        reduceTimer()->start(msec);
+    if (ok && legacy_tables.contains(table)) ok = update(QStringLiteral("main"), table);
+    if (!ok) {
+        TRACE_ARG(db.lastError().text());
+        emit errorOccurred(db.lastError().text());
     }
-    if (count) emit dataChanged();
+    emit syncStateChanged(table, fromTime, toTime, state, ok);
+}
+
+// The statuses are bound into the temp table by one prepared statement in one transaction
+bool SqliteProducer::fillStatus(QSqlDatabase &db, const ServerStatusMap &status)
+{
+    const QLatin1String name(statusTable);
+    QSqlQuery sql(db);
+    if (!sql.exec(QString(sqlStatusCreate).arg(name)) || !sql.exec(QString(sqlStatusClear).arg(name)) ||
+        !sql.prepare(QString(sqlStatusInsert).arg(name))) return false;
+    bool ta = db.transaction();
+    bool ok = true;
+    for (auto it = status.constBegin(); it != status.constEnd() && ok; ++it) {
+        sql.bindValue(0, it.key());
+        sql.bindValue(1, it.value());
+        ok = sql.exec();
+    }
+    if (ta) {
+        if (ok) ok = db.commit();
+        else db.rollback();
+    }
+    return ok;
+}
+
+// One statement applies the statuses of the time range to the table, a row is looked up by
+// its primary key per status
+bool SqliteProducer::updateStatus(QSqlDatabase &db, const QString &ref, qint64 fromTime, qint64 toTime)
+{
+    QSqlQuery sql(db);
+    return sql.exec(QString(sqlStatusApply).arg(ref, QLatin1String(statusTable)).arg(fromTime).arg(toTime));
+}
+
+QStringList SqliteProducer::tableColumns(QSqlDatabase &db, const QString &schema, const QString &table)
+{
+    QStringList columns;
+    QSqlQuery sql(db);
+    if (sql.exec(QString(sqlTableInfo).arg(schema, table))) {
+        while (sql.next()) columns.append(sql.value(1).toString());
+    }
+    return columns;
+}
+
+// Create the table or add the columns missing in the tables of the older versions. A new
+// table stores the ProjectId and TextNote as the ids of the Projects and Notes dictionaries
+// in the rows table, the view named as the table joins them back for the queries.
+bool SqliteProducer::prepareTable(QSqlDatabase &db, const QString &schema, const QString &table, bool backfill)
+{
+    const QString ref = tableRef(schema, table);
+    if (ready_tables.contains(ref)) return true;
+
+    QSqlQuery sql(db);
+    const QString rows = rowsName(table);
+    bool encoded = !tableColumns(db, schema, rows).isEmpty();
+    if (!encoded && tableColumns(db, schema, table).isEmpty()) {
+        if (!sql.exec(QString(sqlDictionaryCreate).arg(tableRef(schema, QLatin1String(dataBaseProjects)))) ||
+            !sql.exec(QString(sqlDictionaryCreate).arg(tableRef(schema, QLatin1String(dataBaseNotes)))) ||
+            !sql.exec(QString(sqlRowsCreate).arg(tableRef(schema, rows), ActivitySchema::definitions(true))) ||
+            !sql.exec(QString(sqlRowsViewCreate).arg(schema, table, rows, ActivitySchema::viewColumns(),
+                                                     ActivitySchema::viewJoins()))) return false;
+        encoded = true;
+    }
+    if (!prepareSync(db, schema, encoded ? rows : table)) return false;
+    if (encoded && !prepareChain(db, schema, table)) return false;
+    if (!prepareRollups(db, schema, table, encoded, backfill)) return false;
+    if (encoded) encoded_tables.append(ref);
+    ready_tables.append(ref);
+    return true;
+}
+
+// The columns appended to the schema since the table was written. The rows written by the
+// older versions read as uploaded, the partial index holds the new ones until the upload
+// flips them by setSyncState().
+bool SqliteProducer::prepareSync(QSqlDatabase &db, const QString &schema, const QString &source)
+{
+    QSqlQuery sql(db);
+    const bool encoded = source.endsWith(QLatin1String(rowsSuffix));
+    const QStringList columns = tableColumns(db, schema, source);
+    for (int i = 0; i < TotalColumns; i++) {
+        if (!(ActivitySchema::columns[i].flags & ActivitySchema::Appended) ||
+            columns.contains(ActivitySchema::storedName(i, encoded))) continue;
+        if (!sql.exec(QString(sqlTableAddColumn).arg(tableRef(schema, source),
+                                                     ActivitySchema::definition(i, encoded)))) return false;
+    }
+    return sql.exec(QString(sqlSyncIndexDrop).arg(schema, source + QLatin1String(syncLegacySuffix))) &&
+           sql.exec(QString(sqlSyncIndexCreate).arg(schema, source + QLatin1String(syncSuffix), source));
+}
+
+// The RowHash of the rows table and the ChainHash of the packed days, NULL in the rows
+// written before the chain; the verifier counts them as unchained
+bool SqliteProducer::prepareChain(QSqlDatabase &db, const QString &schema, const QString &table)
+{
+    QSqlQuery sql(db);
+    const QString rows = rowsName(table);
+    QStringList columns = tableColumns(db, schema, rows);
+    if (!columns.isEmpty() && !columns.contains(QLatin1String("RowHash")) &&
+        !sql.exec(QString(sqlTableAddHash).arg(tableRef(schema, rows), QLatin1String("RowHash")))) return false;
+    const QString packed = packedName(table);
+    columns = tableColumns(db, schema, packed);
+    return columns.isEmpty() || columns.contains(QLatin1String("ChainHash")) ||
+           sql.exec(QString(sqlTableAddHash).arg(tableRef(schema, packed), QLatin1String("ChainHash")));
+}
+
+// The rollups are kept up to date by the triggers in the same transaction as the insert,
+// an update (the LocalTime collision) moves the old values out of the bucket and the new
+// ones in. The rows of a table written before the rollups existed are summed up once, right
+// away or by the RetainBackfill task.
+bool SqliteProducer::prepareRollups(QSqlDatabase &db, const QString &schema, const QString &table, bool encoded, bool backfill)
+{
+    const QString source = encoded ? rowsName(table) : table;
+    const QString project_new = encoded ? QString(sqlRowsProject).arg(QLatin1String(dataBaseProjects), QLatin1String("NEW"))
+                                        : QStringLiteral("NEW.ProjectId");
+    const QString project_old = encoded ? QString(sqlRowsProject).arg(QLatin1String(dataBaseProjects), QLatin1String("OLD"))
+                                        : QStringLiteral("OLD.ProjectId");
+    QString inserts, updates;
+    QSqlQuery sql(db);
+    for (int step : rollupSteps) {
+        const QString rollup = rollupName(table, step);
+        if (tableColumns(db, schema, rollup).isEmpty()) {
+            const QString ref = tableRef(schema, rollup);
+            if (!sql.exec(QString(sqlRollupCreate).arg(ref, ActivitySchema::counters("%1 INTEGER")))) return false;
+            if (backfill) {
+                if (!sql.exec(QString(sqlBackfillInsert).arg(ref))) return false;
+            } else if (!sql.exec(QString(sqlRollupFill).arg(ref, tableRef(schema, table),
+                                                            rollupBucketSql(step, QStringLiteral("LocalTime")),
+                                                            activeSecondsSql(QStringLiteral("ActiveMask")),
+                                                            QStringLiteral("1"),
+                                                            ActivitySchema::counters("SUM(IFNULL(%1,0))")))) return false;
+        }
+        const QString upsert = QString(sqlRollupUpsert).arg(rollup, rollupBucketSql(step, QStringLiteral("NEW.LocalTime")),
+                                                            activeSecondsSql(QStringLiteral("NEW.ActiveMask")), project_new,
+                                                            ActivitySchema::counters("%1"),
+                                                            ActivitySchema::counters("IFNULL(NEW.%1,0)"),
+                                                            ActivitySchema::counters("%1=%1+excluded.%1"));
+        inserts += upsert;
+        updates += QString(sqlRollupRemove).arg(rollup, rollupBucketSql(step, QStringLiteral("OLD.LocalTime")),
+                                                activeSecondsSql(QStringLiteral("OLD.ActiveMask")), project_old,
+                                                ActivitySchema::counters("%1=%1-IFNULL(OLD.%1,0)"));
+        updates += upsert;
+    }
+    const QString prefix = table + QLatin1String(rollupSeparator);
+    const QString column = encoded ? QStringLiteral("ProjectRef") : QStringLiteral("ProjectId");
+    return sql.exec(QString(sqlRollupInsertTrigger).arg(schema, prefix + QLatin1String("insert"), source, inserts)) &&
+           sql.exec(QString(sqlRollupUpdateTrigger).arg(schema, prefix + QLatin1String("update"), source, updates, column,
+                                                        ActivitySchema::counters("%1")));
+}
+
+// The dictionary id of the value, interned once per connection
+qint64 SqliteProducer::internId(QSqlDatabase &db, const QString &schema, const char *dictionary, const QString &value)
+{
+    const QString ref = tableRef(schema, QLatin1String(dictionary));
+    QHash<QString,qint64> &cache = intern_ids[ref];
+    auto it = cache.constFind(value);
+    if (it != cache.constEnd()) return it.value();
+
+    QSqlQuery sql(db);
+    qint64 id = -1;
+    if (sql.prepare(QString(sqlDictionarySelect).arg(ref))) {
+        sql.bindValue(":Value", value);
+        if (sql.exec() && sql.next()) id = sql.value(0).toLongLong();
+        sql.finish();
+    }
+    if (id < 0) {
+        if (!sql.prepare(QString(sqlDictionaryInsert).arg(ref))) return -1;
+        sql.bindValue(":Value", value);
+        if (!sql.exec()) return -1;
+        id = sql.lastInsertId().toLongLong();
+    }
+    cache.insert(value, id);
+    return id;
+}
+
+// Keep the few recently written months attached, the file is created on the first ATTACH
+bool SqliteProducer::attachPartition(QSqlDatabase &db, const QDate &month)
+{
+    const QString schema = partitionSchema(month);
+    int i = attached.indexOf(schema);
+    if (i >= 0) {
+        attached.move(i, attached.size() - 1);
+        return true;
+    }
+    while (attached.size() >= PartitionsAttached) detachPartition(db, attached.first());
+
+    QString path = partitionPath(db_filepath, month);
+    bool created = !QFile::exists(path);
+    QSqlQuery sql(db);
+    if (!sql.exec(QString(sqlAttach).arg(path.replace('\'', QLatin1String("''")), schema))) return false;
+    if (created) { // before the first table
+        sql.exec(QString(sqlAutoVacuumIncremental).arg(schema));
+        sql.exec(QString(sqlUserVersionSet).arg(schema).arg(PartitionVersion));
+    }
+    if (sql.exec(QString(sqlSchemaWal).arg(schema))) sql.finish();
+    sql.exec(QString(sqlSchemaSynchronous).arg(schema).arg(synchronous));
+    attached.append(schema);
+    TRACE_ARG(schema << path);
+    return true;
+}
+
+void SqliteProducer::detachPartition(QSqlDatabase &db, const QString &schema)
+{
+    const QString prefix = schema + '.';
+    for (auto it = insert_queries.begin(); it != insert_queries.end(); ) {
+        if (it.key().startsWith(prefix)) it = insert_queries.erase(it);
+        else ++it;
+    }
+    for (auto it = intern_ids.begin(); it != intern_ids.end(); ) {
+        if (it.key().startsWith(prefix)) it = intern_ids.erase(it);
+        else ++it;
+    }
+    for (auto it = chain_last.begin(); it != chain_last.end(); ) {
+        if (it.key().startsWith(prefix)) it = chain_last.erase(it);
+        else ++it;
+    }
+    for (auto it = chain_heads.begin(); it != chain_heads.end(); ) {
+        if (it.key().startsWith(prefix)) it = chain_heads.erase(it);
+        else ++it;
+    }
+    for (auto it = signed_until.begin(); it != signed_until.end(); ) {
+        if (it.key().startsWith(prefix)) it = signed_until.erase(it);
+        else ++it;
+    }
+    for (int i = ready_tables.size() - 1; i >= 0; i--) {
+        if (ready_tables.at(i).startsWith(prefix)) ready_tables.removeAt(i);
+    }
+    for (int i = encoded_tables.size() - 1; i >= 0; i--) {
+        if (encoded_tables.at(i).startsWith(prefix)) encoded_tables.removeAt(i);
+    }
+    attached.removeAll(schema);
+
+    QSqlQuery sql(db);
+    if (!sql.exec(QString(sqlDetach).arg(schema))) TRACE_ARG(sql.lastError().text());
+}
+
+bool SqliteProducer::openDb(QSqlDatabase &db)
+{
+    if (db.isOpen()) return true;
+    if (!db.open()) return false;
+
+    // a new connection has nothing attached
+    insert_queries.clear();
+    intern_ids.clear();
+    chain_last.clear();
+    chain_heads.clear();
+    ready_tables.clear();
+    encoded_tables.clear();
+    attached.clear();
+
+    // the connection settings, the WAL journal mode is persistent in the file
+    QSqlQuery sql(db);
+    sql.exec(QString(sqlSynchronous).arg(synchronous));
+    sql.exec(sqlAutoCheckpoint);
+    return true;
+}
+
+// The checkpoint runs once the writes pause for CheckpointIdle milliseconds
+void SqliteProducer::scheduleCheckpoint()
+{
+    if (!checkpoint_timer) {
+        checkpoint_timer = new QTimer(this);
+        checkpoint_timer->setSingleShot(true);
+        connect(checkpoint_timer, &QTimer::timeout, this, &SqliteProducer::checkpoint);
+    }
+    checkpoint_timer->start(CheckpointIdle);
+
+    if (full_vacuum) { // postponed by every write until the user is away
+        if (!full_vacuum_timer) {
+            full_vacuum_timer = new QTimer(this);
+            full_vacuum_timer->setSingleShot(true);
+            full_vacuum_timer->setTimerType(Qt::VeryCoarseTimer);
+            connect(full_vacuum_timer, &QTimer::timeout, this, &SqliteProducer::fullVacuum);
+        }
+        full_vacuum_timer->start(VacuumIdle);
+    }
+}
+
+void SqliteProducer::checkpoint()
+{
+    if (conn_name.isEmpty()) return;
+    QSqlDatabase db = QSqlDatabase::database(conn_name);
+    if (!db.isValid() || !db.isOpen()) return;
+
+    QSqlQuery sql(db);
+    if (!sql.exec(QString(sqlCheckpoint).arg("PASSIVE")) || !sql.next()) {
+        TRACE_ARG(sql.lastError().text());
+        return;
+    }
+    int wal_pages = sql.value(1).toInt();
+    int done_pages = sql.value(2).toInt();
+    sql.finish();
+    TRACE_ARG("WAL pages" << wal_pages << "checkpointed" << done_pages);
+
+    if (wal_pages >= CheckpointPages) {
+        // Bound the WAL growth, wait for the readers (busy timeout) and reset the file
+        if (sql.exec(QString(sqlCheckpoint).arg("TRUNCATE"))) sql.finish();
+        else TRACE_ARG(sql.lastError().text());
+    } else if (done_pages < wal_pages) {
+        // A reader holds an older snapshot, try again on the next idle period
+        scheduleCheckpoint();
+    }
+}
+
+// The one-time conversion of the existing main file to auto_vacuum INCREMENTAL rewrites
+// the whole file and blocks the writes, run on VacuumIdle or on the user request
+void SqliteProducer::fullVacuum()
+{
+    if (!full_vacuum || conn_name.isEmpty()) return;
+    QSqlDatabase db = QSqlDatabase::database(conn_name);
+    if (!db.isValid() || !db.isOpen()) return;
+
+    if (!pending_rows.isEmpty() || !spill_rows.isEmpty() || !retain_tasks.isEmpty()) {
+        scheduleCheckpoint(); // not idle yet
+        return;
+    }
+    QElapsedTimer clock;
+    clock.start();
+    QSqlQuery sql(db);
+    if (!sql.exec(QStringLiteral("VACUUM"))) {
+        TRACE_ARG(sql.lastError().text());
+        emit errorOccurred(sql.lastError().text());
+        return;
+    }
+    full_vacuum = false;
+    qInfo() << "Converted to incremental auto_vacuum in" << clock.elapsed() << "ms";
+    scheduleCheckpoint();
+}
+
+int SqliteProducer::freelistCount(QSqlDatabase &db, const QString &schema)
+{
+    QSqlQuery sql(db);
+    return (sql.exec(QString(sqlFreelistCount).arg(schema)) && sql.next()) ? sql.value(0).toInt() : 0;
+}
+
+// Release the free pages in slices of VacuumBudget milliseconds, the queued inserts
+// are processed in the VacuumPause between the slices
+void SqliteProducer::incrementalVacuum()
+{
+    if (conn_name.isEmpty()) return;
+    QSqlDatabase db = QSqlDatabase::database(conn_name);
+    if (!db.isValid() || !db.isOpen()) return;
+
+    QElapsedTimer slice;
+    slice.start();
+    int free_pages;
+    do {
+        QSqlQuery sql(db);
+        if (!sql.exec(QString(sqlIncrementalVacuum).arg(QStringLiteral("main")).arg(VacuumPages))) {
+            TRACE_ARG(sql.lastError().text());
+            emit errorOccurred(sql.lastError().text());
+            return;
+        }
+        while (sql.next()) {} // a page is released per step
+        sql.finish();
+        free_pages = freelistCount(db);
+    } while (free_pages > 0 && slice.elapsed() < VacuumBudget);
+
+    if (free_pages > 0) {
+        if (!vacuum_timer) {
+            vacuum_timer = new QTimer(this);
+            vacuum_timer->setSingleShot(true);
+            connect(vacuum_timer, &QTimer::timeout, this, &SqliteProducer::incrementalVacuum);
+        }
+        vacuum_timer->start(VacuumPause);
+        return;
+    }
+    qInfo() << "Incremental vacuum freed" << vacuum_pages << "pages in" << vacuum_clock.elapsed() << "ms";
+    scheduleCheckpoint();
+}
+
+QTimer *SqliteProducer::reduceTimer()
+{
+    if (!reduce_timer) {
+        reduce_timer = new QTimer(this);
+        reduce_timer->setSingleShot(true);
+        reduce_timer->setTimerType(Qt::VeryCoarseTimer);
+        connect(reduce_timer, &QTimer::timeout, this, &SqliteProducer::reduce);
+    }
+    return reduce_timer;
+}
+
+QTimer *SqliteProducer::retainTimer()
+{
+    if (!retain_timer) {
+        retain_timer = new QTimer(this);
+        retain_timer->setSingleShot(true);
+        connect(retain_timer, &QTimer::timeout, this, &SqliteProducer::retainSlice);
+    }
+    return retain_timer;
+}
+
+static int millisecondsTo(const QString &at)
+{
+    QTime tm = QTime::fromString(at, QStringLiteral("hh:mm:ss"));
+    int ms = QTime::currentTime().msecsTo(tm.isValid() ? tm : QTime(23,59,55));
+    if (ms < 0) ms += 24 * 60 * 60 * 1000;
+    return ms;
+}
+
+void SqliteProducer::reconfig()
+{
+    QString at = db_config.value(QStringLiteral("ReduceAt")).toString();
+    if (!at.isEmpty() && at != reduce_at) {
+        reduceTimer()->start(millisecondsTo(at));
+        reduce_at = at;
+    }
+    if (db_config.contains(QStringLiteral("Synchronous"))) {
+        int sync = qBound(0, db_config.value(QStringLiteral("Synchronous")).toInt(), 3);
+        if (sync != synchronous) {
+            synchronous = sync;
+            QSqlDatabase db = QSqlDatabase::database(conn_name, false);
+            if (db.isOpen()) {
+                QSqlQuery sql(db);
+                sql.exec(QString(sqlSynchronous).arg(synchronous));
+                for (const auto &schema : attached) {
+                    sql.exec(QString(sqlSchemaSynchronous).arg(schema).arg(synchronous));
+                }
+            }
+        }
+    }
+    int kd = db_config.value(QStringLiteral("KeepDays")).toUInt();
+    if (kd && kd != keep_days) {
+        if (kd < keep_days) reduceTimer()->start(0);
+        keep_days = kd;
+    }
+    // 0 keeps the rollups forever
+    int *tiers[] = { &keep_ten_minutes, &keep_hourly, &keep_daily };
+    const char *names[] = { "KeepTenMinutes", "KeepHourly", "KeepDaily" };
+    for (int i = 0; i < 3; i++) {
+        if (!db_config.contains(QLatin1String(names[i]))) continue;
+        int days = qMax(db_config.value(QLatin1String(names[i])).toInt(), 0);
+        if (days == *tiers[i]) continue;
+        if (days && (!*tiers[i] || days < *tiers[i])) reduceTimer()->start(0);
+        *tiers[i] = days;
+    }
+    TRACE_ARG(keep_days << keep_ten_minutes << keep_hourly << keep_daily << reduce_at);
+}
+
+void SqliteProducer::reduce()
+{
+    TRACE();
+
+    if (keep_days < 1) return;
+
+    commitRows();
+
+    if (conn_name.isEmpty()) {
+        TRACE_ARG("Not started");
+        return;
+    }
+    QSqlDatabase db = QSqlDatabase::database(conn_name);
+    if (!db.isValid()) {
+        TRACE_ARG("Not ready");
+        return;
+    }
+    if (!openDb(db)) {
+        TRACE_ARG(db.lastError().text());
+        emit errorOccurred(db.lastError().text());
+        return;
+    }
+    // The tiers are counted back from now; the rows of the main file are deleted, the
+    // partition tables are dropped once their month is entirely out of the tier and the
+    // file is removed when nothing is left to keep
+    const QDate today = QDate::currentDate();
+    for (int i = retain_tasks.size() - 1; i >= 0; i--) { // the backfill goes on first
+        if (retain_tasks.at(i).action != RetainBackfill) retain_tasks.removeAt(i);
+    }
+    for (const auto &table : legacy_tables) {
+        for (int step : retainSteps) {
+            int days = keepDays(step);
+            if (days < 1) continue;
+            qint64 cutoff = QDateTime::currentDateTime().addDays(-days).toSecsSinceEpoch();
+            retain_tasks.append({ RetainDelete, QDate(), step, cutoff, step ? rollupName(table, step) : table });
+        }
+    }
+    const auto files = partitionFiles(db_filepath);
+    for (auto it = files.constBegin(); it != files.constEnd(); ++it) {
+        QList<int> expired;
+        for (int step : retainSteps) {
+            int days = keepDays(step);
+            if (days > 0 && it.key().addMonths(1) <= today.addDays(-days)) expired.append(step);
+        }
+        // the minute rows of a closed month are kept packed by the project days
+        if (!expired.contains(0) && it.key() < partitionMonth(QDateTime::currentSecsSinceEpoch()))
+            retain_tasks.append({ RetainPack, it.key(), 0, 0, QString() });
+        if (expired.isEmpty()) continue;
+        if (expired.size() == int(sizeof(retainSteps) / sizeof(retainSteps[0]))) {
+            retain_tasks.append({ RetainUnlink, it.key(), 0, 0, QString() });
+            continue;
+        }
+        for (int step : expired) {
+            retain_tasks.append({ RetainDrop, it.key(), step, 0, QString() });
+        }
+        retain_tasks.append({ RetainVacuum, it.key(), 0, 0, QString() });
+    }
+    retain_rows = retain_drops = retain_packed = 0;
+    retain_clock.start();
+    retainSlice();
+
+    if (!reduce_at.isEmpty()) {
+        int msec = millisecondsTo(reduce_at);
+        TRACE_ARG("Next time" << QTime(0,0).addMSecs(msec).toString());
+        reduceTimer()->start(msec);
+    }
+}
+
+void SqliteProducer::retainNow(int keepDays)
+{
+    TRACE_ARG(keepDays);
+
+    const int keep = keep_days;
+    keep_days = qMax(1, keepDays);
+    reduce();
+    keep_days = keep;
+    // a slice left unfinished restarts the timer, a failed one clears the tasks
+    while (!retain_tasks.isEmpty() && retain_timer && retain_timer->isActive()) retainSlice();
+    if (retain_timer) retain_timer->stop();
+}
+
+int SqliteProducer::keepDays(int step) const
+{
+    switch (step) {
+    case 0:             return keep_days;
+    case RollupMinutes: return keep_ten_minutes;
+    case RollupHour:    return keep_hourly;
+    case RollupDay:     return keep_daily;
+    }
+    return 0;
+}
+
+// Apply the retention in slices of RetainBudget milliseconds, the queued inserts are
+// processed in the RetainPause between the slices
+void SqliteProducer::retainSlice()
+{
+    if (conn_name.isEmpty()) return;
+    QSqlDatabase db = QSqlDatabase::database(conn_name);
+    if (!db.isValid() || !openDb(db)) return;
+
+    QElapsedTimer slice;
+    slice.start();
+    while (!retain_tasks.isEmpty() && slice.elapsed() < RetainBudget) {
+        bool done = true;
+        if (!retain(db, retain_tasks.first(), done)) {
+            TRACE_ARG(db.lastError().text());
+            emit errorOccurred(db.lastError().text());
+            retain_tasks.clear();
+            return;
+        }
+        if (done) retain_tasks.removeFirst();
+    }
+    if (!retain_tasks.isEmpty()) {
+        retainTimer()->start(RetainPause);
+        return;
+    }
+    qInfo() << "Retention deleted" << retain_rows << "rows, dropped" << retain_drops
+            << "tables and packed" << retain_packed << "rows in" << retain_clock.elapsed() << "ms";
+    if (!legacy_tables.isEmpty() && !full_vacuum) { // until then fullVacuum() reclaims the pages
+        vacuum_pages = freelistCount(db);
+        vacuum_clock.start();
+        if (vacuum_pages > 0) incrementalVacuum();
+    }
+    if (retain_rows || retain_drops) emit dataChanged(QString(), 0, 0);
+}
+
+// One bounded step of a retention task, done is false when the task has more to do
+bool SqliteProducer::retain(QSqlDatabase &db, RetainTask &task, bool &done)
+{
+    done = true;
+    const QString schema = task.month.isValid() ? partitionSchema(task.month) : QStringLiteral("main");
+    if (task.action == RetainUnlink) {
+        const QString path = partitionPath(db_filepath, task.month);
+        bool unsynced = false;
+        if (!attachPartition(db, task.month) || !unsyncedRows(db, schema, unsynced)) return false;
+        if (unsynced) { // the expired month waits for the upload, the next reduce() tries again
+            qInfo() << "Postponed" << path << "with the rows not uploaded yet";
+            return true;
+        }
+        detachPartition(db, schema);
+        if (!QFile::remove(path)) { // still open by a reader on Windows, try next time
+            TRACE_ARG("Can't remove" << path);
+            return true;
+        }
+        QFile::remove(path + QLatin1String("-wal"));
+        QFile::remove(path + QLatin1String("-shm"));
+        qInfo() << "Expired" << path;
+        retain_drops++;
+        return true;
+    }
+    if (task.month.isValid() && !attachPartition(db, task.month)) return false;
+
+    QSqlQuery sql(db);
+    switch (task.action) {
+    case RetainDelete: {
+        const QString ref = tableRef(schema, task.table);
+        const QString column = task.step ? QStringLiteral("BucketTime") : QStringLiteral("LocalTime");
+        const QString synced = task.step || !tableColumns(db, schema, task.table).contains(columnName(SyncState))
+                             ? QString() : QStringLiteral(" AND SyncState IS NULL");
+        bool ta = db.transaction();
+        bool ok = sql.exec(QString(sqlRetainDelete).arg(ref, column).arg(task.cutoff).arg(RetainRows).arg(synced));
+        int rows = ok ? sql.numRowsAffected() : 0;
+        if (ta) {
+            if (ok) ok = db.commit();
+            else db.rollback();
+        }
+        retain_rows += rows;
+        done = (rows < RetainRows);
+        return ok;
+    }
+    case RetainDrop: {
+        bool unsynced = false;
+        if (!task.step && !unsyncedRows(db, schema, unsynced)) return false;
+        if (unsynced) { // the minute rows wait for the upload, the next reduce() tries again
+            qInfo() << "Postponed" << schema << "with the rows not uploaded yet";
+            return true;
+        }
+        QStringList names;
+        if (sql.exec(QString(sqlSchemaTables).arg(schema))) {
+            while (sql.next()) names.append(sql.value(0).toString());
+        }
+        sql.finish();
+        const QString suffix = QLatin1String(rollupSeparator) + QString::number(task.step);
+        for (const auto &name : names) {
+            if (task.step ? !name.endsWith(suffix) : (isRollup(name) || isInternal(name))) continue;
+            // the rollups of an older partition are summed up before their rows go
+            if (!task.step && !prepareTable(db, schema, name)) return false;
+            const QString ref = tableRef(schema, name);
+            insert_queries.remove(ref);
+            ready_tables.removeAll(ref);
+            if (encoded_tables.removeAll(ref)) {
+                if (!sql.exec(QString(sqlDropView).arg(ref)) ||
+                    !sql.exec(QString(sqlDropTable).arg(tableRef(schema, rowsName(name)))) ||
+                    !sql.exec(QString(sqlDropTable).arg(tableRef(schema, plainName(name)))) ||
+                    !sql.exec(QString(sqlDropTable).arg(tableRef(schema, packedName(name)))) ||
+                    !sql.exec(QString(sqlDropTable).arg(tableRef(schema, signedName(name))))) return false;
+                signed_until.remove(tableRef(schema, signedName(name)));
+            } else if (!sql.exec(QString(sqlDropTable).arg(ref))) {
+                return false;
+            }
+            retain_drops++;
+        }
+        return true;
+    }
+    case RetainPack: {
+        QStringList names;
+        if (sql.exec(QString(sqlSchemaTables).arg(schema))) {
+            while (sql.next()) names.append(sql.value(0).toString());
+        }
+        sql.finish();
+        QStringList tables; // the encoded ones, the plain tables are packed once migrated
+        for (const auto &name : names) {
+            if (names.contains(rowsName(name)) && !names.contains(plainName(name))) tables.append(name);
+        }
+        tables.sort();
+        if (task.step >= tables.size()) return true;
+        if (!pack(db, schema, tables.at(task.step), task.cutoff)) return false;
+        if (!task.cutoff) task.step++;
+        done = (task.step >= tables.size());
+        return true;
+    }
+    case RetainBackfill: {
+        // The buckets from the cursor up to the one of the RetainRows-th row are summed up
+        // again, including the rows the triggers added meanwhile; the rest on the last step
+        const QString ref = tableRef(schema, rollupName(task.table, task.step));
+        const QString source = tableRef(schema, task.table);
+        qint64 to = 0;
+        if (!sql.exec(QString(sqlBackfillEnd).arg(source).arg(task.cutoff).arg(RetainRows)
+                      .arg(rollupBucketSql(task.step, QStringLiteral("LocalTime")),
+                           rollupBucketSql(task.step, QString("(LocalTime+%1)").arg(task.step))))) return false;
+        if (sql.next()) {
+            to = sql.value(0).toLongLong();
+            if (to <= task.cutoff) to = sql.value(1).toLongLong(); // a bucket of more than RetainRows rows
+        }
+        sql.finish();
+        QString rows = QString("LocalTime >= %1").arg(task.cutoff);
+        QString buckets = QString("BucketTime >= %1").arg(task.cutoff);
+        if (to) {
+            rows += QString(" AND LocalTime < %1").arg(to);
+            buckets += QString(" AND BucketTime < %1").arg(to);
+        }
+        bool ta = db.transaction();
+        bool ok = sql.exec(QString(sqlRollupClear).arg(ref, buckets)) &&
+                  sql.exec(QString(sqlRollupFill).arg(ref, source, rollupBucketSql(task.step, QStringLiteral("LocalTime")),
+                                                      activeSecondsSql(QStringLiteral("ActiveMask")), rows,
+                                                      ActivitySchema::counters("SUM(IFNULL(%1,0))"))) &&
+                  sql.exec(to ? QString(sqlBackfillUpdate).arg(ref).arg(to) : QString(sqlBackfillDelete).arg(ref));
+        if (ta) {
+            if (ok) ok = db.commit();
+            else db.rollback();
+        }
+        if (!ok) return false;
+        task.cutoff = to;
+        done = !to;
+        if (done) {
+            {
+                QMutexLocker locker(&backfill_mutex);
+                backfill_rollups.removeAll(rollupName(task.table, task.step));
+            }
+            qInfo() << "Backfilled" << ref << "in" << retain_clock.elapsed() << "ms";
+            emit dataChanged(task.table, 0, 0);
+        }
+        return true;
+    }
+    case RetainVacuum:
+        if (!sql.exec(QString(sqlAutoVacuum).arg(schema)) || !sql.next() || sql.value(0).toInt() != 2)
+            return true; // the partitions of the older versions
+        sql.finish();
+        if (!sql.exec(QString(sqlIncrementalVacuum).arg(schema).arg(VacuumPages))) return false;
+        while (sql.next()) {} // a page is released per step
+        sql.finish();
+        done = (freelistCount(db, schema) == 0);
+        return true;
+    default:
+        break;
+    }
+    return true;
+}
+
+// Whether any activity table of the schema has the rows not uploaded yet, the partition
+// holding them is not dropped nor removed
+bool SqliteProducer::unsyncedRows(QSqlDatabase &db, const QString &schema, bool &found)
+{
+    found = false;
+    QStringList names;
+    QSqlQuery sql(db);
+    if (!sql.exec(QString(sqlSchemaTables).arg(schema))) return false;
+    while (sql.next()) names.append(sql.value(0).toString());
+    sql.finish();
+    for (const auto &name : names) {
+        if (isRollup(name) || isInternal(name) ||
+            !tableColumns(db, schema, name).contains(columnName(SyncState))) continue;
+        if (!sql.exec(QString(sqlRetainUnsynced).arg(tableRef(schema, name)))) return false;
+        found = sql.next();
+        sql.finish();
+        if (found) return true;
+    }
+    return true;
+}
+
+// Move the minute rows of the day starting at the cursor into the packed project days, the
+// cursor is the next day then or 0 when the table has nothing more to pack. The rollups stay
+// as they are; the project days with the rows not confirmed by the server yet are left, and
+// so are the broken chains and the whole days with a broken signature for the verifier. The
+// ChainHash seals the packed rows of a day and the signature of the day is renewed over it.
+bool SqliteProducer::pack(QSqlDatabase &db, const QString &schema, const QString &table, qint64 &cursor)
+{
+    if (!prepareChain(db, schema, table)) return false;
+    QSqlQuery sql(db);
+    const QString rows = tableRef(schema, rowsName(table));
+    if (!sql.exec(QString(sqlPackFirst).arg(rows).arg(cursor)) || !sql.next()) return false;
+    const QDate date = sql.value(0).isNull() ? QDate() : QDateTime::fromSecsSinceEpoch(sql.value(0).toLongLong()).date();
+    sql.finish();
+    if (!date.isValid() || date >= QDate::currentDate()) {
+        cursor = 0;
+        return true;
+    }
+    const qint64 from = date.startOfDay().toSecsSinceEpoch();
+    const qint64 to = date.addDays(1).startOfDay().toSecsSinceEpoch();
+    DaySignature state;
+    if (!signClosedDays(db, schema, table) || !daySignature(db, schema, table, from, state)) return false;
+    if (state == DayBroken) {
+        qWarning() << "Broken signature" << rows << from << "the day is not packed";
+        cursor = to;
+        return true;
+    }
+
+    const QString projects = tableRef(schema, QLatin1String(dataBaseProjects));
+    const QByteArray seed = ActivityChain::seed(table);
+    QMap<QString,QVector<ActivityPack::Row>> days;
+    QHash<QString,QByteArray> heads; // the stored chains so far
+    QStringList pending;
+    if (!sql.exec(QString(sqlPackRows).arg(rows, ActivitySchema::viewColumns(), ActivitySchema::viewJoins(schema))
+                  .arg(from).arg(to))) return false;
+    while (sql.next()) {
+        const QString project = sql.value(ProjectId).toString();
+        if ((sql.value(ServerStatus).isNull() || !sql.value(SyncState).isNull()) && !pending.contains(project)) {
+            pending.append(project);
+        }
+        const ActivityPack::Row row = { sql.value(LocalTime).toLongLong(), sql.value(KeyPresses).toLongLong(),
+                                        sql.value(MouseClicks).toLongLong(), sql.value(MouseDistance).toLongLong(),
+                                        sql.value(ActiveMask).toLongLong(), sql.value(TextNote).toString(),
+                                        sql.value(ServerStatus).toString() };
+        const QByteArray stored = sql.value(TotalColumns).toByteArray();
+        if (!stored.isEmpty()) {
+            auto head = heads.find(project);
+            if (head == heads.end()) head = heads.insert(project, seed);
+            if (ActivityChain::rowHash(head.value(), row.localTime, project, row.textNote, row.keyPresses,
+                                       row.mouseClicks, row.mouseDistance, row.activeMask) != stored &&
+                !pending.contains(project)) {
+                qWarning() << "Broken chain" << rows << project << row.localTime;
+                pending.append(project);
+            }
+            head.value() = stored;
+        }
+        days[project].append(row);
+    }
+    sql.finish();
+    for (const auto &project : pending) days.remove(project);
+
+    const QString packed = tableRef(schema, packedName(table));
+    bool ta = db.transaction();
+    bool ok = sql.exec(QString(sqlPackedCreate).arg(packed));
+    for (auto it = days.begin(); it != days.end() && ok; ++it) {
+        QVector<ActivityPack::Row> &day = it.value();
+        // a day packed before gets the rows written later, if any
+        ok = sql.prepare(QString(sqlPackedSelect).arg(packed));
+        sql.bindValue(":DayTime", from);
+        sql.bindValue(":ProjectId", it.key());
+        if (ok && sql.exec() && sql.next() && ActivityPack::unpack(from, sql.value(0).toByteArray(), day)) {
+            std::sort(day.begin(), day.end(), [](const ActivityPack::Row &a, const ActivityPack::Row &b) {
+                return a.localTime < b.localTime;
+            });
+        }
+        sql.finish();
+        ok = ok && sql.prepare(QString(sqlPackedInsert).arg(packed));
+        if (!ok) break;
+        sql.bindValue(":DayTime", from);
+        sql.bindValue(":ProjectId", it.key());
+        sql.bindValue(":RowCount", day.size());
+        sql.bindValue(":LastTime", day.last().localTime);
+        sql.bindValue(":Data", ActivityPack::pack(from, day));
+        QByteArray chain = seed;
+        for (const auto &row : day) {
+            chain = ActivityChain::rowHash(chain, row.localTime, it.key(), row.textNote, row.keyPresses,
+                                           row.mouseClicks, row.mouseDistance, row.activeMask);
+        }
+        sql.bindValue(":ChainHash", chain);
+        ok = sql.exec() && sql.prepare(QString(sqlPackDelete).arg(rows).arg(from).arg(to).arg(projects));
+        if (!ok) break;
+        sql.bindValue(":ProjectId", it.key());
+        ok = sql.exec();
+        retain_packed += sql.numRowsAffected();
+    }
+    if (ok && state == DaySigned) ok = signDays(db, schema, table, from, to); // the packed heads
+    if (ta) {
+        if (ok) ok = db.commit();
+        else db.rollback();
+    }
+    chain_heads.clear(); // a late row of the day starts over
+    cursor = to;
+    return ok;
+}
+
+int SqliteProducer::userVersion(QSqlDatabase &db, const QString &schema)
+{
+    QSqlQuery sql(db);
+    return (sql.exec(QString(sqlUserVersion).arg(schema)) && sql.next()) ? sql.value(0).toInt() : 0;
+}
+
+// Bring the partition files up to PartitionVersion by one bounded step per slice, the queued
+// inserts are processed in the MigratePause between the slices. A step commits its progress
+// together with the data, so the migration resumes where it stopped after a restart.
+void SqliteProducer::migrateSlice()
+{
+    if (conn_name.isEmpty()) return;
+    QSqlDatabase db = QSqlDatabase::database(conn_name);
+    if (!db.isValid()) return;
+    if (!openDb(db)) {
+        TRACE_ARG(db.lastError().text());
+        emit errorOccurred(db.lastError().text());
+        return;
+    }
+    while (!migrate_months.isEmpty()) {
+        const QDate month = migrate_months.first();
+        if (!QFile::exists(partitionPath(db_filepath, month))) { // expired meanwhile
+            migrate_months.removeFirst();
+            continue;
+        }
+        bool done = true;
+        bool ok = attachPartition(db, month);
+        const QString schema = partitionSchema(month);
+        int version = ok ? userVersion(db, schema) : 0;
+        if (ok && version >= PartitionVersion) {
+            migrate_months.removeFirst();
+            continue;
+        }
+        if (!ok || !migrate(db, schema, version + 1, done)) {
+            TRACE_ARG(schema << db.lastError().text());
+            emit errorOccurred(db.lastError().text());
+            migrate_months.clear();
+            return;
+        }
+        if (done) qInfo() << "Migrated" << partitionPath(db_filepath, month) << "to version" << version + 1;
+        break;
+    }
+    if (!migrate_months.isEmpty()) {
+        migrate_timer->start(MigratePause);
+        return;
+    }
+    if (migrate_rows) qInfo() << "Migration moved" << migrate_rows << "rows in" << migrate_clock.elapsed() << "ms";
+}
+
+// One step towards the version in its own transaction, the version is set with the last one
+bool SqliteProducer::migrate(QSqlDatabase &db, const QString &schema, int version, bool &done)
+{
+    done = true;
+    bool ta = db.transaction();
+    bool ok = true;
+    switch (version) {
+    case 1:
+        ok = migrateEncoding(db, schema, done);
+        break;
+    case 2:
+        ok = migrateSync(db, schema);
+        break;
+    case 3:
+        ok = migrateChain(db, schema);
+        break;
+    default:
+        break;
+    }
+    if (ok && done) {
+        QSqlQuery sql(db);
+        ok = sql.exec(QString(sqlUserVersionSet).arg(schema).arg(version));
+    }
+    if (ta) {
+        if (ok) ok = db.commit();
+        else db.rollback();
+    }
+    return ok;
+}
+
+// The plain tables written before the dictionaries are renamed aside and the view named as
+// the table reads both while the rows are moved by MigrateRows. The delete trigger of the
+// plain table takes the moved rows out of the rollups, the rows table puts them back in.
+bool SqliteProducer::migrateEncoding(QSqlDatabase &db, const QString &schema, bool &done)
+{
+    QStringList names;
+    QSqlQuery sql(db);
+    if (sql.exec(QString(sqlSchemaTables).arg(schema))) {
+        while (sql.next()) names.append(sql.value(0).toString());
+    }
+    sql.finish();
+    const QString projects = tableRef(schema, QLatin1String(dataBaseProjects));
+    const QString notes = tableRef(schema, QLatin1String(dataBaseNotes));
+    for (const auto &name : names) {
+        if (isRollup(name) || isInternal(name)) continue;
+        const QString ref = tableRef(schema, name);
+        const QString rows = rowsName(name);
+        const QString plain = plainName(name);
+        if (names.contains(plain)) {
+            done = false;
+            // renamed aside by the version without the SyncState or the RowHash
+            if (!prepareSync(db, schema, plain) || !prepareSync(db, schema, rows) ||
+                !prepareChain(db, schema, name)) return false;
+            const QString chunk = QString(sqlMigrateChunk).arg(tableRef(schema, plain)).arg(MigrateRows);
+            if (!sql.exec(QString(sqlMigrateIntern).arg(projects, QStringLiteral("ProjectId"), chunk,
+                                                        QStringLiteral("IS NOT NULL"))) ||
+                !sql.exec(QString(sqlMigrateIntern).arg(notes, QStringLiteral("TextNote"), chunk,
+                                                        QStringLiteral("<>''"))) ||
+                !sql.exec(QString(sqlMigrateInsert).arg(tableRef(schema, rows), ActivitySchema::names(true),
+                                                        ActivitySchema::encodeValues(schema), chunk,
+                                                        ActivitySchema::mergeSql(true, false))) ||
+                !sql.exec(QString(sqlMigrateDelete).arg(tableRef(schema, plain), chunk))) return false;
+            int moved = sql.numRowsAffected();
+            migrate_rows += moved;
+            chain_last.remove(tableRef(schema, rows)); // the moved rows are unchained, may be the last ones
+            if (moved >= MigrateRows) return true;
+            // all moved, the view reads the rows table alone
+            return sql.exec(QString(sqlDropView).arg(ref)) &&
+                   sql.exec(QString(sqlDropTable).arg(tableRef(schema, plain))) &&
+                   sql.exec(QString(sqlRowsViewCreate).arg(schema, name, rows, ActivitySchema::viewColumns(),
+                                                           ActivitySchema::viewJoins()));
+        }
+        if (names.contains(rows)) continue;
+
+        done = false;
+        if (!prepareTable(db, schema, name)) return false; // the ActiveMask and the rollups
+        insert_queries.remove(ref);
+        ready_tables.removeAll(ref);
+        encoded_tables.removeAll(ref);
+        QString removes;
+        for (int step : rollupSteps) {
+            removes += QString(sqlRollupRemove).arg(rollupName(name, step),
+                                                    rollupBucketSql(step, QStringLiteral("OLD.LocalTime")),
+                                                    activeSecondsSql(QStringLiteral("OLD.ActiveMask")),
+                                                    QStringLiteral("OLD.ProjectId"),
+                                                    ActivitySchema::counters("%1=%1-IFNULL(OLD.%1,0)"));
+        }
+        const QString prefix = name + QLatin1String(rollupSeparator);
+        return sql.exec(QString(sqlTableRename).arg(ref, plain)) &&
+               sql.exec(QString(sqlDropTrigger).arg(tableRef(schema, prefix + QLatin1String("insert")))) &&
+               sql.exec(QString(sqlDropTrigger).arg(tableRef(schema, prefix + QLatin1String("update")))) &&
+               sql.exec(QString(sqlRollupDeleteTrigger).arg(schema, prefix + QLatin1String("delete"), plain, removes)) &&
+               sql.exec(QString(sqlDictionaryCreate).arg(projects)) &&
+               sql.exec(QString(sqlDictionaryCreate).arg(notes)) &&
+               sql.exec(QString(sqlRowsCreate).arg(tableRef(schema, rows), ActivitySchema::definitions(true))) &&
+               sql.exec(QString(sqlRowsViewCreate).arg(schema, name, rows, ActivitySchema::viewColumns(),
+                                                       ActivitySchema::viewJoins()) +
+                        QString(sqlPlainUnion).arg(plain, ActivitySchema::names())) &&
+               prepareRollups(db, schema, name, true, false);
+    }
+    return true;
+}
+
+// The SyncState column and its partial index in the rows tables, the views get the column
+bool SqliteProducer::migrateSync(QSqlDatabase &db, const QString &schema)
+{
+    QStringList names;
+    QSqlQuery sql(db);
+    if (sql.exec(QString(sqlSchemaTables).arg(schema))) {
+        while (sql.next()) names.append(sql.value(0).toString());
+    }
+    sql.finish();
+    for (const auto &name : names) {
+        if (isRollup(name) || isInternal(name)) continue;
+        const QString rows = rowsName(name);
+        if (!names.contains(rows)) {
+            if (!prepareSync(db, schema, name)) return false;
+            continue;
+        }
+        if (!prepareSync(db, schema, rows)) return false;
+        if (tableColumns(db, schema, name).size() >= TotalColumns) continue;
+        if (!sql.exec(QString(sqlDropView).arg(tableRef(schema, name))) ||
+            !sql.exec(QString(sqlRowsViewCreate).arg(schema, name, rows, ActivitySchema::viewColumns(),
+                                                     ActivitySchema::viewJoins()))) return false;
+    }
+    return true;
+}
+
+// The RowHash column in the rows tables and the ChainHash in the packed days
+bool SqliteProducer::migrateChain(QSqlDatabase &db, const QString &schema)
+{
+    QStringList names;
+    QSqlQuery sql(db);
+    if (sql.exec(QString(sqlSchemaTables).arg(schema))) {
+        while (sql.next()) names.append(sql.value(0).toString());
+    }
+    sql.finish();
+    for (const auto &name : names) {
+        if (isRollup(name) || isInternal(name)) continue;
+        if (!prepareChain(db, schema, name)) return false;
+    }
+    return true;
+}
+
+// static
+QDate SqliteProducer::partitionMonth(qint64 localTime)
+{
+    QDate date = QDateTime::fromSecsSinceEpoch(localTime).date();
+    return QDate(date.year(), date.month(), 1);
+}
+
+// static
+QString SqliteProducer::partitionSchema(const QDate &month)
+{
+    return month.toString(QStringLiteral("'m'yyyyMM"));
+}
+
+// static
+QString SqliteProducer::partitionPath(const QString &filepath, const QDate &month)
+{
+    QFileInfo info(filepath);
+    return info.dir().filePath(info.completeBaseName() + month.toString(QLatin1String(partitionFormat))
+                               + '.' + info.suffix());
+}
+
+// static
+QMap<QDate,QString> SqliteProducer::partitionFiles(const QString &filepath)
+{
+    QMap<QDate,QString> files;
+    QFileInfo info(filepath);
+    const QString base = info.completeBaseName();
+    const QString pattern = base + QLatin1String("-????-??.") + info.suffix();
+    const auto names = info.dir().entryList(QStringList(pattern), QDir::Files);
+    for (const auto &name : names) {
+        QDate month = QDate::fromString(name.mid(base.size(), 8), QLatin1String(partitionFormat));
+        if (month.isValid()) files.insert(month, info.dir().filePath(name));
+    }
+    return files;
+}
+
+// static
+QString SqliteProducer::tableRef(const QString &schema, const QString &table)
+{
+    return QString("%1.'%2'").arg(schema, table);
+}
+
+// static
+QString SqliteProducer::rollupName(const QString &table, int step)
+{
+    return table + QLatin1String(rollupSeparator) + QString::number(step);
+}
+
+// static
+bool SqliteProducer::isRollup(const QString &table)
+{
+    return table.contains(QLatin1String(rollupSeparator));
+}
+
+// static
+bool SqliteProducer::namesTable(const QString &query, const QString &table, bool rollups)
+{
+    auto nameChar = [](QChar c) { return c.isLetterOrNumber() || c == QLatin1Char('_'); };
+    for (int i = query.indexOf(table); i >= 0; i = query.indexOf(table, i + 1)) {
+        int end = i + table.size();
+        if (i > 0 && nameChar(query.at(i - 1))) continue;
+        if (end >= query.size()) return true;
+        if (query.at(end) == QLatin1Char(*rollupSeparator)) {
+            if (rollups) return true;
+        } else if (!nameChar(query.at(end))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// static
+QString SqliteProducer::rowsName(const QString &table)
+{
+    return table + QLatin1String(rowsSuffix);
+}
+
+// static
+QString SqliteProducer::plainName(const QString &table)
+{
+    return table + QLatin1String(plainSuffix);
+}
+
+// static
+QString SqliteProducer::packedName(const QString &table)
+{
+    return table + QLatin1String(packedSuffix);
+}
+
+// static
+QString SqliteProducer::signedName(const QString &table)
+{
+    return table + QLatin1String(signedSuffix);
+}
+
+// static
+// The dictionaries, the rows, the plain and the packed tables are read through the views only,
+// the signatures by the verifier
+bool SqliteProducer::isInternal(const QString &table)
+{
+    return table == QLatin1String(dataBaseProjects) || table == QLatin1String(dataBaseNotes) ||
+           table.endsWith(QLatin1String(rowsSuffix)) || table.endsWith(QLatin1String(plainSuffix)) ||
+           table.endsWith(QLatin1String(packedSuffix)) || table.endsWith(QLatin1String(signedSuffix));
+}
+
+// static
+// The coarsest rollup answering the buckets of the seconds and not being backfilled, the
+// table itself otherwise; the day buckets are also added up to the weeks, months and years
+QString SqliteProducer::rollupTable(const QString &table, int bucket)
+{
+    if (table.isEmpty() || isRollup(table) || bucket <= 0) return table;
+    QMutexLocker locker(&backfill_mutex);
+    for (int i = int(sizeof(rollupSteps) / sizeof(rollupSteps[0])) - 1; i >= 0; i--) {
+        const QString rollup = rollupName(table, rollupSteps[i]);
+        if (bucket % rollupSteps[i] == 0 && !backfill_rollups.contains(rollup)) return rollup;
+    }
+    return table;
+}
+
+// static
+QString SqliteProducer::rollupBucketSql(int step, const QString &column)
+{
+    if (step == RollupDay) {
+        return QString("CAST(strftime('%s', %1, 'unixepoch', 'localtime', 'start of day', 'utc') AS INTEGER)").arg(column);
+    }
+    return QString("%1/%2*%2").arg(column).arg(step);
+}
+
+// static
+// The SQL expression counting the bits set in the activity mask column, SQLite has no
+// popcount. The mask uses 60 bits at most, so it stays positive and the SWAR steps
+// don't overflow; the byte sums are added up by the modulo 255.
+QString SqliteProducer::activeSecondsSql(const QString &column)
+{
+    const QString a = QString("(%1 - ((%1 >> 1) & 0x5555555555555555))").arg(column);
+    const QString b = QString("((%1 & 0x3333333333333333) + ((%1 >> 2) & 0x3333333333333333))").arg(a);
+    return QString("(((%1 + (%1 >> 4)) & 0x0F0F0F0F0F0F0F0F) % 255)").arg(b);
 }
 
 // static
 QString SqliteProducer::columnName(int column)
 {
-    return (column >= 0 && column < TotalColumns) ? dataBaseColumn[column] : QString();
+    return (column >= 0 && column < TotalColumns) ? QString(QLatin1String(ActivitySchema::columns[column].name)) : QString();
 }
 
 // static
@@ -397,7 +2388,7 @@ int SqliteProducer::columnIndex(const QString &name)
 {
     if (!name.isEmpty()) {
         for (int i = 0; i < TotalColumns; i++) {
-            if (name == dataBaseColumn[i]) return i;
+            if (name == QLatin1String(ActivitySchema::columns[i].name)) return i;
         }
     }
     return -1;
@@ -408,7 +2399,7 @@ QMap<QString,int> SqliteProducer::columnMap()
 {
     QMap<QString,int> map;
     for (int i = 0; i < TotalColumns; i++) {
-        map.insert(QLatin1String(dataBaseColumn[i]), i);
+        map.insert(QLatin1String(ActivitySchema::columns[i].name), i);
     }
     return map;
 }
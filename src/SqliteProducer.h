@@ -3,11 +3,22 @@
 
 #include <QObject>
 #include <QMap>
+#include <QHash>
+#include <QVector>
 #include <QVariantMap>
+#include <QDate>
+#include <QSharedPointer>
+#include <QElapsedTimer>
 
+#include "ActivityChain.h"
+#include "ActivityRecord.h"
+#include "ActivitySchema.h"
 #include "BaseThread.h"
+#include "LatencyHistogram.h"
 
-class ActivityRecord;
+class QSqlDatabase;
+class QSqlQuery;
+class QSqlError;
 class QTimer;
 
 typedef QMap<qint64,QString> ServerStatusMap;
@@ -22,23 +33,112 @@ public:
     static constexpr char const *dataBaseConfig = "ConfigHistory";
     static constexpr char const *dataBaseReduce = "23:59:55";
     static constexpr char const *sqlConfigQuery = "SELECT * FROM Config";
+    static constexpr char const *partitionFormat = "-yyyy-MM"; // ActivityTrack-2026-10.db
+    static constexpr char const *rollupSeparator = "@"; // the rollup of 0x1234 by hour is 0x1234@3600
+    static constexpr char const *rowsSuffix       = "#rows"; // the dictionary encoded rows behind the view
+    static constexpr char const *plainSuffix      = "#plain"; // the plain rows not migrated yet
+    static constexpr char const *packedSuffix     = "#packed"; // the project days of the closed months
+    static constexpr char const *signedSuffix     = "#signed"; // the signatures of the chain heads of the closed days
+    static constexpr char const *spillSuffix      = "-spill"; // the journal of the records not committed yet
+    static constexpr char const *syncSuffix       = "#unsent"; // the partial index of the rows to upload
+    static constexpr char const *syncLegacySuffix = "#unsynced"; // the index of SyncState=1 alone, dropped
+    static constexpr char const *statusTable      = "StatusUpdate"; // the temp table of the statuses to apply
 
-    static constexpr char const *dataBaseColumn[] = {
-        "LocalTime", "ProjectId", "TextNote", "KeyPresses", "MouseClicks", "MouseDistance", "ServerStatus"
-    };
+    // the indexes of ActivitySchema::columns for the QML, checked at the compile time
     enum DataBaseColumn {
         LocalTime, ProjectId, TextNote, KeyPresses, MouseClicks, MouseDistance, ServerStatus,
+        ActiveMask, // appended by ALTER TABLE to the tables of the older versions
+        SyncState,  // DataBaseSync, NULL once uploaded; appended by ALTER TABLE as well
         TotalColumns
     };
     Q_ENUM(DataBaseColumn)
 
+    static constexpr char const *dataBaseProjects = ActivitySchema::columns[ProjectId].dictionary;
+    static constexpr char const *dataBaseNotes    = ActivitySchema::columns[TextNote].dictionary;
+
     enum DataBaseConfig {
         HistoryOn = 1,   // used as boolean 0=false, 1=true
         TimeStep  = 1,   // default time step in minutes
-        KeepDays  = 365, // default max size in days
+        KeepDays  = 365, // default days the minute rows are kept
+        Synchronous = 1, // default PRAGMA synchronous: 0=OFF, 1=NORMAL, 2=FULL, 3=EXTRA
+        KeepTenMinutes = 365, // default days the 10 minute rollups are kept, 0=forever
+        KeepHourly     = 365, // default days the hourly rollups are kept, 0=forever
+        KeepDaily      = 0    // default days the daily rollups are kept, 0=forever
     };
     Q_ENUM(DataBaseConfig)
 
+    enum DataBaseCommit {
+        CommitWindow = 2000, // default milliseconds the inserted records wait for a group commit
+        CommitCount  = 256   // default number of the records committed immediately
+    };
+    Q_ENUM(DataBaseCommit)
+
+    enum DataBaseSync {
+        SyncUploaded = 0, // the sent rows got by the server, SyncState=NULL
+        SyncPending  = 1, // written or merged since the last upload
+        SyncSending  = 2  // read by the upload in flight, a merge puts the row back to pending
+    };
+    Q_ENUM(DataBaseSync)
+
+    enum DataBaseCheckpoint {
+        CheckpointIdle  = 5000, // milliseconds without writes before the PASSIVE checkpoint
+        CheckpointPages = 4096  // WAL size in pages truncated even when the readers must be waited for
+    };
+    Q_ENUM(DataBaseCheckpoint)
+
+    enum DataBaseVacuum {
+        VacuumPages  = 128, // pages released by one incremental_vacuum statement
+        VacuumBudget = 20,  // milliseconds of one vacuum slice
+        VacuumPause  = 50,  // milliseconds between the slices for the inserts
+        VacuumIdle   = 600000 // milliseconds without writes before the one-time auto_vacuum conversion
+    };
+    Q_ENUM(DataBaseVacuum)
+
+    enum DataBaseRollup {
+        RollupMinutes = 600,  // seconds of the 10 minute buckets
+        RollupHour    = 3600, // seconds of the hourly buckets
+        RollupDay     = 86400 // the daily buckets start at the local midnight
+    };
+    Q_ENUM(DataBaseRollup)
+
+    enum DataBaseRetain {
+        RetainRows   = 2000, // rows of the main file deleted by one statement
+        RetainBudget = 20,   // milliseconds of one retention slice
+        RetainPause  = 50    // milliseconds between the slices for the inserts
+    };
+    Q_ENUM(DataBaseRetain)
+
+    enum DataBaseVersion {
+        MainVersion      = 1, // PRAGMA user_version of the main file: the ConfigHistory columns
+        PartitionVersion = 3  // of the partition files: 1=the dictionary encoded tables, 2=the SyncState, 3=the RowHash
+    };
+    Q_ENUM(DataBaseVersion)
+
+    enum DataBaseMigrate {
+        MigrateRows  = 250,  // rows moved by one migration transaction, a few milliseconds
+        MigrateDelay = 3000, // milliseconds after the start before the first slice
+        MigratePause = 50    // milliseconds between the slices for the inserts
+    };
+    Q_ENUM(DataBaseMigrate)
+
+    enum DataBaseSpill {
+        BusyTimeout = 50,    // milliseconds a statement waits for the lock, then the records are parked
+        SpillRows   = 1440,  // parked records kept in memory, the overflow is appended to the journal
+        ReplayFirst = 500,   // milliseconds before the first replay of the parked records
+        ReplayMax   = 60000  // the replay backoff doubles up to
+    };
+    Q_ENUM(DataBaseSpill)
+
+    enum DataBaseChain {
+        ChainHeads = 1024 // heads of the project day chains kept by the producer, all dropped when full
+    };
+    Q_ENUM(DataBaseChain)
+
+    enum DataBasePartition {
+        PartitionsAttached = 3 // monthly files kept attached by the producer, the least recent is detached
+    };
+    Q_ENUM(DataBasePartition)
+
     explicit SqliteProducer(const QString &filepath, QObject *parent = nullptr);
     ~SqliteProducer();
 
@@ -46,19 +146,125 @@ public:
     static int columnIndex(const QString &name);
     static QMap<QString,int> columnMap();
 
+    // The activity tables live in the monthly partition files next to the main one,
+    // the main file keeps the config and the tables written by the older versions
+    static QDate partitionMonth(qint64 localTime);
+    static QString partitionSchema(const QDate &month);
+    static QString partitionPath(const QString &filepath, const QDate &month);
+    static QMap<QDate,QString> partitionFiles(const QString &filepath);
+    static QString tableRef(const QString &schema, const QString &table);
+
+    // Every activity table has the per project rollups by RollupMinutes, RollupHour and
+    // RollupDay; a query bucketed by a multiple of a step may read the rollup instead
+    static QString rollupName(const QString &table, int step);
+    static bool isRollup(const QString &table);
+    // The table by its whole name in the query, 0x12 is not in 0x1234; with the rollups, the
+    // query naming one of them, 0x1234@600, names the table as well
+    static bool namesTable(const QString &query, const QString &table, bool rollups = false);
+    static QString rollupTable(const QString &table, int bucket);
+    static QString rollupBucketSql(int step, const QString &column);
+    static QString activeSecondsSql(const QString &column);
+
+    // A partition table keeps its ProjectId and TextNote as the ids of the Projects and
+    // Notes dictionaries in the rows table, the view named as the table joins them back
+    static QString rowsName(const QString &table);
+    static QString plainName(const QString &table);
+    static QString packedName(const QString &table);
+    static QString signedName(const QString &table);
+    static bool isInternal(const QString &table);
+
+    // The Ed25519 private key file signing the chain heads of the closed days, set before
+    // start(); without one nothing is signed
+    void setChainKey(const QString &keyPath) { chain_key = keyPath; }
+
+    // Milliseconds from parking the records on a busy or failing database until the replay
+    // committed them; the histogram is lock-free and may be read from any thread
+    const LatencyHistogram &replayLatency() const { return replay_latency; }
+
+    // The whole retention at once in the calling thread, the minute rows are kept keepDays
+    // instead of KeepDays this time; for the callers without the event loop of the slices
+    void retainNow(int keepDays);
+
 public slots:
     void start();
     void configure(const QVariantMap &map);
     void insertRow(const ActivityRecord &record);
+    void insertRows(const QVector<ActivityRecord> &records);
+    void setCommitWindow(int msecs, int count);
+    void commitRows();
+    void checkpoint();
+    void incrementalVacuum();
+    void fullVacuum();
+    void retainSlice();
+    void migrateSlice();
+    void replaySpill();
     void setServerStatus(const QString &tableName, const ServerStatusMap &status);
+    void setSyncState(const QString &tableName, qint64 fromTime, qint64 toTime, int state); // DataBaseSync
 
 signals:
     void configChanged(const QVariantMap &map);
     void errorOccurred(const QString &text);
-    void dataChanged();
+    // the rows of the table between the LocalTime seconds, inclusive, were written or deleted;
+    // the range starts at the local midnight for the daily rollups, an empty table is every
+    // table and 0 is unbound
+    void dataChanged(const QString &table, qint64 fromTime, qint64 toTime);
+    void spillChanged(int queued, int journaled);
+    // setSyncState() is done, the upload reads the SyncSending rows of the range once ok
+    void syncStateChanged(const QString &table, qint64 fromTime, qint64 toTime, int state, bool ok);
 
 private:
+    bool openDb(QSqlDatabase &db);
+    enum RetainAction { RetainDelete, RetainDrop, RetainVacuum, RetainUnlink, RetainPack, RetainBackfill };
+    struct RetainTask {
+        RetainAction action;
+        QDate month;   // the partition, invalid for the main file
+        int step;      // 0 for the activity rows or the rollup step, the table index to pack
+        qint64 cutoff; // the rows before are deleted from the main file, the day to pack next,
+                       // the bucket to backfill next
+        QString table;
+    };
+    int keepDays(int step) const;
+    bool retain(QSqlDatabase &db, RetainTask &task, bool &done);
+    bool unsyncedRows(QSqlDatabase &db, const QString &schema, bool &found);
+    bool pack(QSqlDatabase &db, const QString &schema, const QString &table, qint64 &cursor);
+
+    int userVersion(QSqlDatabase &db, const QString &schema);
+    bool migrate(QSqlDatabase &db, const QString &schema, int version, bool &done);
+    bool migrateEncoding(QSqlDatabase &db, const QString &schema, bool &done);
+    bool migrateSync(QSqlDatabase &db, const QString &schema);
+    bool migrateChain(QSqlDatabase &db, const QString &schema);
+
+    int freelistCount(QSqlDatabase &db, const QString &schema = QStringLiteral("main"));
+    QStringList tableColumns(QSqlDatabase &db, const QString &schema, const QString &table);
+    bool prepareTable(QSqlDatabase &db, const QString &schema, const QString &table, bool backfill = false);
+    bool prepareSync(QSqlDatabase &db, const QString &schema, const QString &source);
+    bool prepareChain(QSqlDatabase &db, const QString &schema, const QString &table);
+    bool prepareRollups(QSqlDatabase &db, const QString &schema, const QString &table, bool encoded, bool backfill);
+    qint64 internId(QSqlDatabase &db, const QString &schema, const char *dictionary, const QString &value);
+    QSqlQuery *insertQuery(QSqlDatabase &db, const QString &schema, const QString &table);
+    ActivityRecord mergeTarget(QSqlDatabase &db, const QString &schema, const ActivityRecord &record, bool &ok);
+    bool chainRow(QSqlDatabase &db, const QString &schema, const ActivityRecord &record, qint64 project,
+                  QByteArray &hash);
+    bool rechainDay(QSqlDatabase &db, const QString &schema, const QString &table, qint64 day, qint64 from);
+    enum DaySignature { DayUnsigned, DaySigned, DayBroken };
+    bool dayHeads(QSqlDatabase &db, const QString &schema, const QString &table, qint64 from, qint64 to,
+                  QMap<qint64,ActivityChain::DayHeads> &days);
+    bool daySignature(QSqlDatabase &db, const QString &schema, const QString &table, qint64 day, DaySignature &state);
+    bool signDays(QSqlDatabase &db, const QString &schema, const QString &table, qint64 from, qint64 to);
+    bool signClosedDays(QSqlDatabase &db, const QString &schema, const QString &table);
+    bool attachPartition(QSqlDatabase &db, const QDate &month);
+    void detachPartition(QSqlDatabase &db, const QString &schema);
+    bool fillStatus(QSqlDatabase &db, const ServerStatusMap &status);
+    bool updateStatus(QSqlDatabase &db, const QString &ref, qint64 fromTime, qint64 toTime);
+    void scheduleCommit();
+    static bool isTransient(const QSqlError &error);
+    void spillRows(const QVector<ActivityRecord> &rows);
+    void scheduleReplay();
+    bool writeJournal(const QVector<ActivityRecord> &rows, int from);
+    int readJournal(QVector<ActivityRecord> &rows);
+    void scheduleCheckpoint();
     QTimer *reduceTimer();
+    QTimer *retainTimer();
     void reconfig();
     void reduce();
 
@@ -66,10 +272,69 @@ private:
     QString db_filepath;
     QString reduce_at;
     int keep_days;
+    int keep_ten_minutes;
+    int keep_hourly;
+    int keep_daily;
     QTimer *reduce_timer;
     QVariantMap db_config;
+    QStringList ready_tables; // "schema.'table'" known to exist with all the columns
+    QStringList encoded_tables; // "schema.'table'" views over the rows tables
+    QHash<QString,QHash<QString,qint64>> intern_ids; // "schema.'dictionary'" -> value -> id
+    QHash<QString,qint64> chain_last; // "schema.'rows'" -> the last LocalTime
+    QHash<QString,QByteArray> chain_heads; // "schema.'rows'/ProjectRef/DayTime" -> the hash of the last row
+    QString chain_key;
+    QByteArray sign_secret; // of the chain key, empty without one
+    QByteArray sign_public;
+    QHash<QString,qint64> signed_until; // "schema.'signed'" -> the day after the last one signed
+    QStringList legacy_tables; // in the main file
+    QStringList attached; // partition schemas, the most recently used last
+
+    int commit_window; // in milliseconds
+    int commit_count;
+    QTimer *commit_timer;
+    QVector<ActivityRecord> pending_rows;
+    QHash<QString,QSharedPointer<QSqlQuery>> insert_queries;
+
+    QVector<ActivityRecord> spill_rows; // parked by the failed commits, the oldest first
+    int spill_journaled; // records in the journal file
+    QTimer *replay_timer;
+    int replay_delay; // in milliseconds, 0 until a replay fails
+    QElapsedTimer spill_clock; // since the first record parked
+    LatencyHistogram replay_latency;
+
+    int synchronous;
+    QTimer *checkpoint_timer;
+
+    bool full_vacuum; // once to switch auto_vacuum to INCREMENTAL
+    QTimer *full_vacuum_timer;
+    QTimer *vacuum_timer;
+    int vacuum_pages;
+    QElapsedTimer vacuum_clock;
+
+    QList<RetainTask> retain_tasks;
+    QTimer *retain_timer;
+    QElapsedTimer retain_clock;
+    int retain_rows;
+    int retain_drops;
+    int retain_packed;
+
+    QList<QDate> migrate_months; // the partitions to check, the oldest first
+    QTimer *migrate_timer;
+    QElapsedTimer migrate_clock;
+    int migrate_rows;
 };
 
+static_assert(SqliteProducer::TotalColumns == ActivitySchema::columnCount, "DataBaseColumn mismatch");
+static_assert(ActivitySchema::indexOf("LocalTime") == SqliteProducer::LocalTime &&
+              ActivitySchema::indexOf("ProjectId") == SqliteProducer::ProjectId &&
+              ActivitySchema::indexOf("TextNote") == SqliteProducer::TextNote &&
+              ActivitySchema::indexOf("KeyPresses") == SqliteProducer::KeyPresses &&
+              ActivitySchema::indexOf("MouseClicks") == SqliteProducer::MouseClicks &&
+              ActivitySchema::indexOf("MouseDistance") == SqliteProducer::MouseDistance &&
+              ActivitySchema::indexOf("ServerStatus") == SqliteProducer::ServerStatus &&
+              ActivitySchema::indexOf("ActiveMask") == SqliteProducer::ActiveMask &&
+              ActivitySchema::indexOf("SyncState") == SqliteProducer::SyncState, "DataBaseColumn mismatch");
+
 class SqliteProducerThread : public BaseThread<SqliteProducer>
 {
     Q_OBJECT
@@ -1,5 +1,6 @@
 #include <QRandomGenerator>
 #include <QFile>
+#include <QtEndian>
 #include <QtDebug>
 
 #ifdef Q_OS_WIN
@@ -314,6 +315,167 @@ static void keypair(unsigned char *pk, const unsigned char *sk) {
     pack(pk, p);
 }
 
+/* --- ed25519 signatures of tweetnacl.c, the detached form */
+
+static const gf
+    gf0 = {0},
+    gf1 = {1},
+    D = {0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070, 0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203},
+    I = {0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43, 0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83};
+
+static const u64 L[32] = {0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+                          0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10};
+
+static int crypto_verify_32(const u8 *x,const u8 *y) {
+    u32 i,d = 0;
+    FOR(i,32) d |= x[i]^y[i];
+    return (1 & ((d - 1) >> 8)) - 1;
+}
+
+static int neq25519(const gf a, const gf b) {
+    u8 c[32],d[32];
+    pack25519(c,a);
+    pack25519(d,b);
+    return crypto_verify_32(c,d);
+}
+
+static void unpack25519(gf o, const u8 *n) {
+    int i;
+    FOR(i,16) o[i]=n[2*i]+((i64)n[2*i+1]<<8);
+    o[15]&=0x7fff;
+}
+
+static void pow2523(gf o,const gf i) {
+    gf c;
+    int a;
+    FOR(a,16) c[a]=i[a];
+    for(a=250;a>=0;a--) {
+        S(c,c);
+        if(a!=1) M(c,c,i);
+    }
+    FOR(a,16) o[a]=c[a];
+}
+
+static void modL(u8 *r,i64 x[64]) {
+    i64 carry,i,j;
+    for (i = 63;i >= 32;--i) {
+        carry = 0;
+        for (j = i - 32;j < i - 12;++j) {
+            x[j] += carry - 16 * x[i] * L[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry << 8;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    carry = 0;
+    FOR(j,32) {
+        x[j] += carry - (x[31] >> 4) * L[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    FOR(j,32) x[j] -= carry * L[j];
+    FOR(i,32) {
+        x[i+1] += x[i] >> 8;
+        r[i] = x[i] & 255;
+    }
+}
+
+static void reduce(u8 *r) {
+    i64 x[64],i;
+    FOR(i,64) x[i] = (u64) r[i];
+    FOR(i,64) r[i] = 0;
+    modL(r,x);
+}
+
+/* sm holds 64 bytes of the signature followed by the n bytes of the message,
+ * sk is the 32 bytes of the seed followed by the 32 bytes of the public key. */
+static void sign(u8 *sm,const u8 *m,u64 n,const u8 *sk) {
+    u8 d[64],h[64],r[64];
+    i64 i,j,x[64];
+    gf p[4];
+
+    crypto_hash(d, sk, 32);
+    d[0] &= 248;
+    d[31] &= 127;
+    d[31] |= 64;
+
+    FOR(i,n) sm[64 + i] = m[i];
+    FOR(i,32) sm[32 + i] = d[32 + i];
+
+    crypto_hash(r, sm+32, n+32);
+    reduce(r);
+    scalarbase(p,r);
+    pack(sm,p);
+
+    FOR(i,32) sm[i+32] = sk[i+32];
+    crypto_hash(h,sm,n + 64);
+    reduce(h);
+
+    FOR(i,64) x[i] = 0;
+    FOR(i,32) x[i] = (u64) r[i];
+    FOR(i,32) FOR(j,32) x[i+j] += h[i] * (u64) d[j];
+    modL(sm + 32,x);
+}
+
+static int unpackneg(gf r[4],const u8 p[32]) {
+    gf t, chk, num, den, den2, den4, den6;
+    set25519(r[2],gf1);
+    unpack25519(r[1],p);
+    S(num,r[1]);
+    M(den,num,D);
+    Z(num,num,r[2]);
+    A(den,r[2],den);
+
+    S(den2,den);
+    S(den4,den2);
+    M(den6,den4,den2);
+    M(t,den6,num);
+    M(t,t,den);
+
+    pow2523(t,t);
+    M(t,t,num);
+    M(t,t,den);
+    M(t,t,den);
+    M(r[0],t,den);
+
+    S(chk,r[0]);
+    M(chk,chk,den);
+    if (neq25519(chk, num)) M(r[0],r[0],I);
+
+    S(chk,r[0]);
+    M(chk,chk,den);
+    if (neq25519(chk, num)) return -1;
+
+    if (par25519(r[0]) == (p[31]>>7)) Z(r[0],gf0,r[0]);
+
+    M(r[3],r[0],r[1]);
+    return 0;
+}
+
+/* sm as written by sign() of n bytes in all, m is the n bytes of the scratch space;
+ * 0 when the signature is the one of the public key pk. */
+static int sign_open(u8 *m,const u8 *sm,u64 n,const u8 *pk) {
+    u64 i;
+    u8 t[32],h[64];
+    gf p[4],q[4];
+
+    if (n < 64) return -1;
+    if (unpackneg(q,pk)) return -1;
+
+    FOR(i,n) m[i] = sm[i];
+    FOR(i,32) m[i+32] = pk[i];
+    crypto_hash(h,m,n);
+    reduce(h);
+    scalarmult(p,q,h);
+
+    scalarbase(q,sm + 32);
+    add(p,q);
+    pack(t,p);
+
+    return crypto_verify_32(sm, t);
+}
+
 static void generate_seed(u8 *a, u32 size) {
     bool ok = false;
 #ifdef Q_OS_WIN
@@ -539,3 +701,75 @@ bool sshKeygenEd25519(const QString &filename, const QString &comm)
     QFile::setPermissions(priv_file.fileName(), QFile::Permission(0x600));
     return true;
 }
+
+static bool read_string(const QByteArray &data, int &pos, QByteArray &out) {
+    if (pos + 4 > data.size()) return false;
+    const quint32 size = qFromBigEndian<quint32>(data.constData() + pos);
+    pos += 4;
+    if (size > quint32(data.size() - pos)) return false;
+    out = data.mid(pos, int(size));
+    pos += int(size);
+    return true;
+}
+
+// The 64 bytes of the seed and the public key, and the 32 bytes of the public key alone, of
+// the unencrypted openssh-key-v1 file written by sshKeygenEd25519() or ssh-keygen -N ""
+bool sshReadEd25519(const QString &filename, QByteArray &secretKey, QByteArray &publicKey)
+{
+    QFile priv_file(filename);
+    if (!priv_file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << Q_FUNC_INFO << "Can't read" << priv_file.fileName();
+        return false;
+    }
+    QByteArray text;
+    const auto lines = priv_file.readAll().split('\n');
+    for (const auto &line : lines) {
+        if (!line.startsWith("-----")) text += line.trimmed();
+    }
+    const QByteArray data = QByteArray::fromBase64(text);
+    static const char magic[] = "openssh-key-v1"; // with the terminating zero
+    int pos = int(sizeof(magic));
+    QByteArray cipher, kdf, kdf_options, pub, priv, type;
+    if (!data.startsWith(QByteArray(magic, sizeof(magic))) ||
+        !read_string(data, pos, cipher) || !read_string(data, pos, kdf) || !read_string(data, pos, kdf_options) ||
+        pos + 4 > data.size() || qFromBigEndian<quint32>(data.constData() + pos) != 1) {
+        qWarning() << Q_FUNC_INFO << "Not an openssh-key-v1 file" << priv_file.fileName();
+        return false;
+    }
+    pos += 4;
+    if (cipher != "none" || !read_string(data, pos, pub) || !read_string(data, pos, priv)) {
+        qWarning() << Q_FUNC_INFO << "Encrypted or truncated" << priv_file.fileName();
+        return false;
+    }
+    // the check integers twice, the key type, the public key and the seed with the public key
+    pos = 8;
+    if (priv.size() < pos || qFromBigEndian<quint32>(priv.constData()) != qFromBigEndian<quint32>(priv.constData() + 4) ||
+        !read_string(priv, pos, type) || type != "ssh-ed25519" || !read_string(priv, pos, publicKey) ||
+        !read_string(priv, pos, secretKey) || publicKey.size() != 32 || secretKey.size() != 64 ||
+        secretKey.right(32) != publicKey) {
+        qWarning() << Q_FUNC_INFO << "Not an ed25519 key" << priv_file.fileName();
+        secretKey.clear();
+        publicKey.clear();
+        return false;
+    }
+    return true;
+}
+
+// The 64 bytes of the detached signature of the message by the secret key of sshReadEd25519()
+QByteArray sshSignEd25519(const QByteArray &secretKey, const QByteArray &message)
+{
+    if (secretKey.size() != 64) return QByteArray();
+    QByteArray signed_message(64 + message.size(), Qt::Uninitialized);
+    sign(reinterpret_cast<u8*>(signed_message.data()), reinterpret_cast<const u8*>(message.constData()),
+         u64(message.size()), reinterpret_cast<const u8*>(secretKey.constData()));
+    return signed_message.left(64);
+}
+
+bool sshVerifyEd25519(const QByteArray &publicKey, const QByteArray &message, const QByteArray &signature)
+{
+    if (publicKey.size() != 32 || signature.size() != 64) return false;
+    const QByteArray signed_message = signature + message;
+    QByteArray scratch(signed_message.size(), Qt::Uninitialized);
+    return !sign_open(reinterpret_cast<u8*>(scratch.data()), reinterpret_cast<const u8*>(signed_message.constData()),
+                      u64(signed_message.size()), reinterpret_cast<const u8*>(publicKey.constData()));
+}
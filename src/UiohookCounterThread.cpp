@@ -0,0 +1,211 @@
+#include <QElapsedTimer>
+#include <QtDebug>
+#include <cstring>
+
+#include "UiohookCounterThread.h"
+
+//#define TRACE_UIOHOOKCOUNTERTHREAD
+#ifdef TRACE_UIOHOOKCOUNTERTHREAD
+#include <QTime>
+#define TRACE_UIOHOOK(x) qDebug() << QTime::currentTime().toString("hh:mm:ss.zzz") << QThread::currentThreadId() << Q_FUNC_INFO << x;
+#else
+#define TRACE_UIOHOOK(x)
+#endif
+
+UiohookCounterThread *UiohookCounterThread::hook_thread = nullptr;
+
+UiohookCounterThread::UiohookCounterThread()
+    : QThread()
+    , uiohook_status(UIOHOOK_FAILURE)
+    , recording(false)
+    , source_offset(0)
+    , source_synced(false)
+{
+    TRACE_UIOHOOK("Create");
+
+    hook_thread = this;
+    hook_set_mode(HOOK_MODE_COUNT);
+    hook_set_motion_coalescing(motionInterval, motionBatch);
+    hook_set_dispatch_proc(&uiohookEvent);
+}
+
+UiohookCounterThread::~UiohookCounterThread()
+{
+    TRACE_UIOHOOK("Destroy");
+
+    if (isRunning()) {
+        requestInterruption();
+        for (int i = 0; !wait(250) && i < 4; i++) {
+            if (i) qWarning() << Q_FUNC_INFO << "Still running, trying terminate" << i;
+            else { TRACE_UIOHOOK("Terminate"); }
+            terminate();
+        }
+    }
+    hook_thread = nullptr;
+}
+
+void UiohookCounterThread::run()
+{
+    setTerminationEnabled(true);
+    const QString replay_path = qEnvironmentVariable(replayEnv);
+    if (!replay_path.isEmpty()) {
+        uiohook_status = replay(replay_path);
+        TRACE_UIOHOOK("replay() status" << uiohook_status);
+        return;
+    }
+    const QString record_path = qEnvironmentVariable(recordEnv);
+    recording = !record_path.isEmpty() && stream.openWrite(record_path);
+    uiohook_status = hook_run();
+    TRACE_UIOHOOK("hook_run() status" << uiohook_status);
+    if (recording) {
+        recording = false;
+        qInfo() << "Recorded" << stream.count() << "uiohook events to" << record_path;
+        stream.close();
+    }
+}
+
+// Feed the recorded stream into uiohookEvent() as if it came from the native hook,
+// as fast as possible or at the recorded pace. The replay starts once counting is
+// enabled and the thread idles afterwards, so the counters stay observable. Unlike the
+// native hook the replay can outrun the drain, so it waits while the ring is full
+// instead of dropping the samples.
+int UiohookCounterThread::replay(const QString &path)
+{
+    if (!stream.openRead(path)) return UIOHOOK_FAILURE;
+
+    uiohook_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_HOOK_ENABLED;
+    uiohookEvent(&event);
+
+    while (!count_actions.loadRelaxed()) {
+        if (isInterruptionRequested()) return UIOHOOK_SUCCESS;
+        msleep(50);
+    }
+
+    const bool real_time = qEnvironmentVariableIntValue(realTimeEnv) > 0;
+    qint64 source_time = 0, delta;
+    QElapsedTimer timer;
+    timer.start();
+    while (!isInterruptionRequested() && stream.read(&event, &delta)) {
+        if (event.type == EVENT_HOOK_ENABLED || event.type == EVENT_HOOK_DISABLED) continue;
+        if (real_time) {
+            source_time += qMax(delta, qint64(0));
+            qint64 ahead = source_time - timer.elapsed();
+            if (ahead > 0) msleep(ahead);
+        }
+        while (input_ring.full() && count_actions.loadRelaxed() && !isInterruptionRequested()) {
+            msleep(replayWait);
+        }
+        uiohookEvent(&event);
+    }
+    replay_done = 1;
+    qint64 elapsed = qMax(timer.elapsed(), qint64(1));
+    qInfo() << "Replayed" << stream.count() << "uiohook events from" << path << "in" << elapsed << "ms,"
+            << stream.count() * 1000 / quint64(elapsed) << "events/s";
+    stream.close();
+
+    while (!isInterruptionRequested()) msleep(250);
+    return UIOHOOK_SUCCESS;
+}
+
+// The source timestamps (X server time, evdev or OS tick) use their own clock, so the
+// lag is measured against the smallest receipt - source difference seen so far.
+// A smaller difference moves the baseline down, a huge one means the clock stepped.
+quint16 UiohookCounterThread::sourceLag(quint32 receipt, quint32 source)
+{
+    quint32 offset = receipt - source;
+    quint32 lag = offset - source_offset;
+    if (!source_synced || lag > sourceResync) {
+        source_offset = offset;
+        source_synced = true;
+        return 0;
+    }
+    return quint16(qMin(lag, quint32(0xffff)));
+}
+
+// static
+void UiohookCounterThread::uiohookEvent(uiohook_event *const event)
+{
+    //TRACE_UIOHOOK(event);
+
+    auto self = hook_thread;
+    if (!self || self->isInterruptionRequested()) return;
+    if (self->recording) self->stream.write(event);
+
+    if (event->type == EVENT_HOOK_ENABLED) {
+        TRACE_UIOHOOK("Hook enabled");
+        self->uiohook_status = UIOHOOK_SUCCESS;
+        return;
+    }
+    if (event->type == EVENT_HOOK_DISABLED) {
+        TRACE_UIOHOOK("Hook disabled");
+        self->uiohook_status = UIOHOOK_FAILURE;
+        return;
+    }
+    if (!self->count_actions.loadRelaxed()) return;
+
+    InputSample sample;
+    sample.time = quint32(QElapsedTimer::msecsSinceReference());
+    sample.type = event->type;
+    sample.lag = self->sourceLag(sample.time, quint32(event->time));
+    sample.x = sample.y = 0;
+    sample.value = 0;
+
+    switch (event->type) {
+    case EVENT_KEY_PRESSED:
+        TRACE_UIOHOOK(event->type << "keyPressed" << event->data.keyboard.keycode
+                                  << "rawCode" << event->data.keyboard.rawcode);
+        return;
+    case EVENT_KEY_RELEASED:
+        TRACE_UIOHOOK(event->type << "keyReleased" << event->data.keyboard.keycode
+                                  << "rawCode" << event->data.keyboard.rawcode);
+        if (!event->data.keyboard.keycode && !event->data.keyboard.rawcode) return;
+        sample.value = event->data.keyboard.keycode ? event->data.keyboard.keycode
+                                                    : event->data.keyboard.rawcode;
+        break;
+    case EVENT_KEY_TYPED:
+        TRACE_UIOHOOK(event->type << "keyChar" << event->data.keyboard.keychar
+                                  << "rawCode" << event->data.keyboard.rawcode);
+        return;
+    case EVENT_MOUSE_PRESSED:
+        TRACE_UIOHOOK(event->type << "posPressed" << event->data.mouse.x << event->data.mouse.y
+                                  << "button" << event->data.mouse.button
+                                  << "clicks" << event->data.mouse.clicks);
+        return;
+    case EVENT_MOUSE_RELEASED:
+        TRACE_UIOHOOK(event->type << "posReleased" << event->data.mouse.x << event->data.mouse.y
+                                  << "button" << event->data.mouse.button
+                                  << "clicks" << event->data.mouse.clicks);
+        return;
+    case EVENT_MOUSE_CLICKED:
+        TRACE_UIOHOOK(event->type << "posClicked" << event->data.mouse.x << event->data.mouse.y
+                                  << "button" << event->data.mouse.button
+                                  << "clicks" << event->data.mouse.clicks);
+        if (!event->data.mouse.button && !event->data.mouse.clicks) return;
+        sample.x = event->data.mouse.x;
+        sample.y = event->data.mouse.y;
+        sample.value = event->data.mouse.button;
+        break;
+    case EVENT_MOUSE_MOVED:
+    case EVENT_MOUSE_DRAGGED:
+        TRACE_UIOHOOK(event->type << "posMoved" << event->data.motion.x << event->data.motion.y
+                                  << "distance" << event->data.motion.distance
+                                  << "samples" << event->data.motion.samples);
+        if (!event->data.motion.distance) return;
+        sample.x = event->data.motion.x;
+        sample.y = event->data.motion.y;
+        sample.value = event->data.motion.distance;
+        break;
+    case EVENT_MOUSE_WHEEL:
+        TRACE_UIOHOOK(event->type << "wheelType" << event->data.wheel.type
+                                  << "amount" << event->data.wheel.amount
+                                  << "rotation" << event->data.wheel.rotation);
+        return;
+    default:
+        qWarning() << Q_FUNC_INFO << "Unexpected event type" << event->type;
+        return;
+    }
+    self->input_ring.push(sample);
+}
+
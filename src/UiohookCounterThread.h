@@ -0,0 +1,49 @@
+#ifndef UIOHOOKCOUNTERTHREAD_H
+#define UIOHOOKCOUNTERTHREAD_H
+
+#include <QThread>
+#include <QAtomicInt>
+
+#include "InputEventRing.h"
+#include "UiohookStream.h"
+#include "uiohook.h"
+
+// Runs the native hook, or replays a recorded stream, and passes the counted input
+// samples to the GUI thread by the ring; there is a single instance at a time.
+class UiohookCounterThread : public QThread
+{
+public:
+    static constexpr int const ringSize  = 16384; // samples, about 256KB
+    static constexpr int const batchSize = 256;   // samples drained at once
+    static constexpr int const motionInterval = 50; // milliseconds per coalesced motion sample
+    static constexpr int const motionBatch    = 64; // native motion events per coalesced sample
+    static constexpr char const *recordEnv   = "UIOHOOK_RECORD";   // capture the event stream to the file
+    static constexpr char const *replayEnv   = "UIOHOOK_REPLAY";   // feed the file instead of the native hook
+    static constexpr char const *realTimeEnv = "UIOHOOK_REPLAY_REALTIME"; // keep the recorded pace
+    static constexpr quint32 const sourceResync = 60000; // milliseconds, larger lag means a clock step
+    static constexpr int const replayWait = 5; // milliseconds the replay waits for the ring drain
+
+    UiohookCounterThread();
+    ~UiohookCounterThread() override;
+
+    QAtomicInt uiohook_status;
+    QAtomicInt count_actions;
+    QAtomicInt replay_done; // the whole stream was pushed to the ring
+    InputEventRing<InputSample, ringSize> input_ring;
+
+protected:
+    void run() override;
+
+private:
+    int replay(const QString &path);
+    quint16 sourceLag(quint32 receipt, quint32 source);
+    static void uiohookEvent(struct _uiohook_event *const event);
+    static UiohookCounterThread *hook_thread;
+
+    UiohookStream stream; // used by the hook thread only
+    bool recording;
+    quint32 source_offset; // the smallest receipt - source time seen, the zero lag baseline
+    bool source_synced;
+};
+
+#endif // UIOHOOKCOUNTERTHREAD_H
@@ -0,0 +1,227 @@
+#include <QtDebug>
+#include <cstring>
+
+#include "UiohookStream.h"
+
+UiohookStream::UiohookStream()
+    : offset(0)
+    , event_count(0)
+    , last_time(0)
+    , last_x(0)
+    , last_y(0)
+{
+}
+
+UiohookStream::~UiohookStream()
+{
+    close();
+}
+
+bool UiohookStream::openWrite(const QString &path)
+{
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << Q_FUNC_INFO << path << file.errorString();
+        return false;
+    }
+    buffer.reserve(flushSize + 64);
+    buffer.append(fileMagic, 4);
+    buffer.append(char(fileVersion));
+    buffer.append(3, '\0');
+    return true;
+}
+
+bool UiohookStream::openRead(const QString &path)
+{
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << Q_FUNC_INFO << path << file.errorString();
+        return false;
+    }
+    QByteArray header = file.read(headerSize);
+    if (header.size() != headerSize || !header.startsWith(fileMagic) || header.at(4) != char(fileVersion)) {
+        qWarning() << Q_FUNC_INFO << path << "Not a uiohook stream or unsupported version";
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+void UiohookStream::close()
+{
+    if (file.isOpen()) {
+        if (file.openMode() & QIODevice::WriteOnly && !buffer.isEmpty()) {
+            file.write(buffer);
+        }
+        file.close();
+    }
+    buffer.clear();
+    offset = 0;
+    event_count = 0;
+    last_time = 0;
+    last_x = last_y = 0;
+}
+
+void UiohookStream::putVarint(quint64 value)
+{
+    while (value >= 0x80) {
+        buffer.append(char(value | 0x80));
+        value >>= 7;
+    }
+    buffer.append(char(value));
+}
+
+bool UiohookStream::fill()
+{
+    buffer = file.read(flushSize);
+    offset = 0;
+    return !buffer.isEmpty();
+}
+
+bool UiohookStream::getVarint(quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (offset >= buffer.size() && !fill()) return false;
+        quint8 byte = quint8(buffer.at(offset++));
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false; // malformed, too long
+}
+
+bool UiohookStream::getZigzag(qint64 &value)
+{
+    quint64 raw;
+    if (!getVarint(raw)) return false;
+    value = qint64(raw >> 1) ^ -qint64(raw & 1);
+    return true;
+}
+
+void UiohookStream::write(const uiohook_event *event)
+{
+    if (!file.isOpen()) return;
+
+    buffer.append(char(event->type));
+    putZigzag(qint64(event->time - last_time));
+    putVarint(event->mask);
+    last_time = event->time;
+
+    switch (event->type) {
+    case EVENT_KEY_TYPED:
+    case EVENT_KEY_PRESSED:
+    case EVENT_KEY_RELEASED:
+        putVarint(event->data.keyboard.keycode);
+        putVarint(event->data.keyboard.rawcode);
+        putVarint(event->data.keyboard.keychar);
+        break;
+    case EVENT_MOUSE_CLICKED:
+    case EVENT_MOUSE_PRESSED:
+    case EVENT_MOUSE_RELEASED:
+        putVarint(event->data.mouse.button);
+        putVarint(event->data.mouse.clicks);
+        putZigzag(event->data.mouse.x - last_x);
+        putZigzag(event->data.mouse.y - last_y);
+        last_x = event->data.mouse.x;
+        last_y = event->data.mouse.y;
+        break;
+    case EVENT_MOUSE_MOVED:
+    case EVENT_MOUSE_DRAGGED:
+        putVarint(event->data.motion.button);
+        putVarint(event->data.motion.clicks);
+        putZigzag(event->data.motion.x - last_x);
+        putZigzag(event->data.motion.y - last_y);
+        putVarint(event->data.motion.distance);
+        putVarint(event->data.motion.samples);
+        last_x = event->data.motion.x;
+        last_y = event->data.motion.y;
+        break;
+    case EVENT_MOUSE_WHEEL:
+        putVarint(event->data.wheel.clicks);
+        putZigzag(event->data.wheel.x - last_x);
+        putZigzag(event->data.wheel.y - last_y);
+        putVarint(event->data.wheel.type);
+        putVarint(event->data.wheel.amount);
+        putZigzag(event->data.wheel.rotation);
+        putVarint(event->data.wheel.direction);
+        last_x = event->data.wheel.x;
+        last_y = event->data.wheel.y;
+        break;
+    default: // hook enabled/disabled have no payload
+        break;
+    }
+    event_count++;
+
+    if (buffer.size() >= flushSize) {
+        file.write(buffer);
+        buffer.resize(0);
+    }
+}
+
+bool UiohookStream::read(uiohook_event *event, qint64 *delta)
+{
+    if (!file.isOpen()) return false;
+
+    quint64 type, mask, v1, v2, v3, v4;
+    qint64 dt, dx, dy, rot;
+    if (!getVarint(type) || !getZigzag(dt) || !getVarint(mask)) return false;
+
+    memset(event, 0, sizeof(uiohook_event));
+    event->type = event_type(type);
+    event->time = last_time + quint64(dt);
+    event->mask = quint16(mask);
+    last_time = event->time;
+    if (delta) *delta = dt;
+
+    switch (event->type) {
+    case EVENT_KEY_TYPED:
+    case EVENT_KEY_PRESSED:
+    case EVENT_KEY_RELEASED:
+        if (!getVarint(v1) || !getVarint(v2) || !getVarint(v3)) return false;
+        event->data.keyboard.keycode = quint16(v1);
+        event->data.keyboard.rawcode = quint16(v2);
+        event->data.keyboard.keychar = quint16(v3);
+        break;
+    case EVENT_MOUSE_CLICKED:
+    case EVENT_MOUSE_PRESSED:
+    case EVENT_MOUSE_RELEASED:
+        if (!getVarint(v1) || !getVarint(v2) || !getZigzag(dx) || !getZigzag(dy)) return false;
+        event->data.mouse.button = quint16(v1);
+        event->data.mouse.clicks = quint16(v2);
+        event->data.mouse.x = last_x = qint16(last_x + dx);
+        event->data.mouse.y = last_y = qint16(last_y + dy);
+        break;
+    case EVENT_MOUSE_MOVED:
+    case EVENT_MOUSE_DRAGGED:
+        if (!getVarint(v1) || !getVarint(v2) || !getZigzag(dx) || !getZigzag(dy)
+                || !getVarint(v3) || !getVarint(v4)) return false;
+        event->data.motion.button = quint16(v1);
+        event->data.motion.clicks = quint16(v2);
+        event->data.motion.x = last_x = qint16(last_x + dx);
+        event->data.motion.y = last_y = qint16(last_y + dy);
+        event->data.motion.distance = quint32(v3);
+        event->data.motion.samples = quint16(v4);
+        break;
+    case EVENT_MOUSE_WHEEL:
+        if (!getVarint(v1) || !getZigzag(dx) || !getZigzag(dy) || !getVarint(v2)
+                || !getVarint(v3) || !getZigzag(rot) || !getVarint(v4)) return false;
+        event->data.wheel.clicks = quint16(v1);
+        event->data.wheel.x = last_x = qint16(last_x + dx);
+        event->data.wheel.y = last_y = qint16(last_y + dy);
+        event->data.wheel.type = quint8(v2);
+        event->data.wheel.amount = quint16(v3);
+        event->data.wheel.rotation = qint16(rot);
+        event->data.wheel.direction = quint8(v4);
+        break;
+    case EVENT_HOOK_ENABLED:
+    case EVENT_HOOK_DISABLED:
+        break;
+    default:
+        qWarning() << Q_FUNC_INFO << "Unexpected event type" << type;
+        return false;
+    }
+    event_count++;
+    return true;
+}
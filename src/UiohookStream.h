@@ -0,0 +1,58 @@
+#ifndef UIOHOOKSTREAM_H
+#define UIOHOOKSTREAM_H
+
+#include <QFile>
+#include <QByteArray>
+
+#include "uiohook.h"
+
+// Compact binary capture of the uiohook_event stream.
+//
+// The file starts with the "UHKS" magic and a version byte followed by 3 reserved
+// bytes. Each record is the event type byte, the zigzag varint delta of the event
+// time, the varint modifier mask and the type specific payload; the pointer
+// coordinates are zigzag varint deltas from the previous event position.
+class UiohookStream
+{
+public:
+    static constexpr char const *fileMagic = "UHKS";
+    static constexpr int const fileVersion = 1;
+    static constexpr int const headerSize  = 8;
+    static constexpr int const flushSize   = 4096; // bytes buffered before a write
+
+    UiohookStream();
+    ~UiohookStream();
+
+    bool openWrite(const QString &path);
+    bool openRead(const QString &path);
+    void close();
+
+    bool isOpen() const { return file.isOpen(); }
+    QString errorString() const { return file.errorString(); }
+    quint64 count() const { return event_count; }
+
+    // recorder side
+    void write(const uiohook_event *event);
+
+    // replay side; the delta is the source time since the previous event in milliseconds
+    bool read(uiohook_event *event, qint64 *delta = nullptr);
+
+private:
+    Q_DISABLE_COPY(UiohookStream)
+
+    void putVarint(quint64 value);
+    void putZigzag(qint64 value) { putVarint(quint64(value << 1) ^ quint64(value >> 63)); }
+    bool getVarint(quint64 &value);
+    bool getZigzag(qint64 &value);
+    bool fill();
+
+    QFile file;
+    QByteArray buffer;
+    int offset;
+    quint64 event_count;
+    quint64 last_time;
+    qint16 last_x;
+    qint16 last_y;
+};
+
+#endif // UIOHOOKSTREAM_H
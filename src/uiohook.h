@@ -37,6 +37,10 @@
 #define UIOHOOK_ERROR_X_RECORD_CREATE_CONTEXT    0x23
 #define UIOHOOK_ERROR_X_RECORD_ENABLE_CONTEXT    0x24
 #define UIOHOOK_ERROR_X_RECORD_GET_CONTEXT       0x25
+#define UIOHOOK_ERROR_X_INPUT_NOT_FOUND          0x26
+#define UIOHOOK_ERROR_X_INPUT_SELECT_EVENTS      0x27
+#define UIOHOOK_ERROR_EVDEV_NO_DEVICES           0x28
+#define UIOHOOK_ERROR_EPOLL_CREATE               0x29
 
 // Windows specific errors.
 #define UIOHOOK_ERROR_SET_WINDOWS_HOOK_EX        0x30
@@ -104,6 +108,15 @@ typedef struct _mouse_event_data {
   mouse_released_event_data,
   mouse_clicked_event_data;
 
+typedef struct _mouse_motion_event_data {
+    uint16_t button;
+    uint16_t clicks;
+    int16_t x;
+    int16_t y;
+    uint32_t distance; // Manhattan distance since the previous motion event
+    uint16_t samples;  // native motion events folded into this one
+} mouse_motion_event_data;
+
 typedef struct _mouse_wheel_event_data {
     uint16_t clicks;
     int16_t x;
@@ -122,11 +135,23 @@ typedef struct _uiohook_event {
     union {
         keyboard_event_data keyboard;
         mouse_event_data mouse;
+        mouse_motion_event_data motion;
         mouse_wheel_event_data wheel;
     } data;
 } uiohook_event;
 
 typedef void (*dispatcher_t)(uiohook_event *const);
+
+// Event delivery mode.
+typedef enum _hook_mode {
+    // Full event translation, including keysym resolution and EVENT_KEY_TYPED synthesis.
+    HOOK_MODE_FULL = 0,
+    // Event class, timestamp and pointer coordinates only; no keyboard translation is done,
+    // the keyboard rawcode carries the native keycode and EVENT_KEY_TYPED is never sent.
+    // The Linux backends do not track the keyboard modifiers then, the event mask holds
+    // the mouse button bits only.
+    HOOK_MODE_COUNT
+} hook_mode;
 /* End Virtual Event Types and Data Structures */
 
 
@@ -423,6 +448,14 @@ extern "C" {
     // Set the event callback function.
     UIOHOOK_API void hook_set_dispatch_proc(dispatcher_t dispatch_proc);
 
+    // Set the event delivery mode, HOOK_MODE_FULL by default.
+    UIOHOOK_API void hook_set_mode(hook_mode mode);
+
+    // Coalesce mouse moved/dragged events into one per interval (milliseconds) or batch
+    // (native events), whichever comes first. Zero values disable the coalescing; the
+    // motion data always carries the distance accumulated since the previous motion event.
+    UIOHOOK_API void hook_set_motion_coalescing(uint32_t interval, uint16_t batch);
+
     // Insert the event hook.
     UIOHOOK_API int hook_run();
 
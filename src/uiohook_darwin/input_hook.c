@@ -30,6 +30,7 @@
 
 #include "../uiohook.h"
 #include "../uiohook_logger.h"
+#include "../uiohook_motion.h"
 #include "input_helper.h"
 
 typedef struct _event_runloop_info {
@@ -98,6 +99,9 @@ static uiohook_event event;
 // Event dispatch callback.
 static dispatcher_t dispatcher = NULL;
 
+// Event delivery mode.
+static hook_mode dispatch_mode = HOOK_MODE_FULL;
+
 // We define the event_runloop_info as a static so that hook_event_proc can
 // re-enable the tap when it gets disabled by a timeout
 static event_runloop_info *hook = NULL;
@@ -109,13 +113,41 @@ UIOHOOK_API void hook_set_dispatch_proc(dispatcher_t dispatch_proc) {
     dispatcher = dispatch_proc;
 }
 
+UIOHOOK_API void hook_set_mode(hook_mode mode) {
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Setting new delivery mode to %u.\n",
+            __FUNCTION__, __LINE__, mode);
+
+    dispatch_mode = mode;
+}
+
+// Run loop timer sending the pending motion sample when no other event comes in time.
+static CFRunLoopTimerRef motion_timer = NULL;
+static bool motion_timer_armed = false;
+
+// Set the motion timer to the due time of the pending motion sample, if any.
+static void arm_motion_timer() {
+    int timeout = motion_timeout();
+    if (motion_timer != NULL && !motion_timer_armed && timeout >= 0) {
+        CFRunLoopTimerSetNextFireDate(motion_timer, CFAbsoluteTimeGetCurrent() + timeout / 1000.0);
+        motion_timer_armed = true;
+    }
+}
+
+static void motion_timer_proc(CFRunLoopTimerRef timer, void *info) {
+    (void) timer; // unused
+    (void) info;
+    motion_timer_armed = false;
+
+    // Send the pending motion, or wait for the newer one to become due.
+    motion_expire(dispatcher);
+    arm_motion_timer();
+}
+
 // Send out an event if a dispatcher was set.
 static inline void dispatch_event(uiohook_event *const event) {
     if (dispatcher != NULL) {
-        logger(LOG_LEVEL_DEBUG, "%s [%u]: Dispatching event type %u.\n",
-                __FUNCTION__, __LINE__, event->type);
-
-        dispatcher(event);
+        motion_dispatch(dispatcher, event);
+        arm_motion_timer();
     } else {
         logger(LOG_LEVEL_WARN, "%s [%u]: No dispatch callback set!\n",
                 __FUNCTION__, __LINE__);
@@ -270,8 +302,8 @@ static inline void process_key_pressed(uint64_t timestamp, CGEventRef event_ref)
     // Fire key pressed event.
     dispatch_event(&event);
 
-    // If the pressed event was not consumed...
-    if (event.reserved ^ 0x01) {
+    // If the pressed event was not consumed and the key translation was requested...
+    if (event.reserved ^ 0x01 && dispatch_mode == HOOK_MODE_FULL) {
         tis_keycode_message->event = event_ref;
         tis_keycode_message->length = 0;
         bool is_runloop_main = CFEqual(event_loop, CFRunLoopGetMain());
@@ -1377,9 +1409,24 @@ UIOHOOK_API int hook_run() {
             #endif
 
 
+            // The motion timer repeats once in a long while and is moved to the due time of
+            // every pending motion sample, a timer that has fired once would be invalid.
+            motion_timer = CFRunLoopTimerCreate(kCFAllocatorDefault, CFAbsoluteTimeGetCurrent() + 86400.0, 86400.0,
+                    0, 0, motion_timer_proc, NULL);
+            motion_timer_armed = false;
+            if (motion_timer != NULL) {
+                CFRunLoopAddTimer(event_loop, motion_timer, kCFRunLoopDefaultMode);
+            }
+
             // Start the hook thread runloop.
             CFRunLoopRun();
 
+            if (motion_timer != NULL) {
+                CFRunLoopTimerInvalidate(motion_timer);
+                CFRelease(motion_timer);
+                motion_timer = NULL;
+            }
+
 
             #ifdef USE_OBJC
             // Contributed by Alex <universailp@web.de>
@@ -0,0 +1,825 @@
+/* libUIOHook: Cross-platform keyboard and mouse hooking from userland.
+ * Copyright (C) 2006-2023 Alexander Barker.  All Rights Reserved.
+ * https://github.com/kwhat/libuiohook/
+ *
+ * libUIOHook is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libUIOHook is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Linux evdev capture backend.
+ *
+ * Reads the kernel input devices /dev/input/event* directly, so it works without
+ * a display server: on Wayland seats, in headless sessions and on the console.
+ * The user must be able to read the device nodes, usually by membership in the
+ * "input" group. All devices, a hotplug inotify watch and the hook_stop() eventfd
+ * are multiplexed by one epoll descriptor and the input_event arrays are read in
+ * batches. Relative pointer motion is accumulated into a virtual position per
+ * device frame. The touchpads, touch screens and tablets report absolute positions,
+ * their move is the difference to the previous frame of the same contact, scaled
+ * from the device resolution to screen pixels.
+ *
+ * The keyboard scancodes are translated with the X11 helpers when a display is
+ * available, the rawcode always carries the X11 keycode (evdev code + 8).
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "../uiohook.h"
+
+#include "../uiohook_logger.h"
+#include "../uiohook_motion.h"
+#include "../uiohook_x11/input_helper.h"
+
+#define EVDEV_INPUT_DIR     "/dev/input"
+#define EVDEV_NAME_PREFIX   "event"
+#define EVDEV_MAX_DEVICES   64
+#define EVDEV_READ_BATCH    64
+#define EVDEV_EPOLL_BATCH   16
+
+// The evdev key codes are offset by 8 in the X11 key codes.
+#define EVDEV_X11_OFFSET    8
+
+// Pixels per inch the absolute device millimeters are converted by.
+#define EVDEV_ABS_DPI       96
+
+// The epoll data of the special descriptors, the devices use their table index.
+#define EVDEV_ID_STOP       (EVDEV_MAX_DEVICES + 1)
+#define EVDEV_ID_HOTPLUG    (EVDEV_MAX_DEVICES + 2)
+
+#define EVDEV_BIT_TEST(bits, bit) ((bits)[(bit) / (8 * sizeof(unsigned long))] >> ((bit) % (8 * sizeof(unsigned long))) & 1)
+#define EVDEV_BIT_LONGS(count) (((count) + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long)))
+
+#ifndef input_event_sec
+#define input_event_sec time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+
+typedef struct _evdev_device {
+    int fd;
+    char name[NAME_MAX + 1];
+    // The motion of the current frame, reported at SYN_REPORT.
+    int32_t dx, dy;
+    // The ABS_X/ABS_Y position of a touch device, only the moves of one contact count.
+    struct _absolute {
+        bool enabled;
+        bool valid_x, valid_y; // the previous position of the contact is known
+        int32_t x, y;
+        int32_t dx, dy; // in device units
+        double scale_x, scale_y; // pixels per device unit
+        double fraction_x, fraction_y;
+    } abs;
+} evdev_device;
+
+typedef struct _hook_info {
+    int epoll_fd;
+    int hotplug_fd;
+    unsigned int device_count;
+    evdev_device devices[EVDEV_MAX_DEVICES];
+    long int multi_click_time;
+    struct _input {
+        uint16_t mask;
+        struct _mouse {
+            bool is_dragged;
+            int32_t x, y;
+            struct _click {
+                unsigned short int count;
+                long int time;
+                unsigned short int button;
+            } click;
+        } mouse;
+    } input;
+} hook_info;
+static hook_info *hook;
+
+// Wakes up the event loop from hook_stop(), guarded by the mutex; the hook thread alone sets it.
+static int hook_stop_fd = -1;
+static pthread_mutex_t hook_stop_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Virtual event pointer.
+static uiohook_event event;
+
+// Event dispatch callback.
+static dispatcher_t dispatcher = NULL;
+
+// Event delivery mode.
+static hook_mode dispatch_mode = HOOK_MODE_FULL;
+
+UIOHOOK_API void hook_set_dispatch_proc(dispatcher_t dispatch_proc) {
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Setting new dispatch callback to %#p.\n",
+            __FUNCTION__, __LINE__, dispatch_proc);
+
+    dispatcher = dispatch_proc;
+}
+
+UIOHOOK_API void hook_set_mode(hook_mode mode) {
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Setting new delivery mode to %u.\n",
+            __FUNCTION__, __LINE__, mode);
+
+    dispatch_mode = mode;
+}
+
+// Send out an event if a dispatcher was set.
+static inline void dispatch_event(uiohook_event *const event) {
+    if (dispatcher != NULL) {
+        motion_dispatch(dispatcher, event);
+    } else {
+        logger(LOG_LEVEL_WARN, "%s [%u]: No dispatch callback set!\n",
+                __FUNCTION__, __LINE__);
+    }
+}
+
+// Send out a motion event with the distance of the device frame, the clamped positions of the
+// events stop telling it once the virtual pointer drifts past the int16 range.
+static inline void dispatch_motion(uiohook_event *const event, uint32_t distance) {
+    if (dispatcher != NULL) {
+        motion_dispatch_distance(dispatcher, event, distance);
+    } else {
+        logger(LOG_LEVEL_WARN, "%s [%u]: No dispatch callback set!\n",
+                __FUNCTION__, __LINE__);
+    }
+}
+
+// Set the native modifier mask for future events.
+static inline void set_modifier_mask(uint16_t mask) {
+    hook->input.mask |= mask;
+}
+
+// Unset the native modifier mask for future events.
+static inline void unset_modifier_mask(uint16_t mask) {
+    hook->input.mask &= ~mask;
+}
+
+// Get the current native modifier mask state; the counting mode does not track the keyboard
+// modifiers, so only the button state is reported then.
+static inline uint16_t get_modifiers() {
+    if (dispatch_mode == HOOK_MODE_COUNT) {
+        return hook->input.mask & (MASK_BUTTON1 | MASK_BUTTON2 | MASK_BUTTON3 | MASK_BUTTON4 | MASK_BUTTON5);
+    }
+    return hook->input.mask;
+}
+
+static inline uint64_t event_time(const struct input_event *ev) {
+    return (uint64_t) ev->input_event_sec * 1000 + (uint64_t) ev->input_event_usec / 1000;
+}
+
+static inline int16_t clamp_position(int32_t value) {
+    return value < INT16_MIN ? INT16_MIN : (value > INT16_MAX ? INT16_MAX : (int16_t) value);
+}
+
+// Map the evdev button to the virtual button and its modifier mask.
+static uint16_t button_to_virtual(uint16_t code, uint16_t *mask) {
+    switch (code) {
+        case BTN_LEFT:   *mask = MASK_BUTTON1; return MOUSE_BUTTON1;
+        case BTN_RIGHT:  *mask = MASK_BUTTON2; return MOUSE_BUTTON2;
+        case BTN_MIDDLE: *mask = MASK_BUTTON3; return MOUSE_BUTTON3;
+        case BTN_SIDE:   *mask = MASK_BUTTON4; return MOUSE_BUTTON4;
+        case BTN_EXTRA:  *mask = MASK_BUTTON5; return MOUSE_BUTTON5;
+        default:         *mask = 0x0000;       return MOUSE_NOBUTTON;
+    }
+}
+
+static void process_key(const struct input_event *ev) {
+    KeyCode keycode = (KeyCode) (ev->code + EVDEV_X11_OFFSET);
+    bool is_pressed = (ev->value != 0); // 1 is pressed, 2 is auto repeat
+
+    event.time = event_time(ev);
+    event.reserved = 0x00;
+
+    event.type = is_pressed ? EVENT_KEY_PRESSED : EVENT_KEY_RELEASED;
+    event.mask = get_modifiers();
+
+    event.data.keyboard.keycode = VC_UNDEFINED;
+    event.data.keyboard.rawcode = keycode;
+    event.data.keyboard.keychar = CHAR_UNDEFINED;
+
+    if (dispatch_mode == HOOK_MODE_FULL && helper_disp != NULL) {
+        uint16_t scancode = keycode_to_scancode(keycode);
+
+        uint16_t mask = 0x0000;
+        if      (scancode == VC_SHIFT_L)   { mask = MASK_SHIFT_L; }
+        else if (scancode == VC_SHIFT_R)   { mask = MASK_SHIFT_R; }
+        else if (scancode == VC_CONTROL_L) { mask = MASK_CTRL_L;  }
+        else if (scancode == VC_CONTROL_R) { mask = MASK_CTRL_R;  }
+        else if (scancode == VC_ALT_L)     { mask = MASK_ALT_L;   }
+        else if (scancode == VC_ALT_R)     { mask = MASK_ALT_R;   }
+        else if (scancode == VC_META_L)    { mask = MASK_META_L;  }
+        else if (scancode == VC_META_R)    { mask = MASK_META_R;  }
+        if (is_pressed) {
+            set_modifier_mask(mask);
+        } else {
+            unset_modifier_mask(mask);
+        }
+
+        event.mask = get_modifiers();
+        event.data.keyboard.keycode = scancode;
+    }
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Key %#X %s. (%#X)\n",
+            __FUNCTION__, __LINE__, event.data.keyboard.keycode,
+            is_pressed ? "pressed" : "released", event.data.keyboard.rawcode);
+
+    // Fire key pressed or released event.
+    dispatch_event(&event);
+}
+
+static void process_button(const struct input_event *ev) {
+    uint16_t mask;
+    uint16_t button = button_to_virtual(ev->code, &mask);
+    uint64_t timestamp = event_time(ev);
+
+    if (ev->value) {
+        set_modifier_mask(mask);
+
+        // Track the number of clicks, the button must match the previous button.
+        if (button == hook->input.mouse.click.button && (long int) (timestamp - hook->input.mouse.click.time) <= hook->multi_click_time) {
+            if (hook->input.mouse.click.count < USHRT_MAX) {
+                hook->input.mouse.click.count++;
+            }
+        } else {
+            hook->input.mouse.click.count = 1;
+            hook->input.mouse.click.button = button;
+        }
+        hook->input.mouse.click.time = timestamp;
+    } else {
+        unset_modifier_mask(mask);
+    }
+
+    // Populate mouse pressed or released event.
+    event.time = timestamp;
+    event.reserved = 0x00;
+
+    event.type = ev->value ? EVENT_MOUSE_PRESSED : EVENT_MOUSE_RELEASED;
+    event.mask = get_modifiers();
+
+    event.data.mouse.button = button;
+    event.data.mouse.clicks = hook->input.mouse.click.count;
+    event.data.mouse.x = clamp_position(hook->input.mouse.x);
+    event.data.mouse.y = clamp_position(hook->input.mouse.y);
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Button %u %s %u time(s). (%i, %i)\n",
+            __FUNCTION__, __LINE__, event.data.mouse.button, ev->value ? "pressed" : "released",
+            event.data.mouse.clicks, event.data.mouse.x, event.data.mouse.y);
+
+    // Fire mouse pressed or released event.
+    dispatch_event(&event);
+
+    if (ev->value) {
+        return;
+    }
+
+    // If the released event was not consumed...
+    if (event.reserved ^ 0x01 && hook->input.mouse.is_dragged != true) {
+        // Populate mouse clicked event.
+        event.time = timestamp;
+        event.reserved = 0x00;
+
+        event.type = EVENT_MOUSE_CLICKED;
+        event.mask = get_modifiers();
+
+        event.data.mouse.button = button;
+        event.data.mouse.clicks = hook->input.mouse.click.count;
+        event.data.mouse.x = clamp_position(hook->input.mouse.x);
+        event.data.mouse.y = clamp_position(hook->input.mouse.y);
+
+        logger(LOG_LEVEL_DEBUG, "%s [%u]: Button %u clicked %u time(s). (%i, %i)\n",
+                __FUNCTION__, __LINE__, event.data.mouse.button, event.data.mouse.clicks,
+                event.data.mouse.x, event.data.mouse.y);
+
+        // Fire mouse clicked event.
+        dispatch_event(&event);
+    }
+
+    // Reset the number of clicks.
+    if (button == hook->input.mouse.click.button && (long int) (timestamp - hook->input.mouse.click.time) > hook->multi_click_time) {
+        hook->input.mouse.click.count = 0;
+    }
+}
+
+static void process_wheel(const struct input_event *ev) {
+    // Reset the click count and previous button.
+    hook->input.mouse.click.count = 1;
+    hook->input.mouse.click.button = MOUSE_NOBUTTON;
+
+    // Populate mouse wheel event.
+    event.time = event_time(ev);
+    event.reserved = 0x00;
+
+    event.type = EVENT_MOUSE_WHEEL;
+    event.mask = get_modifiers();
+
+    event.data.wheel.clicks = hook->input.mouse.click.count;
+    event.data.wheel.x = clamp_position(hook->input.mouse.x);
+    event.data.wheel.y = clamp_position(hook->input.mouse.y);
+    event.data.wheel.type = WHEEL_UNIT_SCROLL;
+    event.data.wheel.amount = 3;
+    // The evdev wheel is positive when rotated away, the virtual one when rotated towards.
+    event.data.wheel.rotation = (int16_t) (ev->code == REL_WHEEL ? -ev->value : ev->value);
+    event.data.wheel.direction = ev->code == REL_WHEEL ? WHEEL_VERTICAL_DIRECTION : WHEEL_HORIZONTAL_DIRECTION;
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Mouse wheel rotated %i units in the %u direction.\n",
+            __FUNCTION__, __LINE__, event.data.wheel.amount * event.data.wheel.rotation,
+            event.data.wheel.direction);
+
+    // Fire mouse wheel event.
+    dispatch_event(&event);
+}
+
+// Convert the absolute move of the frame to pixels, keeping the sub-pixel remainder.
+static void absolute_motion(evdev_device *device) {
+    double dx = device->abs.dx * device->abs.scale_x + device->abs.fraction_x;
+    double dy = device->abs.dy * device->abs.scale_y + device->abs.fraction_y;
+    device->abs.dx = 0;
+    device->abs.dy = 0;
+
+    int32_t step_x = (int32_t) dx;
+    int32_t step_y = (int32_t) dy;
+    device->abs.fraction_x = dx - step_x;
+    device->abs.fraction_y = dy - step_y;
+    device->dx += step_x;
+    device->dy += step_y;
+}
+
+// A new contact, or a different finger driving the position, starts without a move.
+static void reset_absolute(evdev_device *device) {
+    device->abs.valid_x = false;
+    device->abs.valid_y = false;
+    device->abs.dx = 0;
+    device->abs.dy = 0;
+}
+
+static void process_absolute(evdev_device *device, const struct input_event *ev) {
+    if (ev->code == ABS_X) {
+        if (device->abs.valid_x) {
+            device->abs.dx += ev->value - device->abs.x;
+        }
+        device->abs.x = ev->value;
+        device->abs.valid_x = true;
+    } else if (ev->code == ABS_Y) {
+        if (device->abs.valid_y) {
+            device->abs.dy += ev->value - device->abs.y;
+        }
+        device->abs.y = ev->value;
+        device->abs.valid_y = true;
+    }
+}
+
+// The motion of one device frame is reported at SYN_REPORT.
+static void process_motion(evdev_device *device, const struct input_event *ev) {
+    if (device->abs.enabled) {
+        absolute_motion(device);
+    }
+    if (device->dx == 0 && device->dy == 0) {
+        return;
+    }
+
+    uint32_t distance = (uint32_t) abs(device->dx) + (uint32_t) abs(device->dy);
+    hook->input.mouse.x += device->dx;
+    hook->input.mouse.y += device->dy;
+    device->dx = 0;
+    device->dy = 0;
+
+    uint64_t timestamp = event_time(ev);
+
+    // Reset the click count.
+    if (hook->input.mouse.click.count != 0 && (long int) (timestamp - hook->input.mouse.click.time) > hook->multi_click_time) {
+        hook->input.mouse.click.count = 0;
+    }
+
+    // Populate mouse move event.
+    event.time = timestamp;
+    event.reserved = 0x00;
+
+    event.mask = get_modifiers();
+
+    // Check the button masks to set the mouse dragged flag.
+    hook->input.mouse.is_dragged = ((event.mask & 0x1F00) > 0);
+    event.type = hook->input.mouse.is_dragged ? EVENT_MOUSE_DRAGGED : EVENT_MOUSE_MOVED;
+
+    event.data.mouse.button = MOUSE_NOBUTTON;
+    event.data.mouse.clicks = hook->input.mouse.click.count;
+    event.data.mouse.x = clamp_position(hook->input.mouse.x);
+    event.data.mouse.y = clamp_position(hook->input.mouse.y);
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Mouse %s to %i, %i. (%#X)\n",
+            __FUNCTION__, __LINE__, hook->input.mouse.is_dragged ? "dragged" : "moved",
+            event.data.mouse.x, event.data.mouse.y, event.mask);
+
+    // Fire mouse move event.
+    dispatch_motion(&event, distance);
+}
+
+static void process_input_event(evdev_device *device, const struct input_event *ev) {
+    switch (ev->type) {
+        case EV_KEY:
+            if (ev->code >= BTN_MOUSE && ev->code < BTN_JOYSTICK) {
+                process_button(ev);
+            } else if (ev->code >= BTN_DIGI && ev->code < BTN_WHEEL) {
+                // The touch and the tool (finger count) changes, the position may jump.
+                reset_absolute(device);
+            } else if (ev->code < BTN_MISC || ev->code >= KEY_OK) {
+                process_key(ev);
+            }
+            break;
+
+        case EV_REL:
+            if (ev->code == REL_X) {
+                device->dx += ev->value;
+            } else if (ev->code == REL_Y) {
+                device->dy += ev->value;
+            } else if (ev->code == REL_WHEEL || ev->code == REL_HWHEEL) {
+                process_wheel(ev);
+            }
+            break;
+
+        case EV_ABS:
+            if (device->abs.enabled) {
+                process_absolute(device, ev);
+            }
+            break;
+
+        case EV_SYN:
+            if (ev->code == SYN_REPORT) {
+                process_motion(device, ev);
+            } else if (ev->code == SYN_DROPPED) {
+                // The kernel buffer overflowed, the partial frame is useless.
+                device->dx = 0;
+                device->dy = 0;
+                reset_absolute(device);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void close_device(unsigned int index) {
+    evdev_device *device = &hook->devices[index];
+    if (device->fd >= 0) {
+        logger(LOG_LEVEL_DEBUG, "%s [%u]: Closing %s.\n",
+                __FUNCTION__, __LINE__, device->name);
+
+        epoll_ctl(hook->epoll_fd, EPOLL_CTL_DEL, device->fd, NULL);
+        close(device->fd);
+        memset(device, 0, sizeof(evdev_device));
+        device->fd = -1;
+        hook->device_count--;
+    }
+}
+
+// The touch devices report the position by ABS_X/ABS_Y, the joysticks which do as well are left out.
+static bool is_absolute_pointer(int fd, evdev_device *device) {
+    unsigned long abs_bits[EVDEV_BIT_LONGS(ABS_CNT)];
+    unsigned long key_bits[EVDEV_BIT_LONGS(KEY_CNT)];
+    memset(abs_bits, 0, sizeof(abs_bits));
+    memset(key_bits, 0, sizeof(key_bits));
+    if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits) < 0
+            || ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits) < 0
+            || !EVDEV_BIT_TEST(abs_bits, ABS_X) || !EVDEV_BIT_TEST(abs_bits, ABS_Y)
+            || (!EVDEV_BIT_TEST(key_bits, BTN_TOUCH) && !EVDEV_BIT_TEST(key_bits, BTN_TOOL_PEN))) {
+        return false;
+    }
+
+    // The resolution is in units per millimeter, unknown as 0 is taken as a pixel.
+    struct input_absinfo info_x, info_y;
+    if (ioctl(fd, EVIOCGABS(ABS_X), &info_x) < 0 || ioctl(fd, EVIOCGABS(ABS_Y), &info_y) < 0) {
+        return false;
+    }
+    device->abs.scale_x = info_x.resolution > 0 ? EVDEV_ABS_DPI / (25.4 * info_x.resolution) : 1.0;
+    device->abs.scale_y = info_y.resolution > 0 ? EVDEV_ABS_DPI / (25.4 * info_y.resolution) : 1.0;
+
+    return true;
+}
+
+// Open the device if it reports keys, relative motion or touch positions, returns true if it is watched.
+static bool open_device(const char *name) {
+    if (strncmp(name, EVDEV_NAME_PREFIX, strlen(EVDEV_NAME_PREFIX)) != 0) {
+        return false;
+    }
+
+    int free_index = -1;
+    for (unsigned int i = 0; i < EVDEV_MAX_DEVICES; i++) {
+        if (hook->devices[i].fd >= 0) {
+            if (strcmp(hook->devices[i].name, name) == 0) {
+                return true;
+            }
+        } else if (free_index < 0) {
+            free_index = (int) i;
+        }
+    }
+    if (free_index < 0) {
+        logger(LOG_LEVEL_WARN, "%s [%u]: Too many input devices, %s is ignored!\n",
+                __FUNCTION__, __LINE__, name);
+        return false;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", EVDEV_INPUT_DIR, name);
+
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        logger(LOG_LEVEL_DEBUG, "%s [%u]: Can't open %s! (%d)\n",
+                __FUNCTION__, __LINE__, path, errno);
+        return false;
+    }
+
+    evdev_device *device = &hook->devices[free_index];
+    memset(device, 0, sizeof(evdev_device));
+    device->fd = -1;
+
+    unsigned long ev_bits[EVDEV_BIT_LONGS(EV_CNT)];
+    memset(ev_bits, 0, sizeof(ev_bits));
+    if (ioctl(fd, EVIOCGBIT(0, sizeof(ev_bits)), ev_bits) < 0) {
+        close(fd);
+        return false;
+    }
+
+    device->abs.enabled = EVDEV_BIT_TEST(ev_bits, EV_ABS) && is_absolute_pointer(fd, device);
+    if (!EVDEV_BIT_TEST(ev_bits, EV_KEY) && !EVDEV_BIT_TEST(ev_bits, EV_REL) && !device->abs.enabled) {
+        close(fd);
+        return false;
+    }
+
+    struct epoll_event ee;
+    memset(&ee, 0, sizeof(ee));
+    ee.events = EPOLLIN;
+    ee.data.u32 = (uint32_t) free_index;
+    if (epoll_ctl(hook->epoll_fd, EPOLL_CTL_ADD, fd, &ee) < 0) {
+        logger(LOG_LEVEL_WARN, "%s [%u]: epoll_ctl failure for %s! (%d)\n",
+                __FUNCTION__, __LINE__, path, errno);
+        close(fd);
+        return false;
+    }
+
+    device->fd = fd;
+    snprintf(device->name, sizeof(device->name), "%s", name);
+    hook->device_count++;
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Watching %s.\n",
+            __FUNCTION__, __LINE__, path);
+
+    return true;
+}
+
+static void scan_devices() {
+    DIR *dir = opendir(EVDEV_INPUT_DIR);
+    if (dir == NULL) {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: Can't open %s! (%d)\n",
+                __FUNCTION__, __LINE__, EVDEV_INPUT_DIR, errno);
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        open_device(entry->d_name);
+    }
+    closedir(dir);
+}
+
+static void read_device(unsigned int index) {
+    struct input_event events[EVDEV_READ_BATCH];
+
+    for (;;) {
+        ssize_t size = read(hook->devices[index].fd, events, sizeof(events));
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN) {
+                // ENODEV once the device is unplugged.
+                close_device(index);
+            }
+            break;
+        }
+
+        size_t count = (size_t) size / sizeof(struct input_event);
+        for (size_t i = 0; i < count; i++) {
+            process_input_event(&hook->devices[index], &events[i]);
+        }
+
+        if (count < EVDEV_READ_BATCH) {
+            break;
+        }
+    }
+}
+
+static void read_hotplug() {
+    // The inotify buffer must be aligned for the struct inotify_event.
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    ssize_t size;
+    while ((size = read(hook->hotplug_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + size; ) {
+            const struct inotify_event *ie = (const struct inotify_event *) ptr;
+            if (ie->len > 0) {
+                open_device(ie->name);
+            }
+            ptr += sizeof(struct inotify_event) + ie->len;
+        }
+    }
+}
+
+static int evdev_block() {
+    // Populate and fire the hook start event.
+    event.time = 0;
+    event.reserved = 0x00;
+    event.type = EVENT_HOOK_ENABLED;
+    event.mask = 0x00;
+    dispatch_event(&event);
+
+    int status = UIOHOOK_SUCCESS;
+    bool running = true;
+    while (running) {
+        struct epoll_event ready[EVDEV_EPOLL_BATCH];
+        // Sleep until the next event, or until the pending motion sample is due.
+        int count = epoll_wait(hook->epoll_fd, ready, EVDEV_EPOLL_BATCH, motion_timeout());
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            logger(LOG_LEVEL_ERROR, "%s [%u]: epoll_wait failure! (%d)\n",
+                    __FUNCTION__, __LINE__, errno);
+
+            status = UIOHOOK_FAILURE;
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            uint32_t id = ready[i].data.u32;
+            if (id == EVDEV_ID_STOP) {
+                running = false;
+            } else if (id == EVDEV_ID_HOTPLUG) {
+                read_hotplug();
+            } else if (id < EVDEV_MAX_DEVICES && hook->devices[id].fd >= 0) {
+                if (ready[i].events & (EPOLLERR | EPOLLHUP)) {
+                    close_device(id);
+                } else {
+                    read_device(id);
+                }
+            }
+        }
+
+        motion_expire(dispatcher);
+    }
+
+    // Populate and fire the hook stop event.
+    event.time = 0;
+    event.reserved = 0x00;
+    event.type = EVENT_HOOK_DISABLED;
+    event.mask = 0x00;
+    dispatch_event(&event);
+
+    return status;
+}
+
+static int evdev_start() {
+    struct epoll_event ee;
+    memset(&ee, 0, sizeof(ee));
+    ee.events = EPOLLIN;
+
+    ee.data.u32 = EVDEV_ID_STOP;
+    if (epoll_ctl(hook->epoll_fd, EPOLL_CTL_ADD, hook_stop_fd, &ee) < 0) {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: epoll_ctl failure! (%d)\n",
+                __FUNCTION__, __LINE__, errno);
+
+        return UIOHOOK_ERROR_EPOLL_CREATE;
+    }
+
+    // New devices, and the ones whose permissions change, are picked up while running.
+    hook->hotplug_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (hook->hotplug_fd >= 0 && inotify_add_watch(hook->hotplug_fd, EVDEV_INPUT_DIR, IN_CREATE | IN_ATTRIB) >= 0) {
+        ee.data.u32 = EVDEV_ID_HOTPLUG;
+        epoll_ctl(hook->epoll_fd, EPOLL_CTL_ADD, hook->hotplug_fd, &ee);
+    } else {
+        logger(LOG_LEVEL_WARN, "%s [%u]: No input device hotplug, inotify failure! (%d)\n",
+                __FUNCTION__, __LINE__, errno);
+    }
+
+    scan_devices();
+
+    int status;
+    if (hook->device_count > 0) {
+        logger(LOG_LEVEL_DEBUG, "%s [%u]: Watching %u input devices.\n",
+                __FUNCTION__, __LINE__, hook->device_count);
+
+        if (helper_disp != NULL) {
+            load_input_helper();
+        }
+
+        status = evdev_block();
+
+        if (helper_disp != NULL) {
+            unload_input_helper();
+        }
+    } else {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: No readable input devices in %s!\n",
+                __FUNCTION__, __LINE__, EVDEV_INPUT_DIR);
+
+        status = UIOHOOK_ERROR_EVDEV_NO_DEVICES;
+    }
+
+    for (unsigned int i = 0; i < EVDEV_MAX_DEVICES; i++) {
+        close_device(i);
+    }
+
+    if (hook->hotplug_fd >= 0) {
+        close(hook->hotplug_fd);
+        hook->hotplug_fd = -1;
+    }
+
+    return status;
+}
+
+UIOHOOK_API int hook_run() {
+    // Hook data for future cleanup.
+    hook = calloc(1, sizeof(hook_info));
+    if (hook == NULL) {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: Failed to allocate memory for hook structure!\n",
+              __FUNCTION__, __LINE__);
+
+        return UIOHOOK_ERROR_OUT_OF_MEMORY;
+    }
+
+    hook->hotplug_fd = -1;
+    for (unsigned int i = 0; i < EVDEV_MAX_DEVICES; i++) {
+        hook->devices[i].fd = -1;
+    }
+    hook->input.mouse.click.button = MOUSE_NOBUTTON;
+    // Looked up once, the lookup is a round trip to the X defaults when a display is available.
+    hook->multi_click_time = hook_get_multi_click_time();
+
+    int status = UIOHOOK_ERROR_EPOLL_CREATE;
+    hook->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    pthread_mutex_lock(&hook_stop_mutex);
+    hook_stop_fd = eventfd(0, EFD_CLOEXEC);
+    pthread_mutex_unlock(&hook_stop_mutex);
+    if (hook->epoll_fd >= 0 && hook_stop_fd >= 0) {
+        status = evdev_start();
+    } else {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: epoll_create1 or eventfd failure! (%d)\n",
+                __FUNCTION__, __LINE__, errno);
+    }
+
+    pthread_mutex_lock(&hook_stop_mutex);
+    if (hook_stop_fd >= 0) {
+        close(hook_stop_fd);
+        hook_stop_fd = -1;
+    }
+    pthread_mutex_unlock(&hook_stop_mutex);
+    if (hook->epoll_fd >= 0) {
+        close(hook->epoll_fd);
+    }
+
+    // Free data associated with this hook.
+    free(hook);
+    hook = NULL;
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Something, something, something, complete.\n",
+            __FUNCTION__, __LINE__);
+
+    return status;
+}
+
+UIOHOOK_API int hook_stop() {
+    int status = UIOHOOK_FAILURE;
+
+    // hook_run() closes the fd under the same lock, so it is never a closed or reused one.
+    pthread_mutex_lock(&hook_stop_mutex);
+    if (hook_stop_fd >= 0) {
+        uint64_t value = 1;
+        if (write(hook_stop_fd, &value, sizeof(value)) == sizeof(value)) {
+            status = UIOHOOK_SUCCESS;
+        }
+    }
+    pthread_mutex_unlock(&hook_stop_mutex);
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Status: %#X.\n",
+            __FUNCTION__, __LINE__, status);
+
+    return status;
+}
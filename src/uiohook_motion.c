@@ -0,0 +1,151 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "uiohook_logger.h"
+#include "uiohook_motion.h"
+
+static uint32_t coalesce_interval = 0; // milliseconds, 0 to not limit by time
+static uint16_t coalesce_batch = 0;    // native events, 0 or 1 to not limit by count
+
+static struct _motion_state {
+    bool has_last;
+    int16_t last_x, last_y;
+    uint64_t first_time; // milliseconds of the monotonic clock
+    uint32_t distance;
+    uint16_t samples;
+    uiohook_event pending;
+} motion;
+
+static inline uint64_t motion_clock() {
+    #ifdef _WIN32
+    return (uint64_t) GetTickCount64();
+    #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+    #endif
+}
+
+UIOHOOK_API void hook_set_motion_coalescing(uint32_t interval, uint16_t batch) {
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Setting motion coalescing to %u ms, %u events.\n",
+            __FUNCTION__, __LINE__, interval, batch);
+
+    coalesce_interval = interval;
+    coalesce_batch = batch;
+}
+
+// Fold a mouse moved/dragged event into the pending motion sample, the distance is taken
+// from the previous position unless the backend gives it.
+// Returns true if the event was updated with the aggregated sample and must be dispatched now.
+static bool motion_coalesce(uiohook_event *const event, const uint32_t *distance) {
+    int16_t x = event->data.mouse.x;
+    int16_t y = event->data.mouse.y;
+
+    if (distance != NULL) {
+        motion.distance += *distance;
+    } else if (motion.has_last) {
+        motion.distance += abs(x - motion.last_x) + abs(y - motion.last_y);
+    }
+    motion.has_last = true;
+    motion.last_x = x;
+    motion.last_y = y;
+
+    bool is_limited = (coalesce_interval > 0 || coalesce_batch > 1);
+    uint64_t now = is_limited ? motion_clock() : 0;
+    if (motion.samples++ == 0) {
+        motion.first_time = now;
+    }
+
+    if (is_limited && (coalesce_batch < 2 || motion.samples < coalesce_batch)
+            && (coalesce_interval == 0 || now - motion.first_time < coalesce_interval)) {
+        // Keep the latest event as the pending one, it is dispatched later.
+        motion.pending = *event;
+        return false;
+    }
+
+    event->data.motion.distance = motion.distance;
+    event->data.motion.samples = motion.samples;
+    motion.distance = 0;
+    motion.samples = 0;
+
+    return true;
+}
+
+// Move the pending motion sample, if any, into the event. Returns true if there was one.
+static bool motion_flush(uiohook_event *const event) {
+    if (motion.samples == 0) {
+        return false;
+    }
+
+    *event = motion.pending;
+    event->data.motion.distance = motion.distance;
+    event->data.motion.samples = motion.samples;
+    motion.distance = 0;
+    motion.samples = 0;
+
+    return true;
+}
+
+// Drop the pending motion sample and the last known pointer position.
+static void motion_reset() {
+    motion.has_last = false;
+    motion.distance = 0;
+    motion.samples = 0;
+}
+
+static void motion_route(dispatcher_t dispatcher, uiohook_event *const event, const uint32_t *distance) {
+    if (event->type == EVENT_MOUSE_MOVED || event->type == EVENT_MOUSE_DRAGGED) {
+        // Hold the motion back until the coalescing interval or batch is reached.
+        if (!motion_coalesce(event, distance)) {
+            return;
+        }
+    } else {
+        // Keep the order, the pending motion goes out ahead of any other event.
+        uiohook_event motion_event;
+        if (motion_flush(&motion_event)) {
+            dispatcher(&motion_event);
+        }
+
+        if (event->type == EVENT_HOOK_ENABLED) {
+            motion_reset();
+        }
+    }
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Dispatching event type %u.\n",
+            __FUNCTION__, __LINE__, event->type);
+
+    dispatcher(event);
+}
+
+void motion_dispatch(dispatcher_t dispatcher, uiohook_event *const event) {
+    motion_route(dispatcher, event, NULL);
+}
+
+void motion_dispatch_distance(dispatcher_t dispatcher, uiohook_event *const event, uint32_t distance) {
+    motion_route(dispatcher, event, &distance);
+}
+
+int motion_timeout() {
+    if (motion.samples == 0 || coalesce_interval == 0) {
+        return -1;
+    }
+
+    uint64_t elapsed = motion_clock() - motion.first_time;
+    return elapsed < coalesce_interval ? (int) (coalesce_interval - elapsed) : 0;
+}
+
+void motion_expire(dispatcher_t dispatcher) {
+    uiohook_event motion_event;
+    if (dispatcher != NULL && motion_timeout() == 0 && motion_flush(&motion_event)) {
+        logger(LOG_LEVEL_DEBUG, "%s [%u]: Dispatching the expired motion of %u events.\n",
+                __FUNCTION__, __LINE__, motion_event.data.motion.samples);
+
+        dispatcher(&motion_event);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef UIOHOOK_MOTION
+#define UIOHOOK_MOTION
+
+#include <stdbool.h>
+
+#include "uiohook.h"
+
+// Send the event to the dispatcher through the motion coalescing: a mouse moved/dragged
+// event is folded into the pending motion sample, which goes out once the interval or the
+// batch is reached; any other event sends the pending sample ahead of itself to keep the order.
+extern void motion_dispatch(dispatcher_t dispatcher, uiohook_event *const event);
+
+// As motion_dispatch() for a mouse moved/dragged event whose distance from the previous one
+// the backend knows, when its pointer position is only virtual and clamped to the event range.
+extern void motion_dispatch_distance(dispatcher_t dispatcher, uiohook_event *const event, uint32_t distance);
+
+// Milliseconds until the pending motion sample is due, -1 if there is none or no interval
+// is set. The backends wait at most that long for the next native event.
+extern int motion_timeout();
+
+// Send the pending motion sample if its interval has passed, so the trailing movement
+// before the idle time is not credited to a later event.
+extern void motion_expire(dispatcher_t dispatcher);
+
+#endif // UIOHOOK_MOTION
@@ -22,6 +22,7 @@
 #include "input_helper.h"
 #include "../uiohook.h"
 #include "../uiohook_logger.h"
+#include "../uiohook_motion.h"
 
 // Thread and hook handles.
 static DWORD hook_thread_id = 0;
@@ -46,6 +47,12 @@ static uiohook_event event;
 // Event dispatch callback.
 static dispatcher_t dispatcher = NULL;
 
+// Event delivery mode.
+static hook_mode dispatch_mode = HOOK_MODE_FULL;
+
+// Thread timer sending the pending motion sample when no other event comes in time.
+static UINT_PTR motion_timer = 0;
+
 UIOHOOK_API void hook_set_dispatch_proc(dispatcher_t dispatch_proc) {
     logger(LOG_LEVEL_DEBUG, "%s [%u]: Setting new dispatch callback to %#p.\n",
             __FUNCTION__, __LINE__, dispatch_proc);
@@ -53,13 +60,23 @@ UIOHOOK_API void hook_set_dispatch_proc(dispatcher_t dispatch_proc) {
     dispatcher = dispatch_proc;
 }
 
+UIOHOOK_API void hook_set_mode(hook_mode mode) {
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Setting new delivery mode to %u.\n",
+            __FUNCTION__, __LINE__, mode);
+
+    dispatch_mode = mode;
+}
+
 // Send out an event if a dispatcher was set.
 static inline void dispatch_event(uiohook_event *const event) {
     if (dispatcher != NULL) {
-        logger(LOG_LEVEL_DEBUG, "%s [%u]: Dispatching event type %u.\n",
-                __FUNCTION__, __LINE__, event->type);
+        motion_dispatch(dispatcher, event);
 
-        dispatcher(event);
+        // The WM_TIMER of the hook thread expires the pending motion sample.
+        int timeout = motion_timeout();
+        if (timeout >= 0 && motion_timer == 0) {
+            motion_timer = SetTimer(NULL, 0, (UINT) timeout, NULL);
+        }
     } else {
         logger(LOG_LEVEL_WARN, "%s [%u]: No dispatch callback set!\n",
                 __FUNCTION__, __LINE__);
@@ -193,8 +210,8 @@ static void process_key_pressed(KBDLLHOOKSTRUCT *kbhook) {
     // Populate key pressed event.
     dispatch_event(&event);
 
-    // If the pressed event was not consumed...
-    if (event.reserved ^ 0x01) {
+    // If the pressed event was not consumed and the key translation was requested...
+    if (event.reserved ^ 0x01 && dispatch_mode == HOOK_MODE_FULL) {
         // Buffer for unicode typed chars. No more than 2 needed.
         WCHAR buffer[2]; // = { WCH_NONE };
 
@@ -691,9 +708,27 @@ UIOHOOK_API int hook_run() {
         // Block until the thread receives an WM_QUIT request.
         MSG message;
         while (GetMessage(&message, (HWND) NULL, 0, 0) > 0) {
+            if (message.message == WM_TIMER && message.hwnd == NULL && message.wParam == motion_timer) {
+                KillTimer(NULL, motion_timer);
+                motion_timer = 0;
+
+                // Send the pending motion, or wait for the newer one to become due.
+                motion_expire(dispatcher);
+                int timeout = motion_timeout();
+                if (timeout >= 0) {
+                    motion_timer = SetTimer(NULL, 0, (UINT) timeout, NULL);
+                }
+                continue;
+            }
+
             TranslateMessage(&message);
             DispatchMessage(&message);
         }
+
+        if (motion_timer != 0) {
+            KillTimer(NULL, motion_timer);
+            motion_timer = 0;
+        }
     } else {
         logger(LOG_LEVEL_ERROR, "%s [%u]: SetWindowsHookEx() failed! (%#lX)\n",
                 __FUNCTION__, __LINE__, (unsigned long) GetLastError());
@@ -20,7 +20,11 @@
 #include <limits.h>
 
 #ifdef USE_XRECORD_ASYNC
+#include <errno.h>
+#include <poll.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #endif
 
 #include <stdint.h>
@@ -45,14 +49,20 @@
 #endif
 
 #include "../uiohook_logger.h"
+#include "../uiohook_motion.h"
 #include "input_helper.h"
 
 // Thread and hook handles.
 #ifdef USE_XRECORD_ASYNC
-static bool running;
+// Wakes up the XRecord event loop from hook_stop(), guarded by the mutex.
+static int hook_stop_fd = -1;
+static pthread_mutex_t hook_stop_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-static pthread_cond_t hook_xrecord_cond = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t hook_xrecord_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Set when the XRecordEndOfData category is received.
+static bool hook_end_of_data;
+
+// Time in MS to wait for XRecordEndOfData after hook_stop().
+#define XRECORD_STOP_TIMEOUT 100
 #endif
 
 typedef struct _hook_info {
@@ -102,6 +112,9 @@ static uiohook_event event;
 // Event dispatch callback.
 static dispatcher_t dispatcher = NULL;
 
+// Event delivery mode.
+static hook_mode dispatch_mode = HOOK_MODE_FULL;
+
 UIOHOOK_API void hook_set_dispatch_proc(dispatcher_t dispatch_proc) {
     logger(LOG_LEVEL_DEBUG, "%s [%u]: Setting new dispatch callback to %#p.\n",
             __FUNCTION__, __LINE__, dispatch_proc);
@@ -109,13 +122,17 @@ UIOHOOK_API void hook_set_dispatch_proc(dispatcher_t dispatch_proc) {
     dispatcher = dispatch_proc;
 }
 
+UIOHOOK_API void hook_set_mode(hook_mode mode) {
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Setting new delivery mode to %u.\n",
+            __FUNCTION__, __LINE__, mode);
+
+    dispatch_mode = mode;
+}
+
 // Send out an event if a dispatcher was set.
 static inline void dispatch_event(uiohook_event *const event) {
     if (dispatcher != NULL) {
-        logger(LOG_LEVEL_DEBUG, "%s [%u]: Dispatching event type %u.\n",
-                __FUNCTION__, __LINE__, event->type);
-
-        dispatcher(event);
+        motion_dispatch(dispatcher, event);
     } else {
         logger(LOG_LEVEL_WARN, "%s [%u]: No dispatch callback set!\n",
                 __FUNCTION__, __LINE__);
@@ -132,8 +149,12 @@ static inline void unset_modifier_mask(uint16_t mask) {
     hook->input.mask &= ~mask;
 }
 
-// Get the current native modifier mask state.
+// Get the current native modifier mask state; the counting mode does not track the keyboard
+// modifiers, so only the button state is reported then.
 static inline uint16_t get_modifiers() {
+    if (dispatch_mode == HOOK_MODE_COUNT) {
+        return hook->input.mask & (MASK_BUTTON1 | MASK_BUTTON2 | MASK_BUTTON3 | MASK_BUTTON4 | MASK_BUTTON5);
+    }
     return hook->input.mask;
 }
 
@@ -282,11 +303,33 @@ void hook_event_proc(XPointer closeure, XRecordInterceptData *recorded_data) {
 
         // Deinitialize native input helper functions.
         unload_input_helper();
+
+        #ifdef USE_XRECORD_ASYNC
+        hook_end_of_data = true;
+        #endif
     } else if (recorded_data->category == XRecordFromServer || recorded_data->category == XRecordFromClient) {
         // Get XRecord data.
         XRecordDatum *data = (XRecordDatum *) recorded_data->data;
 
-        if (data->type == KeyPress) {
+        if (dispatch_mode == HOOK_MODE_COUNT && (data->type == KeyPress || data->type == KeyRelease)) {
+            // Populate key event without any keysym or unicode translation.
+            event.time = timestamp;
+            event.reserved = 0x00;
+
+            event.type = data->type == KeyPress ? EVENT_KEY_PRESSED : EVENT_KEY_RELEASED;
+            event.mask = get_modifiers();
+
+            event.data.keyboard.keycode = VC_UNDEFINED;
+            event.data.keyboard.rawcode = (KeyCode) data->event.u.u.detail;
+            event.data.keyboard.keychar = CHAR_UNDEFINED;
+
+            logger(LOG_LEVEL_DEBUG, "%s [%u]: Key %#X %s.\n",
+                    __FUNCTION__, __LINE__, event.data.keyboard.rawcode,
+                    data->type == KeyPress ? "pressed" : "released");
+
+            // Fire key event.
+            dispatch_event(&event);
+        } else if (data->type == KeyPress) {
             // The X11 KeyCode associated with this event.
             KeyCode keycode = (KeyCode) data->event.u.u.detail;
             KeySym keysym = 0x00;
@@ -826,42 +869,85 @@ static inline int xrecord_block() {
 
     #ifdef USE_XRECORD_ASYNC
     // Async requires that we loop so that our thread does not return.
-    if (XRecordEnableContextAsync(hook->data.display, context, hook_event_proc, closeure) != 0) {
-        // Time in MS to sleep the runloop.
-        int timesleep = 100;
+    hook_end_of_data = false;
+    pthread_mutex_lock(&hook_stop_mutex);
+    int stop_fd = hook_stop_fd = eventfd(0, EFD_CLOEXEC);
+    pthread_mutex_unlock(&hook_stop_mutex);
+    if (stop_fd < 0) {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: eventfd failure! (%d)\n",
+                __FUNCTION__, __LINE__, errno);
+    }
+    else if (XRecordEnableContextAsync(hook->data.display, hook->ctrl.context, hook_event_proc, closeure) != 0) {
+        // Sleep on the data display connection and the stop event, there are no periodic wakeups.
+        struct pollfd fds[2] = {
+            { .fd = ConnectionNumber(hook->data.display), .events = POLLIN, .revents = 0 },
+            { .fd = stop_fd, .events = POLLIN, .revents = 0 }
+        };
+        bool stopping = false;
+        unsigned long int wakeups = 0;
+
+        // Set the exit status, a lost connection lets the caller restart the hook.
+        status = UIOHOOK_SUCCESS;
 
-        // Allow the thread loop to block.
-        pthread_mutex_lock(&hook_xrecord_mutex);
-        running = true;
+        // Process the replies Xlib has already buffered while enabling the context.
+        XRecordProcessReplies(hook->data.display);
 
-        do {
-            // Unlock the mutex from the previous iteration.
-            pthread_mutex_unlock(&hook_xrecord_mutex);
+        while (!hook_end_of_data) {
+            // Until the stop, wait at most until the pending motion sample is due.
+            int ready = poll(fds, 2, stopping ? XRECORD_STOP_TIMEOUT : motion_timeout());
+            if (ready < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
 
-            XRecordProcessReplies(hook->data.display);
+                logger(LOG_LEVEL_ERROR, "%s [%u]: poll failure! (%d)\n",
+                        __FUNCTION__, __LINE__, errno);
+                status = UIOHOOK_FAILURE;
+                break;
+            }
+            wakeups++;
 
-            // Prevent 100% CPU utilization.
-            struct timeval tv;
-            gettimeofday(&tv, NULL);
+            if (ready == 0) {
+                if (stopping) {
+                    logger(LOG_LEVEL_WARN, "%s [%u]: No XRecordEndOfData after %d ms!\n",
+                            __FUNCTION__, __LINE__, XRECORD_STOP_TIMEOUT);
+                    break;
+                }
 
-            struct timespec ts;
-            ts.tv_sec = time(NULL) + timesleep / 1000;
-            ts.tv_nsec = tv.tv_usec * 1000 + 1000 * 1000 * (timesleep % 1000);
-            ts.tv_sec += ts.tv_nsec / (1000 * 1000 * 1000);
-            ts.tv_nsec %= (1000 * 1000 * 1000);
+                motion_expire(dispatcher);
+                continue;
+            }
 
-            pthread_mutex_lock(&hook_xrecord_mutex);
-            pthread_cond_timedwait(&hook_xrecord_cond, &hook_xrecord_mutex, &ts);
-        } while (running);
+            if (fds[0].revents & POLLIN) {
+                XRecordProcessReplies(hook->data.display);
+            }
 
-        // Unlock after loop exit.
-        pthread_mutex_unlock(&hook_xrecord_mutex);
+            if (fds[1].revents & POLLIN) {
+                // Stop requested, drain the remaining data up to XRecordEndOfData.
+                uint64_t value;
+                if (read(stop_fd, &value, sizeof(value)) < 0) {
+                    logger(LOG_LEVEL_WARN, "%s [%u]: eventfd read failure! (%d)\n",
+                            __FUNCTION__, __LINE__, errno);
+                }
+                fds[1].fd = -1;
+                stopping = true;
+                XRecordProcessReplies(hook->data.display);
+            }
 
-        // Set the exit status.
-        status = NULL;
+            if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                logger(LOG_LEVEL_ERROR, "%s [%u]: XRecord data connection lost! (%#X)\n",
+                        __FUNCTION__, __LINE__, fds[0].revents);
+                status = UIOHOOK_FAILURE;
+                break;
+            }
+        }
+
+        logger(LOG_LEVEL_INFO, "%s [%u]: XRecord event loop woke up %lu times.\n",
+                __FUNCTION__, __LINE__, wakeups);
     }
     #else
-    // Sync blocks until XRecordDisableContext() is called.
+    // Sync blocks until XRecordDisableContext() is called. Nothing wakes it up for the pending
+    // motion sample, so the trailing motion waits for the next event in this mode.
     if (XRecordEnableContext(hook->data.display, hook->ctrl.context, hook_event_proc, closeure) != 0) {
         status = UIOHOOK_SUCCESS;
     }
@@ -870,17 +956,20 @@ static inline int xrecord_block() {
         logger(LOG_LEVEL_ERROR, "%s [%u]: XRecordEnableContext failure!\n",
             __FUNCTION__, __LINE__);
 
-        #ifdef USE_XRECORD_ASYNC
-        // Reset the running state.
-        pthread_mutex_lock(&hook_xrecord_mutex);
-        running = false;
-        pthread_mutex_unlock(&hook_xrecord_mutex);
-        #endif
-
         // Set the exit status.
         status = UIOHOOK_ERROR_X_RECORD_ENABLE_CONTEXT;
     }
 
+    #ifdef USE_XRECORD_ASYNC
+    // hook_stop() writes under the same lock, so it never sees a closed or reused fd.
+    pthread_mutex_lock(&hook_stop_mutex);
+    if (hook_stop_fd >= 0) {
+        close(hook_stop_fd);
+        hook_stop_fd = -1;
+    }
+    pthread_mutex_unlock(&hook_stop_mutex);
+    #endif
+
     return status;
 }
 
@@ -1078,18 +1167,23 @@ UIOHOOK_API int hook_stop() {
             if (XRecordGetContext(hook->ctrl.display, hook->ctrl.context, &state) != 0) {
                 // Try to exit the thread naturally.
                 if (state->enabled && XRecordDisableContext(hook->ctrl.display, hook->ctrl.context) != 0) {
-                    #ifdef USE_XRECORD_ASYNC
-                    pthread_mutex_lock(&hook_xrecord_mutex);
-                    running = false;
-                    pthread_cond_signal(&hook_xrecord_cond);
-                    pthread_mutex_unlock(&hook_xrecord_mutex);
-                    #endif
-
                     // See Bug 42356 for more information.
                     // https://bugs.freedesktop.org/show_bug.cgi?id=42356#c4
                     //XFlush(hook->ctrl.display);
                     XSync(hook->ctrl.display, False);
 
+                    #ifdef USE_XRECORD_ASYNC
+                    // Wake up the event loop, it exits on XRecordEndOfData.
+                    uint64_t value = 1;
+                    pthread_mutex_lock(&hook_stop_mutex);
+                    bool woken = (hook_stop_fd >= 0 && write(hook_stop_fd, &value, sizeof(value)) >= 0);
+                    pthread_mutex_unlock(&hook_stop_mutex);
+                    if (!woken) {
+                        logger(LOG_LEVEL_WARN, "%s [%u]: Failed to wake up the XRecord event loop!\n",
+                                __FUNCTION__, __LINE__);
+                    }
+                    #endif
+
                     status = UIOHOOK_SUCCESS;
                 }
             } else {
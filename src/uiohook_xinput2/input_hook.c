@@ -0,0 +1,757 @@
+/* libUIOHook: Cross-platform keyboard and mouse hooking from userland.
+ * Copyright (C) 2006-2023 Alexander Barker.  All Rights Reserved.
+ * https://github.com/kwhat/libuiohook/
+ *
+ * libUIOHook is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libUIOHook is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* XInput2 raw event capture backend.
+ *
+ * Unlike the XRecord backend this one needs a single xcb connection, selects the
+ * XI2 raw device events on the root window and receives them as compact generic
+ * events instead of whole recorded protocol packets. Raw events carry no window
+ * coordinates, so the pointer position is queried once at start and then tracked
+ * by the (accelerated) relative motion valuators. Tablets and virtual machine
+ * pointers report absolute device coordinates instead, the valuator modes are
+ * queried per device and such values are mapped to the screen like the server
+ * does. Raw events bypass the keyboard
+ * state as well, so EVENT_KEY_TYPED is never produced by this backend.
+ *
+ * The keyboard, button mapping and system properties helpers are shared with the
+ * XRecord backend in ../uiohook_x11.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "../uiohook.h"
+
+#include <xcb/xcb.h>
+#include <xcb/xinput.h>
+
+#include "../uiohook_logger.h"
+#include "../uiohook_motion.h"
+#include "../uiohook_x11/input_helper.h"
+
+// XInput2 version required for the raw events delivered regardless of grabs.
+#define XI2_MAJOR_VERSION 2
+#define XI2_MINOR_VERSION 2
+
+// Axis numbers of the pointer motion valuators.
+#define XI2_AXIS_X 0
+#define XI2_AXIS_Y 1
+
+// Device ids are below the server's MAXDEVICES.
+#define XI2_MAX_DEVICES 256
+
+typedef struct _hook_info {
+    xcb_connection_t *connection;
+    xcb_window_t root;
+    uint8_t opcode;
+    struct _input {
+        uint16_t mask;
+        struct _mouse {
+            bool is_dragged;
+            int16_t x, y;
+            uint16_t width, height;
+            double fraction_x, fraction_y;
+            struct _click {
+                unsigned short int count;
+                long int time;
+                unsigned short int button;
+            } click;
+        } mouse;
+    } input;
+    // The absolute pointer valuators of the slave devices by the device id, zeroed are relative.
+    struct _axis {
+        bool absolute;
+        double min, max;
+    } axes[XI2_MAX_DEVICES][XI2_AXIS_Y + 1];
+} hook_info;
+static hook_info *hook;
+
+// Wakes up the event loop from hook_stop(), guarded by the mutex; the hook thread alone sets it.
+static int hook_stop_fd = -1;
+static pthread_mutex_t hook_stop_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Virtual event pointer.
+static uiohook_event event;
+
+// Event dispatch callback.
+static dispatcher_t dispatcher = NULL;
+
+// Event delivery mode.
+static hook_mode dispatch_mode = HOOK_MODE_FULL;
+
+UIOHOOK_API void hook_set_dispatch_proc(dispatcher_t dispatch_proc) {
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Setting new dispatch callback to %#p.\n",
+            __FUNCTION__, __LINE__, dispatch_proc);
+
+    dispatcher = dispatch_proc;
+}
+
+UIOHOOK_API void hook_set_mode(hook_mode mode) {
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Setting new delivery mode to %u.\n",
+            __FUNCTION__, __LINE__, mode);
+
+    dispatch_mode = mode;
+}
+
+// Send out an event if a dispatcher was set.
+static inline void dispatch_event(uiohook_event *const event) {
+    if (dispatcher != NULL) {
+        motion_dispatch(dispatcher, event);
+    } else {
+        logger(LOG_LEVEL_WARN, "%s [%u]: No dispatch callback set!\n",
+                __FUNCTION__, __LINE__);
+    }
+}
+
+// Set the native modifier mask for future events.
+static inline void set_modifier_mask(uint16_t mask) {
+    hook->input.mask |= mask;
+}
+
+// Unset the native modifier mask for future events.
+static inline void unset_modifier_mask(uint16_t mask) {
+    hook->input.mask &= ~mask;
+}
+
+// Get the current native modifier mask state; the counting mode does not track the keyboard
+// modifiers, so only the button state is reported then.
+static inline uint16_t get_modifiers() {
+    if (dispatch_mode == HOOK_MODE_COUNT) {
+        return hook->input.mask & (MASK_BUTTON1 | MASK_BUTTON2 | MASK_BUTTON3 | MASK_BUTTON4 | MASK_BUTTON5);
+    }
+    return hook->input.mask;
+}
+
+// Map the X11 button to the virtual button and its modifier mask.
+static uint16_t button_to_virtual(unsigned int map_button, uint16_t *mask) {
+    switch (map_button) {
+        case Button1:  *mask = MASK_BUTTON1; return MOUSE_BUTTON1;
+        case Button2:  *mask = MASK_BUTTON2; return MOUSE_BUTTON2;
+        case Button3:  *mask = MASK_BUTTON3; return MOUSE_BUTTON3;
+        case XButton1: *mask = MASK_BUTTON4; return MOUSE_BUTTON4;
+        case XButton2: *mask = MASK_BUTTON5; return MOUSE_BUTTON5;
+        default:       *mask = 0x0000;       return MOUSE_NOBUTTON;
+    }
+}
+
+// Query the pointer position and the button state the raw events are tracked from.
+static void initialize_pointer(xcb_screen_t *screen) {
+    hook->input.mouse.width = screen->width_in_pixels;
+    hook->input.mouse.height = screen->height_in_pixels;
+    hook->input.mouse.fraction_x = 0;
+    hook->input.mouse.fraction_y = 0;
+
+    xcb_query_pointer_reply_t *reply = xcb_query_pointer_reply(hook->connection,
+            xcb_query_pointer(hook->connection, hook->root), NULL);
+    if (reply != NULL) {
+        hook->input.mouse.x = reply->root_x;
+        hook->input.mouse.y = reply->root_y;
+
+        if (reply->mask & XCB_KEY_BUT_MASK_BUTTON_1) { set_modifier_mask(MASK_BUTTON1); }
+        if (reply->mask & XCB_KEY_BUT_MASK_BUTTON_2) { set_modifier_mask(MASK_BUTTON2); }
+        if (reply->mask & XCB_KEY_BUT_MASK_BUTTON_3) { set_modifier_mask(MASK_BUTTON3); }
+        if (reply->mask & XCB_KEY_BUT_MASK_BUTTON_4) { set_modifier_mask(MASK_BUTTON4); }
+        if (reply->mask & XCB_KEY_BUT_MASK_BUTTON_5) { set_modifier_mask(MASK_BUTTON5); }
+
+        free(reply);
+    } else {
+        logger(LOG_LEVEL_WARN, "%s [%u]: xcb_query_pointer failed to get the pointer position!\n",
+                __FUNCTION__, __LINE__);
+
+        hook->input.mouse.x = hook->input.mouse.width / 2;
+        hook->input.mouse.y = hook->input.mouse.height / 2;
+    }
+}
+
+static inline double fp3232_to_double(xcb_input_fp3232_t value) {
+    return (double) value.integral + (double) value.frac / 4294967296.0;
+}
+
+// Find the slave devices whose pointer valuators are absolute, their raw values are device
+// coordinates within the valuator range rather than motion deltas.
+static void query_devices() {
+    memset(hook->axes, 0, sizeof(hook->axes));
+
+    xcb_input_xi_query_device_reply_t *reply = xcb_input_xi_query_device_reply(hook->connection,
+            xcb_input_xi_query_device(hook->connection, XCB_INPUT_DEVICE_ALL), NULL);
+    if (reply == NULL) {
+        logger(LOG_LEVEL_WARN, "%s [%u]: xcb_input_xi_query_device failed, the valuators are taken as relative!\n",
+                __FUNCTION__, __LINE__);
+        return;
+    }
+
+    xcb_input_xi_device_info_iterator_t info = xcb_input_xi_query_device_infos_iterator(reply);
+    for (; info.rem > 0; xcb_input_xi_device_info_next(&info)) {
+        if (info.data->deviceid >= XI2_MAX_DEVICES) {
+            continue;
+        }
+
+        xcb_input_device_class_iterator_t it = xcb_input_xi_device_info_classes_iterator(info.data);
+        for (; it.rem > 0; xcb_input_device_class_next(&it)) {
+            if (it.data->type != XCB_INPUT_DEVICE_CLASS_TYPE_VALUATOR) {
+                continue;
+            }
+
+            xcb_input_valuator_class_t *valuator = (xcb_input_valuator_class_t *) it.data;
+            double min = fp3232_to_double(valuator->min);
+            double max = fp3232_to_double(valuator->max);
+            if (valuator->number <= XI2_AXIS_Y && valuator->mode == XCB_INPUT_VALUATOR_MODE_ABSOLUTE && max > min) {
+                struct _axis *axis = &hook->axes[info.data->deviceid][valuator->number];
+                axis->absolute = true;
+                axis->min = min;
+                axis->max = max;
+
+                logger(LOG_LEVEL_DEBUG, "%s [%u]: Device %u axis %u is absolute in %f..%f.\n",
+                        __FUNCTION__, __LINE__, info.data->deviceid, valuator->number, min, max);
+            }
+        }
+    }
+
+    free(reply);
+}
+
+// Move the tracked pointer position by the raw motion valuators.
+static bool update_pointer(xcb_input_raw_button_press_event_t *raw) {
+    uint32_t *valuator_mask = xcb_input_raw_button_press_valuator_mask(raw);
+    xcb_input_fp3232_t *values = xcb_input_raw_button_press_axisvalues(raw);
+    int mask_bits = xcb_input_raw_button_press_valuator_mask_length(raw) * 32;
+    struct _axis *axes = raw->sourceid < XI2_MAX_DEVICES ? hook->axes[raw->sourceid] : NULL;
+
+    double dx = 0, dy = 0;
+    for (int axis = 0, index = 0; axis < mask_bits && axis <= XI2_AXIS_Y; axis++) {
+        if (valuator_mask[axis / 32] & (1u << (axis % 32))) {
+            double value = fp3232_to_double(values[index]);
+            if (axes != NULL && axes[axis].absolute) {
+                // The device range spans the whole screen, the move is the difference to
+                // the position of the previous sample.
+                int size = axis == XI2_AXIS_X ? hook->input.mouse.width : hook->input.mouse.height;
+                int position = (int) ((value - axes[axis].min) * (size - 1) / (axes[axis].max - axes[axis].min) + 0.5);
+                if (axis == XI2_AXIS_X) {
+                    value = position - hook->input.mouse.x;
+                    hook->input.mouse.fraction_x = 0;
+                } else {
+                    value = position - hook->input.mouse.y;
+                    hook->input.mouse.fraction_y = 0;
+                }
+            }
+
+            if (axis == XI2_AXIS_X) {
+                dx = value;
+            } else {
+                dy = value;
+            }
+            index++;
+        }
+    }
+
+    // Keep the sub-pixel remainder so slow movements are not lost.
+    dx += hook->input.mouse.fraction_x;
+    dy += hook->input.mouse.fraction_y;
+    int step_x = (int) dx;
+    int step_y = (int) dy;
+    hook->input.mouse.fraction_x = dx - step_x;
+    hook->input.mouse.fraction_y = dy - step_y;
+    if (step_x == 0 && step_y == 0) {
+        return false;
+    }
+
+    int x = hook->input.mouse.x + step_x;
+    int y = hook->input.mouse.y + step_y;
+    if (x < 0) { x = 0; } else if (x >= hook->input.mouse.width)  { x = hook->input.mouse.width - 1;  }
+    if (y < 0) { y = 0; } else if (y >= hook->input.mouse.height) { y = hook->input.mouse.height - 1; }
+    hook->input.mouse.x = (int16_t) x;
+    hook->input.mouse.y = (int16_t) y;
+
+    return true;
+}
+
+static void process_key(xcb_input_raw_key_press_event_t *raw, bool is_pressed) {
+    KeyCode keycode = (KeyCode) raw->detail;
+
+    event.time = raw->time;
+    event.reserved = 0x00;
+
+    event.type = is_pressed ? EVENT_KEY_PRESSED : EVENT_KEY_RELEASED;
+    event.mask = get_modifiers();
+
+    event.data.keyboard.rawcode = keycode;
+    event.data.keyboard.keychar = CHAR_UNDEFINED;
+    if (dispatch_mode == HOOK_MODE_COUNT) {
+        event.data.keyboard.keycode = VC_UNDEFINED;
+    } else {
+        uint16_t scancode = keycode_to_scancode(keycode);
+
+        // TODO If you have a better suggestion for this ugly, let me know.
+        uint16_t mask = 0x0000;
+        if      (scancode == VC_SHIFT_L)   { mask = MASK_SHIFT_L; }
+        else if (scancode == VC_SHIFT_R)   { mask = MASK_SHIFT_R; }
+        else if (scancode == VC_CONTROL_L) { mask = MASK_CTRL_L;  }
+        else if (scancode == VC_CONTROL_R) { mask = MASK_CTRL_R;  }
+        else if (scancode == VC_ALT_L)     { mask = MASK_ALT_L;   }
+        else if (scancode == VC_ALT_R)     { mask = MASK_ALT_R;   }
+        else if (scancode == VC_META_L)    { mask = MASK_META_L;  }
+        else if (scancode == VC_META_R)    { mask = MASK_META_R;  }
+        if (is_pressed) {
+            set_modifier_mask(mask);
+        } else {
+            unset_modifier_mask(mask);
+        }
+
+        event.mask = get_modifiers();
+        event.data.keyboard.keycode = scancode;
+    }
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Key %#X %s. (%#X)\n",
+            __FUNCTION__, __LINE__, event.data.keyboard.keycode,
+            is_pressed ? "pressed" : "released", event.data.keyboard.rawcode);
+
+    // Fire key pressed or released event.
+    dispatch_event(&event);
+}
+
+static void process_button_press(xcb_input_raw_button_press_event_t *raw) {
+    unsigned int map_button = button_map_lookup(raw->detail);
+
+    // X11 handles wheel events as button events.
+    if (map_button == WheelUp || map_button == WheelDown
+            || map_button == WheelLeft || map_button == WheelRight) {
+        // Reset the click count and previous button.
+        hook->input.mouse.click.count = 1;
+        hook->input.mouse.click.button = MOUSE_NOBUTTON;
+
+        // Populate mouse wheel event.
+        event.time = raw->time;
+        event.reserved = 0x00;
+
+        event.type = EVENT_MOUSE_WHEEL;
+        event.mask = get_modifiers();
+
+        event.data.wheel.clicks = hook->input.mouse.click.count;
+        event.data.wheel.x = hook->input.mouse.x;
+        event.data.wheel.y = hook->input.mouse.y;
+        event.data.wheel.type = WHEEL_UNIT_SCROLL;
+        event.data.wheel.amount = 3;
+        event.data.wheel.rotation = (map_button == WheelUp || map_button == WheelLeft) ? -1 : 1;
+        event.data.wheel.direction = (map_button == WheelUp || map_button == WheelDown)
+                ? WHEEL_VERTICAL_DIRECTION : WHEEL_HORIZONTAL_DIRECTION;
+
+        logger(LOG_LEVEL_DEBUG, "%s [%u]: Mouse wheel rotated %i units in the %u direction at %u, %u.\n",
+                __FUNCTION__, __LINE__, event.data.wheel.amount * event.data.wheel.rotation,
+                event.data.wheel.direction, event.data.wheel.x, event.data.wheel.y);
+
+        // Fire mouse wheel event.
+        dispatch_event(&event);
+        return;
+    }
+
+    uint16_t mask;
+    uint16_t button = button_to_virtual(map_button, &mask);
+    set_modifier_mask(mask);
+
+    // Track the number of clicks, the button must match the previous button.
+    if (button == hook->input.mouse.click.button && (long int) (raw->time - hook->input.mouse.click.time) <= hook_get_multi_click_time()) {
+        if (hook->input.mouse.click.count < USHRT_MAX) {
+            hook->input.mouse.click.count++;
+        }
+    } else {
+        hook->input.mouse.click.count = 1;
+        hook->input.mouse.click.button = button;
+    }
+    hook->input.mouse.click.time = raw->time;
+
+    // Populate mouse pressed event.
+    event.time = raw->time;
+    event.reserved = 0x00;
+
+    event.type = EVENT_MOUSE_PRESSED;
+    event.mask = get_modifiers();
+
+    event.data.mouse.button = button;
+    event.data.mouse.clicks = hook->input.mouse.click.count;
+    event.data.mouse.x = hook->input.mouse.x;
+    event.data.mouse.y = hook->input.mouse.y;
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Button %u  pressed %u time(s). (%u, %u)\n",
+            __FUNCTION__, __LINE__, event.data.mouse.button, event.data.mouse.clicks,
+            event.data.mouse.x, event.data.mouse.y);
+
+    // Fire mouse pressed event.
+    dispatch_event(&event);
+}
+
+static void process_button_release(xcb_input_raw_button_release_event_t *raw) {
+    unsigned int map_button = button_map_lookup(raw->detail);
+
+    // The wheel release events carry no information.
+    if (map_button == WheelUp || map_button == WheelDown
+            || map_button == WheelLeft || map_button == WheelRight) {
+        return;
+    }
+
+    uint16_t mask;
+    uint16_t button = button_to_virtual(map_button, &mask);
+    unset_modifier_mask(mask);
+
+    // Populate mouse released event.
+    event.time = raw->time;
+    event.reserved = 0x00;
+
+    event.type = EVENT_MOUSE_RELEASED;
+    event.mask = get_modifiers();
+
+    event.data.mouse.button = button;
+    event.data.mouse.clicks = hook->input.mouse.click.count;
+    event.data.mouse.x = hook->input.mouse.x;
+    event.data.mouse.y = hook->input.mouse.y;
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Button %u released %u time(s). (%u, %u)\n",
+            __FUNCTION__, __LINE__, event.data.mouse.button, event.data.mouse.clicks,
+            event.data.mouse.x, event.data.mouse.y);
+
+    // Fire mouse released event.
+    dispatch_event(&event);
+
+    // If the pressed event was not consumed...
+    if (event.reserved ^ 0x01 && hook->input.mouse.is_dragged != true) {
+        // Populate mouse clicked event.
+        event.time = raw->time;
+        event.reserved = 0x00;
+
+        event.type = EVENT_MOUSE_CLICKED;
+        event.mask = get_modifiers();
+
+        event.data.mouse.button = button;
+        event.data.mouse.clicks = hook->input.mouse.click.count;
+        event.data.mouse.x = hook->input.mouse.x;
+        event.data.mouse.y = hook->input.mouse.y;
+
+        logger(LOG_LEVEL_DEBUG, "%s [%u]: Button %u clicked %u time(s). (%u, %u)\n",
+                __FUNCTION__, __LINE__, event.data.mouse.button, event.data.mouse.clicks,
+                event.data.mouse.x, event.data.mouse.y);
+
+        // Fire mouse clicked event.
+        dispatch_event(&event);
+    }
+
+    // Reset the number of clicks.
+    if (button == hook->input.mouse.click.button && (long int) (event.time - hook->input.mouse.click.time) > hook_get_multi_click_time()) {
+        hook->input.mouse.click.count = 0;
+    }
+}
+
+static void process_motion(xcb_input_raw_motion_event_t *raw) {
+    if (!update_pointer(raw)) {
+        return;
+    }
+
+    // Reset the click count.
+    if (hook->input.mouse.click.count != 0 && (long int) (raw->time - hook->input.mouse.click.time) > hook_get_multi_click_time()) {
+        hook->input.mouse.click.count = 0;
+    }
+
+    // Populate mouse move event.
+    event.time = raw->time;
+    event.reserved = 0x00;
+
+    event.mask = get_modifiers();
+
+    // Check the button masks to set the mouse dragged flag.
+    hook->input.mouse.is_dragged = ((event.mask & 0x1F00) > 0);
+    event.type = hook->input.mouse.is_dragged ? EVENT_MOUSE_DRAGGED : EVENT_MOUSE_MOVED;
+
+    event.data.mouse.button = MOUSE_NOBUTTON;
+    event.data.mouse.clicks = hook->input.mouse.click.count;
+    event.data.mouse.x = hook->input.mouse.x;
+    event.data.mouse.y = hook->input.mouse.y;
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Mouse %s to %i, %i. (%#X)\n",
+            __FUNCTION__, __LINE__, hook->input.mouse.is_dragged ? "dragged" : "moved",
+            event.data.mouse.x, event.data.mouse.y, event.mask);
+
+    // Fire mouse move event.
+    dispatch_event(&event);
+}
+
+static void process_generic_event(xcb_ge_generic_event_t *generic) {
+    switch (generic->event_type) {
+        case XCB_INPUT_RAW_KEY_PRESS:
+            process_key((xcb_input_raw_key_press_event_t *) generic, true);
+            break;
+
+        case XCB_INPUT_RAW_KEY_RELEASE:
+            process_key((xcb_input_raw_key_release_event_t *) generic, false);
+            break;
+
+        case XCB_INPUT_RAW_BUTTON_PRESS:
+            process_button_press((xcb_input_raw_button_press_event_t *) generic);
+            break;
+
+        case XCB_INPUT_RAW_BUTTON_RELEASE:
+            process_button_release((xcb_input_raw_button_release_event_t *) generic);
+            break;
+
+        case XCB_INPUT_RAW_MOTION:
+            process_motion((xcb_input_raw_motion_event_t *) generic);
+            break;
+
+        case XCB_INPUT_HIERARCHY:
+            query_devices();
+            break;
+
+        case XCB_INPUT_DEVICE_CHANGED:
+            // The master devices change on every slave switch, which the raw events tell by the source.
+            if (((xcb_input_device_changed_event_t *) generic)->reason == XCB_INPUT_CHANGE_REASON_DEVICE_CHANGE) {
+                query_devices();
+            }
+            break;
+
+        default:
+            logger(LOG_LEVEL_DEBUG, "%s [%u]: Unhandled XInput2 event: %#X.\n",
+                    __FUNCTION__, __LINE__, (unsigned int) generic->event_type);
+            break;
+    }
+}
+
+static int xinput_block() {
+    // Sleep on the connection and the stop event, there are no periodic wakeups.
+    struct pollfd fds[2] = {
+        { .fd = xcb_get_file_descriptor(hook->connection), .events = POLLIN, .revents = 0 },
+        { .fd = hook_stop_fd, .events = POLLIN, .revents = 0 }
+    };
+
+    // Populate and fire the hook start event.
+    load_input_helper();
+
+    event.time = 0;
+    event.reserved = 0x00;
+    event.type = EVENT_HOOK_ENABLED;
+    event.mask = 0x00;
+    dispatch_event(&event);
+
+    int status = UIOHOOK_SUCCESS;
+    bool running = true;
+    while (running) {
+        xcb_generic_event_t *ev;
+        while ((ev = xcb_poll_for_event(hook->connection)) != NULL) {
+            if ((ev->response_type & ~0x80) == XCB_GE_GENERIC
+                    && ((xcb_ge_generic_event_t *) ev)->extension == hook->opcode) {
+                process_generic_event((xcb_ge_generic_event_t *) ev);
+            }
+            free(ev);
+        }
+
+        if (xcb_connection_has_error(hook->connection)) {
+            logger(LOG_LEVEL_ERROR, "%s [%u]: XCB connection lost!\n",
+                    __FUNCTION__, __LINE__);
+
+            status = UIOHOOK_ERROR_X_OPEN_DISPLAY;
+            break;
+        }
+
+        motion_expire(dispatcher);
+
+        // Sleep until the next event, or until the pending motion sample is due.
+        if (poll(fds, 2, motion_timeout()) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            logger(LOG_LEVEL_ERROR, "%s [%u]: poll failure! (%d)\n",
+                    __FUNCTION__, __LINE__, errno);
+
+            status = UIOHOOK_FAILURE;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            running = false;
+        }
+    }
+
+    // Populate and fire the hook stop event.
+    event.time = 0;
+    event.reserved = 0x00;
+    event.type = EVENT_HOOK_DISABLED;
+    event.mask = 0x00;
+    dispatch_event(&event);
+
+    unload_input_helper();
+
+    return status;
+}
+
+static int xinput_select() {
+    struct {
+        xcb_input_event_mask_t head;
+        uint32_t mask;
+        xcb_input_event_mask_t devices_head;
+        uint32_t devices_mask;
+    } selection;
+
+    selection.head.deviceid = XCB_INPUT_DEVICE_ALL_MASTER;
+    selection.head.mask_len = 1;
+    selection.mask = XCB_INPUT_XI_EVENT_MASK_RAW_KEY_PRESS
+            | XCB_INPUT_XI_EVENT_MASK_RAW_KEY_RELEASE
+            | XCB_INPUT_XI_EVENT_MASK_RAW_BUTTON_PRESS
+            | XCB_INPUT_XI_EVENT_MASK_RAW_BUTTON_RELEASE
+            | XCB_INPUT_XI_EVENT_MASK_RAW_MOTION;
+
+    // Plugged in or reconfigured devices may change the valuator modes.
+    selection.devices_head.deviceid = XCB_INPUT_DEVICE_ALL;
+    selection.devices_head.mask_len = 1;
+    selection.devices_mask = XCB_INPUT_XI_EVENT_MASK_HIERARCHY
+            | XCB_INPUT_XI_EVENT_MASK_DEVICE_CHANGED;
+
+    xcb_generic_error_t *error = xcb_request_check(hook->connection,
+            xcb_input_xi_select_events_checked(hook->connection, hook->root, 2, &selection.head));
+    if (error != NULL) {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: xcb_input_xi_select_events failure! (%u)\n",
+                __FUNCTION__, __LINE__, error->error_code);
+
+        free(error);
+        return UIOHOOK_ERROR_X_INPUT_SELECT_EVENTS;
+    }
+
+    query_devices();
+
+    return xinput_block();
+}
+
+static int xinput_query() {
+    const xcb_query_extension_reply_t *extension = xcb_get_extension_data(hook->connection, &xcb_input_id);
+    if (extension == NULL || !extension->present) {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: XInput extension is not currently available!\n",
+                __FUNCTION__, __LINE__);
+
+        return UIOHOOK_ERROR_X_INPUT_NOT_FOUND;
+    }
+    hook->opcode = extension->major_opcode;
+
+    xcb_input_xi_query_version_reply_t *version = xcb_input_xi_query_version_reply(hook->connection,
+            xcb_input_xi_query_version(hook->connection, XI2_MAJOR_VERSION, XI2_MINOR_VERSION), NULL);
+    if (version == NULL || version->major_version < XI2_MAJOR_VERSION
+            || (version->major_version == XI2_MAJOR_VERSION && version->minor_version < XI2_MINOR_VERSION)) {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: XInput %i.%i is not currently available!\n",
+                __FUNCTION__, __LINE__, XI2_MAJOR_VERSION, XI2_MINOR_VERSION);
+
+        free(version);
+        return UIOHOOK_ERROR_X_INPUT_NOT_FOUND;
+    }
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: XInput version: %i.%i.\n",
+            __FUNCTION__, __LINE__, version->major_version, version->minor_version);
+    free(version);
+
+    return xinput_select();
+}
+
+static int xinput_start() {
+    int status = UIOHOOK_FAILURE;
+
+    int screen_number = 0;
+    hook->connection = xcb_connect(NULL, &screen_number);
+    if (xcb_connection_has_error(hook->connection) == 0) {
+        logger(LOG_LEVEL_DEBUG, "%s [%u]: xcb_connect successful.\n",
+                __FUNCTION__, __LINE__);
+
+        xcb_screen_iterator_t it = xcb_setup_roots_iterator(xcb_get_setup(hook->connection));
+        for (int i = 0; i < screen_number && it.rem > 0; i++) {
+            xcb_screen_next(&it);
+        }
+        hook->root = it.data->root;
+
+        initialize_pointer(it.data);
+
+        status = xinput_query();
+    } else {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: xcb_connect failure!\n",
+                __FUNCTION__, __LINE__);
+
+        status = UIOHOOK_ERROR_X_OPEN_DISPLAY;
+    }
+
+    xcb_disconnect(hook->connection);
+    hook->connection = NULL;
+
+    return status;
+}
+
+UIOHOOK_API int hook_run() {
+    // Hook data for future cleanup.
+    hook = calloc(1, sizeof(hook_info));
+    if (hook == NULL) {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: Failed to allocate memory for hook structure!\n",
+              __FUNCTION__, __LINE__);
+
+        return UIOHOOK_ERROR_OUT_OF_MEMORY;
+    }
+
+    hook->input.mouse.click.button = MOUSE_NOBUTTON;
+
+    int status = UIOHOOK_FAILURE;
+    pthread_mutex_lock(&hook_stop_mutex);
+    hook_stop_fd = eventfd(0, EFD_CLOEXEC);
+    pthread_mutex_unlock(&hook_stop_mutex);
+    if (hook_stop_fd >= 0) {
+        status = xinput_start();
+
+        pthread_mutex_lock(&hook_stop_mutex);
+        close(hook_stop_fd);
+        hook_stop_fd = -1;
+        pthread_mutex_unlock(&hook_stop_mutex);
+    } else {
+        logger(LOG_LEVEL_ERROR, "%s [%u]: eventfd failure! (%d)\n",
+                __FUNCTION__, __LINE__, errno);
+    }
+
+    // Free data associated with this hook.
+    free(hook);
+    hook = NULL;
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Something, something, something, complete.\n",
+            __FUNCTION__, __LINE__);
+
+    return status;
+}
+
+UIOHOOK_API int hook_stop() {
+    int status = UIOHOOK_FAILURE;
+
+    // hook_run() closes the fd under the same lock, so it is never a closed or reused one.
+    pthread_mutex_lock(&hook_stop_mutex);
+    if (hook_stop_fd >= 0) {
+        uint64_t value = 1;
+        if (write(hook_stop_fd, &value, sizeof(value)) == sizeof(value)) {
+            status = UIOHOOK_SUCCESS;
+        }
+    }
+    pthread_mutex_unlock(&hook_stop_mutex);
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Status: %#X.\n",
+            __FUNCTION__, __LINE__, status);
+
+    return status;
+}
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+# The minute rows inserted one transaction per row, as before the group commit, against the
+# groups of SqliteProducer::CommitCount rows in one transaction, both by the prepared upsert
+# of the rows table into a WAL file with synchronous=NORMAL and FULL. A tenth of the rows
+# collide with a row of the same project and are merged, as after a restart within the same
+# minute. The median of 3 runs on a fresh file each; exits 1 when the merged totals differ.
+#   python3 tests/bench/commit.py [work directory]
+import os
+import sqlite3
+import sys
+import tempfile
+import time
+
+WORK = sys.argv[1] if len(sys.argv) > 1 else tempfile.mkdtemp()
+DAY0 = 1735689600  # 2025-01-01
+ROWS = 5000
+COMMIT_COUNT = 256  # SqliteProducer::CommitCount
+UPSERT = ("INSERT INTO t VALUES (?,?,NULL,?,?,?,NULL,255,1) ON CONFLICT(LocalTime) DO UPDATE SET"
+          " KeyPresses=IFNULL(KeyPresses,0)+IFNULL(excluded.KeyPresses,0),"
+          " MouseClicks=IFNULL(MouseClicks,0)+IFNULL(excluded.MouseClicks,0),"
+          " MouseDistance=IFNULL(MouseDistance,0)+IFNULL(excluded.MouseDistance,0),"
+          " ServerStatus=NULL, SyncState=1 WHERE ProjectRef=excluded.ProjectRef")
+
+
+def records():
+    rows, minute = [], 0
+    for i in range(ROWS):
+        if i % 10 != 9:  # every tenth one repeats the minute before
+            minute += 1
+        rows.append((DAY0 + minute * 60, 1 + minute // 90 % 8, 10, 2, 300))
+    return rows
+
+
+def setup(path, synchronous):
+    for suffix in ("", "-wal", "-shm"):
+        if os.path.exists(path + suffix):
+            os.remove(path + suffix)
+    db = sqlite3.connect(path, isolation_level=None)
+    db.execute("PRAGMA journal_mode=WAL")
+    db.execute("PRAGMA synchronous=%d" % synchronous)
+    db.execute("PRAGMA wal_autocheckpoint=0")
+    db.execute("CREATE TABLE t (LocalTime INTEGER PRIMARY KEY NOT NULL, ProjectRef INTEGER NOT NULL, NoteRef INTEGER,"
+               " KeyPresses INTEGER, MouseClicks INTEGER, MouseDistance INTEGER, ServerStatus TEXT, ActiveMask INTEGER,"
+               " SyncState INTEGER) WITHOUT ROWID")
+    return db
+
+
+def per_row(db, rows):
+    for row in rows:
+        db.execute("BEGIN")
+        db.execute(UPSERT, row)
+        db.execute("COMMIT")
+
+
+def grouped(db, rows):
+    for i in range(0, len(rows), COMMIT_COUNT):
+        db.execute("BEGIN")
+        db.executemany(UPSERT, rows[i:i + COMMIT_COUNT])
+        db.execute("COMMIT")
+
+
+def measure(name, insert, synchronous, rows):
+    times, totals = [], None
+    for run in range(3):
+        db = setup(os.path.join(WORK, "commit-%s-%d.db" % (name, run)), synchronous)
+        start = time.perf_counter()
+        insert(db, rows)
+        times.append(time.perf_counter() - start)
+        totals = db.execute("SELECT COUNT(*), TOTAL(KeyPresses), TOTAL(MouseDistance) FROM t").fetchone()
+        db.close()
+    times.sort()
+    elapsed = times[1]
+    print("%-8s synchronous=%d  %7.1f ms  %9.0f rows/s  %8.1f us/row" % (name, synchronous, elapsed * 1000,
+                                                                      len(rows) / elapsed, elapsed * 1e6 / len(rows)))
+    return totals
+
+
+def main():
+    rows = records()
+    print("sqlite", sqlite3.sqlite_version, "rows", ROWS, "group", COMMIT_COUNT)
+    ok = True
+    for synchronous in (1, 2):
+        single = measure("per-row", per_row, synchronous, rows)
+        group = measure("group", grouped, synchronous, rows)
+        ok = ok and single == group and group[1] == ROWS * 10
+    if not ok:
+        print("the merged totals differ")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
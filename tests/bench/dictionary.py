@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+# The file size and the scan times of a synthetic year of minute rows stored with the text
+# ProjectId and TextNote against the Projects and Notes dictionaries behind the view, the
+# layout of SqliteProducer::prepareTable(). Needs only the Python sqlite3 module.
+#   python3 tests/bench/dictionary.py [work directory]
+import os
+import random
+import sqlite3
+import sys
+import tempfile
+import time
+import uuid
+
+WORK = sys.argv[1] if len(sys.argv) > 1 else tempfile.mkdtemp()
+DAY0 = 1735689600  # 2025-01-01
+
+COLUMNS = ("LocalTime INTEGER PRIMARY KEY NOT NULL, {project}, {note}, KeyPresses INTEGER,"
+           " MouseClicks INTEGER, MouseDistance INTEGER, ServerStatus TEXT, ActiveMask INTEGER")
+
+
+def synthetic_year():
+    random.seed(1)
+    projects = [str(uuid.uuid4()) for _ in range(6)]
+    notes = ["Reviewing pull request #%d for the sync module" % i for i in range(30)]
+    rows = []
+    for day in range(365):
+        for minute in range(600):  # 10 active hours
+            rows.append((DAY0 + day * 86400 + 8 * 3600 + minute * 60,
+                         projects[(day + minute // 90) % 6], notes[(day * 7 + minute // 45) % 30],
+                         random.randint(0, 200), random.randint(0, 40), random.randint(0, 5000),
+                         None, random.getrandbits(60)))
+    return projects, notes, rows
+
+
+def plain(path, projects, notes, rows):
+    db = sqlite3.connect(path)
+    db.execute("CREATE TABLE 'w' (%s) WITHOUT ROWID"
+               % COLUMNS.format(project="ProjectId TEXT NOT NULL", note="TextNote TEXT"))
+    db.executemany("INSERT INTO 'w' VALUES (?,?,?,?,?,?,?,?)", rows)
+    db.commit()
+    db.execute("VACUUM")
+    db.close()
+
+
+def dictionary(path, projects, notes, rows):
+    db = sqlite3.connect(path)
+    db.execute("CREATE TABLE Projects (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)")
+    db.execute("CREATE TABLE Notes (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)")
+    db.execute("CREATE TABLE 'w#rows' (%s) WITHOUT ROWID"
+               % COLUMNS.format(project="ProjectRef INTEGER NOT NULL", note="NoteRef INTEGER"))
+    db.execute("CREATE VIEW 'w' AS SELECT r.LocalTime AS LocalTime, p.Value AS ProjectId, n.Value AS TextNote,"
+               " r.KeyPresses AS KeyPresses, r.MouseClicks AS MouseClicks, r.MouseDistance AS MouseDistance,"
+               " r.ServerStatus AS ServerStatus, r.ActiveMask AS ActiveMask FROM 'w#rows' AS r"
+               " JOIN Projects AS p ON p.Id=r.ProjectRef LEFT JOIN Notes AS n ON n.Id=r.NoteRef")
+    project_ids = {p: db.execute("INSERT INTO Projects (Value) VALUES (?)", (p,)).lastrowid for p in projects}
+    note_ids = {n: db.execute("INSERT INTO Notes (Value) VALUES (?)", (n,)).lastrowid for n in notes}
+    db.executemany("INSERT INTO 'w#rows' VALUES (?,?,?,?,?,?,?,?)",
+                   [(r[0], project_ids[r[1]], note_ids[r[2]]) + r[3:] for r in rows])
+    db.commit()
+    db.execute("VACUUM")
+    db.close()
+
+
+def best_of(db, query, args=(), runs=5):
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        db.execute(query, args).fetchall()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best * 1000
+
+
+def main():
+    projects, notes, rows = synthetic_year()
+    print("sqlite", sqlite3.sqlite_version, "rows", len(rows))
+    for name, create in (("plain", plain), ("dictionary", dictionary)):
+        path = os.path.join(WORK, name + ".db")
+        if os.path.exists(path):
+            os.remove(path)
+        create(path, projects, notes, rows)
+        db = sqlite3.connect(path)
+        scan = best_of(db, "SELECT ProjectId, COUNT(*), TOTAL(KeyPresses), TOTAL(MouseClicks), TOTAL(MouseDistance)"
+                           " FROM 'w' GROUP BY ProjectId")
+        tail = best_of(db, "SELECT COUNT(*), TOTAL(KeyPresses) FROM 'w' WHERE LocalTime > ?", (DAY0 + 300 * 86400,))
+        db.close()
+        print("%-10s %8d KiB  group by project %6.1f ms  range %5.1f ms"
+              % (name, os.path.getsize(path) // 1024, scan, tail))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+# The latency of the partition migration steps: a month of plain minute rows with the
+# 10 minute rollup is renamed to <table>#plain and moved into the dictionary encoded rows
+# table MIGRATE_ROWS at a time, as SqliteProducer::migrateEncoding() does. A row inserted
+# in the middle is merged and the rollup must still add up to the rows.
+#   python3 tests/bench/migration.py [work directory]
+import os
+import random
+import sqlite3
+import sys
+import tempfile
+import time
+
+WORK = sys.argv[1] if len(sys.argv) > 1 else tempfile.mkdtemp()
+MIGRATE_ROWS = 250  # SqliteProducer::MigrateRows
+SCHEMA = "m1"
+TABLE = "0x1234"
+ROLLUP = TABLE + "@600"
+PLAIN = TABLE + "#plain"
+ROWS = TABLE + "#rows"
+DAY0 = 1790000000
+
+
+def upsert(project):
+    return ("INSERT INTO '%s' (BucketTime, ProjectId, RowCount, KeyPresses, MouseClicks, MouseDistance, ActiveSeconds)"
+            " VALUES (NEW.LocalTime/600*600, %s, 1, IFNULL(NEW.KeyPresses,0), IFNULL(NEW.MouseClicks,0),"
+            " IFNULL(NEW.MouseDistance,0), 0) ON CONFLICT(BucketTime, ProjectId) DO UPDATE SET RowCount=RowCount+1,"
+            " KeyPresses=KeyPresses+excluded.KeyPresses, MouseClicks=MouseClicks+excluded.MouseClicks,"
+            " MouseDistance=MouseDistance+excluded.MouseDistance, ActiveSeconds=ActiveSeconds+excluded.ActiveSeconds;"
+            % (ROLLUP, project))
+
+
+def remove(project):
+    return ("UPDATE '%s' SET RowCount=RowCount-1, KeyPresses=KeyPresses-IFNULL(OLD.KeyPresses,0),"
+            " MouseClicks=MouseClicks-IFNULL(OLD.MouseClicks,0), MouseDistance=MouseDistance-IFNULL(OLD.MouseDistance,0)"
+            " WHERE BucketTime=OLD.LocalTime/600*600 AND ProjectId=%s;"
+            " DELETE FROM '%s' WHERE BucketTime=OLD.LocalTime/600*600 AND ProjectId=%s AND RowCount<=0;"
+            % (ROLLUP, project, ROLLUP, project))
+
+
+def totals(db):
+    return db.execute("SELECT ProjectId, SUM(RowCount), SUM(KeyPresses) FROM %s.'%s' GROUP BY 1 ORDER BY 1"
+                      % (SCHEMA, ROLLUP)).fetchall()
+
+
+def rows(db):
+    return db.execute("SELECT ProjectId, COUNT(*), SUM(KeyPresses) FROM %s.'%s' GROUP BY 1 ORDER BY 1"
+                      % (SCHEMA, TABLE)).fetchall()
+
+
+def main():
+    main_path = os.path.join(WORK, "main.db")
+    part_path = os.path.join(WORK, "part.db")
+    for path in (main_path, part_path):
+        for suffix in ("", "-wal", "-shm"):
+            if os.path.exists(path + suffix):
+                os.remove(path + suffix)
+    db = sqlite3.connect(main_path, isolation_level=None)
+    db.execute("ATTACH '%s' AS %s" % (part_path, SCHEMA))
+    db.execute("PRAGMA %s.journal_mode=WAL" % SCHEMA)
+
+    # the plain table of an older version with its rollup
+    db.execute("CREATE TABLE %s.'%s' (LocalTime INTEGER PRIMARY KEY NOT NULL, ProjectId TEXT NOT NULL, TextNote TEXT,"
+               " KeyPresses INTEGER, MouseClicks INTEGER, MouseDistance INTEGER, ServerStatus TEXT, ActiveMask INTEGER)"
+               " WITHOUT ROWID" % (SCHEMA, TABLE))
+    db.execute("CREATE TABLE %s.'%s' (BucketTime INTEGER NOT NULL, ProjectId TEXT NOT NULL, RowCount INTEGER,"
+               " KeyPresses INTEGER, MouseClicks INTEGER, MouseDistance INTEGER, ActiveSeconds INTEGER,"
+               " PRIMARY KEY (BucketTime, ProjectId)) WITHOUT ROWID" % (SCHEMA, ROLLUP))
+    db.execute("CREATE TRIGGER %s.'%s@insert' AFTER INSERT ON '%s' BEGIN %s END"
+               % (SCHEMA, TABLE, TABLE, upsert("NEW.ProjectId")))
+    random.seed(1)
+    db.execute("BEGIN")
+    for i in range(43000):
+        db.execute("INSERT INTO %s.'%s' VALUES (?,?,?,?,?,?,?,?)" % (SCHEMA, TABLE),
+                   (DAY0 + i * 60, "proj%d" % random.randrange(6), random.choice(["", "note%d" % random.randrange(30)]),
+                    random.randrange(100), random.randrange(50), random.randrange(5000), None if i % 3 else "ok", 0))
+    db.execute("COMMIT")
+
+    # the first step: the plain rows behind the view, the encoded table takes the inserts
+    view = ("SELECT r.LocalTime AS LocalTime, p.Value AS ProjectId, n.Value AS TextNote, r.KeyPresses AS KeyPresses,"
+            " r.MouseClicks AS MouseClicks, r.MouseDistance AS MouseDistance, r.ServerStatus AS ServerStatus,"
+            " r.ActiveMask AS ActiveMask FROM '%s' AS r JOIN 'Projects' AS p ON p.Id=r.ProjectRef"
+            " LEFT JOIN 'Notes' AS n ON n.Id=r.NoteRef" % ROWS)
+    project_new = "(SELECT Value FROM 'Projects' WHERE Id=NEW.ProjectRef)"
+    project_old = "(SELECT Value FROM 'Projects' WHERE Id=OLD.ProjectRef)"
+    db.execute("BEGIN")
+    db.execute("ALTER TABLE %s.'%s' RENAME TO '%s'" % (SCHEMA, TABLE, PLAIN))
+    db.execute("DROP TRIGGER %s.'%s@insert'" % (SCHEMA, TABLE))
+    db.execute("CREATE TRIGGER %s.'%s@delete' AFTER DELETE ON '%s' BEGIN %s END"
+               % (SCHEMA, TABLE, PLAIN, remove("OLD.ProjectId")))
+    db.execute("CREATE TABLE %s.'Projects' (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)" % SCHEMA)
+    db.execute("CREATE TABLE %s.'Notes' (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)" % SCHEMA)
+    db.execute("CREATE TABLE %s.'%s' (LocalTime INTEGER PRIMARY KEY NOT NULL, ProjectRef INTEGER NOT NULL,"
+               " NoteRef INTEGER, KeyPresses INTEGER, MouseClicks INTEGER, MouseDistance INTEGER, ServerStatus TEXT,"
+               " ActiveMask INTEGER) WITHOUT ROWID" % (SCHEMA, ROWS))
+    db.execute("CREATE VIEW %s.'%s' AS %s UNION ALL SELECT LocalTime, ProjectId, TextNote, KeyPresses, MouseClicks,"
+               " MouseDistance, ServerStatus, ActiveMask FROM '%s'" % (SCHEMA, TABLE, view, PLAIN))
+    db.execute("CREATE TRIGGER %s.'%s@insert' AFTER INSERT ON '%s' BEGIN %s END"
+               % (SCHEMA, TABLE, ROWS, upsert(project_new)))
+    db.execute("CREATE TRIGGER %s.'%s@update' AFTER UPDATE OF ProjectRef, KeyPresses ON '%s' BEGIN %s%s END"
+               % (SCHEMA, TABLE, ROWS, remove(project_old), upsert(project_new)))
+    db.execute("COMMIT")
+
+    # a live insert on a LocalTime of the plain rows
+    db.execute("INSERT OR IGNORE INTO %s.'Projects' (Value) VALUES ('proj1')" % SCHEMA)
+    project = db.execute("SELECT Id FROM %s.'Projects' WHERE Value='proj1'" % SCHEMA).fetchone()[0]
+    db.execute("INSERT INTO %s.'%s' (LocalTime, ProjectRef, KeyPresses, MouseClicks, MouseDistance)"
+               " VALUES (%d, %d, 1, 1, 1)" % (SCHEMA, ROWS, DAY0 + 5 * 60, project))
+
+    chunk = "SELECT * FROM %s.'%s' ORDER BY LocalTime LIMIT %d" % (SCHEMA, PLAIN, MIGRATE_ROWS)
+    latency = []
+    while True:
+        start = time.perf_counter()
+        db.execute("BEGIN")
+        db.execute("INSERT OR IGNORE INTO %s.'Projects' (Value) SELECT DISTINCT ProjectId FROM (%s)" % (SCHEMA, chunk))
+        db.execute("INSERT OR IGNORE INTO %s.'Notes' (Value) SELECT DISTINCT TextNote FROM (%s) WHERE TextNote<>''"
+                   % (SCHEMA, chunk))
+        db.execute("INSERT INTO %s.'%s' (LocalTime, ProjectRef, NoteRef, KeyPresses, MouseClicks, MouseDistance,"
+                   " ServerStatus, ActiveMask) SELECT c.LocalTime, (SELECT Id FROM %s.'Projects' WHERE Value=c.ProjectId),"
+                   " (SELECT Id FROM %s.'Notes' WHERE Value=c.TextNote), c.KeyPresses, c.MouseClicks, c.MouseDistance,"
+                   " c.ServerStatus, c.ActiveMask FROM (%s) AS c WHERE 1 ON CONFLICT(LocalTime) DO UPDATE SET"
+                   " KeyPresses=KeyPresses+excluded.KeyPresses, MouseClicks=MouseClicks+excluded.MouseClicks,"
+                   " MouseDistance=MouseDistance+excluded.MouseDistance,"
+                   " ActiveMask=IFNULL(ActiveMask,0)|IFNULL(excluded.ActiveMask,0), ServerStatus=NULL"
+                   % (SCHEMA, ROWS, SCHEMA, SCHEMA, chunk))
+        moved = db.execute("DELETE FROM %s.'%s' WHERE LocalTime IN (SELECT LocalTime FROM (%s))"
+                           % (SCHEMA, PLAIN, chunk)).rowcount
+        db.execute("COMMIT")
+        latency.append((time.perf_counter() - start) * 1000)
+        if moved < MIGRATE_ROWS:
+            break
+
+    # the last step
+    db.execute("BEGIN")
+    db.execute("DROP VIEW %s.'%s'" % (SCHEMA, TABLE))
+    db.execute("DROP TABLE %s.'%s'" % (SCHEMA, PLAIN))
+    db.execute("CREATE VIEW %s.'%s' AS %s" % (SCHEMA, TABLE, view))
+    db.execute("PRAGMA %s.user_version=1" % SCHEMA)
+    db.execute("COMMIT")
+    exact = totals(db) == rows(db)
+
+    latency.sort()
+    print("sqlite", sqlite3.sqlite_version)
+    print("rollup", "exact" if exact else "DIFFERS %s != %s" % (totals(db), rows(db)))
+    print("rows", db.execute("SELECT COUNT(*) FROM %s.'%s'" % (SCHEMA, TABLE)).fetchone()[0])
+    print("steps %d of %d rows: median %.2f ms, p99 %.2f ms, max %.2f ms, total %.0f ms"
+          % (len(latency), MIGRATE_ROWS, latency[len(latency) // 2], latency[int(len(latency) * 0.99)],
+             latency[-1], sum(latency)))
+    return 0 if exact else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
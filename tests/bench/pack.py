@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+# The cold storage of a synthetic year, as tests/pack/tst_activitypack.cpp builds it: the
+# vacuumed file of the rows table with the dictionaries against the one of the packed
+# project days in the ActivityPack format (the varint columns, the string table and the
+# qCompress framing: the 4 byte big endian length and the zlib stream). Once as the test
+# lays them out and once with the RowHash and the ChainHash the producer writes now.
+# The full history scan reads every row back with its keys: the rows table by one SELECT,
+# the packed days by one SELECT and the unpack; the unpack here is Python, slower than
+# ActivityPack::unpack, so the packed scan time is an upper bound. The median of 3 runs;
+# exits 1 when a scan does not read back the keys written.
+#   python3 tests/bench/pack.py [work directory]
+import hashlib
+import os
+import random
+import sqlite3
+import struct
+import sys
+import tempfile
+import time
+import zlib
+
+WORK = sys.argv[1] if len(sys.argv) > 1 else tempfile.mkdtemp()
+YEAR_START = 1767225600  # 2026-01-01 UTC
+YEAR_PROJECTS = 6
+FORMAT_VERSION = 1
+PACKED_COMPRESSED = 0x01
+COMPRESS_MIN = 64
+MASK60 = (1 << 60) - 1
+
+
+def project_id(project):
+    return "{00000000-0000-4000-8000-%012d}" % project
+
+
+def year_days():
+    # 1 to 3 sessions a day of 1 to 5 hours on a random project each
+    rnd = random.Random(1)
+    year = {}
+    for d in range(365):
+        day_time = YEAR_START + d * 86400
+        days = year.setdefault(day_time, {})
+        t = day_time + 8 * 3600
+        for _ in range(1 + rnd.randrange(3)):
+            project = rnd.randrange(YEAR_PROJECTS)
+            note = rnd.randrange(31)
+            status = "Server: accepted %d" % rnd.randrange(3)
+            for _ in range(60 + rnd.randrange(240)):
+                mask = MASK60 if rnd.randrange(5) else rnd.getrandbits(64) & MASK60
+                days.setdefault(project, []).append(
+                    (t, rnd.randrange(120), rnd.randrange(40), rnd.randrange(8000), mask,
+                     "Working on the task number %d" % (note - 1) if note else "", status))
+                t += 60
+            t += 1800
+    return year
+
+
+def put_varint(out, value):
+    while value >= 0x80:
+        out.append((value & 0x7f) | 0x80)
+        value >>= 7
+    out.append(value)
+
+
+def pack(day_time, rows):
+    strings, index = [], {}
+
+    def string_index(text):
+        if not text:
+            return 0
+        if text not in index:
+            strings.append(text)
+            index[text] = len(strings)
+        return index[text]
+
+    notes = [string_index(r[5]) for r in rows]
+    status = [string_index(r[6]) for r in rows]
+    payload = bytearray()
+    put_varint(payload, len(rows))
+    put_varint(payload, len(strings))
+    for text in strings:
+        utf8 = text.encode()
+        put_varint(payload, len(utf8))
+        payload += utf8
+    last = day_time
+    for r in rows:
+        put_varint(payload, r[0] - last)
+        last = r[0]
+    for column in range(1, 5):
+        for r in rows:
+            put_varint(payload, r[column])
+    for i in notes + status:
+        put_varint(payload, i)
+    if len(payload) >= COMPRESS_MIN:
+        packed = struct.pack(">I", len(payload)) + zlib.compress(bytes(payload))
+        if len(packed) < len(payload):
+            return bytes([FORMAT_VERSION, PACKED_COMPRESSED]) + packed
+    return bytes([FORMAT_VERSION, 0]) + bytes(payload)
+
+
+def get_varint(payload, p):
+    value = shift = 0
+    while True:
+        byte = payload[p]
+        p += 1
+        value |= (byte & 0x7f) << shift
+        if not byte & 0x80:
+            return value, p
+        shift += 7
+
+
+def unpack(day_time, blob):
+    payload = zlib.decompress(blob[6:]) if blob[1] & PACKED_COMPRESSED else blob[2:]
+    count, p = get_varint(payload, 0)
+    size, p = get_varint(payload, p)
+    strings = []
+    for _ in range(size):
+        size, p = get_varint(payload, p)
+        strings.append(payload[p:p + size].decode())
+        p += size
+    values = []
+    for _ in range(7 * count):  # the LocalTime deltas, the 4 integers, the TextNote and the ServerStatus
+        value, p = get_varint(payload, p)
+        values.append(value)
+    if p != len(payload):
+        return None
+    rows, last = [], day_time
+    for i in range(count):
+        last += values[i]
+        note, status = values[5 * count + i], values[6 * count + i]
+        rows.append((last, values[count + i], values[2 * count + i], values[3 * count + i], values[4 * count + i],
+                     strings[note - 1] if note else "", strings[status - 1] if status else ""))
+    return rows
+
+
+def remove(path):
+    for suffix in ("", "-wal", "-shm", "-journal"):
+        if os.path.exists(path + suffix):
+            os.remove(path + suffix)
+
+
+def write_rows(path, year, hashed):
+    remove(path)
+    db = sqlite3.connect(path, isolation_level=None)
+    db.execute("CREATE TABLE Projects (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)")
+    db.execute("CREATE TABLE Notes (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)")
+    db.execute("CREATE TABLE 't#rows' (LocalTime INTEGER PRIMARY KEY NOT NULL, ProjectRef INTEGER NOT NULL,"
+               " NoteRef INTEGER, KeyPresses INTEGER, MouseClicks INTEGER, MouseDistance INTEGER,"
+               " ServerStatus TEXT, ActiveMask INTEGER%s) WITHOUT ROWID"
+               % (", SyncState INTEGER, RowHash BLOB" if hashed else ""))
+    db.executemany("INSERT INTO Projects VALUES (?,?)", [(p + 1, project_id(p)) for p in range(YEAR_PROJECTS)])
+    db.executemany("INSERT INTO Notes VALUES (?,?)", [(n + 1, "Working on the task number %d" % n) for n in range(30)])
+    db.execute("BEGIN")
+    total = 0
+    for day_time, days in year.items():
+        for project, rows in days.items():
+            head = b"seed"
+            for r in rows:
+                values = (r[0], project + 1, int(r[5].split()[-1]) + 1 if r[5] else None, r[1], r[2], r[3], r[6], r[4])
+                if hashed:
+                    head = hashlib.sha512(head + repr(r).encode()).digest()[:32]
+                    values += (None, head)
+                db.execute("INSERT INTO 't#rows' VALUES (%s)" % ",".join("?" * len(values)), values)
+                total += 1
+    db.execute("COMMIT")
+    db.execute("VACUUM")
+    db.close()
+    return total
+
+
+def write_packed(path, year, hashed):
+    remove(path)
+    db = sqlite3.connect(path, isolation_level=None)
+    db.execute("CREATE TABLE 't#packed' (DayTime INTEGER NOT NULL, ProjectId TEXT NOT NULL, RowCount INTEGER,"
+               " LastTime INTEGER, Data BLOB%s, UNIQUE (DayTime, ProjectId))" % (", ChainHash BLOB" if hashed else ""))
+    db.execute("BEGIN")
+    for day_time, days in year.items():
+        for project, rows in days.items():
+            values = (day_time, project_id(project), len(rows), rows[-1][0], pack(day_time, rows))
+            if hashed:
+                values += (hashlib.sha512(values[4]).digest()[:32],)
+            db.execute("INSERT INTO 't#packed' VALUES (%s)" % ",".join("?" * len(values)), values)
+    db.execute("COMMIT")
+    db.execute("VACUUM")
+    db.close()
+
+
+def scan_rows(path):
+    db = sqlite3.connect(path)
+    keys = rows = 0
+    for r in db.execute("SELECT r.LocalTime, p.Value, r.NoteRef, r.KeyPresses, r.MouseClicks, r.MouseDistance,"
+                        " r.ServerStatus, r.ActiveMask FROM 't#rows' AS r JOIN Projects AS p ON p.Id=r.ProjectRef"):
+        keys += r[3]
+        rows += 1
+    db.close()
+    return rows, keys
+
+
+def scan_packed(path):
+    db = sqlite3.connect(path)
+    keys = rows = 0
+    for day_time, project, data in db.execute("SELECT DayTime, ProjectId, Data FROM 't#packed'"):
+        for r in unpack(day_time, data):
+            keys += r[1]
+            rows += 1
+    db.close()
+    return rows, keys
+
+
+def timed(scan, path):
+    times, result = [], None
+    for _ in range(3):
+        start = time.perf_counter()
+        result = scan(path)
+        times.append(time.perf_counter() - start)
+    return sorted(times)[1], result
+
+
+def main():
+    year = year_days()
+    expected = (sum(len(rows) for days in year.values() for rows in days.values()),
+                sum(r[1] for days in year.values() for rows in days.values() for r in rows))
+    for day_time, days in year.items():  # the format round trip
+        for rows in days.values():
+            if unpack(day_time, pack(day_time, rows)) != rows:
+                print("the unpacked rows differ")
+                sys.exit(1)
+    print("sqlite", sqlite3.sqlite_version, "rows", expected[0], "project days",
+          sum(len(days) for days in year.values()))
+    ok = True
+    for hashed in (False, True):
+        name = "hashed" if hashed else "plain"
+        rows_path = os.path.join(WORK, "pack-rows-%s.db" % name)
+        packed_path = os.path.join(WORK, "pack-packed-%s.db" % name)
+        write_rows(rows_path, year, hashed)
+        write_packed(packed_path, year, hashed)
+        rows_size, packed_size = os.path.getsize(rows_path), os.path.getsize(packed_path)
+        rows_time, rows_result = timed(scan_rows, rows_path)
+        packed_time, packed_result = timed(scan_packed, packed_path)
+        print("%-6s rows table %6d KiB  packed %5d KiB  %4.1fx smaller" % (name, rows_size // 1024, packed_size // 1024,
+                                                                         rows_size / packed_size))
+        print("%-6s scan rows table %7.1f ms  packed %7.1f ms" % (name, rows_time * 1000, packed_time * 1000))
+        ok = ok and rows_result == expected and packed_result == expected
+    if not ok:
+        print("the scans read back other keys")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
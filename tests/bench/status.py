@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# The server statuses applied to a WAL file with synchronous=NORMAL: the former CASE
+# statements of 11 statuses against the temp table bound once and one UPDATE of the month,
+# by UPDATE ... FROM (SQLite 3.33 and later) and by the correlated subquery of
+# SqliteProducer's sqlStatusApply. The median of 3 runs on a fresh file each.
+#   python3 tests/bench/status.py [work directory]
+import os
+import sqlite3
+import sys
+import tempfile
+import time
+
+WORK = sys.argv[1] if len(sys.argv) > 1 else tempfile.mkdtemp()
+DAY0 = 1700000000
+MONTH_FROM, MONTH_TO = 0, 9999999999  # a single partition holds them all
+
+STATUS_CREATE = "CREATE TEMP TABLE IF NOT EXISTS 'StatusUpdate' (StatusTime INTEGER PRIMARY KEY, Status TEXT)"
+STATUS_APPLY = ("UPDATE t SET ServerStatus=(SELECT Status FROM temp.'StatusUpdate' WHERE StatusTime=LocalTime)"
+                " WHERE LocalTime IN (SELECT StatusTime FROM temp.'StatusUpdate'"
+                " WHERE StatusTime >= %d AND StatusTime < %d)" % (MONTH_FROM, MONTH_TO))
+STATUS_FROM = ("UPDATE t SET ServerStatus=s.Status FROM temp.'StatusUpdate' AS s WHERE t.LocalTime=s.StatusTime"
+               " AND s.StatusTime >= %d AND s.StatusTime < %d" % (MONTH_FROM, MONTH_TO))
+
+
+def setup(path, rows):
+    for suffix in ("", "-wal", "-shm"):
+        if os.path.exists(path + suffix):
+            os.remove(path + suffix)
+    db = sqlite3.connect(path, isolation_level=None)
+    db.execute("PRAGMA journal_mode=WAL")
+    db.execute("PRAGMA synchronous=1")
+    db.execute("CREATE TABLE t (LocalTime INTEGER PRIMARY KEY NOT NULL, ProjectRef INTEGER NOT NULL, NoteRef INTEGER,"
+               " KeyPresses INTEGER, MouseClicks INTEGER, MouseDistance INTEGER, ServerStatus TEXT, ActiveMask INTEGER,"
+               " SyncState INTEGER) WITHOUT ROWID")
+    db.execute("BEGIN")
+    db.executemany("INSERT INTO t VALUES (?,1,NULL,1,2,3,NULL,255,NULL)", [(DAY0 + i * 60,) for i in range(rows)])
+    db.execute("COMMIT")
+    return db
+
+
+def case_batches(db, statuses):
+    items = list(statuses.items())
+    db.execute("BEGIN")
+    for i in range(0, len(items), 11):
+        batch = items[i:i + 11]
+        cases = " ".join("WHEN LocalTime=%d THEN '%s'" % (k, v.replace("'", "''")) for k, v in batch)
+        times = ", ".join(str(k) for k, _ in batch)
+        db.execute("UPDATE t SET ServerStatus=(CASE %s END) WHERE LocalTime IN (%s)" % (cases, times))
+    db.execute("COMMIT")
+
+
+def temp_table(db, statuses, apply):
+    db.execute(STATUS_CREATE)
+    db.execute("BEGIN")
+    db.execute("DELETE FROM temp.'StatusUpdate'")
+    db.executemany("INSERT OR REPLACE INTO temp.'StatusUpdate' (StatusTime, Status) VALUES (?, ?)", statuses.items())
+    db.execute(apply)
+    db.execute("COMMIT")
+
+
+def main():
+    path = os.path.join(WORK, "status.db")
+    variants = [("CASE batches", case_batches),
+                ("temp + subquery", lambda db, st: temp_table(db, st, STATUS_APPLY))]
+    if sqlite3.sqlite_version_info >= (3, 33, 0):
+        variants.insert(1, ("temp + FROM", lambda db, st: temp_table(db, st, STATUS_FROM)))
+    print("sqlite", sqlite3.sqlite_version)
+    status = 0
+    for count in (10000, 100000):
+        statuses = {DAY0 + i * 60: "Accepted %d" % (i % 7) for i in range(count)}
+        for name, apply in variants:
+            times = []
+            for _ in range(3):
+                db = setup(path, max(count, 100000) + 1000)
+                start = time.perf_counter()
+                apply(db, statuses)
+                times.append((time.perf_counter() - start) * 1000)
+                if db.execute("SELECT COUNT(*) FROM t WHERE ServerStatus IS NOT NULL").fetchone()[0] != count:
+                    print("%s: wrong number of statuses" % name)
+                    status = 1
+                db.close()
+            times.sort()
+            print("%7d statuses  %-16s %6.0f ms" % (count, name, times[1]))
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
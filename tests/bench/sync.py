@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+# The sync query over three attached monthly partitions with a backlog of 150 rows: the
+# buckets after the watermark grouped by an expression, as before the SyncState column,
+# against the rows marked sending (SyncState 1 -> 2) found through the partial <table>#unsent
+# index, and the bulk flip of setSyncState() of the sent rows alone after the upload; a row
+# merged in between is pending again and stays in the index.
+#   python3 tests/bench/sync.py [work directory]
+import os
+import random
+import sqlite3
+import sys
+import tempfile
+import time
+import uuid
+
+WORK = sys.argv[1] if len(sys.argv) > 1 else tempfile.mkdtemp()
+TABLE = "0xabc"
+MONTHS = 3
+MONTH_ROWS = 30 * 24 * 60 * 2 // 3
+BACKLOG = 150
+STEP = 600  # the sync bucket
+DAY0 = 1735689600  # 2025-01-01
+COLUMNS = ("LocalTime, ProjectId, TextNote, KeyPresses, MouseClicks, MouseDistance, ServerStatus, ActiveMask,"
+           " SyncState")
+
+
+def median(db, query, runs=7):
+    times = []
+    for _ in range(runs):
+        start = time.perf_counter()
+        rows = len(db.execute(query).fetchall())
+        times.append((time.perf_counter() - start) * 1000)
+    times.sort()
+    return rows, times[runs // 2]
+
+
+def main():
+    random.seed(1)
+    projects = [str(uuid.uuid4()) for _ in range(8)]
+    db = sqlite3.connect(":memory:")
+    for m in range(MONTHS):
+        path = os.path.join(WORK, "part%d.db" % m)
+        if os.path.exists(path):
+            os.remove(path)
+        schema = "m%d" % m
+        db.execute("ATTACH '%s' AS %s" % (path, schema))
+        db.execute("CREATE TABLE %s.Projects (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)" % schema)
+        db.execute("CREATE TABLE %s.Notes (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)" % schema)
+        db.execute("CREATE TABLE %s.'%s#rows' (LocalTime INTEGER PRIMARY KEY NOT NULL, ProjectRef INTEGER NOT NULL,"
+                   " NoteRef INTEGER, KeyPresses INTEGER, MouseClicks INTEGER, MouseDistance INTEGER, ServerStatus TEXT,"
+                   " ActiveMask INTEGER, SyncState INTEGER) WITHOUT ROWID" % (schema, TABLE))
+        db.execute("CREATE INDEX %s.'%s#unsent' ON '%s#rows' (LocalTime) WHERE SyncState IS NOT NULL"
+                   % (schema, TABLE, TABLE))
+        db.execute("CREATE VIEW %s.'%s' AS SELECT r.LocalTime AS LocalTime, p.Value AS ProjectId, n.Value AS TextNote,"
+                   " r.KeyPresses AS KeyPresses, r.MouseClicks AS MouseClicks, r.MouseDistance AS MouseDistance,"
+                   " r.ServerStatus AS ServerStatus, r.ActiveMask AS ActiveMask, r.SyncState AS SyncState"
+                   " FROM '%s#rows' AS r JOIN 'Projects' AS p ON p.Id=r.ProjectRef LEFT JOIN 'Notes' AS n"
+                   " ON n.Id=r.NoteRef" % (schema, TABLE, TABLE))
+        db.executemany("INSERT INTO %s.Projects (Value) VALUES (?)" % schema, [(p,) for p in projects])
+        base = DAY0 + m * 30 * 86400
+        db.executemany("INSERT INTO %s.'%s#rows' VALUES (?,?,?,?,?,?,?,?,?)" % (schema, TABLE),
+                       [(base + i * 60, random.randint(1, 8), None, 10, 2, 300, None, 255, None)
+                        for i in range(MONTH_ROWS)])
+    db.commit()
+    last = DAY0 + (MONTHS - 1) * 30 * 86400 + (MONTH_ROWS - 1) * 60
+    watermark = last - BACKLOG * 60
+    db.execute("UPDATE m%d.'%s#rows' SET SyncState=1 WHERE LocalTime > %d" % (MONTHS - 1, TABLE, watermark))
+    db.commit()
+    start = time.perf_counter()
+    for m in range(MONTHS):
+        db.execute("UPDATE m%d.'%s#rows' SET SyncState=2 WHERE SyncState=1 AND LocalTime < %d"
+                   % (m, TABLE, last + STEP))
+    db.commit()
+    mark = (time.perf_counter() - start) * 1000
+    # the consumer's view over the attached months
+    db.execute("CREATE TEMP VIEW '%s' AS %s" % (TABLE, " UNION ALL ".join(
+        "SELECT %s FROM m%d.'%s'" % (COLUMNS, m, TABLE) for m in range(MONTHS))))
+
+    buckets = ("SELECT LocalTime/{step}*{step}+{step} AS column0, ProjectId, TextNote, COUNT(*) AS minutesActive,"
+               " TOTAL(KeyPresses), TOTAL(MouseClicks), TOTAL(MouseDistance) FROM temp.'{table}' WHERE {where}"
+               " GROUP BY column0, ProjectId").format
+    queries = (("watermark", buckets(step=STEP, table=TABLE, where="column0 > %d" % watermark)),
+               ("SyncState", buckets(step=STEP, table=TABLE, where="SyncState=2 AND LocalTime < %d" % (last + STEP))))
+    print("sqlite", sqlite3.sqlite_version, "rows", MONTHS * MONTH_ROWS, "unsynced", BACKLOG)
+    for name, query in queries:
+        plan = [row[-1] for row in db.execute("EXPLAIN QUERY PLAN " + query)]
+        rows, elapsed = median(db, query)
+        print("%-10s %3d buckets  median %6.2f ms" % (name, rows, elapsed))
+        for step in plan:
+            print("    " + step)
+
+    # the merge of the last minute while the upload is in flight
+    db.execute("UPDATE m%d.'%s#rows' SET SyncState=1 WHERE LocalTime = %d" % (MONTHS - 1, TABLE, last))
+    start = time.perf_counter()
+    for m in range(MONTHS):
+        db.execute("UPDATE m%d.'%s#rows' SET SyncState=NULL WHERE SyncState=2 AND LocalTime < %d"
+                   % (m, TABLE, last + STEP))
+    db.commit()
+    print("mark %.2f ms  flip %.2f ms" % (mark, (time.perf_counter() - start) * 1000))
+    pending = db.execute("SELECT COUNT(*) FROM temp.'%s' WHERE SyncState IS NOT NULL" % TABLE).fetchone()[0]
+    if pending != 1:
+        print("the merged row is lost, %d pending" % pending)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
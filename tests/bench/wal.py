@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+# The writer against the concurrent readers under the WAL and the rollback journal: one
+# thread commits the minute rows in groups as SqliteProducer does, with its 50 ms busy
+# timeout after which the records are parked in the spill, while N reader threads run the
+# day totals query of a SqliteExecTask on their own read-only connections with the Qt
+# default busy timeout. The WAL is checkpointed PASSIVE by the writer as the producer does
+# on its idle timer. Reports the commit and query latencies and the commits which would be
+# spilled; exits 1 when a committed group is missing from the file.
+#   python3 tests/bench/wal.py [work directory] [readers]
+import os
+import sqlite3
+import sys
+import tempfile
+import threading
+import time
+
+WORK = sys.argv[1] if len(sys.argv) > 1 else tempfile.mkdtemp()
+READERS = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+DAY0 = 1735689600  # 2025-01-01
+MONTH_ROWS = 30 * 24 * 60
+DURATION = 5.0      # seconds of the contention per journal mode
+GROUP_ROWS = 32     # the rows of a group commit
+GROUP_PAUSE = 0.02  # seconds between the group commits, the CommitWindow compressed
+CHECKPOINT_EVERY = 50  # group commits between the PASSIVE checkpoints
+WRITER_TIMEOUT = 0.05  # SqliteProducer::BusyTimeout
+READER_TIMEOUT = 5.0   # QSQLITE_BUSY_TIMEOUT default
+
+QUERY = ("SELECT LocalTime/86400*86400 AS day, ProjectRef, COUNT(*), TOTAL(KeyPresses), TOTAL(MouseClicks),"
+         " TOTAL(MouseDistance) FROM t WHERE LocalTime >= %d AND LocalTime < %d GROUP BY day, ProjectRef")
+
+
+def setup(path, mode):
+    for suffix in ("", "-wal", "-shm", "-journal"):
+        if os.path.exists(path + suffix):
+            os.remove(path + suffix)
+    db = sqlite3.connect(path, isolation_level=None)
+    db.execute("PRAGMA journal_mode=%s" % mode)
+    db.execute("CREATE TABLE t (LocalTime INTEGER PRIMARY KEY NOT NULL, ProjectRef INTEGER NOT NULL, NoteRef INTEGER,"
+               " KeyPresses INTEGER, MouseClicks INTEGER, MouseDistance INTEGER, ServerStatus TEXT, ActiveMask INTEGER,"
+               " SyncState INTEGER) WITHOUT ROWID")
+    db.execute("BEGIN")
+    db.executemany("INSERT INTO t VALUES (?,?,NULL,10,2,300,NULL,255,NULL)",
+                   [(DAY0 + i * 60, 1 + i // 90 % 8) for i in range(MONTH_ROWS)])
+    db.execute("COMMIT")
+    db.close()
+
+
+def percentiles(values):
+    if not values:
+        return "     -"
+    values.sort()
+    return "p50 %7.2f  p99 %7.2f  max %7.2f" % (values[len(values) // 2], values[len(values) * 99 // 100],
+                                              values[-1])
+
+
+def writer(path, mode, stop, result):
+    db = sqlite3.connect(path, isolation_level=None, timeout=WRITER_TIMEOUT, check_same_thread=False)
+    db.execute("PRAGMA synchronous=1")
+    if mode == "WAL":
+        db.execute("PRAGMA wal_autocheckpoint=0")
+    latencies, spilled, committed = [], 0, []
+    cursor = DAY0 + MONTH_ROWS * 60
+    groups = 0
+    while not stop.is_set():
+        rows = [(cursor + i * 60, 1 + groups % 8) for i in range(GROUP_ROWS)]
+        start = time.perf_counter()
+        try:
+            db.execute("BEGIN IMMEDIATE")
+            db.executemany("INSERT INTO t VALUES (?,?,NULL,10,2,300,NULL,255,1)", rows)
+            db.execute("COMMIT")
+            committed.append(rows[0][0])
+            cursor += GROUP_ROWS * 60
+        except sqlite3.OperationalError:  # busy, the producer parks the records and retries
+            if db.in_transaction:
+                db.execute("ROLLBACK")
+            spilled += 1
+        latencies.append((time.perf_counter() - start) * 1000)
+        groups += 1
+        if mode == "WAL" and groups % CHECKPOINT_EVERY == 0:
+            db.execute("PRAGMA wal_checkpoint(PASSIVE)")
+        time.sleep(GROUP_PAUSE)
+    db.close()
+    result.update(latencies=latencies, spilled=spilled, committed=committed)
+
+
+def reader(path, index, stop, result):
+    db = sqlite3.connect("file:%s?mode=ro" % path, uri=True, isolation_level=None, timeout=READER_TIMEOUT,
+                         check_same_thread=False)
+    latencies, failed = [], 0
+    day = index
+    while not stop.is_set():
+        fr = DAY0 + (day % 30) * 86400
+        start = time.perf_counter()
+        try:
+            db.execute(QUERY % (fr, fr + 7 * 86400)).fetchall()
+        except sqlite3.OperationalError:
+            failed += 1
+        latencies.append((time.perf_counter() - start) * 1000)
+        day += 1
+    db.close()
+    result.update(latencies=latencies, failed=failed)
+
+
+def run(mode):
+    path = os.path.join(WORK, "wal-%s.db" % mode.lower())
+    setup(path, mode)
+    stop = threading.Event()
+    written = {}
+    reads = [{} for _ in range(READERS)]
+    threads = [threading.Thread(target=writer, args=(path, mode, stop, written))]
+    threads += [threading.Thread(target=reader, args=(path, i, stop, reads[i])) for i in range(READERS)]
+    for thread in threads:
+        thread.start()
+    time.sleep(DURATION)
+    stop.set()
+    for thread in threads:
+        thread.join()
+
+    queries = [v for r in reads for v in r["latencies"]]
+    print("%-6s writer %5d commits %4d spilled  ms %s" % (mode, len(written["committed"]), written["spilled"],
+                                                          percentiles(written["latencies"])))
+    print("%-6s readers %4d queries %4d failed   ms %s" % (mode, len(queries), sum(r["failed"] for r in reads),
+                                                          percentiles(queries)))
+    db = sqlite3.connect(path)
+    found = db.execute("SELECT COUNT(*) FROM t WHERE LocalTime >= %d" % (DAY0 + MONTH_ROWS * 60)).fetchone()[0]
+    db.close()
+    return found == len(written["committed"]) * GROUP_ROWS
+
+
+def main():
+    print("sqlite", sqlite3.sqlite_version, "rows", MONTH_ROWS, "readers", READERS, "seconds", DURATION)
+    ok = run("DELETE")
+    if not run("WAL") or not ok:
+        print("the committed rows are missing")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,30 @@
+TEMPLATE = app
+TARGET = tst_activitychain
+QT = core sql testlib
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../src
+
+HEADERS += \
+    ../../src/ActivityChain.h \
+    ../../src/ActivityPack.h \
+    ../../src/ActivityRecord.h \
+    ../../src/ActivitySchema.h \
+    ../../src/BaseThread.h \
+    ../../src/LatencyHistogram.h \
+    ../../src/SqliteProducer.h
+
+SOURCES += \
+    ../../src/ActivityChain.cpp \
+    ../../src/ActivityPack.cpp \
+    ../../src/ActivityRecord.cpp \
+    ../../src/ActivitySchema.cpp \
+    ../../src/SqliteProducer.cpp \
+    ../../src/SshKeygenEd25519.cpp \
+    tst_activitychain.cpp
+
+linux {
+    SOURCES += ../../src/SystemSignal.cpp
+    HEADERS += ../../src/SystemSignal.h
+}
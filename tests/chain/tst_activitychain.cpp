@@ -0,0 +1,277 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QUuid>
+
+#include "ActivityChain.h"
+#include "SqliteProducer.h"
+
+extern bool sshKeygenEd25519(const QString &filename, const QString &comm);
+
+// The hash chain of the minute rows written by the producer: the hash itself, the verifier
+// over the partitions and a changed row, and the throughput of the hash and of the verifier
+class TestActivityChain : public QObject
+{
+    Q_OBJECT
+
+    static constexpr int const chainMonths = 3;
+    static constexpr int const dayMinutes  = 600; // 10 active hours
+    static constexpr char const *chainTable = "0x1234";
+
+    QTemporaryDir dir;
+    QString db_filepath;
+    qint64 total_rows = 0;
+    QUuid projects[3];
+    qint64 changed = 0; // the LocalTime of the changed row
+
+    bool writeRow(const QDateTime &time, int project, int keyPresses);
+
+    static QByteArray sampleHash(const QByteArray &prev, qint64 localTime) {
+        return ActivityChain::rowHash(prev, localTime, QStringLiteral("{0f8fad5b-d9cb-469f-a165-70867728950e}"),
+                                      QStringLiteral("fix issue 42"), localTime % 97, localTime % 13,
+                                      localTime % 1000, localTime);
+    }
+
+private slots:
+    void initTestCase();
+    void rowHash();
+    void verify();
+    void lateRow();
+    void changedRow();
+    void lateRowOnBrokenDay();
+    void signedDays();
+    void hashRate();
+    void verifyRate_data();
+    void verifyRate();
+};
+
+// The months before the current one written by the producer, three projects taking turns
+void TestActivityChain::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    db_filepath = dir.filePath("chain.db");
+    for (auto &project : projects) project = QUuid::createUuid();
+
+    SqliteProducer producer(db_filepath);
+    QString error;
+    connect(&producer, &SqliteProducer::errorOccurred, this, [&error](const QString &text) { error = text; });
+    producer.start();
+    QVERIFY2(error.isEmpty(), qPrintable(error));
+
+    const QDate first = QDate::currentDate().addMonths(-chainMonths);
+    for (QDate date(first.year(), first.month(), 1); date < QDate(QDate::currentDate().year(),
+                                                                  QDate::currentDate().month(), 1); date = date.addDays(1)) {
+        QVector<ActivityRecord> records;
+        QDateTime time = date.startOfDay().addSecs(8 * 3600);
+        for (int m = 0; m < dayMinutes; m++, time = time.addSecs(60)) {
+            records.append(ActivityRecord(QLatin1String(chainTable), time, projects[(m / 90) % 3],
+                                          m % 5 ? QStringLiteral("fix issue 42") : QString(),
+                                          m % 97, m % 13, m % 1000, (quint64(1) << 60) - 1));
+        }
+        producer.insertRows(records);
+        producer.commitRows();
+        QVERIFY2(error.isEmpty(), qPrintable(error));
+        total_rows += records.size();
+    }
+}
+
+// One row through a producer of its own, so that it comes after the last row of the table
+bool TestActivityChain::writeRow(const QDateTime &time, int project, int keyPresses)
+{
+    SqliteProducer producer(db_filepath);
+    bool ok = true;
+    connect(&producer, &SqliteProducer::errorOccurred, this, [&ok]() { ok = false; });
+    producer.start();
+    producer.insertRows(QVector<ActivityRecord>() << ActivityRecord(QLatin1String(chainTable), time, projects[project],
+                                                                    QString(), keyPresses, 0, 0, 1));
+    producer.commitRows();
+    return ok;
+}
+
+void TestActivityChain::rowHash()
+{
+    const QByteArray seed = ActivityChain::seed(QLatin1String(chainTable));
+    QCOMPARE(seed.size(), int(ActivityChain::hashSize));
+    QCOMPARE(seed, ActivityChain::seed(QLatin1String(chainTable)));
+    QVERIFY(seed != ActivityChain::seed(QStringLiteral("0x1235")));
+
+    const QByteArray hash = sampleHash(seed, 1700000000);
+    QCOMPARE(hash.size(), int(ActivityChain::hashSize));
+    QCOMPARE(hash, sampleHash(seed, 1700000000));
+    QVERIFY(hash != sampleHash(seed, 1700000060));
+    QVERIFY(hash != sampleHash(hash, 1700000000));
+    // the strings are zero terminated, moving a character between them changes the hash
+    QVERIFY(ActivityChain::rowHash(seed, 0, QStringLiteral("ab"), QStringLiteral("c"), 0, 0, 0, 0) !=
+            ActivityChain::rowHash(seed, 0, QStringLiteral("a"), QStringLiteral("bc"), 0, 0, 0, 0));
+}
+
+void TestActivityChain::verify()
+{
+    const ActivityChain::Result result = ActivityChain::verify(db_filepath, QLatin1String(chainTable));
+    QVERIFY2(result.error.isEmpty(), qPrintable(result.error));
+    QCOMPARE(result.rows, total_rows);
+    QCOMPARE(result.unchained, qint64(0));
+    QVERIFY(result.broken.isEmpty());
+}
+
+// A row between two of the first day rechains the project day from that row on
+void TestActivityChain::lateRow()
+{
+    const QDate first = QDate::currentDate().addMonths(-chainMonths);
+    QVERIFY(writeRow(QDate(first.year(), first.month(), 1).startOfDay().addSecs(8 * 3600 + 10 * 60 + 30), 0, 7));
+    total_rows++;
+
+    const ActivityChain::Result result = ActivityChain::verify(db_filepath, QLatin1String(chainTable));
+    QVERIFY2(result.error.isEmpty(), qPrintable(result.error));
+    QCOMPARE(result.rows, total_rows);
+    QCOMPARE(result.unchained, qint64(0));
+    QVERIFY(result.broken.isEmpty());
+}
+
+// A counter changed behind the producer is reported as exactly that row
+void TestActivityChain::changedRow()
+{
+    const QMap<QDate,QString> files = SqliteProducer::partitionFiles(db_filepath);
+    QVERIFY(!files.isEmpty());
+    const QString rows = SqliteProducer::rowsName(QLatin1String(chainTable));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("tamper"));
+        db.setDatabaseName(files.first());
+        QVERIFY(db.open());
+        QSqlQuery sql(db);
+        QVERIFY(sql.exec(QString("SELECT LocalTime FROM '%1' ORDER BY LocalTime LIMIT 1 OFFSET 1000").arg(rows)));
+        QVERIFY(sql.next());
+        changed = sql.value(0).toLongLong();
+        sql.finish();
+        QVERIFY2(sql.exec(QString("UPDATE '%1' SET KeyPresses=KeyPresses+1 WHERE LocalTime=%2").arg(rows).arg(changed)),
+                 qPrintable(sql.lastError().text()));
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(QStringLiteral("tamper"));
+
+    const ActivityChain::Result result = ActivityChain::verify(db_filepath, QLatin1String(chainTable));
+    QCOMPARE(result.broken, QVector<qint64>() << changed);
+    QCOMPARE(result.rows, total_rows);
+}
+
+// A row later in the day of the changed one does not rechain over it, it stays unchained
+void TestActivityChain::lateRowOnBrokenDay()
+{
+    QVERIFY(writeRow(QDateTime::fromSecsSinceEpoch(changed + 3 * 3600 + 30), 1, 7));
+
+    const ActivityChain::Result result = ActivityChain::verify(db_filepath, QLatin1String(chainTable));
+    QCOMPARE(result.broken, QVector<qint64>() << changed);
+    QCOMPARE(result.rows, total_rows);
+    QCOMPARE(result.unchained, qint64(1));
+}
+
+// The closed days written by a producer with the key are signed; a row removed from the end
+// of a day behind the producer leaves its chain whole and breaks the signature of the day
+void TestActivityChain::signedDays()
+{
+    const QString key = dir.filePath("chain_ed25519");
+    QVERIFY(sshKeygenEd25519(key, QStringLiteral("chain@test")));
+    QByteArray secret, pub;
+    QVERIFY(ActivityChain::readKey(key, secret, pub));
+    const QByteArray message = ActivityChain::headsMessage(QLatin1String(chainTable), 1700000000, {});
+    const QByteArray signature = ActivityChain::signHeads(secret, message);
+    QCOMPARE(signature.size(), 64);
+    QVERIFY(ActivityChain::verifyHeads(pub, message, signature));
+    QVERIFY(!ActivityChain::verifyHeads(pub, message + '\0', signature));
+
+    const QString filepath = dir.filePath("signed.db");
+    const QDate today = QDate::currentDate();
+    {
+        SqliteProducer producer(filepath);
+        producer.setChainKey(key);
+        QString error;
+        connect(&producer, &SqliteProducer::errorOccurred, this, [&error](const QString &text) { error = text; });
+        producer.start();
+        QVector<ActivityRecord> records;
+        for (int d = 3; d >= 1; d--) {
+            QDateTime time = today.addDays(-d).startOfDay().addSecs(9 * 3600);
+            for (int m = 0; m < 60; m++, time = time.addSecs(60)) {
+                records.append(ActivityRecord(QLatin1String(chainTable), time, projects[m / 20], QString(), m, 0, 0, 1));
+            }
+        }
+        producer.insertRows(records);
+        producer.commitRows();
+        QVERIFY2(error.isEmpty(), qPrintable(error));
+    }
+    ActivityChain::Result result = ActivityChain::verify(filepath, QLatin1String(chainTable), 0, pub);
+    QVERIFY2(result.error.isEmpty(), qPrintable(result.error));
+    QCOMPARE(result.rows, qint64(180));
+    QCOMPARE(result.signedDays, qint64(3));
+    QCOMPARE(result.unsignedDays, qint64(0));
+    QVERIFY(result.broken.isEmpty());
+
+    const QDate day = today.addDays(-2);
+    const QString rows = SqliteProducer::rowsName(QLatin1String(chainTable));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("tamper"));
+        db.setDatabaseName(SqliteProducer::partitionPath(filepath, QDate(day.year(), day.month(), 1)));
+        QVERIFY(db.open());
+        QSqlQuery sql(db);
+        QVERIFY2(sql.exec(QString("DELETE FROM '%1' WHERE LocalTime=(SELECT MAX(LocalTime) FROM '%1' WHERE LocalTime < %2)")
+                          .arg(rows).arg(day.addDays(1).startOfDay().toSecsSinceEpoch())),
+                 qPrintable(sql.lastError().text()));
+        QCOMPARE(sql.numRowsAffected(), 1);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(QStringLiteral("tamper"));
+
+    result = ActivityChain::verify(filepath, QLatin1String(chainTable), 0, pub);
+    QCOMPARE(result.rows, qint64(179));
+    QCOMPARE(result.broken, QVector<qint64>() << day.startOfDay().toSecsSinceEpoch());
+    QCOMPARE(result.signedDays, qint64(2));
+
+    // the chains alone do not see it
+    result = ActivityChain::verify(filepath, QLatin1String(chainTable));
+    QVERIFY(result.broken.isEmpty());
+    QCOMPARE(result.signedDays, qint64(0));
+}
+
+// The hash of one row, a uuid and a short note, in rows per second
+void TestActivityChain::hashRate()
+{
+    const int count = 100000;
+    QByteArray prev = ActivityChain::seed(QLatin1String(chainTable));
+    int runs = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        for (int i = 0; i < count; i++) prev = sampleHash(prev, 1700000000 + i * 60);
+        runs++;
+    }
+    qInfo().noquote() << QString::asprintf("%.0f krows/s", double(runs) * count / qMax(timer.nsecsElapsed() / 1e6, 0.001));
+}
+
+void TestActivityChain::verifyRate_data()
+{
+    QTest::addColumn<int>("threads");
+    QTest::newRow("1 thread") << 1;
+    QTest::newRow("all cores") << 0;
+}
+
+// The whole verification, the partitions are read in parallel by the threads
+void TestActivityChain::verifyRate()
+{
+    QFETCH(int, threads);
+
+    ActivityChain::Result result;
+    int runs = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        result = ActivityChain::verify(db_filepath, QLatin1String(chainTable), threads);
+        runs++;
+    }
+    QVERIFY(result.rows > 0);
+    qInfo().noquote() << QString::asprintf("%lld rows, %.0f krows/s", result.rows,
+                                           double(runs) * result.rows / qMax(timer.nsecsElapsed() / 1e6, 0.001));
+}
+
+QTEST_GUILESS_MAIN(TestActivityChain)
+#include "tst_activitychain.moc"
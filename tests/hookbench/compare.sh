@@ -0,0 +1,40 @@
+#!/bin/sh
+# Builds the hook benchmark for each X11 capture backend and loop and runs it on a private
+# Xvfb display, the injected script is the same for all so the counts must be equal and the
+# wakeups, the key latency and the hook thread CPU time per event compare the backends, the
+# last one summed up at the end. Extra arguments go to hookbench, e.g. --moves 50000.
+#   tests/hookbench/compare.sh [hookbench options]
+set -e
+
+SOURCE=$(cd "$(dirname "$0")" && pwd)
+WORK=${WORK:-$(mktemp -d)}
+DISPLAY_NUM=${DISPLAY_NUM:-99}
+QMAKE=${QMAKE:-qmake}
+
+build() { # name, qmake arguments
+    mkdir -p "$WORK/$1"
+    (cd "$WORK/$1" && "$QMAKE" "$SOURCE" $2 >/dev/null && make -s >/dev/null)
+}
+
+build xrecord ""
+build xrecord-sync "XRECORD_SYNC=1"
+build xinput2 "UIOHOOK_BACKEND=xinput2"
+
+Xvfb ":$DISPLAY_NUM" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+XVFB=$!
+trap 'kill $XVFB 2>/dev/null' EXIT
+sleep 1
+
+status=0
+summary=""
+for variant in xrecord xrecord-sync xinput2; do
+    echo "== $variant"
+    DISPLAY=":$DISPLAY_NUM" "$WORK/$variant/hookbench" "$@" >"$WORK/$variant.out" || status=1
+    cat "$WORK/$variant.out"
+    cost=$(sed -n 's/^cpu_ns_per_event //p' "$WORK/$variant.out")
+    summary="$summary$(printf '%-14s %8s ns/event' "$variant" "${cost:--}")
+"
+done
+echo "== hook thread CPU"
+printf '%s' "$summary"
+exit $status
@@ -0,0 +1,500 @@
+// Capture backend benchmark and equivalence check.
+//
+// Runs the uiohook backend it is built with in the counting mode and with the motion
+// coalescing of ActivityCounter, then:
+//   1. measures the hook thread wakeups per second while there is no input,
+//   2. injects a fixed script of key strokes, clicks and pointer moves through XTest, or
+//      through uinput devices for the evdev backend,
+//   3. compares what the hook delivered with what was injected and reports the key latency
+//      and the CPU time of the hook thread per injected native event.
+// The output is one "name value" line per result, the exit status is 1 when the delivered
+// counts differ from the injected ones. Use an otherwise idle display such as Xvfb, or for
+// uinput an otherwise idle machine with the write access to /dev/uinput:
+//   hookbench [--inject xtest|uinput] [--keys N] [--clicks N] [--moves N] [--step PIXELS] [--idle SECONDS]
+//
+// The uinput script moves two mice in opposite directions within the same frames, then one
+// mouse in one direction far past the int16 range of the event positions, and a touchpad by
+// strokes which start away from where the previous one ended, so a shared motion accumulator,
+// a distance taken from the clamped positions or a jump between the touches shows up as the
+// wrong distance.
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/uinput.h>
+
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+#include "uiohook.h"
+
+#define MOTION_INTERVAL 50  // milliseconds, as UiohookCounterThread::motionInterval
+#define MOTION_BATCH    64  // as UiohookCounterThread::motionBatch
+#define SETTLE_TIME     300 // milliseconds after the injection, longer than the motion interval
+#define MAX_KEYS        100000
+#define UDEV_SETTLE     1000 // milliseconds for the new uinput devices to get their permissions
+#define TOUCH_STROKE    100  // touchpad moves per touch
+#define TOUCH_MAX       65535
+#define DRIFT_MOVES     40000 // one way mouse moves, the drift leaves the int16 range at any step
+
+static struct _bench_options {
+    bool uinput;
+    int keys;
+    int clicks;
+    int moves;
+    int step;
+    int idle;
+} options = { false, 2000, 500, 20000, 3, 5 };
+
+static atomic_int hook_enabled;
+static atomic_int hook_tid;
+static atomic_uint key_releases;
+static atomic_uint mouse_clicks;
+static atomic_uint motion_events;
+static atomic_uint motion_samples;
+static atomic_ullong motion_distance;
+
+// The uinput devices, see create_uinput().
+static int uinput_keyboard = -1;
+static int uinput_mouse[2] = { -1, -1 };
+static int uinput_touchpad = -1;
+
+// Monotonic milliseconds of the injection and the receipt of each key release.
+static uint64_t *key_injected;
+static uint64_t *key_received;
+
+static uint64_t clock_msec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static void dispatch_proc(uiohook_event *const event) {
+    switch (event->type) {
+        case EVENT_HOOK_ENABLED:
+            atomic_store(&hook_tid, (int) syscall(SYS_gettid));
+            atomic_store(&hook_enabled, 1);
+            break;
+
+        case EVENT_KEY_RELEASED: {
+            unsigned int index = atomic_fetch_add(&key_releases, 1);
+            if (index < MAX_KEYS) {
+                key_received[index] = clock_msec();
+            }
+            break;
+        }
+
+        case EVENT_MOUSE_CLICKED:
+            atomic_fetch_add(&mouse_clicks, 1);
+            break;
+
+        case EVENT_MOUSE_MOVED:
+        case EVENT_MOUSE_DRAGGED:
+            atomic_fetch_add(&motion_events, 1);
+            atomic_fetch_add(&motion_samples, event->data.motion.samples);
+            atomic_fetch_add(&motion_distance, event->data.motion.distance);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void *hook_thread_proc(void *arg) {
+    (void) arg; // unused
+    intptr_t status = hook_run();
+    if (!atomic_load(&hook_enabled)) {
+        atomic_store(&hook_enabled, -1);
+    }
+    return (void *) status;
+}
+
+// Voluntary and involuntary context switches of the thread so far.
+static long thread_switches(int tid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    long total = 0, value;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "voluntary_ctxt_switches: %ld", &value) == 1
+                || sscanf(line, "nonvoluntary_ctxt_switches: %ld", &value) == 1) {
+            total += value;
+        }
+    }
+    fclose(file);
+
+    return total;
+}
+
+// Nanoseconds of the CPU time the thread has used so far, -1 if it can't be read.
+static int64_t thread_cpu_nsec(pthread_t thread) {
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &ts) != 0) {
+        return -1;
+    }
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_msec(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static bool parse_options(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            return false;
+        }
+
+        int value = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "--inject") == 0 && strcmp(argv[i + 1], "xtest") == 0) {
+            options.uinput = false;
+        } else if (strcmp(argv[i], "--inject") == 0 && strcmp(argv[i + 1], "uinput") == 0) {
+            options.uinput = true;
+        } else if (strcmp(argv[i], "--keys") == 0 && value >= 0 && value <= MAX_KEYS) {
+            options.keys = value;
+        } else if (strcmp(argv[i], "--clicks") == 0 && value >= 0) {
+            options.clicks = value;
+        } else if (strcmp(argv[i], "--moves") == 0 && value >= 0) {
+            options.moves = value;
+        } else if (strcmp(argv[i], "--step") == 0 && value > 0) {
+            options.step = value;
+        } else if (strcmp(argv[i], "--idle") == 0 && value >= 0) {
+            options.idle = value;
+        } else {
+            return false;
+        }
+        i++;
+    }
+
+    return true;
+}
+
+// The key strokes are paced by a millisecond so each one is a separate read of the hook,
+// the clicks and the moves go as fast as the server takes them.
+static void inject_xtest(Display *display) {
+    KeyCode keycode = XKeysymToKeycode(display, XK_a);
+    for (int i = 0; i < options.keys; i++) {
+        XTestFakeKeyEvent(display, keycode, True, CurrentTime);
+        key_injected[i] = clock_msec();
+        XTestFakeKeyEvent(display, keycode, False, CurrentTime);
+        XFlush(display);
+        usleep(1000);
+    }
+
+    for (int i = 0; i < options.clicks; i++) {
+        XTestFakeButtonEvent(display, Button1, True, CurrentTime);
+        XTestFakeButtonEvent(display, Button1, False, CurrentTime);
+    }
+    XSync(display, False);
+
+    // Back and forth around the screen center, the pointer is never clamped at an edge.
+    for (int i = 0; i < options.moves; i++) {
+        int delta = (i & 1) ? -options.step : options.step;
+        XTestFakeRelativeMotionEvent(display, delta, delta, CurrentTime);
+        if ((i & 255) == 255) {
+            XSync(display, False);
+        }
+    }
+    XSync(display, False);
+}
+
+static int create_uinput(const char *name, bool keys, bool relative, bool absolute) {
+    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (keys) {
+        ioctl(fd, UI_SET_EVBIT, EV_KEY);
+        ioctl(fd, UI_SET_KEYBIT, KEY_A);
+    }
+    if (relative) {
+        ioctl(fd, UI_SET_EVBIT, EV_KEY);
+        ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);
+        ioctl(fd, UI_SET_EVBIT, EV_REL);
+        ioctl(fd, UI_SET_RELBIT, REL_X);
+        ioctl(fd, UI_SET_RELBIT, REL_Y);
+    }
+    if (absolute) {
+        // No resolution, the hook takes a device unit as a pixel then.
+        ioctl(fd, UI_SET_EVBIT, EV_KEY);
+        ioctl(fd, UI_SET_KEYBIT, BTN_TOUCH);
+        ioctl(fd, UI_SET_KEYBIT, BTN_TOOL_FINGER);
+        ioctl(fd, UI_SET_EVBIT, EV_ABS);
+        for (int code = ABS_X; code <= ABS_Y; code++) {
+            struct uinput_abs_setup axis;
+            memset(&axis, 0, sizeof(axis));
+            axis.code = code;
+            axis.absinfo.maximum = TOUCH_MAX;
+            ioctl(fd, UI_ABS_SETUP, &axis);
+        }
+    }
+
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    snprintf(setup.name, sizeof(setup.name), "hookbench %s", name);
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void destroy_uinput(int fd) {
+    if (fd >= 0) {
+        ioctl(fd, UI_DEV_DESTROY);
+        close(fd);
+    }
+}
+
+static void emit(int fd, int type, int code, int value) {
+    struct input_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = type;
+    ev.code = code;
+    ev.value = value;
+    if (write(fd, &ev, sizeof(ev)) != sizeof(ev)) {
+        fprintf(stderr, "uinput write failure\n");
+    }
+}
+
+// The native events the injection script sends, the key and button strokes are two each.
+static unsigned long long injected_events() {
+    unsigned long long events = (unsigned long long) options.keys * 2 + (unsigned long long) options.clicks * 2;
+    if (!options.uinput) {
+        return events + options.moves;
+    }
+    int strokes = options.moves / TOUCH_STROKE;
+    return events + (unsigned long long) options.moves * 2 + DRIFT_MOVES
+            + (unsigned long long) strokes * (TOUCH_STROKE + 2);
+}
+
+// The pointer distance the uinput script moves.
+static unsigned long long uinput_distance() {
+    int strokes = options.moves / TOUCH_STROKE;
+    return (unsigned long long) options.moves * options.step * 4
+            + (unsigned long long) DRIFT_MOVES * options.step * 2
+            + (unsigned long long) strokes * TOUCH_STROKE * options.step * 2;
+}
+
+static void inject_uinput() {
+    for (int i = 0; i < options.keys; i++) {
+        key_injected[i] = clock_msec();
+        emit(uinput_keyboard, EV_KEY, KEY_A, 1);
+        emit(uinput_keyboard, EV_SYN, SYN_REPORT, 0);
+        emit(uinput_keyboard, EV_KEY, KEY_A, 0);
+        emit(uinput_keyboard, EV_SYN, SYN_REPORT, 0);
+        usleep(1000);
+    }
+
+    for (int i = 0; i < options.clicks; i++) {
+        emit(uinput_mouse[0], EV_KEY, BTN_LEFT, 1);
+        emit(uinput_mouse[0], EV_SYN, SYN_REPORT, 0);
+        emit(uinput_mouse[0], EV_KEY, BTN_LEFT, 0);
+        emit(uinput_mouse[0], EV_SYN, SYN_REPORT, 0);
+    }
+
+    // The frames of both mice are open at once and cancel out if they are summed together.
+    for (int i = 0; i < options.moves; i++) {
+        int delta = (i & 1) ? -options.step : options.step;
+        emit(uinput_mouse[0], EV_REL, REL_X, delta);
+        emit(uinput_mouse[0], EV_REL, REL_Y, delta);
+        emit(uinput_mouse[1], EV_REL, REL_X, -delta);
+        emit(uinput_mouse[1], EV_REL, REL_Y, -delta);
+        emit(uinput_mouse[0], EV_SYN, SYN_REPORT, 0);
+        emit(uinput_mouse[1], EV_SYN, SYN_REPORT, 0);
+        if ((i & 255) == 255) {
+            usleep(1000);
+        }
+    }
+
+    // The virtual pointer of the evdev backend has no screen edge to stop at.
+    for (int i = 0; i < DRIFT_MOVES; i++) {
+        emit(uinput_mouse[0], EV_REL, REL_X, options.step);
+        emit(uinput_mouse[0], EV_REL, REL_Y, options.step);
+        emit(uinput_mouse[0], EV_SYN, SYN_REPORT, 0);
+        if ((i & 255) == 255) {
+            usleep(1000);
+        }
+    }
+
+    // Each stroke starts at another place, the jump at the touch down is not a move. The strokes
+    // go back and forth, so the pointer stays near where it started.
+    int strokes = options.moves / TOUCH_STROKE;
+    for (int stroke = 0; stroke < strokes; stroke++) {
+        int delta = (stroke & 1) ? -options.step : options.step;
+        int x = (stroke & 1) ? TOUCH_MAX / 2 : 1000;
+        int y = (stroke & 2) ? TOUCH_MAX / 2 : 1000;
+        emit(uinput_touchpad, EV_KEY, BTN_TOUCH, 1);
+        emit(uinput_touchpad, EV_KEY, BTN_TOOL_FINGER, 1);
+        emit(uinput_touchpad, EV_ABS, ABS_X, x);
+        emit(uinput_touchpad, EV_ABS, ABS_Y, y);
+        emit(uinput_touchpad, EV_SYN, SYN_REPORT, 0);
+        for (int i = 1; i <= TOUCH_STROKE; i++) {
+            emit(uinput_touchpad, EV_ABS, ABS_X, x + i * delta);
+            emit(uinput_touchpad, EV_ABS, ABS_Y, y + i * delta);
+            emit(uinput_touchpad, EV_SYN, SYN_REPORT, 0);
+        }
+        emit(uinput_touchpad, EV_KEY, BTN_TOUCH, 0);
+        emit(uinput_touchpad, EV_KEY, BTN_TOOL_FINGER, 0);
+        emit(uinput_touchpad, EV_SYN, SYN_REPORT, 0);
+        usleep(1000);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (!parse_options(argc, argv)) {
+        fprintf(stderr, "Usage: %s [--inject xtest|uinput] [--keys N] [--clicks N] [--moves N] [--step PIXELS] [--idle SECONDS]\n", argv[0]);
+        return 2;
+    }
+
+    Display *display = NULL;
+    if (options.uinput) {
+        // Created before the hook starts, it picks them up by the initial device scan.
+        uinput_keyboard = create_uinput("keyboard", true, false, false);
+        uinput_mouse[0] = create_uinput("mouse 1", false, true, false);
+        uinput_mouse[1] = create_uinput("mouse 2", false, true, false);
+        uinput_touchpad = create_uinput("touchpad", false, false, true);
+        if (uinput_keyboard < 0 || uinput_mouse[0] < 0 || uinput_mouse[1] < 0 || uinput_touchpad < 0) {
+            fprintf(stderr, "No uinput devices\n");
+            return 2;
+        }
+        usleep(UDEV_SETTLE * 1000);
+    } else {
+        display = XOpenDisplay(NULL);
+        if (display == NULL) {
+            fprintf(stderr, "No X display\n");
+            return 2;
+        }
+
+        // The moves are measured in pixels, so no pointer acceleration.
+        XChangePointerControl(display, True, True, 1, 1, 0);
+        Screen *screen = DefaultScreenOfDisplay(display);
+        XTestFakeMotionEvent(display, -1, WidthOfScreen(screen) / 2, HeightOfScreen(screen) / 2, CurrentTime);
+        XSync(display, False);
+    }
+
+    key_injected = calloc(MAX_KEYS, sizeof(uint64_t));
+    key_received = calloc(MAX_KEYS, sizeof(uint64_t));
+
+    hook_set_mode(HOOK_MODE_COUNT);
+    hook_set_motion_coalescing(MOTION_INTERVAL, MOTION_BATCH);
+    hook_set_dispatch_proc(&dispatch_proc);
+
+    pthread_t hook_thread;
+    if (pthread_create(&hook_thread, NULL, hook_thread_proc, NULL) != 0) {
+        fprintf(stderr, "No hook thread\n");
+        return 2;
+    }
+    for (int i = 0; i < 500 && atomic_load(&hook_enabled) == 0; i++) {
+        usleep(10000);
+    }
+    if (atomic_load(&hook_enabled) != 1) {
+        fprintf(stderr, "The hook did not start\n");
+        return 2;
+    }
+
+    int tid = atomic_load(&hook_tid);
+    long switches = thread_switches(tid);
+    sleep(options.idle);
+    if (options.idle > 0 && switches >= 0) {
+        printf("idle_wakeups_per_s %.2f\n", (double) (thread_switches(tid) - switches) / options.idle);
+    }
+
+    // The first move only gives the hook the pointer position to measure the distance from.
+    if (options.uinput) {
+        emit(uinput_mouse[0], EV_REL, REL_X, options.step);
+        emit(uinput_mouse[0], EV_SYN, SYN_REPORT, 0);
+    } else {
+        XTestFakeRelativeMotionEvent(display, options.step, 0, CurrentTime);
+        XSync(display, False);
+    }
+    usleep(SETTLE_TIME * 1000);
+
+    atomic_store(&key_releases, 0);
+    atomic_store(&mouse_clicks, 0);
+    atomic_store(&motion_events, 0);
+    atomic_store(&motion_samples, 0);
+    atomic_store(&motion_distance, 0);
+
+    uint64_t start = clock_msec();
+    switches = thread_switches(tid);
+    int64_t cpu_start = thread_cpu_nsec(hook_thread);
+    if (options.uinput) {
+        inject_uinput();
+    } else {
+        inject_xtest(display);
+    }
+    uint64_t injected = clock_msec();
+    usleep(SETTLE_TIME * 1000);
+    int64_t cpu_end = thread_cpu_nsec(hook_thread);
+
+    unsigned int keys = atomic_load(&key_releases);
+    unsigned int clicks = atomic_load(&mouse_clicks);
+    unsigned long long distance = atomic_load(&motion_distance);
+    unsigned long long expected_distance = options.uinput ? uinput_distance()
+            : (unsigned long long) options.moves * options.step * 2;
+
+    printf("inject_ms %" PRIu64 "\n", injected - start);
+    printf("busy_wakeups %ld\n", thread_switches(tid) - switches);
+    printf("keys %u expected %d\n", keys, options.keys);
+    printf("clicks %u expected %d\n", clicks, options.clicks);
+    printf("distance %llu expected %llu\n", distance, expected_distance);
+    printf("motion_events %u samples %u\n", atomic_load(&motion_events), atomic_load(&motion_samples));
+    if (cpu_start >= 0 && cpu_end >= 0) {
+        unsigned long long events = injected_events();
+        printf("hook_cpu_ms %.1f events %llu\n", (cpu_end - cpu_start) / 1e6, events);
+        printf("cpu_ns_per_event %.0f\n", events > 0 ? (double) (cpu_end - cpu_start) / events : 0.0);
+    }
+
+    unsigned int measured = keys < (unsigned int) options.keys ? keys : (unsigned int) options.keys;
+    if (measured > 0) {
+        uint64_t *latency = calloc(measured, sizeof(uint64_t));
+        for (unsigned int i = 0; i < measured; i++) {
+            latency[i] = key_received[i] >= key_injected[i] ? key_received[i] - key_injected[i] : 0;
+        }
+        qsort(latency, measured, sizeof(uint64_t), compare_msec);
+        printf("key_latency_ms p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64 "\n",
+                latency[measured / 2], latency[measured * 99 / 100], latency[measured - 1]);
+        free(latency);
+    }
+
+    hook_stop();
+    void *status;
+    pthread_join(hook_thread, &status);
+    if (options.uinput) {
+        destroy_uinput(uinput_keyboard);
+        destroy_uinput(uinput_mouse[0]);
+        destroy_uinput(uinput_mouse[1]);
+        destroy_uinput(uinput_touchpad);
+    } else {
+        XCloseDisplay(display);
+    }
+
+    bool ok = (keys == (unsigned int) options.keys && clicks == (unsigned int) options.clicks
+            && distance == expected_distance);
+    printf("result %s\n", ok ? "PASS" : "FAIL");
+
+    return ok ? 0 : 1;
+}
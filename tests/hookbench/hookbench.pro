@@ -0,0 +1,41 @@
+# The capture backend benchmark, see hookbench.c; Linux only, built like the application:
+#   qmake tests/hookbench                      XRecord, the async loop
+#   qmake tests/hookbench XRECORD_SYNC=1       XRecord, the synchronous loop
+#   qmake tests/hookbench UIOHOOK_BACKEND=xinput2
+#   qmake tests/hookbench UIOHOOK_BACKEND=evdev   run with --inject uinput, see uinput.sh
+TEMPLATE = app
+TARGET = hookbench
+CONFIG -= qt app_bundle
+CONFIG += console
+
+!linux: error("The hook benchmark runs on Linux only")
+
+DEFINES += USE_XKB_COMMON USE_XKB_FILE USE_EVDEV
+isEmpty(XRECORD_SYNC): DEFINES += USE_XRECORD_ASYNC
+LIBS += -lX11 -lXtst -lxkbcommon-x11 -lxkbcommon -lX11-xcb -lxcb -lxkbfile -lpthread
+equals(UIOHOOK_BACKEND, xinput2) {
+    UIOHOOK_HOOK_DIR = uiohook_xinput2
+    LIBS += -lxcb-xinput
+} else : equals(UIOHOOK_BACKEND, evdev) {
+    UIOHOOK_HOOK_DIR = uiohook_evdev
+} else : isEmpty(UIOHOOK_BACKEND) {
+    UIOHOOK_HOOK_DIR = uiohook_x11
+} else {
+    error("Unsupported UIOHOOK_BACKEND=$${UIOHOOK_BACKEND}, use xinput2, evdev or leave it empty")
+}
+
+INCLUDEPATH += ../../src
+
+SOURCES += \
+    ../../src/uiohook_x11/input_helper.c \
+    ../../src/$${UIOHOOK_HOOK_DIR}/input_hook.c \
+    ../../src/uiohook_x11/system_properties.c \
+    ../../src/uiohook_logger.c \
+    ../../src/uiohook_motion.c \
+    hookbench.c
+
+HEADERS += \
+    ../../src/uiohook_x11/input_helper.h \
+    ../../src/uiohook.h \
+    ../../src/uiohook_logger.h \
+    ../../src/uiohook_motion.h
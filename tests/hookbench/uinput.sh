@@ -0,0 +1,17 @@
+#!/bin/sh
+# Builds the hook benchmark for the evdev backend and runs it with the uinput devices, it
+# needs the write access to /dev/uinput and the read access to /dev/input/event* (root or
+# the input group with a udev rule for uinput). The real devices are read as well, leave
+# them alone while it runs. Extra arguments go to hookbench, e.g. --moves 50000.
+#   tests/hookbench/uinput.sh [hookbench options]
+set -e
+
+SOURCE=$(cd "$(dirname "$0")" && pwd)
+WORK=${WORK:-$(mktemp -d)}
+QMAKE=${QMAKE:-qmake}
+
+mkdir -p "$WORK/evdev"
+(cd "$WORK/evdev" && "$QMAKE" "$SOURCE" UIOHOOK_BACKEND=evdev >/dev/null && make -s >/dev/null)
+
+echo "== evdev"
+"$WORK/evdev/hookbench" --inject uinput "$@"
@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = tst_activitypack
+QT = core sql testlib
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../src
+
+HEADERS += \
+    ../../src/ActivityPack.h
+
+SOURCES += \
+    ../../src/ActivityPack.cpp \
+    tst_activitypack.cpp
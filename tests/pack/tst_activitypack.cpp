@@ -0,0 +1,239 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QFileInfo>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+#include "ActivityPack.h"
+
+// The packed project days of the closed months: the round trip, the malformed blobs and
+// the size and the decoding time of a synthetic year against the rows table
+class TestActivityPack : public QObject
+{
+    Q_OBJECT
+
+    static constexpr qint64 const yearStart = 1767225600; // 2026-01-01 UTC
+    static constexpr int const yearProjects = 6;
+
+    typedef QMap<int,QVector<ActivityPack::Row>> ProjectDays; // project -> the rows of the day
+    QMap<qint64,ProjectDays> year; // the day start -> the project days
+
+    static QVector<ActivityPack::Row> sampleDay(qint64 dayTime, int rows);
+    static QString projectId(int project) { return QString("{00000000-0000-4000-8000-%1}").arg(project, 12, 10, QLatin1Char('0')); }
+
+private slots:
+    void initTestCase();
+    void roundTrip_data();
+    void roundTrip();
+    void malformed();
+    void storage();
+    void packYear();
+    void unpackYear();
+};
+
+// static
+QVector<ActivityPack::Row> TestActivityPack::sampleDay(qint64 dayTime, int rows)
+{
+    QRandomGenerator random(quint32(dayTime));
+    QVector<ActivityPack::Row> day;
+    qint64 time = dayTime + 8 * 3600;
+    for (int i = 0; i < rows; i++, time += 60) {
+        day.append({ time, random.bounded(120), random.bounded(40), random.bounded(8000),
+                     qint64(random.generate64() & ((quint64(1) << 60) - 1)),
+                     i % 7 ? QString("Working on the task number %1").arg(i % 3) : QString(),
+                     QString("Server: accepted %1").arg(i % 2) });
+    }
+    return day;
+}
+
+// 1 to 3 sessions a day of 1 to 5 hours on a random project each, as the recorded benchmark
+void TestActivityPack::initTestCase()
+{
+    QRandomGenerator random(1);
+    for (int d = 0; d < 365; d++) {
+        const qint64 dayTime = yearStart + d * 86400;
+        ProjectDays &days = year[dayTime];
+        qint64 time = dayTime + 8 * 3600;
+        const int sessions = 1 + random.bounded(3);
+        for (int s = 0; s < sessions; s++) {
+            const int project = random.bounded(yearProjects);
+            const int note = random.bounded(31);
+            const QString status = QString("Server: accepted %1").arg(random.bounded(3));
+            const int minutes = 60 + random.bounded(240);
+            for (int m = 0; m < minutes; m++, time += 60) {
+                const qint64 mask = random.bounded(5) ? qint64((quint64(1) << 60) - 1)
+                                                      : qint64(random.generate64() & ((quint64(1) << 60) - 1));
+                days[project].append({ time, random.bounded(120), random.bounded(40), random.bounded(8000), mask,
+                                       note ? QString("Working on the task number %1").arg(note - 1) : QString(),
+                                       status });
+            }
+            time += 1800;
+        }
+    }
+}
+
+void TestActivityPack::roundTrip_data()
+{
+    QTest::addColumn<int>("rows");
+    QTest::addColumn<bool>("compress");
+    QTest::newRow("empty") << 0 << true;
+    QTest::newRow("one") << 1 << true;
+    QTest::newRow("day raw") << 600 << false;
+    QTest::newRow("day compressed") << 600 << true;
+}
+
+void TestActivityPack::roundTrip()
+{
+    QFETCH(int, rows);
+    QFETCH(bool, compress);
+
+    const qint64 dayTime = yearStart + 42 * 86400;
+    const QVector<ActivityPack::Row> day = sampleDay(dayTime, rows);
+    const QByteArray blob = ActivityPack::pack(dayTime, day, compress);
+    QCOMPARE(int(blob.at(0)), ActivityPack::formatVersion);
+    if (!compress) QCOMPARE(int(blob.at(1)), 0);
+
+    QVector<ActivityPack::Row> unpacked;
+    QVERIFY(ActivityPack::unpack(dayTime, blob, unpacked));
+    QCOMPARE(unpacked.size(), day.size());
+    for (int i = 0; i < day.size(); i++) {
+        QCOMPARE(unpacked.at(i).localTime, day.at(i).localTime);
+        QCOMPARE(unpacked.at(i).keyPresses, day.at(i).keyPresses);
+        QCOMPARE(unpacked.at(i).mouseClicks, day.at(i).mouseClicks);
+        QCOMPARE(unpacked.at(i).mouseDistance, day.at(i).mouseDistance);
+        QCOMPARE(unpacked.at(i).activeMask, day.at(i).activeMask);
+        QCOMPARE(unpacked.at(i).textNote, day.at(i).textNote);
+        QCOMPARE(unpacked.at(i).serverStatus, day.at(i).serverStatus);
+    }
+}
+
+void TestActivityPack::malformed()
+{
+    const qint64 dayTime = yearStart;
+    const QByteArray blob = ActivityPack::pack(dayTime, sampleDay(dayTime, 100), false);
+    QVector<ActivityPack::Row> rows;
+    QVERIFY(!ActivityPack::unpack(dayTime, QByteArray(), rows));
+    QVERIFY(!ActivityPack::unpack(dayTime, blob.left(blob.size() - 1), rows));
+    QVERIFY(!ActivityPack::unpack(dayTime, blob + char(0), rows));
+    QByteArray version = blob;
+    version[0] = char(ActivityPack::formatVersion + 1);
+    QVERIFY(!ActivityPack::unpack(dayTime, version, rows));
+    QVERIFY(rows.isEmpty());
+}
+
+// The vacuumed file of the rows table with the dictionaries against the one of the packed days
+void TestActivityPack::storage()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString rows_path = dir.filePath("rows.db");
+    const QString packed_path = dir.filePath("packed.db");
+    qint64 total = 0;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "rows");
+        db.setDatabaseName(rows_path);
+        QVERIFY(db.open());
+        QSqlQuery sql(db);
+        QVERIFY(sql.exec("CREATE TABLE Projects (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)"));
+        QVERIFY(sql.exec("CREATE TABLE Notes (Id INTEGER PRIMARY KEY, Value TEXT NOT NULL UNIQUE)"));
+        QVERIFY(sql.exec("CREATE TABLE 't#rows' (LocalTime INTEGER PRIMARY KEY NOT NULL, ProjectRef INTEGER NOT NULL,"
+                         " NoteRef INTEGER, KeyPresses INTEGER, MouseClicks INTEGER, MouseDistance INTEGER,"
+                         " ServerStatus TEXT, ActiveMask INTEGER) WITHOUT ROWID"));
+        for (int p = 0; p < yearProjects; p++) {
+            QVERIFY(sql.exec(QString("INSERT INTO Projects (Id, Value) VALUES (%1, '%2')").arg(p + 1).arg(projectId(p))));
+        }
+        for (int n = 0; n < 30; n++) {
+            QVERIFY(sql.exec(QString("INSERT INTO Notes (Id, Value) VALUES (%1, 'Working on the task number %2')")
+                             .arg(n + 1).arg(n)));
+        }
+        QVERIFY(db.transaction());
+        QVERIFY(sql.prepare("INSERT INTO 't#rows' VALUES (?, ?, ?, ?, ?, ?, ?, ?)"));
+        for (auto day = year.constBegin(); day != year.constEnd(); ++day) {
+            for (auto it = day->constBegin(); it != day->constEnd(); ++it) {
+                for (const auto &row : it.value()) {
+                    sql.bindValue(0, row.localTime);
+                    sql.bindValue(1, it.key() + 1);
+                    sql.bindValue(2, row.textNote.isEmpty() ? QVariant() : QVariant(row.textNote.section(' ', -1).toInt() + 1));
+                    sql.bindValue(3, row.keyPresses);
+                    sql.bindValue(4, row.mouseClicks);
+                    sql.bindValue(5, row.mouseDistance);
+                    sql.bindValue(6, row.serverStatus);
+                    sql.bindValue(7, row.activeMask);
+                    QVERIFY2(sql.exec(), qPrintable(sql.lastError().text()));
+                    total++;
+                }
+            }
+        }
+        QVERIFY(db.commit());
+        QVERIFY(sql.exec("VACUUM"));
+        db.close();
+    }
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "packed");
+        db.setDatabaseName(packed_path);
+        QVERIFY(db.open());
+        QSqlQuery sql(db);
+        QVERIFY(sql.exec("CREATE TABLE 't#packed' (DayTime INTEGER NOT NULL, ProjectId TEXT NOT NULL, RowCount INTEGER,"
+                         " LastTime INTEGER, Data BLOB, UNIQUE (DayTime, ProjectId))"));
+        QVERIFY(db.transaction());
+        QVERIFY(sql.prepare("INSERT INTO 't#packed' VALUES (?, ?, ?, ?, ?)"));
+        for (auto day = year.constBegin(); day != year.constEnd(); ++day) {
+            for (auto it = day->constBegin(); it != day->constEnd(); ++it) {
+                sql.bindValue(0, day.key());
+                sql.bindValue(1, projectId(it.key()));
+                sql.bindValue(2, it->size());
+                sql.bindValue(3, it->last().localTime);
+                sql.bindValue(4, ActivityPack::pack(day.key(), it.value()));
+                QVERIFY2(sql.exec(), qPrintable(sql.lastError().text()));
+            }
+        }
+        QVERIFY(db.commit());
+        QVERIFY(sql.exec("VACUUM"));
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("rows");
+    QSqlDatabase::removeDatabase("packed");
+
+    const qint64 rows_size = QFileInfo(rows_path).size();
+    const qint64 packed_size = QFileInfo(packed_path).size();
+    qInfo().noquote() << QString::asprintf("%lld rows: rows table %lld KiB, packed %lld KiB, %.1fx smaller",
+                                           total, rows_size / 1024, packed_size / 1024,
+                                           double(rows_size) / qMax(packed_size, qint64(1)));
+    QVERIFY(packed_size < rows_size);
+}
+
+void TestActivityPack::packYear()
+{
+    qint64 bytes = 0;
+    QBENCHMARK {
+        bytes = 0;
+        for (auto day = year.constBegin(); day != year.constEnd(); ++day) {
+            for (const auto &rows : *day) bytes += ActivityPack::pack(day.key(), rows).size();
+        }
+    }
+    qInfo().noquote() << QString::asprintf("%lld bytes packed", bytes);
+}
+
+void TestActivityPack::unpackYear()
+{
+    QVector<QPair<qint64,QByteArray>> blobs;
+    for (auto day = year.constBegin(); day != year.constEnd(); ++day) {
+        for (const auto &rows : *day) blobs.append(qMakePair(day.key(), ActivityPack::pack(day.key(), rows)));
+    }
+    qint64 keys = 0;
+    QBENCHMARK {
+        keys = 0;
+        QVector<ActivityPack::Row> rows;
+        for (auto blob = blobs.constBegin(); blob != blobs.constEnd(); ++blob) {
+            rows.clear();
+            QVERIFY(ActivityPack::unpack(blob->first, blob->second, rows));
+            for (auto row = rows.constBegin(); row != rows.constEnd(); ++row) keys += row->keyPresses;
+        }
+    }
+    QVERIFY(keys > 0);
+}
+
+QTEST_GUILESS_MAIN(TestActivityPack)
+#include "tst_activitypack.moc"
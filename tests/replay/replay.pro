@@ -0,0 +1,19 @@
+TEMPLATE = app
+TARGET = tst_replay
+QT = core testlib
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../src
+
+HEADERS += \
+    ../../src/uiohook.h \
+    ../../src/InputEventRing.h \
+    ../../src/UiohookCounterThread.h \
+    ../../src/UiohookStream.h
+
+SOURCES += \
+    ../../src/UiohookCounterThread.cpp \
+    ../../src/UiohookStream.cpp \
+    tst_replay.cpp \
+    uiohook_stub.c
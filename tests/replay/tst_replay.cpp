@@ -0,0 +1,126 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <cstring>
+
+#include "UiohookCounterThread.h"
+#include "UiohookStream.h"
+
+// The UIOHOOK_REPLAY path of the UiohookCounterThread: a capture several times the ring
+// size is replayed as fast as possible while the consumer drains as seldom as the
+// ActivityCounter does, nothing may be dropped and the counts must match the capture
+class TestReplay : public QObject
+{
+    Q_OBJECT
+
+    static constexpr int const captureEvents = 4 * UiohookCounterThread::ringSize;
+    static constexpr int const drainPeriod   = 250; // milliseconds, shortened from a second
+    static constexpr int const timeout       = 60000;
+
+    QTemporaryDir dir;
+    QString capture_path;
+    int capture_keys = 0;
+    int capture_clicks = 0;
+    qint64 capture_distance = 0;
+
+    void writeCapture();
+
+private slots:
+    void initTestCase();
+    void replay();
+};
+
+// The fixed capture: a key release, a click and a motion sample in turn, mixed with the
+// events the counting ignores
+void TestReplay::writeCapture()
+{
+    UiohookStream stream;
+    QVERIFY(stream.openWrite(capture_path));
+
+    uiohook_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_HOOK_ENABLED;
+    stream.write(&event);
+
+    for (int i = 0; i < captureEvents; i++) {
+        memset(&event, 0, sizeof(event));
+        event.time = quint64(i);
+        switch (i % 4) {
+        case 0:
+            event.type = EVENT_KEY_RELEASED;
+            event.data.keyboard.keycode = quint16(1 + i % 100);
+            capture_keys++;
+            break;
+        case 1:
+            event.type = EVENT_MOUSE_CLICKED;
+            event.data.mouse.button = MOUSE_BUTTON1;
+            event.data.mouse.clicks = 1;
+            event.data.mouse.x = qint16(i % 1000);
+            event.data.mouse.y = qint16(i % 700);
+            capture_clicks++;
+            break;
+        case 2:
+            event.type = EVENT_MOUSE_MOVED;
+            event.data.motion.x = qint16(i % 1000);
+            event.data.motion.y = qint16(i % 700);
+            event.data.motion.distance = quint32(1 + i % 37);
+            event.data.motion.samples = 3;
+            capture_distance += event.data.motion.distance;
+            break;
+        default:
+            event.type = EVENT_KEY_PRESSED;
+            event.data.keyboard.keycode = quint16(1 + i % 100);
+            break;
+        }
+        stream.write(&event);
+    }
+    stream.close();
+}
+
+void TestReplay::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    capture_path = dir.filePath(QStringLiteral("capture.uhks"));
+    writeCapture();
+    QVERIFY(capture_keys + capture_clicks > UiohookCounterThread::ringSize);
+    qputenv(UiohookCounterThread::replayEnv, capture_path.toLocal8Bit());
+}
+
+void TestReplay::replay()
+{
+    UiohookCounterThread thread;
+    thread.start();
+    thread.count_actions = 1;
+
+    int keys = 0, clicks = 0;
+    qint64 distance = 0;
+    InputSample batch[UiohookCounterThread::batchSize];
+    QElapsedTimer timer;
+    timer.start();
+    for (;;) {
+        bool done = thread.replay_done.loadAcquire();
+        int count;
+        while ((count = thread.input_ring.pop(batch, UiohookCounterThread::batchSize)) > 0) {
+            for (int i = 0; i < count; i++) {
+                switch (batch[i].type) {
+                case EVENT_KEY_RELEASED:  keys++; break;
+                case EVENT_MOUSE_CLICKED: clicks++; break;
+                case EVENT_MOUSE_MOVED:   distance += batch[i].value; break;
+                default: QFAIL("Unexpected sample type");
+                }
+            }
+        }
+        if (done) break;
+        QVERIFY2(timer.elapsed() < timeout, "The replay did not finish");
+        QThread::msleep(drainPeriod);
+    }
+
+    QCOMPARE(thread.input_ring.dropped(), 0u);
+    QCOMPARE(keys, capture_keys);
+    QCOMPARE(clicks, capture_clicks);
+    QCOMPARE(distance, capture_distance);
+    QCOMPARE(int(thread.uiohook_status), int(UIOHOOK_SUCCESS));
+}
+
+QTEST_GUILESS_MAIN(TestReplay)
+#include "tst_replay.moc"
@@ -0,0 +1,24 @@
+// The replay does not run the native hook, these only satisfy the linker.
+
+#include "uiohook.h"
+
+UIOHOOK_API void hook_set_dispatch_proc(dispatcher_t dispatch_proc) {
+    (void) dispatch_proc; // unused
+}
+
+UIOHOOK_API void hook_set_mode(hook_mode mode) {
+    (void) mode; // unused
+}
+
+UIOHOOK_API void hook_set_motion_coalescing(uint32_t interval, uint16_t batch) {
+    (void) interval; // unused
+    (void) batch; // unused
+}
+
+UIOHOOK_API int hook_run() {
+    return UIOHOOK_FAILURE;
+}
+
+UIOHOOK_API int hook_stop() {
+    return UIOHOOK_FAILURE;
+}
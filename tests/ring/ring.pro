@@ -0,0 +1,13 @@
+TEMPLATE = app
+TARGET = tst_inputeventring
+QT = core testlib
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../src
+
+HEADERS += \
+    ../../src/InputEventRing.h
+
+SOURCES += \
+    tst_inputeventring.cpp
@@ -0,0 +1,147 @@
+#include <QtTest>
+#include <QThread>
+#include <QElapsedTimer>
+
+#include "InputEventRing.h"
+
+// The ring of the ActivityCounter: the order, the overflow and the throughput of one
+// producer and one consumer thread
+class TestInputEventRing : public QObject
+{
+    Q_OBJECT
+
+    static constexpr int const ringSize  = 16384; // as UiohookCounterThread::ringSize
+    static constexpr int const batchSize = 256;   // as UiohookCounterThread::batchSize
+    typedef InputEventRing<InputSample, ringSize> Ring;
+
+    static InputSample sample(quint32 value) {
+        InputSample s;
+        s.time = value;
+        s.type = quint16(value);
+        s.lag = 0;
+        s.x = s.y = 0;
+        s.value = value;
+        return s;
+    }
+
+    // returns the samples per second, the order is verified by the consumer
+    static double transfer(Ring &ring, quint32 total, bool &ordered);
+
+private slots:
+    void order();
+    void overflow();
+    void clear();
+    void threads();
+    void throughput_data();
+    void throughput();
+};
+
+void TestInputEventRing::order()
+{
+    QScopedPointer<Ring> ring(new Ring);
+    InputSample batch[batchSize];
+    quint32 next = 0, expect = 0;
+    for (int round = 0; round < 100; round++) { // wraps the indexes several times
+        for (int i = 0; i < 1000; i++) QVERIFY(ring->push(sample(next++)));
+        QCOMPARE(ring->size(), 1000);
+        int count;
+        while ((count = ring->pop(batch, batchSize)) > 0) {
+            for (int i = 0; i < count; i++) QCOMPARE(batch[i].value, expect++);
+        }
+    }
+    QCOMPARE(expect, next);
+    QCOMPARE(ring->dropped(), 0u);
+}
+
+void TestInputEventRing::overflow()
+{
+    QScopedPointer<Ring> ring(new Ring);
+    for (int i = 0; i < ringSize; i++) {
+        QVERIFY(!ring->full());
+        QVERIFY(ring->push(sample(quint32(i))));
+    }
+    QVERIFY(ring->full());
+    QVERIFY(!ring->push(sample(0)));
+    QVERIFY(!ring->push(sample(0)));
+    QCOMPARE(ring->dropped(), 2u);
+    QCOMPARE(ring->size(), ringSize);
+
+    InputSample batch[batchSize];
+    QCOMPARE(ring->pop(batch, batchSize), batchSize);
+    QCOMPARE(batch[0].value, 0u);
+    QVERIFY(!ring->full());
+    QVERIFY(ring->push(sample(0)));
+}
+
+void TestInputEventRing::clear()
+{
+    QScopedPointer<Ring> ring(new Ring);
+    for (int i = 0; i < 100; i++) ring->push(sample(quint32(i)));
+    ring->clear();
+    QCOMPARE(ring->size(), 0);
+    InputSample batch[batchSize];
+    QCOMPARE(ring->pop(batch, batchSize), 0);
+}
+
+// static
+double TestInputEventRing::transfer(Ring &ring, quint32 total, bool &ordered)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QScopedPointer<QThread> producer(QThread::create([&ring, total]() {
+        for (quint32 i = 0; i < total; ) {
+            if (ring.push(sample(i))) i++;
+        }
+    }));
+    producer->start();
+
+    InputSample batch[batchSize];
+    quint32 expect = 0;
+    ordered = true;
+    while (expect < total) {
+        const int count = ring.pop(batch, batchSize);
+        for (int i = 0; i < count; i++) {
+            if (batch[i].value != expect++) ordered = false;
+        }
+    }
+    producer->wait();
+    return total * 1000.0 / qMax(timer.nsecsElapsed() / 1000000.0, 0.001);
+}
+
+void TestInputEventRing::threads()
+{
+    QScopedPointer<Ring> ring(new Ring);
+    bool ordered = false;
+    transfer(*ring, 1000000, ordered);
+    QVERIFY(ordered);
+    QCOMPARE(ring->size(), 0);
+}
+
+void TestInputEventRing::throughput_data()
+{
+    QTest::addColumn<quint32>("total");
+    QTest::newRow("1M") << quint32(1000000);
+    QTest::newRow("10M") << quint32(10000000);
+}
+
+// The samples per second through the ring with the producer spinning on the full ring;
+// the dropped() count is the number of the producer retries then
+void TestInputEventRing::throughput()
+{
+    QFETCH(quint32, total);
+
+    double rate = 0;
+    quint32 retries = 0;
+    QBENCHMARK {
+        QScopedPointer<Ring> ring(new Ring);
+        bool ordered = false;
+        rate = transfer(*ring, total, ordered);
+        retries = ring->dropped();
+        QVERIFY(ordered);
+    }
+    qInfo().noquote() << QString::asprintf("%.1f M samples/s, %u producer retries, %d bytes/sample",
+                                           rate / 1000000.0, retries, int(sizeof(InputSample)));
+}
+
+QTEST_GUILESS_MAIN(TestInputEventRing)
+#include "tst_inputeventring.moc"
@@ -0,0 +1,13 @@
+#include "ActivityStore.h"
+#include "SqliteStore.h"
+#include "SegmentStore.h"
+
+// static
+ActivityStore *ActivityStore::create(Engine engine, const QString &filepath)
+{
+    switch (engine) {
+    case EngineSqlite:  return new SqliteStore(filepath);
+    case EngineSegment: return new SegmentStore(filepath);
+    }
+    return nullptr;
+}
@@ -0,0 +1,68 @@
+#ifndef ACTIVITYSTORE_H
+#define ACTIVITYSTORE_H
+
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+#include "ActivityRecord.h"
+#include "SqliteProducer.h" // the ServerStatusMap
+
+// The storage engine of the activity rows. The SQLite engine is the one of the application,
+// the segment engine is a log structured alternative to compare with. The calls are made
+// from the thread the store is created in and return when the work is done.
+//
+// The application writes through SqliteProducer and its views read the SQLite files, so the
+// stores are not part of it; the suite next to them runs both engines through the same
+// conformance checks and benchmarks.
+class ActivityStore
+{
+public:
+    enum Engine { EngineSqlite, EngineSegment };
+
+    struct Row {
+        QString tableName;
+        qint64 localTime; // seconds since epoch
+        QString projectId;
+        QString textNote;
+        qint64 keyPresses;
+        qint64 mouseClicks;
+        qint64 mouseDistance;
+        quint64 activeMask;
+        QString serverStatus;
+    };
+
+    static ActivityStore *create(Engine engine, const QString &filepath);
+    virtual ~ActivityStore() {}
+
+    virtual bool open() = 0;
+    virtual void close() = 0;
+
+    // the records of the same table, second and project are merged: the counters are added up,
+    // the masks are or'ed, the note is replaced and the status is reset; the record of another
+    // project goes to the next second without a row of another project, see ActivitySchema
+    virtual bool append(const QVector<ActivityRecord> &records) = 0;
+    // the rows ordered by the LocalTime, the bounds are inclusive, 0 is unbound
+    virtual bool scan(const QString &table, qint64 fromTime, qint64 toTime, QVector<Row> &rows) = 0;
+    virtual bool setServerStatus(const QString &table, const ServerStatusMap &status) = 0;
+    // the rows from the time on are kept, the older ones are removed as the engine allows
+    virtual bool retain(qint64 beforeTime) = 0;
+
+    virtual QString errorString() const = 0;
+    // the bytes of the appended rows and the bytes written to the files for them, the
+    // write amplification is the second over the first
+    virtual qint64 bytesAppended() const = 0;
+    virtual qint64 bytesWritten() const = 0;
+
+protected:
+    // the logical sizes counted by every engine alike: the numbers as 8 bytes, the text as UTF-8
+    static qint64 recordBytes(const ActivityRecord &record) {
+        return 5 * sizeof(qint64) + record.tableName().toUtf8().size() + record.projectId().toUtf8().size()
+                + record.textNote().toUtf8().size();
+    }
+    static qint64 statusBytes(const QString &status) {
+        return sizeof(qint64) + status.toUtf8().size();
+    }
+};
+
+#endif // ACTIVITYSTORE_H
@@ -0,0 +1,496 @@
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QtDebug>
+#include <limits>
+
+#include "SegmentStore.h"
+#include "ActivityPack.h"
+#include "ActivitySchema.h"
+
+//#define TRACE_SEGMENTSTORE
+#ifdef TRACE_SEGMENTSTORE
+#include <QTime>
+#include <QThread>
+#define TRACE()      qDebug() << QTime::currentTime().toString("hh:mm:ss.zzz") << QThread::currentThreadId() << Q_FUNC_INFO;
+#define TRACE_ARG(x) qDebug() << QTime::currentTime().toString("hh:mm:ss.zzz") << QThread::currentThreadId() << Q_FUNC_INFO << x;
+#else
+#define TRACE()
+#define TRACE_ARG(x)
+#endif
+
+static const char *compactSuffix = ".compact"; // the merged segment until the inputs are removed
+static const char *partialSuffix = ".partial"; // the merged segment being written
+
+static void putString(QByteArray &buffer, const QString &text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    ActivityPack::putVarint(buffer, quint64(utf8.size()));
+    buffer.append(utf8);
+}
+
+static bool getString(const QByteArray &buffer, int &offset, QString &text)
+{
+    quint64 size;
+    if (!ActivityPack::getVarint(buffer, offset, size) || size > quint64(buffer.size() - offset)) return false;
+    text = QString::fromUtf8(buffer.constData() + offset, int(size));
+    offset += int(size);
+    return true;
+}
+
+SegmentStore::SegmentStore(const QString &filepath)
+    : dir_path(QFileInfo(filepath).absolutePath() + QLatin1Char('/') +
+               QFileInfo(filepath).completeBaseName() + QLatin1String("-segments"))
+    , watermark(0)
+    , compacting(false)
+    , bytes_appended(0)
+    , bytes_written(0)
+{
+    compact_pool.setMaxThreadCount(1);
+}
+
+SegmentStore::~SegmentStore()
+{
+    close();
+}
+
+// static
+QString SegmentStore::segmentPath(const QString &dirpath, int number)
+{
+    return QString("%1/%2%3").arg(dirpath).arg(number, 8, 10, QLatin1Char('0')).arg(QLatin1String(segmentSuffix));
+}
+
+bool SegmentStore::open()
+{
+    close();
+    QDir dir(dir_path);
+    if (!dir.mkpath(QStringLiteral("."))) {
+        last_error = QString("Can't create '%1'").arg(dir_path);
+        return false;
+    }
+    // A merged segment renamed to .compact is complete, it replaces the segments up to its number
+    const auto partial = dir.entryList({ QString("*%1").arg(QLatin1String(partialSuffix)) }, QDir::Files);
+    for (const auto &name : partial) dir.remove(name);
+    const auto merged = dir.entryList({ QString("*%1").arg(QLatin1String(compactSuffix)) }, QDir::Files);
+    for (const auto &name : merged) {
+        int number = name.section('.', 0, 0).toInt();
+        const auto names = dir.entryList({ QString("*%1").arg(QLatin1String(segmentSuffix)) }, QDir::Files);
+        for (const auto &seg : names) {
+            if (seg.section('.', 0, 0).toInt() <= number) dir.remove(seg);
+        }
+        dir.rename(name, QFileInfo(segmentPath(dir_path, number)).fileName());
+    }
+    QMutexLocker lock(&mutex);
+    watermark = 0;
+    const auto names = dir.entryList({ QString("*%1").arg(QLatin1String(segmentSuffix)) }, QDir::Files, QDir::Name);
+    for (const auto &name : names) {
+        Segment segment = { dir.filePath(name), name.section('.', 0, 0).toInt(), 0, 0, {} };
+        if (!load(segment)) return false;
+        segments.append(segment);
+    }
+    if (segments.isEmpty()) segments.append({ segmentPath(dir_path, 1), 1, 0, 0, {} });
+    active.setFileName(segments.last().path);
+    if (!active.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        last_error = active.errorString();
+        return false;
+    }
+    TRACE_ARG(dir_path << segments.size() << watermark);
+    return segments.last().size < segmentSize || roll();
+}
+
+void SegmentStore::close()
+{
+    waitForCompaction();
+    QMutexLocker lock(&mutex);
+    if (active.isOpen()) active.close();
+    segments.clear();
+}
+
+// Index the whole records of the segment file, a torn record at the end is cut off
+bool SegmentStore::load(Segment &segment)
+{
+    QFile file(segment.path);
+    if (!file.open(QIODevice::ReadWrite)) {
+        last_error = file.errorString();
+        return false;
+    }
+    const qint64 size = file.size();
+    if (!size) return true;
+    uchar *data = file.map(0, size);
+    if (!data) {
+        last_error = file.errorString();
+        return false;
+    }
+    const QByteArray buffer = QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(size));
+    int offset = 0;
+    Record record;
+    while (offset < buffer.size()) {
+        int start = offset;
+        if (!decode(buffer, offset, record)) {
+            offset = start;
+            break;
+        }
+        if (record.type == RecordRetain) watermark = qMax(watermark, record.row.localTime);
+        indexRecord(segment, start, record.row.localTime);
+    }
+    segment.size = offset;
+    file.unmap(data);
+    if (segment.size < size) {
+        qWarning() << Q_FUNC_INFO << segment.path << "Truncated at" << segment.size << "of" << size;
+        file.resize(segment.size);
+    }
+    return true;
+}
+
+// static
+void SegmentStore::indexRecord(Segment &segment, qint64 offset, qint64 localTime)
+{
+    if (segment.records++ % indexStride == 0) {
+        segment.index.append({ offset, localTime, localTime });
+        return;
+    }
+    Block &block = segment.index.last();
+    block.minTime = qMin(block.minTime, localTime);
+    block.maxTime = qMax(block.maxTime, localTime);
+}
+
+// static
+void SegmentStore::encode(QByteArray &buffer, const Record &record)
+{
+    QByteArray payload;
+    payload.append(char(record.type));
+    putString(payload, record.row.tableName);
+    ActivityPack::putZigzag(payload, record.row.localTime);
+    switch (record.type) {
+    case RecordRow:
+        putString(payload, record.row.projectId);
+        putString(payload, record.row.textNote);
+        ActivityPack::putVarint(payload, quint64(record.row.keyPresses));
+        ActivityPack::putVarint(payload, quint64(record.row.mouseClicks));
+        ActivityPack::putVarint(payload, quint64(record.row.mouseDistance));
+        ActivityPack::putVarint(payload, record.row.activeMask);
+        break;
+    case RecordStatus:
+        putString(payload, record.row.serverStatus);
+        break;
+    case RecordRetain:
+        break;
+    }
+    ActivityPack::putVarint(buffer, quint64(payload.size()));
+    buffer.append(payload);
+}
+
+// static
+bool SegmentStore::decode(const QByteArray &buffer, int &offset, Record &record)
+{
+    quint64 size;
+    if (!ActivityPack::getVarint(buffer, offset, size) || !size || size > quint64(buffer.size() - offset)) return false;
+    const QByteArray payload = QByteArray::fromRawData(buffer.constData() + offset, int(size));
+    offset += int(size);
+
+    int pos = 1;
+    quint64 value;
+    record.type = RecordType(payload.at(0));
+    record.row = Row();
+    if (!getString(payload, pos, record.row.tableName) ||
+        !ActivityPack::getZigzag(payload, pos, record.row.localTime)) return false;
+    switch (record.type) {
+    case RecordRow:
+        if (!getString(payload, pos, record.row.projectId) || !getString(payload, pos, record.row.textNote))
+            return false;
+        if (!ActivityPack::getVarint(payload, pos, value)) return false;
+        record.row.keyPresses = qint64(value);
+        if (!ActivityPack::getVarint(payload, pos, value)) return false;
+        record.row.mouseClicks = qint64(value);
+        if (!ActivityPack::getVarint(payload, pos, value)) return false;
+        record.row.mouseDistance = qint64(value);
+        if (!ActivityPack::getVarint(payload, pos, record.row.activeMask)) return false;
+        break;
+    case RecordStatus:
+        if (!getString(payload, pos, record.row.serverStatus)) return false;
+        break;
+    case RecordRetain:
+        break;
+    default:
+        return false;
+    }
+    return pos == payload.size();
+}
+
+// The same upsert as the one of the SQLite tables
+// static
+void SegmentStore::merge(QMap<qint64,Row> &rows, const Record &record, qint64 watermark)
+{
+    if (record.row.localTime < watermark) return;
+    auto it = rows.find(record.row.localTime);
+    switch (record.type) {
+    case RecordRow:
+        // the row of another project is left alone, the record goes to the next free second
+        for (int shift = 1; it != rows.end() && it->projectId != record.row.projectId; shift++) {
+            if (shift >= ActivitySchema::mergeShift) return;
+            it = rows.find(record.row.localTime + shift);
+            if (it == rows.end()) {
+                Row row = record.row;
+                row.localTime += shift;
+                rows.insert(row.localTime, row);
+                return;
+            }
+        }
+        if (it == rows.end()) {
+            rows.insert(record.row.localTime, record.row);
+            break;
+        }
+        it->textNote = record.row.textNote;
+        it->keyPresses += record.row.keyPresses;
+        it->mouseClicks += record.row.mouseClicks;
+        it->mouseDistance += record.row.mouseDistance;
+        it->activeMask |= record.row.activeMask;
+        it->serverStatus.clear();
+        break;
+    case RecordStatus:
+        if (it != rows.end()) it->serverStatus = record.row.serverStatus;
+        break;
+    case RecordRetain:
+        break;
+    }
+}
+
+// Append the records to the active segment and index them, the mutex is locked
+bool SegmentStore::write(const QVector<Record> &records)
+{
+    if (!active.isOpen()) {
+        last_error = QStringLiteral("Not open");
+        return false;
+    }
+    QByteArray buffer;
+    QVector<int> offsets;
+    offsets.reserve(records.size());
+    for (const auto &record : records) {
+        offsets.append(buffer.size());
+        encode(buffer, record);
+    }
+    if (active.write(buffer) != buffer.size() || !active.flush()) {
+        last_error = active.errorString();
+        return false;
+    }
+    Segment &segment = segments.last();
+    for (int i = 0; i < records.size(); i++) {
+        indexRecord(segment, segment.size + offsets.at(i), records.at(i).row.localTime);
+    }
+    segment.size += buffer.size();
+    bytes_written += buffer.size();
+    if (segment.size >= segmentSize && !roll()) return false;
+
+    if (!compacting && segments.size() > compactSegments) {
+        compacting = true;
+        compact_pool.start(new SegmentCompactTask(this));
+    }
+    return true;
+}
+
+// Seal the active segment and start the next one
+bool SegmentStore::roll()
+{
+    active.close();
+    int number = segments.last().number + 1;
+    segments.append({ segmentPath(dir_path, number), number, 0, 0, {} });
+    active.setFileName(segments.last().path);
+    if (!active.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        last_error = active.errorString();
+        return false;
+    }
+    TRACE_ARG(active.fileName());
+    return true;
+}
+
+bool SegmentStore::append(const QVector<ActivityRecord> &records)
+{
+    QVector<Record> list;
+    list.reserve(records.size());
+    for (const auto &record : records) {
+        if (!record.isValid()) continue;
+        list.append({ RecordRow, { record.tableName(), record.localTime().toSecsSinceEpoch(), record.projectId(),
+                                   record.textNote(), record.keyPresses(), record.mouseClicks(),
+                                   record.mouseDistance(), record.activeMask(), QString() } });
+    }
+    QMutexLocker lock(&mutex);
+    if (list.isEmpty()) return true;
+    if (!write(list)) return false;
+    for (const auto &record : records) {
+        if (record.isValid()) bytes_appended += recordBytes(record);
+    }
+    return true;
+}
+
+bool SegmentStore::setServerStatus(const QString &table, const ServerStatusMap &status)
+{
+    QVector<Record> list;
+    list.reserve(status.size());
+    for (auto it = status.constBegin(); it != status.constEnd(); ++it) {
+        Record record = { RecordStatus, Row() };
+        record.row.tableName = table;
+        record.row.localTime = it.key();
+        record.row.serverStatus = it.value();
+        list.append(record);
+    }
+    QMutexLocker lock(&mutex);
+    if (list.isEmpty()) return true;
+    if (!write(list)) return false;
+    for (const auto &text : status) bytes_appended += statusBytes(text);
+    return true;
+}
+
+// The watermark hides the older rows right away, the sealed segments entirely before it
+// are removed and the compaction drops the rest
+bool SegmentStore::retain(qint64 beforeTime)
+{
+    QMutexLocker lock(&mutex);
+    if (beforeTime <= watermark) return true;
+    Record record = { RecordRetain, Row() };
+    record.row.localTime = beforeTime;
+    if (!write({ record })) return false;
+    watermark = beforeTime;
+    if (compacting) return true; // the merged inputs are removed by the compaction
+
+    for (int i = segments.size() - 2; i >= 0; i--) {
+        const Segment &segment = segments.at(i);
+        bool expired = true;
+        for (const auto &block : segment.index) {
+            if (block.maxTime >= beforeTime) {
+                expired = false;
+                break;
+            }
+        }
+        if (!expired) continue;
+        if (!QFile::remove(segment.path)) TRACE_ARG("Can't remove" << segment.path);
+        segments.remove(i);
+    }
+    return true;
+}
+
+bool SegmentStore::scan(const QString &table, qint64 fromTime, qint64 toTime, QVector<Row> &rows)
+{
+    if (toTime <= 0) toTime = std::numeric_limits<qint64>::max();
+    QMap<qint64,Row> merged;
+    QMutexLocker lock(&mutex);
+    for (const auto &segment : segments) {
+        if (!segment.size) continue;
+        QFile file(segment.path);
+        uchar *data = file.open(QIODevice::ReadOnly) ? file.map(0, segment.size) : nullptr;
+        if (!data) {
+            last_error = file.errorString();
+            return false;
+        }
+        const QByteArray buffer = QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(segment.size));
+        for (int i = 0; i < segment.index.size(); i++) {
+            const Block &block = segment.index.at(i);
+            if (block.maxTime < fromTime || block.minTime > toTime) continue;
+            int offset = int(block.offset);
+            const int end = i + 1 < segment.index.size() ? int(segment.index.at(i + 1).offset) : buffer.size();
+            Record record;
+            while (offset < end && decode(buffer, offset, record)) {
+                if (record.row.tableName != table) continue;
+                if (record.row.localTime < fromTime || record.row.localTime > toTime) continue;
+                merge(merged, record, watermark);
+            }
+        }
+        file.unmap(data);
+    }
+    rows.reserve(rows.size() + merged.size());
+    for (auto it = merged.constBegin(); it != merged.constEnd(); ++it) rows.append(it.value());
+    return true;
+}
+
+// Merge all the sealed segments into one numbered as the last of them. The inputs are
+// immutable, so they are read without the lock; the list is swapped under it at the end.
+void SegmentStore::compact()
+{
+    QVector<Segment> inputs;
+    qint64 mark;
+    {
+        QMutexLocker lock(&mutex);
+        inputs = segments.mid(0, segments.size() - 1);
+        mark = watermark;
+    }
+    if (inputs.size() < 2) {
+        QMutexLocker lock(&mutex);
+        compacting = false;
+        return;
+    }
+    QMap<QString,QMap<qint64,Row>> tables;
+    for (const auto &segment : inputs) {
+        QFile file(segment.path);
+        uchar *data = (segment.size && file.open(QIODevice::ReadOnly)) ? file.map(0, segment.size) : nullptr;
+        if (!data) continue;
+        const QByteArray buffer = QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(segment.size));
+        int offset = 0;
+        Record record;
+        while (offset < buffer.size() && decode(buffer, offset, record)) {
+            if (record.type != RecordRetain) merge(tables[record.row.tableName], record, mark);
+        }
+        file.unmap(data);
+    }
+    Segment output = { segmentPath(dir_path, inputs.last().number), inputs.last().number, 0, 0, {} };
+    QVector<Record> records;
+    if (mark) {
+        Record retain = { RecordRetain, Row() };
+        retain.row.localTime = mark;
+        records.append(retain);
+    }
+    for (auto table = tables.constBegin(); table != tables.constEnd(); ++table) {
+        for (const auto &row : table.value()) {
+            records.append({ RecordRow, row });
+            records.last().row.serverStatus.clear();
+            if (!row.serverStatus.isEmpty()) records.append({ RecordStatus, row });
+        }
+    }
+    QByteArray buffer;
+    for (const auto &record : records) {
+        indexRecord(output, buffer.size(), record.row.localTime);
+        encode(buffer, record);
+    }
+    output.size = buffer.size();
+
+    const QString partial = output.path + QLatin1String(partialSuffix);
+    const QString merged = output.path + QLatin1String(compactSuffix);
+    QFile file(partial);
+    bool ok = file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(buffer) == buffer.size();
+    file.close();
+    ok = ok && QFile::rename(partial, merged);
+    if (!ok) {
+        qWarning() << Q_FUNC_INFO << partial << file.errorString();
+        QFile::remove(partial);
+        QMutexLocker lock(&mutex);
+        compacting = false;
+        return;
+    }
+    QMutexLocker lock(&mutex);
+    for (const auto &segment : inputs) QFile::remove(segment.path);
+    QFile::rename(merged, output.path);
+    segments.remove(0, inputs.size());
+    segments.prepend(output);
+    bytes_written += buffer.size();
+    compacting = false;
+    TRACE_ARG(inputs.size() << "segments into" << output.path << output.size);
+}
+
+void SegmentStore::waitForCompaction()
+{
+    compact_pool.waitForDone();
+}
+
+QString SegmentStore::errorString() const
+{
+    QMutexLocker lock(&mutex);
+    return last_error;
+}
+
+qint64 SegmentStore::bytesAppended() const
+{
+    return bytes_appended.loadRelaxed();
+}
+
+qint64 SegmentStore::bytesWritten() const
+{
+    return bytes_written.loadRelaxed();
+}
@@ -0,0 +1,95 @@
+#ifndef SEGMENTSTORE_H
+#define SEGMENTSTORE_H
+
+#include <QFile>
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QAtomicInteger>
+
+#include "ActivityStore.h"
+
+// Log structured store of the activity rows in the append-only segment files.
+//
+// A segment is the sequence of the varint length prefixed records: the row, the server
+// status of a row and the retention watermark. The records are only appended to the active
+// segment, it is sealed at segmentSize bytes; the sealed ones are read memory mapped. Every
+// indexStride records of a segment are a block of the sparse time index with the LocalTime
+// bounds, the scan skips the blocks out of the range. The sealed segments are merged in the
+// background into one, the merged rows and the statuses applied, the retained rows dropped.
+class SegmentStore : public ActivityStore
+{
+public:
+    static constexpr char const *segmentSuffix = ".seg";
+    static constexpr int const segmentSize     = 4 * 1024 * 1024; // bytes of the active segment
+    static constexpr int const indexStride     = 64; // records per block of the time index
+    static constexpr int const compactSegments = 4;  // sealed segments merged at once
+
+    explicit SegmentStore(const QString &filepath);
+    ~SegmentStore() override;
+
+    bool open() override;
+    void close() override;
+    bool append(const QVector<ActivityRecord> &records) override;
+    bool scan(const QString &table, qint64 fromTime, qint64 toTime, QVector<Row> &rows) override;
+    bool setServerStatus(const QString &table, const ServerStatusMap &status) override;
+    bool retain(qint64 beforeTime) override;
+    QString errorString() const override;
+    qint64 bytesAppended() const override;
+    qint64 bytesWritten() const override;
+
+    void compact(); // merges the sealed segments, runs in the compaction thread
+    void waitForCompaction();
+
+private:
+    Q_DISABLE_COPY(SegmentStore)
+
+    enum RecordType { RecordRow = 1, RecordStatus, RecordRetain };
+    struct Block {
+        qint64 offset;
+        qint64 minTime;
+        qint64 maxTime;
+    };
+    struct Segment {
+        QString path;
+        int number;
+        qint64 size; // the bytes of the whole records
+        int records;
+        QVector<Block> index;
+    };
+    struct Record {
+        RecordType type;
+        Row row; // the retention watermark is the LocalTime
+    };
+
+    static QString segmentPath(const QString &dirpath, int number);
+    static void encode(QByteArray &buffer, const Record &record);
+    static bool decode(const QByteArray &buffer, int &offset, Record &record);
+    static void merge(QMap<qint64,Row> &rows, const Record &record, qint64 watermark);
+    static void indexRecord(Segment &segment, qint64 offset, qint64 localTime);
+    bool load(Segment &segment);
+    bool write(const QVector<Record> &records);
+    bool roll();
+
+    const QString dir_path;
+    mutable QMutex mutex; // the segment list, the compaction swaps it
+    QVector<Segment> segments; // the numbers ascending, the last one is active
+    QFile active;
+    qint64 watermark; // the rows before are retained
+    bool compacting;
+    QThreadPool compact_pool;
+    QString last_error;
+    QAtomicInteger<qint64> bytes_appended;
+    QAtomicInteger<qint64> bytes_written;
+};
+
+class SegmentCompactTask : public QRunnable
+{
+public:
+    explicit SegmentCompactTask(SegmentStore *store) : segment_store(store) {}
+private:
+    void run() override { segment_store->compact(); }
+    SegmentStore *segment_store;
+};
+
+#endif // SEGMENTSTORE_H
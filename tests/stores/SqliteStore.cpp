@@ -0,0 +1,209 @@
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QTimer>
+#include <limits>
+
+#include "SqliteStore.h"
+#include "SqliteProducer.h"
+#include "ActivityPack.h"
+
+static const char *sqlAttach =
+    "ATTACH DATABASE '%1' AS %2";
+static const char *sqlDetach =
+    "DETACH DATABASE %1";
+static const char *sqlTableInfo =
+    "PRAGMA %1.table_info('%2')";
+static const char *sqlScanRange =
+    "SELECT LocalTime, ProjectId, TextNote, KeyPresses, MouseClicks, MouseDistance, ServerStatus, ActiveMask"
+    " FROM %1 WHERE LocalTime BETWEEN %2 AND %3";
+static const char *sqlPackedRange =
+    "SELECT DayTime, ProjectId, Data FROM %1 WHERE DayTime <= %2 AND LastTime >= %3";
+
+SqliteStore::SqliteStore(const QString &filepath)
+    : db_filepath(filepath)
+    , conn_name(QString("SqliteStore%1").arg(reinterpret_cast<quintptr>(this)))
+    , producer(nullptr)
+    , bytes_appended(0)
+    , bytes_base(0)
+{
+}
+
+SqliteStore::~SqliteStore()
+{
+    close();
+}
+
+bool SqliteStore::open()
+{
+    close();
+    last_error.clear();
+    producer = new SqliteProducer(db_filepath);
+    QObject::connect(producer, &SqliteProducer::errorOccurred, [this](const QString &text) { last_error = text; });
+    producer->start();
+    if (!last_error.isEmpty()) return false;
+
+    QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), conn_name);
+    db.setDatabaseName(db_filepath);
+    db.setConnectOptions("QSQLITE_OPEN_READONLY");
+    if (!db.open()) {
+        last_error = db.lastError().text();
+        return false;
+    }
+    bytes_base = writtenBytes();
+    return true;
+}
+
+void SqliteStore::close()
+{
+    if (producer) {
+        delete producer; // commits the pending rows
+        producer = nullptr;
+    }
+    if (QSqlDatabase::contains(conn_name)) {
+        QSqlDatabase::database(conn_name, false).close();
+        QSqlDatabase::removeDatabase(conn_name);
+    }
+}
+
+bool SqliteStore::append(const QVector<ActivityRecord> &records)
+{
+    if (!producer) return false;
+    last_error.clear();
+    producer->insertRows(records);
+    producer->commitRows();
+    if (!last_error.isEmpty()) return false;
+    for (const auto &record : records) {
+        if (record.isValid()) bytes_appended += recordBytes(record);
+    }
+    return true;
+}
+
+bool SqliteStore::setServerStatus(const QString &table, const ServerStatusMap &status)
+{
+    if (!producer) return false;
+    last_error.clear();
+    producer->setServerStatus(table, status);
+    if (!last_error.isEmpty()) return false;
+    for (const auto &text : status) bytes_appended += statusBytes(text);
+    return true;
+}
+
+// The producer retention by the days, the partitions are dropped by the whole months
+bool SqliteStore::retain(qint64 beforeTime)
+{
+    if (!producer) return false;
+    last_error.clear();
+    producer->retainNow(int((QDateTime::currentSecsSinceEpoch() - beforeTime) / (24 * 60 * 60)));
+    return last_error.isEmpty();
+}
+
+bool SqliteStore::scan(const QString &table, qint64 fromTime, qint64 toTime, QVector<Row> &rows)
+{
+    QSqlDatabase db = QSqlDatabase::database(conn_name, false);
+    if (!db.isOpen()) {
+        last_error = QStringLiteral("Not open");
+        return false;
+    }
+    if (toTime <= 0) toTime = std::numeric_limits<qint64>::max();
+    QMap<qint64,Row> merged;
+    if (!scanTable(db, QStringLiteral("main"), table, fromTime, toTime, merged)) return false;
+
+    const QDate first = fromTime > 0 ? SqliteProducer::partitionMonth(fromTime) : QDate();
+    const QDate last = SqliteProducer::partitionMonth(qMin(toTime, QDateTime::currentSecsSinceEpoch()));
+    const auto files = SqliteProducer::partitionFiles(db_filepath);
+    for (auto it = files.constBegin(); it != files.constEnd(); ++it) {
+        if (first.isValid() && it.key() < first) continue;
+        if (it.key() > last) break;
+        const QString schema = SqliteProducer::partitionSchema(it.key());
+        QString path = it.value();
+        QSqlQuery sql(db);
+        if (!sql.exec(QString(sqlAttach).arg(path.replace('\'', QLatin1String("''")), schema))) {
+            last_error = sql.lastError().text();
+            return false;
+        }
+        bool ok = scanTable(db, schema, table, fromTime, toTime, merged);
+        sql.exec(QString(sqlDetach).arg(schema));
+        if (!ok) return false;
+    }
+    rows.reserve(rows.size() + merged.size());
+    for (auto it = merged.constBegin(); it != merged.constEnd(); ++it) rows.append(it.value());
+    return true;
+}
+
+// The view or the legacy table of the schema and the packed project days, if any
+bool SqliteStore::scanTable(QSqlDatabase &db, const QString &schema, const QString &table,
+                            qint64 fromTime, qint64 toTime, QMap<qint64,Row> &rows)
+{
+    QSqlQuery sql(db);
+    sql.setForwardOnly(true);
+    if (!sql.exec(QString(sqlTableInfo).arg(schema, table)) || !sql.next()) return true; // no such table
+    sql.finish();
+    if (!sql.exec(QString(sqlScanRange).arg(SqliteProducer::tableRef(schema, table)).arg(fromTime).arg(toTime))) {
+        last_error = sql.lastError().text();
+        return false;
+    }
+    while (sql.next()) {
+        rows.insert(sql.value(0).toLongLong(), { table, sql.value(0).toLongLong(), sql.value(1).toString(),
+                                                 sql.value(2).toString(), sql.value(3).toLongLong(),
+                                                 sql.value(4).toLongLong(), sql.value(5).toLongLong(),
+                                                 sql.value(7).toULongLong(), sql.value(6).toString() });
+    }
+    sql.finish();
+    const QString packed = SqliteProducer::packedName(table);
+    if (!sql.exec(QString(sqlTableInfo).arg(schema, packed)) || !sql.next()) return true;
+    sql.finish();
+    if (!sql.exec(QString(sqlPackedRange).arg(SqliteProducer::tableRef(schema, packed)).arg(toTime).arg(fromTime))) {
+        last_error = sql.lastError().text();
+        return false;
+    }
+    QVector<ActivityPack::Row> day;
+    while (sql.next()) {
+        day.resize(0);
+        if (!ActivityPack::unpack(sql.value(0).toLongLong(), sql.value(2).toByteArray(), day)) continue;
+        for (const auto &row : day) {
+            if (row.localTime < fromTime || row.localTime > toTime) continue;
+            rows.insert(row.localTime, { table, row.localTime, sql.value(1).toString(), row.textNote,
+                                         row.keyPresses, row.mouseClicks, row.mouseDistance,
+                                         quint64(row.activeMask), row.serverStatus });
+        }
+    }
+    return true;
+}
+
+QString SqliteStore::errorString() const
+{
+    return last_error;
+}
+
+qint64 SqliteStore::bytesAppended() const
+{
+    return bytes_appended;
+}
+
+qint64 SqliteStore::bytesWritten() const
+{
+    return writtenBytes() - bytes_base;
+}
+
+// The bytes the process passed to write(), SQLite writes the pages to the WAL and copies them
+// to the database by the checkpoints. Elsewhere the size of the files is the lower bound.
+qint64 SqliteStore::writtenBytes() const
+{
+#ifdef Q_OS_LINUX
+    QFile io(QStringLiteral("/proc/self/io"));
+    if (io.open(QIODevice::ReadOnly)) {
+        for (QByteArray line = io.readLine(); !line.isEmpty(); line = io.readLine()) {
+            if (line.startsWith("wchar:")) return line.mid(6).trimmed().toLongLong();
+        }
+    }
+#endif
+    qint64 size = QFileInfo(db_filepath).size() + QFileInfo(db_filepath + QLatin1String("-wal")).size();
+    for (const auto &path : SqliteProducer::partitionFiles(db_filepath)) {
+        size += QFileInfo(path).size() + QFileInfo(path + QLatin1String("-wal")).size();
+    }
+    return size;
+}
@@ -0,0 +1,42 @@
+#ifndef SQLITESTORE_H
+#define SQLITESTORE_H
+
+#include "ActivityStore.h"
+
+class QSqlDatabase;
+class SqliteProducer;
+
+// The SQLite engine of the application behind the store interface: the producer writes in
+// the calling thread and the scan reads the partitions of the range by its own connection
+class SqliteStore : public ActivityStore
+{
+public:
+    explicit SqliteStore(const QString &filepath);
+    ~SqliteStore() override;
+
+    bool open() override;
+    void close() override;
+    bool append(const QVector<ActivityRecord> &records) override;
+    bool scan(const QString &table, qint64 fromTime, qint64 toTime, QVector<Row> &rows) override;
+    bool setServerStatus(const QString &table, const ServerStatusMap &status) override;
+    bool retain(qint64 beforeTime) override;
+    QString errorString() const override;
+    qint64 bytesAppended() const override;
+    qint64 bytesWritten() const override;
+
+private:
+    Q_DISABLE_COPY(SqliteStore)
+
+    bool scanTable(QSqlDatabase &db, const QString &schema, const QString &table,
+                   qint64 fromTime, qint64 toTime, QMap<qint64,Row> &rows);
+    qint64 writtenBytes() const;
+
+    const QString db_filepath;
+    QString conn_name;
+    SqliteProducer *producer;
+    QString last_error;
+    qint64 bytes_appended;
+    qint64 bytes_base; // written by the process before the open
+};
+
+#endif // SQLITESTORE_H
@@ -0,0 +1,303 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QScopedPointer>
+#include <QUuid>
+
+#include "ActivityStore.h"
+
+Q_DECLARE_METATYPE(ActivityStore::Engine)
+
+// The same conformance and benchmark suite for every engine of the store: the append and the
+// range scan, the merge of the LocalTime collision, the server status, the reopen and the
+// retention, then the write amplification and the scan throughput of a fortnight of rows
+class TestActivityStore : public QObject
+{
+    Q_OBJECT
+
+    static constexpr char const *storeTable = "0x1234";
+    static constexpr int const dayMinutes   = 600; // 10 active hours
+    static constexpr int const batchRows    = 10;  // the records of one append
+
+    QUuid projects[3];
+
+    static void engines();
+    static qint64 dayStart(int daysAgo) {
+        return QDate::currentDate().addDays(-daysAgo).startOfDay().addSecs(8 * 3600).toSecsSinceEpoch();
+    }
+    ActivityRecord record(qint64 time, int project, const QString &note, int keyPresses) const {
+        return ActivityRecord(QLatin1String(storeTable), QDateTime::fromSecsSinceEpoch(time), projects[project], note,
+                              keyPresses, keyPresses / 3, keyPresses * 10, quint64(1) << (keyPresses % 60));
+    }
+    ActivityStore *openStore(ActivityStore::Engine engine, const QTemporaryDir &dir) const;
+    bool appendDays(ActivityStore *store, int fromDaysAgo, int days, int minutes, qint64 &count) const;
+
+private slots:
+    void initTestCase();
+    void appendScan_data() { engines(); }
+    void appendScan();
+    void merge_data() { engines(); }
+    void merge();
+    void serverStatus_data() { engines(); }
+    void serverStatus();
+    void reopen_data() { engines(); }
+    void reopen();
+    void retain_data() { engines(); }
+    void retain();
+    void writeAmplification_data() { engines(); }
+    void writeAmplification();
+    void scanRate_data() { engines(); }
+    void scanRate();
+};
+
+// static
+void TestActivityStore::engines()
+{
+    QTest::addColumn<ActivityStore::Engine>("engine");
+    QTest::newRow("sqlite") << ActivityStore::EngineSqlite;
+    QTest::newRow("segment") << ActivityStore::EngineSegment;
+}
+
+ActivityStore *TestActivityStore::openStore(ActivityStore::Engine engine, const QTemporaryDir &dir) const
+{
+    ActivityStore *store = ActivityStore::create(engine, dir.filePath("store.db"));
+    if (store && !store->open()) qWarning() << store->errorString();
+    return store;
+}
+
+// The minute rows of the days, the projects taking turns by an hour and a half
+bool TestActivityStore::appendDays(ActivityStore *store, int fromDaysAgo, int days, int minutes, qint64 &count) const
+{
+    for (int d = fromDaysAgo; d > fromDaysAgo - days; d--) {
+        const qint64 start = dayStart(d);
+        QVector<ActivityRecord> batch;
+        for (int m = 0; m < minutes; m++) {
+            batch.append(record(start + m * 60, (m / 90) % 3, m % 5 ? QStringLiteral("fix issue 42") : QString(),
+                                1 + m % 97));
+            if (batch.size() < batchRows && m + 1 < minutes) continue;
+            if (!store->append(batch)) return false;
+            count += batch.size();
+            batch.clear();
+        }
+    }
+    return true;
+}
+
+void TestActivityStore::initTestCase()
+{
+    for (auto &project : projects) project = QUuid::createUuid();
+}
+
+void TestActivityStore::appendScan()
+{
+    QFETCH(ActivityStore::Engine, engine);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QScopedPointer<ActivityStore> store(openStore(engine, dir));
+    QVERIFY(store);
+    qint64 count = 0;
+    QVERIFY2(appendDays(store.data(), 3, 3, 120, count), qPrintable(store->errorString()));
+
+    QVector<ActivityStore::Row> rows;
+    QVERIFY2(store->scan(QLatin1String(storeTable), 0, 0, rows), qPrintable(store->errorString()));
+    QCOMPARE(rows.size(), int(count));
+    for (int i = 0; i < rows.size(); i++) {
+        const ActivityStore::Row &row = rows.at(i);
+        const int m = i % 120;
+        QCOMPARE(row.tableName, QString::fromLatin1(storeTable));
+        QCOMPARE(row.localTime, dayStart(3 - i / 120) + m * 60);
+        QCOMPARE(row.projectId, projects[(m / 90) % 3].toString(QUuid::WithoutBraces));
+        QCOMPARE(row.textNote, m % 5 ? QStringLiteral("fix issue 42") : QString());
+        QCOMPARE(row.keyPresses, qint64(1 + m % 97));
+        QCOMPARE(row.mouseClicks, qint64((1 + m % 97) / 3));
+        QCOMPARE(row.mouseDistance, qint64((1 + m % 97) * 10));
+        QCOMPARE(row.activeMask, quint64(1) << ((1 + m % 97) % 60));
+        QVERIFY(row.serverStatus.isEmpty());
+    }
+
+    // the bounds are inclusive
+    rows.clear();
+    QVERIFY(store->scan(QLatin1String(storeTable), dayStart(2) + 10 * 60, dayStart(2) + 19 * 60, rows));
+    QCOMPARE(rows.size(), 10);
+    QCOMPARE(rows.first().localTime, dayStart(2) + 10 * 60);
+    QCOMPARE(rows.last().localTime, dayStart(2) + 19 * 60);
+
+    rows.clear();
+    QVERIFY(store->scan(QStringLiteral("0x1235"), 0, 0, rows));
+    QVERIFY(rows.isEmpty());
+}
+
+// The record of the same second and project is added up, the one of another project goes to the next second
+void TestActivityStore::merge()
+{
+    QFETCH(ActivityStore::Engine, engine);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QScopedPointer<ActivityStore> store(openStore(engine, dir));
+    QVERIFY(store);
+    const qint64 time = dayStart(1);
+    QVERIFY(store->append({ record(time, 0, QStringLiteral("one"), 5) }));
+    QVERIFY(store->append({ record(time, 0, QStringLiteral("two"), 7) }));
+    QVERIFY(store->append({ record(time, 1, QStringLiteral("three"), 3) }));
+
+    QVector<ActivityStore::Row> rows;
+    QVERIFY(store->scan(QLatin1String(storeTable), 0, 0, rows));
+    QCOMPARE(rows.size(), 2);
+    QCOMPARE(rows.at(0).localTime, time);
+    QCOMPARE(rows.at(0).projectId, projects[0].toString(QUuid::WithoutBraces));
+    QCOMPARE(rows.at(0).textNote, QStringLiteral("two"));
+    QCOMPARE(rows.at(0).keyPresses, qint64(12));
+    QCOMPARE(rows.at(0).mouseClicks, qint64(5 / 3 + 7 / 3));
+    QCOMPARE(rows.at(0).mouseDistance, qint64(120));
+    QCOMPARE(rows.at(0).activeMask, (quint64(1) << 5) | (quint64(1) << 7));
+    QCOMPARE(rows.at(1).localTime, time + 1);
+    QCOMPARE(rows.at(1).projectId, projects[1].toString(QUuid::WithoutBraces));
+    QCOMPARE(rows.at(1).keyPresses, qint64(3));
+}
+
+// The status of the rows, the merge of a record resets it
+void TestActivityStore::serverStatus()
+{
+    QFETCH(ActivityStore::Engine, engine);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QScopedPointer<ActivityStore> store(openStore(engine, dir));
+    QVERIFY(store);
+    const qint64 time = dayStart(1);
+    QVERIFY(store->append({ record(time, 0, QString(), 1), record(time + 60, 0, QString(), 2),
+                            record(time + 120, 0, QString(), 3) }));
+    ServerStatusMap status;
+    status.insert(time, QStringLiteral("Accepted"));
+    status.insert(time + 120, QStringLiteral("Rejected"));
+    status.insert(time + 180, QStringLiteral("No such row"));
+    QVERIFY2(store->setServerStatus(QLatin1String(storeTable), status), qPrintable(store->errorString()));
+
+    QVector<ActivityStore::Row> rows;
+    QVERIFY(store->scan(QLatin1String(storeTable), 0, 0, rows));
+    QCOMPARE(rows.size(), 3);
+    QCOMPARE(rows.at(0).serverStatus, QStringLiteral("Accepted"));
+    QVERIFY(rows.at(1).serverStatus.isEmpty());
+    QCOMPARE(rows.at(2).serverStatus, QStringLiteral("Rejected"));
+
+    QVERIFY(store->append({ record(time, 0, QString(), 4) }));
+    rows.clear();
+    QVERIFY(store->scan(QLatin1String(storeTable), time, time, rows));
+    QCOMPARE(rows.size(), 1);
+    QVERIFY(rows.first().serverStatus.isEmpty());
+    QCOMPARE(rows.first().keyPresses, qint64(5));
+}
+
+// The rows and the statuses survive the close
+void TestActivityStore::reopen()
+{
+    QFETCH(ActivityStore::Engine, engine);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QScopedPointer<ActivityStore> store(openStore(engine, dir));
+    QVERIFY(store);
+    qint64 count = 0;
+    QVERIFY(appendDays(store.data(), 2, 2, 60, count));
+    ServerStatusMap status;
+    status.insert(dayStart(1), QStringLiteral("Accepted"));
+    QVERIFY(store->setServerStatus(QLatin1String(storeTable), status));
+    QVector<ActivityStore::Row> before;
+    QVERIFY(store->scan(QLatin1String(storeTable), 0, 0, before));
+    store->close();
+
+    QVERIFY2(store->open(), qPrintable(store->errorString()));
+    QVector<ActivityStore::Row> after;
+    QVERIFY(store->scan(QLatin1String(storeTable), 0, 0, after));
+    QCOMPARE(after.size(), int(count));
+    QCOMPARE(after.size(), before.size());
+    for (int i = 0; i < after.size(); i++) {
+        QCOMPARE(after.at(i).localTime, before.at(i).localTime);
+        QCOMPARE(after.at(i).projectId, before.at(i).projectId);
+        QCOMPARE(after.at(i).keyPresses, before.at(i).keyPresses);
+        QCOMPARE(after.at(i).serverStatus, before.at(i).serverStatus);
+    }
+}
+
+// The rows from the time on are all kept; the engine removes the older ones as it allows,
+// the SQLite one by the whole days of the producer policy
+void TestActivityStore::retain()
+{
+    QFETCH(ActivityStore::Engine, engine);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QScopedPointer<ActivityStore> store(openStore(engine, dir));
+    QVERIFY(store);
+    qint64 count = 0;
+    QVERIFY(appendDays(store.data(), 10, 10, 60, count));
+    const qint64 before_time = QDate::currentDate().addDays(-5).startOfDay().toSecsSinceEpoch();
+    QVector<ActivityStore::Row> kept, older;
+    QVERIFY(store->scan(QLatin1String(storeTable), before_time, 0, kept));
+    QVERIFY(store->scan(QLatin1String(storeTable), 0, before_time - 1, older));
+    QCOMPARE(kept.size() + older.size(), int(count));
+
+    QVERIFY2(store->retain(before_time), qPrintable(store->errorString()));
+    QVector<ActivityStore::Row> rows;
+    QVERIFY(store->scan(QLatin1String(storeTable), before_time, 0, rows));
+    QCOMPARE(rows.size(), kept.size());
+    for (int i = 0; i < rows.size(); i++) {
+        QCOMPARE(rows.at(i).localTime, kept.at(i).localTime);
+        QCOMPARE(rows.at(i).keyPresses, kept.at(i).keyPresses);
+    }
+    rows.clear();
+    QVERIFY(store->scan(QLatin1String(storeTable), 0, before_time - 1, rows));
+    QVERIFY(rows.size() <= older.size());
+    if (engine == ActivityStore::EngineSegment) QVERIFY(rows.isEmpty());
+    qInfo().noquote() << QString::asprintf("%d of %d older rows left", rows.size(), older.size());
+}
+
+// A fortnight of the minute rows appended by batchRows as the application commits them
+void TestActivityStore::writeAmplification()
+{
+    QFETCH(ActivityStore::Engine, engine);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QScopedPointer<ActivityStore> store(openStore(engine, dir));
+    QVERIFY(store);
+    qint64 count = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY2(appendDays(store.data(), 14, 14, dayMinutes, count), qPrintable(store->errorString()));
+    const qint64 elapsed = timer.elapsed();
+    store->close(); // the compaction and the checkpoint are written too
+    qInfo().noquote() << QString::asprintf("%lld rows in %lld ms: appended %lld KiB, written %lld KiB, %.1fx",
+                                           count, elapsed, store->bytesAppended() / 1024, store->bytesWritten() / 1024,
+                                           double(store->bytesWritten()) / qMax(store->bytesAppended(), qint64(1)));
+    QVERIFY(store->bytesWritten() > 0);
+}
+
+void TestActivityStore::scanRate()
+{
+    QFETCH(ActivityStore::Engine, engine);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QScopedPointer<ActivityStore> store(openStore(engine, dir));
+    QVERIFY(store);
+    qint64 count = 0;
+    QVERIFY(appendDays(store.data(), 14, 14, dayMinutes, count));
+
+    QVector<ActivityStore::Row> rows;
+    int runs = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        rows.clear();
+        QVERIFY(store->scan(QLatin1String(storeTable), 0, 0, rows));
+        runs++;
+    }
+    QCOMPARE(rows.size(), int(count));
+    qInfo().noquote() << QString::asprintf("%lld rows, %.0f krows/s", count,
+                                           double(runs) * count / qMax(timer.nsecsElapsed() / 1e6, 0.001));
+}
+
+QTEST_GUILESS_MAIN(TestActivityStore)
+#include "tst_activitystore.moc"
@@ -0,0 +1,15 @@
+# The unit tests and the benchmarks, built apart from the application:
+#   qmake tests/tests.pro && make && make check
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    chain \
+    pack \
+    replay \
+    ring \
+    stores
+
+# Needs an X display, see hookbench/compare.sh
+linux: SUBDIRS += hookbench
+
+# The storage layout benchmarks are Python sqlite3 scripts, run apart: python3 tests/bench/<name>.py
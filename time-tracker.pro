@@ -21,6 +21,7 @@ CONFIG -= debug
 CONFIG -= debug_and_release
 CONFIG -= qtquickcompiler
 CONFIG += release deploy
+CONFIG += c++17
 CONFIG += lrelease embed_translations
 CONFIG += file_copies
 #macx:CONFIG += app_bundle  # by default; to remove CONFIG -= app_bundle
@@ -30,8 +31,18 @@ DEFINES += APP_VERSION='\\"$${APP_VERSION}\\"'
 
 linux {
     UIOHOOK_OS_DIR = uiohook_x11
-    DEFINES += USE_XKB_COMMON USE_XKB_FILE USE_EVDEV
+    DEFINES += USE_XKB_COMMON USE_XKB_FILE USE_EVDEV USE_XRECORD_ASYNC
     LIBS += -lX11 -lXtst -lxkbcommon-x11 -lxkbcommon -lX11-xcb -lxcb -lxkbfile
+    # The capture backend is XRecord by default, use "qmake UIOHOOK_BACKEND=xinput2" for XInput2 raw events
+    # or "qmake UIOHOOK_BACKEND=evdev" to read /dev/input directly (Wayland, headless, needs the input group)
+    equals(UIOHOOK_BACKEND, xinput2) {
+        UIOHOOK_HOOK_DIR = uiohook_xinput2
+        LIBS += -lxcb-xinput
+    } else : equals(UIOHOOK_BACKEND, evdev) {
+        UIOHOOK_HOOK_DIR = uiohook_evdev
+    } else : !isEmpty(UIOHOOK_BACKEND) {
+        error("Unsupported UIOHOOK_BACKEND=$${UIOHOOK_BACKEND}, use xinput2, evdev or leave it empty")
+    }
 } else : win32 {
     contains(QMAKE_TARGET.arch, x86_64) {
         UIOHOOK_OS_DIR = uiohook_windows
@@ -55,15 +66,20 @@ linux {
 } else {
     error("Unsupported build platform. Currently only Linux, Windows and MacOS are supported")
 }
+isEmpty(UIOHOOK_HOOK_DIR): UIOHOOK_HOOK_DIR = $${UIOHOOK_OS_DIR}
 
 SOURCES += \
     src/$${UIOHOOK_OS_DIR}/input_helper.c \
-    src/$${UIOHOOK_OS_DIR}/input_hook.c \
+    src/$${UIOHOOK_HOOK_DIR}/input_hook.c \
     src/$${UIOHOOK_OS_DIR}/system_properties.c \
     src/uiohook_logger.c \
+    src/uiohook_motion.c \
     src/main.cpp \
+    src/ActivityChain.cpp \
     src/ActivityCounter.cpp \
+    src/ActivityPack.cpp \
     src/ActivityRecord.cpp \
+    src/ActivitySchema.cpp \
     src/ActivityTableModel.cpp \
     src/HttpRequest.cpp \
     src/HttpRequestArgs.cpp \
@@ -72,23 +88,33 @@ SOURCES += \
     src/SqliteProducer.cpp \
     src/SshKeygenEd25519.cpp \
     src/SystemHelper.cpp \
+    src/UiohookCounterThread.cpp \
+    src/UiohookStream.cpp \
     src/UrlModel.cpp
 
 HEADERS += \
     src/$${UIOHOOK_OS_DIR}/input_helper.h \
     src/uiohook.h \
     src/uiohook_logger.h \
+    src/uiohook_motion.h \
+    src/ActivityChain.h \
     src/ActivityCounter.h \
+    src/ActivityPack.h \
     src/ActivityRecord.h \
+    src/ActivitySchema.h \
     src/ActivityTableModel.h \
     src/BaseThread.h \
     src/HttpRequest.h \
     src/HttpRequestArgs.h \
+    src/InputEventRing.h \
+    src/LatencyHistogram.h \
     src/PermanentCache.h \
     src/SqliteConsumer.h \
     src/SqliteExecQuery.h \
     src/SqliteProducer.h \
     src/SystemHelper.h \
+    src/UiohookCounterThread.h \
+    src/UiohookStream.h \
     src/UrlModel.h
 
 linux {